@@ -0,0 +1,102 @@
+// STL
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+namespace
+{
+	std::atomic<bool> g_enabled(false);
+	std::atomic<uint64_t> g_count(0);
+
+	void* Allocate(size_t size)
+	{
+		if (g_enabled.load(std::memory_order_relaxed))
+			g_count.fetch_add(1, std::memory_order_relaxed);
+
+		void* p = malloc(size > 0 ? size : 1);
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+}
+
+void AllocationCounter::Enable(bool enable)
+{
+	g_enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool AllocationCounter::IsEnabled()
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::Count()
+{
+	return g_count.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+	return Allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+	return Allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return Allocate(size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return 0;
+	}
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return Allocate(size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return 0;
+	}
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// STL
+#include <stdint.h>
+
+/*
+	Counts calls to the global operator new while enabled, the hook that checks steady state
+	frames make no heap allocations. AllocationCounter.cpp replaces the global operators, so
+	linking it counts every allocation the executable makes. On Windows a DLL such as sutil
+	keeps its own operators and is not counted.
+*/
+class AllocationCounter
+{
+public:
+	static void Enable(bool enable);
+	static bool IsEnabled();
+
+	// Allocations counted so far, only advances while enabled
+	static uint64_t Count();
+};
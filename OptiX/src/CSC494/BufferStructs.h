@@ -2,6 +2,39 @@
 
 #include <optixu/optixu_vector_types.h>
 
+// Maximum number of hits recorded along a single physics ray
+const int INTERSECTION_SAMPLES = 16;
+
+// Reflection rays are counted per depth, the last bucket also counts every deeper reflection
+const int REFLECTION_DEPTH_BUCKETS = 8;
+
+// Slots of the frame statistics buffer, each slot is one unsigned int counter
+enum FrameStatSlot
+{
+	STAT_RADIANCE_RAYS = 0,		// Camera rays, including the continuation rays of physics rays
+	STAT_SHADOW_RAYS,
+	STAT_REFLECTION_RAYS,
+	STAT_PHYSICS_RAYS,			// Launch indices that gather volume samples
+	STAT_SAMPLE_OVERFLOWS,		// Hits dropped because a ray already had INTERSECTION_SAMPLES
+	STAT_PAIRS_FOUND,			// Overlapping body intervals found along physics rays
+	STAT_RESPONSE_PIXELS,		// Response pixels with a volume above the response threshold
+	STAT_REFLECTIONS_OVER_BUDGET,	// Reflections dropped at the frame's hard cap, see ReflectionRayCap
+	STAT_HEAP_ALLOCATIONS,		// Host heap allocations during the frame, counted when AllocationCounter is linked
+	STAT_HITS_HISTOGRAM,		// Hits per physics ray, INTERSECTION_SAMPLES + 1 buckets
+	STAT_REFLECTION_DEPTHS = STAT_HITS_HISTOGRAM + INTERSECTION_SAMPLES + 1,	// Reflection rays per depth, REFLECTION_DEPTH_BUCKETS buckets
+	STAT_SLOT_COUNT = STAT_REFLECTION_DEPTHS + REFLECTION_DEPTH_BUCKETS
+};
+
+struct IntersectionData
+{
+#if defined(__cplusplus)
+	typedef optix::float3 float3;
+#endif
+	unsigned int rigidBodyId;
+	float t;
+	float3 normal;
+};
+
 struct IntersectionResponse
 {
 #if defined(__cplusplus)
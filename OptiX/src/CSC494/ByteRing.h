@@ -0,0 +1,124 @@
+#pragma once
+
+// STL
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/*
+	Single producer, single consumer queue of variable sized messages, lock free.
+
+	Every message is contiguous in the ring so the producer can write it in place: Reserve()
+	hands out room for the whole message, Commit() publishes it. A message that doesn't fit
+	before the end of the ring starts over at the front, leaving a wrap marker behind.
+	Messages are 8 byte aligned. Reserve() never waits, it returns null while the consumer
+	hasn't freed enough room. Size the ring for several messages: one larger than half of it
+	may never find a contiguous gap.
+*/
+class ByteRing
+{
+public:
+	explicit ByteRing(size_t capacity) :
+		buffer((capacity + 7) / 8),
+		capacity(buffer.size() * 8),
+		head(0),
+		tail(0),
+		reserved(0),
+		reservedBytes(0)
+	{
+	};
+
+	// Producer side
+	void* Reserve(size_t bytes)
+	{
+		const size_t need = Need(bytes);
+		const size_t w = head.load(std::memory_order_relaxed);
+		const size_t r = tail.load(std::memory_order_acquire);
+
+		// The producer never catches up with the consumer, w == r means empty
+		if (w >= r)
+		{
+			if (need < capacity - w || (need == capacity - w && r != 0))
+				return Begin(w, bytes);
+			if (need < r)
+			{
+				SetSize(w, WRAP);
+				return Begin(0, bytes);
+			}
+			return 0;
+		}
+		return need < r - w ? Begin(w, bytes) : 0;
+	}
+
+	void Commit()
+	{
+		SetSize(reserved, static_cast<uint32_t>(reservedBytes));
+		size_t next = reserved + Need(reservedBytes);
+		if (next == capacity)
+			next = 0;
+		head.store(next, std::memory_order_release);
+	}
+
+	// Consumer side, the oldest message or null if there is none
+	const void* Front(size_t& bytes)
+	{
+		size_t r = tail.load(std::memory_order_relaxed);
+		const size_t w = head.load(std::memory_order_acquire);
+		if (r == w)
+			return 0;
+
+		if (GetSize(r) == WRAP)
+		{
+			r = 0;
+			tail.store(0, std::memory_order_release);
+			if (r == w)
+				return 0;
+		}
+
+		bytes = GetSize(r);
+		return Data() + r + HEADER;
+	}
+
+	void Pop()
+	{
+		const size_t r = tail.load(std::memory_order_relaxed);
+		size_t next = r + Need(GetSize(r));
+		if (next == capacity)
+			next = 0;
+		tail.store(next, std::memory_order_release);
+	}
+
+	size_t Capacity() const { return capacity; }
+
+private:
+	ByteRing(const ByteRing&);
+	ByteRing& operator=(const ByteRing&);
+
+	static const size_t HEADER = 8;
+	static const uint32_t WRAP = 0xFFFFFFFFu;
+
+	static size_t Need(size_t bytes) { return HEADER + ((bytes + 7) & ~static_cast<size_t>(7)); }
+
+	char* Data() { return reinterpret_cast<char*>(buffer.data()); }
+
+	void* Begin(size_t offset, size_t bytes)
+	{
+		reserved = offset;
+		reservedBytes = bytes;
+		return Data() + offset + HEADER;
+	}
+
+	void SetSize(size_t offset, uint32_t size) { memcpy(Data() + offset, &size, sizeof(size)); }
+	uint32_t GetSize(size_t offset) { uint32_t size; memcpy(&size, Data() + offset, sizeof(size)); return size; }
+
+	std::vector<uint64_t> buffer;
+	const size_t capacity;
+
+	std::atomic<size_t> head;	// Written by the producer
+	std::atomic<size_t> tail;	// Written by the consumer
+
+	// Producer only
+	size_t reserved;
+	size_t reservedBytes;
+};
@@ -1,4 +1,14 @@
+// STL
+#include <thread>
+
+#include <Mesh.h>
+#include <MeshBVH.h>
+#include <MeshOptimizer.h>
+
 #include "Scene.h"
+#include "Profiler.h"
+#include "SweepRunner.h"
+#include "GeometryCreator.h"
 
 using namespace optix;
 
@@ -12,18 +22,86 @@ void printUsageAndExit(const std::string& argv0)
 		"  -h | --help         Print this usage message and exit.\n"
 		"  -f | --file         Save single frame to file and exit.\n"
 		"  -n | --nopbo        Disable GL interop for display buffer.\n"
+		"  -p | --profile      Time each frame stage and write a Chrome trace to the given file on exit.\n"
+		"  -c | --counters     Count rays, hits and collision pixels per frame and write them to the given CSV file.\n"
+		"       --sweep        Run the default scalability sweep headless and append the results to the given CSV file.\n"
+		"       --sweep-config Run one sweep configuration, \"<bodies>,<width>x<height>,<physicsRayStep>,<threads>\" (requires --sweep).\n"
+		"       --frames       Frames timed per sweep configuration (default 120).\n"
+		"       --instancing   Time startup and memory for 1000 cow instances with and without a shared mesh,\n"
+		"                      appending the results to the given CSV file.\n"
+		"  -o | --optimize     Weld and reorder mesh vertices and triangles after loading.\n"
+		"       --roulette     End reflections below the importance cutoff by Russian roulette instead of dropping them.\n"
+		"       --ray-budget   Reflection rays per frame to aim for, the roulette cutoff rises while frames need more\n"
+		"                      (requires --roulette).\n"
+		"       --frame-target Frame time to hold in milliseconds by scaling the render resolution and the physics ray step.\n"
+		"       --rates        \"<physics>,<collision>,<render>\" tick rates in Hz: physics and the collision pass run on\n"
+		"                      threads of their own and responses apply once per collision tick. A render rate of 0\n"
+		"                      runs without a window for --run-time seconds (default 10).\n"
+		"  -t | --telemetry    Log every frame's contacts and body states to the given binary file (see TelemetryToCsv).\n"
+		"  -r | --record       Record every frame to numbered images or a .y4m stream on a writer thread. Images take\n"
+		"                      a frame number pattern (frame_%05u.ppm), otherwise frame.ppm writes frame_00000.ppm, ...\n"
+		"       --bvh          Build a host BVH for the given mesh file on one thread and on every thread,\n"
+		"                      print its statistics and save it next to the mesh cache.\n"
 		"App Keystrokes:\n"
 		"  q  Quit\n"
 		"  s  Save image to '" << PROJECT_NAME << ".ppm'\n"
+		"  p  Print frame stage timings (requires --profile)\n"
+		"  c  Print the last frame's counters (requires --counters)\n"
 		<< std::endl;
 
 	exit(1);
 }
 
+/*
+	Times the binned SAH builder on one mesh, single threaded and with every hardware thread,
+	then goes through the cache so the next run loads the tree instead
+*/
+int buildHostBVH(const std::string& path, bool optimize)
+{
+	HostMesh mesh(path);
+	if (optimize)
+	{
+		printMeshOptimizeStats(optimizeMesh(mesh));
+	}
+	std::cout << path << ": " << mesh.num_triangles << " triangles" << std::endl;
+
+	MeshBVHBuildOptions options;
+	MeshBVH bvh;
+	options.threads = 1;
+	bvh.build(mesh, options);
+	std::cout << "1 thread:  ";
+	printMeshBVHStats(bvh.stats());
+
+	options.threads = 0;
+	bvh.build(mesh, options);
+	std::cout << std::thread::hardware_concurrency() << " threads: ";
+	printMeshBVHStats(bvh.stats());
+
+	bvh.buildCached(path, mesh, options);
+	std::cout << "Cache:     ";
+	printMeshBVHStats(bvh.stats());
+	std::cout << "Cache entry " << MeshBVH::entryPath(path) << std::endl;
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
 	std::string out_file;
 	bool use_pbo = true;
+	std::string sweep_file;
+	std::string sweep_config;
+	std::string instancing_file;
+	std::string bvh_file;
+	bool optimize = false;
+	unsigned int sweep_frames = 120;
+	ReflectionTermination reflection_termination = REFLECTION_CUTOFF;
+	unsigned int reflection_ray_budget = 0;
+	double frame_target = 0.0;
+	double physics_hz = 0.0;
+	double collision_hz = 0.0;
+	double render_hz = 0.0;
+	double run_time = 10.0;
+	std::string record_file;
 	for (int i = 1; i < argc; ++i)
 	{
 		const std::string arg(argv[i]);
@@ -45,6 +123,126 @@ int main(int argc, char** argv)
 		{
 			use_pbo = false;
 		}
+		else if (arg == "-p" || arg == "--profile")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			Profiler::Enable(true);
+			Profiler::SetThreadName("main");
+			Profiler::SetTraceFile(argv[++i]);
+		}
+		else if (arg == "-c" || arg == "--counters")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			Scene::Get().SetCounterFile(argv[++i]);
+		}
+		else if (arg == "-o" || arg == "--optimize")
+		{
+			GeometryCreator::SetOptimizeMeshes(true);
+			optimize = true;
+		}
+		else if (arg == "--roulette")
+		{
+			reflection_termination = REFLECTION_RUSSIAN_ROULETTE;
+		}
+		else if (arg == "--ray-budget")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			reflection_ray_budget = static_cast<unsigned int>(atoi(argv[++i]));
+		}
+		else if (arg == "--frame-target")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			frame_target = atof(argv[++i]);
+		}
+		else if (arg == "--rates")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			if (sscanf(argv[++i], "%lf,%lf,%lf", &physics_hz, &collision_hz, &render_hz) != 3 || physics_hz <= 0.0 || collision_hz <= 0.0 || render_hz < 0.0)
+			{
+				std::cerr << "Invalid rates '" << argv[i] << "'\n";
+				printUsageAndExit(argv[0]);
+			}
+		}
+		else if (arg == "--run-time")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			run_time = atof(argv[++i]);
+		}
+		else if (arg == "-t" || arg == "--telemetry")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			Scene::Get().SetTelemetryFile(argv[++i]);
+		}
+		else if (arg == "-r" || arg == "--record")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			record_file = argv[++i];
+		}
+		else if (arg == "--bvh")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			bvh_file = argv[++i];
+		}
+		else if (arg == "--instancing")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+			instancing_file = argv[++i];
+		}
+		else if (arg == "--sweep" || arg == "--sweep-config" || arg == "--frames")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsageAndExit(argv[0]);
+			}
+
+			if (arg == "--sweep")
+				sweep_file = argv[++i];
+			else if (arg == "--sweep-config")
+				sweep_config = argv[++i];
+			else
+				sweep_frames = static_cast<unsigned int>(atoi(argv[++i]));
+		}
 		else
 		{
 			std::cerr << "Unknown option '" << arg << "'\n";
@@ -52,5 +250,56 @@ int main(int argc, char** argv)
 		}
 	}
 
+	if (!sweep_config.empty() && sweep_file.empty())
+	{
+		std::cerr << "Option '--sweep-config' requires --sweep.\n";
+		printUsageAndExit(argv[0]);
+	}
+
+	if (reflection_ray_budget > 0 && reflection_termination != REFLECTION_RUSSIAN_ROULETTE)
+	{
+		std::cerr << "Option '--ray-budget' requires --roulette.\n";
+		printUsageAndExit(argv[0]);
+	}
+
+	Scene::Get().SetReflectionControl(reflection_termination, reflection_ray_budget);
+	Scene::Get().SetFrameTarget(frame_target);
+	if (physics_hz > 0.0)
+		Scene::Get().SetSchedule(physics_hz, collision_hz, render_hz, run_time);
+	if (!record_file.empty())
+		Scene::Get().SetRecording(record_file);
+
+	if (!bvh_file.empty())
+	{
+		return buildHostBVH(bvh_file, optimize);
+	}
+
+	if (!instancing_file.empty())
+	{
+		const std::string mesh = std::string(sutil::samplesDir()) + "/data/cow.obj";
+		const int result = SweepRunner::Run(SweepRunner::InstancingSweep(sweep_frames, mesh), instancing_file);
+		Scene::Get().CloseLogs();
+		return result;
+	}
+
+	if (!sweep_file.empty())
+	{
+		std::vector<SweepConfig> configs = SweepRunner::DefaultSweep(sweep_frames);
+		if (!sweep_config.empty())
+		{
+			SweepConfig config;
+			config.frames = sweep_frames;
+			if (!SweepRunner::ParseConfig(sweep_config, config))
+			{
+				std::cerr << "Invalid sweep configuration '" << sweep_config << "'\n";
+				printUsageAndExit(argv[0]);
+			}
+			configs.assign(1, config);
+		}
+		const int result = SweepRunner::Run(configs, sweep_file);
+		Scene::Get().CloseLogs();
+		return result;
+	}
+
 	Scene::Get().Setup(argc, argv, out_file, use_pbo);
 }
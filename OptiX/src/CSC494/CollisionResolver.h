@@ -0,0 +1,141 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+
+// STL
+#include <cmath>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "BufferStructs.h"
+
+using namespace optix;
+
+// The responses of one pair of bodies. Normals and points are averaged weighted by volume
+struct PairContact
+{
+	uint32_t bodyA;				// The entry body, bodyB the other one in the overlap
+	uint32_t bodyB;
+	uint32_t samples;			// Physics rays that saw the overlap
+	float volume;				// Summed over the samples
+	float entryNormal[3];
+	float entryPoint[3];
+	float exitNormal[3];
+	float exitPoint[3];
+};
+
+/*
+	Turns the per pixel intersection responses written by the physics rays into
+	impulses on the bodies involved. Templated on the body type so the scene can
+	pass its RigidBody list and the benchmarks a plain RigidBodyState list.
+*/
+class CollisionResolver
+{
+public:
+	// Returns the total intersection volume found in the responses.
+	// If responsePixels is given, it is incremented for every response that was applied
+	template<typename Body>
+	static float ApplyResponses(const IntersectionResponse* responses, size_t count, float k, std::vector<Body>& bodies,
+								unsigned int* responsePixels = 0)
+	{
+		float volume = 0.0f;
+		unsigned int applied = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			const IntersectionResponse& response = responses[i];
+			if (response.volume > 0.00001f)
+			{
+				float volumeConstraint = response.volume;
+
+				// Apply force at collision entry
+				bodies[response.entryId].AddImpulseAtPosition(-response.entryNormal * volumeConstraint * k, response.entryPoint);
+				int otherId = response.collisionId == response.entryId ? response.exitId : response.collisionId;
+				bodies[otherId].AddImpulseAtPosition(response.entryNormal * volumeConstraint * k, response.entryPoint);
+
+				// Apply force at collision exit
+				bodies[response.exitId].AddImpulseAtPosition(-response.exitNormal * volumeConstraint * k, response.exitPoint);
+				otherId = response.collisionId;
+				bodies[otherId].AddImpulseAtPosition(response.exitNormal * volumeConstraint * k, response.exitPoint);
+
+				volume += response.volume;
+				applied++;
+			}
+		}
+
+		if (responsePixels)
+			*responsePixels += applied;
+		return volume;
+	}
+
+	// One contact per (entry body, other body) pair, paired the way ApplyResponses pushes them.
+	// pairs is scratch space, kept by the caller so it doesn't reallocate every call
+	static void ReduceContacts(const IntersectionResponse* responses, size_t count, std::vector<PairContact>& contacts,
+							   std::unordered_map<uint64_t, size_t>& pairs)
+	{
+		contacts.clear();
+		pairs.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			const IntersectionResponse& response = responses[i];
+			if (response.volume <= 0.00001f)
+				continue;
+
+			const uint32_t a = static_cast<uint32_t>(response.entryId);
+			const uint32_t b = static_cast<uint32_t>(response.collisionId == response.entryId ? response.exitId : response.collisionId);
+			const uint64_t key = (static_cast<uint64_t>(a) << 32) | b;
+
+			auto found = pairs.find(key);
+			if (found == pairs.end())
+			{
+				PairContact contact = {};
+				contact.bodyA = a;
+				contact.bodyB = b;
+				found = pairs.insert(std::make_pair(key, contacts.size())).first;
+				contacts.push_back(contact);
+			}
+
+			PairContact& contact = contacts[found->second];
+			const float v = response.volume;
+			contact.samples++;
+			contact.volume += v;
+			AddScaled(contact.entryNormal, response.entryNormal, v);
+			AddScaled(contact.entryPoint, response.entryPoint, v);
+			AddScaled(contact.exitNormal, response.exitNormal, v);
+			AddScaled(contact.exitPoint, response.exitPoint, v);
+		}
+
+		for (size_t i = 0; i < contacts.size(); i++)
+		{
+			PairContact& contact = contacts[i];
+			Normalize(contact.entryNormal);
+			Normalize(contact.exitNormal);
+			for (int k = 0; k < 3; k++)
+			{
+				contact.entryPoint[k] /= contact.volume;
+				contact.exitPoint[k] /= contact.volume;
+			}
+		}
+	}
+
+private:
+	static void AddScaled(float* sum, const float3& v, float scale)
+	{
+		sum[0] += v.x * scale;
+		sum[1] += v.y * scale;
+		sum[2] += v.z * scale;
+	}
+
+	static void Normalize(float* v)
+	{
+		const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length > 0.0f)
+		{
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+};
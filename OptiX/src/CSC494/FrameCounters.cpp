@@ -0,0 +1,166 @@
+// STL
+#include <cstring>
+#include <iostream>
+
+#include "FrameCounters.h"
+
+namespace
+{
+	const char* SlotName(int slot)
+	{
+		switch (slot)
+		{
+			case STAT_RADIANCE_RAYS: return "radiance_rays";
+			case STAT_SHADOW_RAYS: return "shadow_rays";
+			case STAT_REFLECTION_RAYS: return "reflection_rays";
+			case STAT_PHYSICS_RAYS: return "physics_rays";
+			case STAT_SAMPLE_OVERFLOWS: return "sample_overflows";
+			case STAT_PAIRS_FOUND: return "pairs_found";
+			case STAT_RESPONSE_PIXELS: return "response_pixels";
+			case STAT_REFLECTIONS_OVER_BUDGET: return "reflections_over_budget";
+			case STAT_HEAP_ALLOCATIONS: return "heap_allocations";
+			default: return "";
+		}
+	}
+}
+
+float FrameStats::MeanHitsPerPhysicsRay() const
+{
+	unsigned int rays = 0;
+	unsigned int hits = 0;
+	for (int i = 0; i <= INTERSECTION_SAMPLES; i++)
+	{
+		rays += HitsHistogram(i);
+		hits += HitsHistogram(i) * i;
+	}
+	return rays > 0 ? float(hits) / rays : 0.0f;
+}
+
+FrameCounters::FrameCounters() :
+	enabled(false),
+	frame(0),
+	allocationCount(0),
+	frameAllocations(0),
+	flushInterval(60)
+{
+	memset(&current, 0, sizeof(current));
+	memset(&latest, 0, sizeof(latest));
+}
+
+FrameCounters::~FrameCounters()
+{
+	Shutdown();
+}
+
+void FrameCounters::Enable(bool enable)
+{
+	enabled = enable;
+}
+
+bool FrameCounters::IsEnabled() const
+{
+	return enabled;
+}
+
+void FrameCounters::SetAllocationCounter(uint64_t (*count)())
+{
+	allocationCount = count;
+}
+
+void FrameCounters::SetCsvFile(const std::string& path, unsigned int interval)
+{
+	csv.open(path.c_str());
+	if (!csv.is_open())
+	{
+		std::cerr << "FrameCounters: could not open '" << path << "' for writing" << std::endl;
+		return;
+	}
+
+	flushInterval = interval > 0 ? interval : 1;
+	WriteCsvHeader();
+}
+
+void FrameCounters::WriteCsvHeader()
+{
+	csv << "frame";
+	for (int slot = 0; slot < STAT_HITS_HISTOGRAM; slot++)
+		csv << "," << SlotName(slot);
+	for (int hits = 0; hits <= INTERSECTION_SAMPLES; hits++)
+		csv << ",hits_" << hits;
+	for (int depth = 1; depth <= REFLECTION_DEPTH_BUCKETS; depth++)
+		csv << ",reflection_depth_" << depth;
+	csv << "\n";
+}
+
+void FrameCounters::WriteCsvRow(const FrameStats& stats)
+{
+	csv << stats.frame;
+	for (int slot = 0; slot < STAT_SLOT_COUNT; slot++)
+		csv << "," << stats.counters[slot];
+	csv << "\n";
+}
+
+void FrameCounters::BeginFrame()
+{
+	memset(&current, 0, sizeof(current));
+	current.frame = frame;
+	frameAllocations = allocationCount ? allocationCount() : 0;
+}
+
+void FrameCounters::Add(FrameStatSlot slot, unsigned int value)
+{
+	current.counters[slot] += value;
+}
+
+void FrameCounters::Accumulate(const unsigned int* counters)
+{
+	for (int slot = 0; slot < STAT_SLOT_COUNT; slot++)
+		current.counters[slot] += counters[slot];
+}
+
+void FrameCounters::EndFrame()
+{
+	if (allocationCount)
+		current.counters[STAT_HEAP_ALLOCATIONS] += static_cast<unsigned int>(allocationCount() - frameAllocations);
+	{
+		std::lock_guard<std::mutex> lock(latestMutex);
+		latest = current;
+	}
+	frame++;
+
+	if (csv.is_open())
+	{
+		WriteCsvRow(current);
+		if (frame % flushInterval == 0)
+			csv.flush();
+	}
+}
+
+FrameStats FrameCounters::Latest() const
+{
+	std::lock_guard<std::mutex> lock(latestMutex);
+	return latest;
+}
+
+void FrameCounters::Print(const FrameStats& stats, std::ostream& out)
+{
+	out << "Frame " << stats.frame << "\n";
+	for (int slot = 0; slot < STAT_HITS_HISTOGRAM; slot++)
+		out << "  " << SlotName(slot) << ": " << stats.counters[slot] << "\n";
+
+	out << "  hits per physics ray (mean " << stats.MeanHitsPerPhysicsRay() << "):";
+	for (int hits = 0; hits <= INTERSECTION_SAMPLES; hits++)
+		out << " " << stats.HitsHistogram(hits);
+	out << "\n";
+
+	out << "  reflection rays per depth:";
+	for (int bucket = 0; bucket < REFLECTION_DEPTH_BUCKETS; bucket++)
+		out << " " << stats.ReflectionDepth(bucket);
+	out << std::endl;
+}
+
+void FrameCounters::Shutdown()
+{
+	if (csv.is_open())
+		csv.close();
+}
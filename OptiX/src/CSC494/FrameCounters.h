@@ -0,0 +1,87 @@
+#pragma once
+
+// STL
+#include <fstream>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+#include "BufferStructs.h"
+
+/*
+	Per frame work counters: rays cast by type, hits per physics ray, reflection
+	rays per depth, sample overflows, response pixels and overlapping pairs.
+
+	The GPU programs count into the frameStats buffer (see FrameStatSlot), host
+	code adds its own counts with Add(). EndFrame() closes the frame, keeps it as
+	the latest frame and appends it to the CSV file if one is set. Counting is
+	off until Enable(true) so the programs skip their atomics by default.
+*/
+struct FrameStats
+{
+	unsigned int frame;
+	unsigned int counters[STAT_SLOT_COUNT];
+
+	unsigned int Get(FrameStatSlot slot) const { return counters[slot]; }
+	unsigned int HitsHistogram(int hits) const { return counters[STAT_HITS_HISTOGRAM + hits]; }
+	// Reflection rays of depth bucket + 1, the last bucket also counts deeper ones
+	unsigned int ReflectionDepth(int bucket) const { return counters[STAT_REFLECTION_DEPTHS + bucket]; }
+
+	// Mean number of hits recorded per physics ray
+	float MeanHitsPerPhysicsRay() const;
+};
+
+/*
+	One set of counters per producer: the thread that counts calls BeginFrame() to EndFrame(),
+	Latest() may be called from any thread. A Simulation counts into the one its options name.
+*/
+class FrameCounters
+{
+public:
+	FrameCounters();
+	~FrameCounters();
+
+	void Enable(bool enable);
+	bool IsEnabled() const;
+
+	// Heap allocations per frame come from count, ie AllocationCounter::Count in an executable
+	// that links AllocationCounter.cpp. Left at zero without one
+	void SetAllocationCounter(uint64_t (*count)());
+
+	// Append one row per frame to path, flushed every flushInterval frames
+	void SetCsvFile(const std::string& path, unsigned int flushInterval = 60);
+
+	void BeginFrame();
+	void Add(FrameStatSlot slot, unsigned int value = 1);
+
+	// Adds a full set of slots, ie the mapped GPU stats buffer
+	void Accumulate(const unsigned int* counters);
+	void EndFrame();
+
+	// Counts of the last completed frame. A copy, so any thread may ask while another counts
+	FrameStats Latest() const;
+
+	static void Print(const FrameStats& stats, std::ostream& out);
+
+	// Flushes and closes the CSV file
+	void Shutdown();
+
+private:
+	FrameCounters(const FrameCounters&);
+	FrameCounters& operator=(const FrameCounters&);
+
+	void WriteCsvHeader();
+	void WriteCsvRow(const FrameStats& stats);
+
+	bool enabled;
+	unsigned int frame;
+	FrameStats current;
+	FrameStats latest;
+	mutable std::mutex latestMutex;		// The counting thread isn't always the one reading latest
+
+	uint64_t (*allocationCount)();
+	uint64_t frameAllocations;
+
+	std::ofstream csv;
+	unsigned int flushInterval;
+};
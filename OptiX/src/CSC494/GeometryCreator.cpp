@@ -3,7 +3,6 @@
 #include <optixu/optixu_math_stream_namespace.h>
 
 #include <sutil.h>
-#include <OptiXMesh.h>
 
 #include "GeometryCreator.h"
 #include "MaterialProperties.h"
@@ -12,34 +11,23 @@ using namespace optix;
 
 GeometryInstance GeometryCreator::CreateSphere(float radius, MaterialProperties materialProps)
 {
+	Material sphere_matl = GetMaterial(materialProps);
+
+	std::map<float, Geometry>::iterator cached = sphereCache.find(radius);
+	if (cached != sphereCache.end())
+	{
+		return context->createGeometryInstance(cached->second, &sphere_matl, &sphere_matl + 1);
+	}
+
 	// Create geometry and transform
 	Geometry sphere = context->createGeometry();
 	sphere->setPrimitiveCount(1u);
 
 	// Create programs
-	const char* ptx = sutil::getPtxString(projectPrefix, "sphere_model.cu");
-	Program sphere_bounds = context->createProgramFromPTXString(ptx, "bounds");
-	Program sphere_intersect = context->createProgramFromPTXString(ptx, "robust_intersect");
-	sphere->setBoundingBoxProgram(sphere_bounds);
-	sphere->setIntersectionProgram(sphere_intersect);
+	sphere->setBoundingBoxProgram(GetProgram("sphere_model.cu", "bounds"));
+	sphere->setIntersectionProgram(GetProgram("sphere_model.cu", "robust_intersect"));
 	sphere["radius"]->setFloat(radius);
-
-	// Create material
-	Material sphere_matl = context->createMaterial();
-	Program sphere_ch = context->createProgramFromPTXString(scenePtx, materialProps.closestHitProgram);
-	sphere_matl->setClosestHitProgram(0, sphere_ch);
-
-	// Shadow caster program
-	Program sphere_shadow = context->createProgramFromPTXString(scenePtx, "any_hit_shadow");
-	sphere_matl->setAnyHitProgram(1, sphere_shadow);
-
-	// Link material properties to the cuda files
-	sphere_matl["ambientColorIntensity"]->setFloat(materialProps.ambientColor);
-    sphere_matl["diffuseColorIntensity"]->setFloat(materialProps.diffuseColor);
-	sphere_matl["specularColorIntensity"]->setFloat(materialProps.specularColor);
-	sphere_matl["specularPower"]->setFloat(materialProps.specularPower);
-	sphere_matl["fresnel"]->setFloat(materialProps.fresnel);
-	sphere_matl["reflectivity"]->setFloat(materialProps.reflectivity);
+	sphereCache[radius] = sphere;
 
 	// Create Instance
 	return context->createGeometryInstance(sphere, &sphere_matl, &sphere_matl + 1); // + 1 designates how many materials we are using
@@ -47,69 +35,115 @@ GeometryInstance GeometryCreator::CreateSphere(float radius, MaterialProperties
 
 GeometryInstance GeometryCreator::CreateBox(float3 axisLengths, MaterialProperties materialProps)
 {
+	Material box_matl = GetMaterial(materialProps);
+
+	const BoxKey key(axisLengths.x, axisLengths.y, axisLengths.z);
+	std::map<BoxKey, Geometry>::iterator cached = boxCache.find(key);
+	if (cached != boxCache.end())
+	{
+		return context->createGeometryInstance(cached->second, &box_matl, &box_matl + 1);
+	}
+
 	// Create geometry
 	Geometry box = context->createGeometry();
 	box->setPrimitiveCount(1u);
 
 	// Create programs
-	const char *ptx = sutil::getPtxString(projectPrefix, "box.cu");
-	Program box_bounds = context->createProgramFromPTXString(ptx, "box_bounds");
-	Program box_intersect = context->createProgramFromPTXString(ptx, "box_intersect");
-
-	box->setBoundingBoxProgram(box_bounds);
-	box->setIntersectionProgram(box_intersect);
+	box->setBoundingBoxProgram(GetProgram("box.cu", "box_bounds"));
+	box->setIntersectionProgram(GetProgram("box.cu", "box_intersect"));
 	box["axisLengths"]->setFloat(axisLengths);
-
-	// Create Material
-	Material box_matl = context->createMaterial();
-	Program box_ch = context->createProgramFromPTXString(scenePtx, materialProps.closestHitProgram);
-	box_matl->setClosestHitProgram(0, box_ch);
-
-	// Shadow caster program
-	Program box_shadow = context->createProgramFromPTXString(scenePtx, "any_hit_shadow");
-	box_matl->setAnyHitProgram(1, box_shadow);
-
-	// Link material properties to the cuda files
-	box_matl["ambientColorIntensity"]->setFloat(materialProps.ambientColor);
-    box_matl["diffuseColorIntensity"]->setFloat(materialProps.diffuseColor);
-	box_matl["specularColorIntensity"]->setFloat(materialProps.specularColor);
-	box_matl["specularPower"]->setFloat(materialProps.specularPower);
-	box_matl["fresnel"]->setFloat(materialProps.fresnel);
-	box_matl["reflectivity"]->setFloat(materialProps.reflectivity);
+	boxCache[key] = box;
 
 	return context->createGeometryInstance(box, &box_matl, &box_matl + 1);
 }
 
-GeometryInstance GeometryCreator::CreateMesh(std::string meshFilePath, MaterialProperties materialProps)
+GeometryInstance GeometryCreator::CreateMesh(std::string meshFilePath, MaterialProperties materialProps, Acceleration& acceleration, bool shared,
+											 std::shared_ptr<const WideBVH>* hostBVH)
 {
-	const char* ptx = sutil::getPtxString(projectPrefix, "triangle_mesh.cu");
-
-	// Override default programs with our own
-	Program intersection = context->createProgramFromPTXString(ptx, "mesh_intersect_refine");
-	Program bounds = context->createProgramFromPTXString(ptx, "mesh_bounds");
-
-	OptiXMesh mesh;
-    mesh.context = context;
-    mesh.intersection = intersection;
-    mesh.bounds = bounds;
-
-	Material mesh_matl = context->createMaterial();
-	Program mesh_ch = context->createProgramFromPTXString(scenePtx, materialProps.closestHitProgram);
-	mesh_matl->setClosestHitProgram(0, mesh_ch);
+	Material mesh_matl = GetMaterial(materialProps, false);
+
+	if (!meshRegistry)
+	{
+		// .obj are really small so just bump them up by default
+		Matrix4x4 xform = Matrix4x4::identity();
+		xform *= 0.5f;
+
+		// Override default programs with our own
+		meshRegistry.reset(new MeshRegistry(context,
+			GetProgram("triangle_mesh.cu", "mesh_intersect_refine"),
+			GetProgram("triangle_mesh.cu", "mesh_bounds"),
+			xform));
+	}
+
+	const bool buildHostBVH = hostBVH != 0;
+	const SharedMesh mesh = shared ? meshRegistry->Acquire(meshFilePath, mesh_matl, buildHostBVH) : meshRegistry->LoadUnique(meshFilePath, mesh_matl, buildHostBVH);
+	acceleration = mesh.acceleration;
+	if (hostBVH)
+	{
+		*hostBVH = mesh.hostBVH;
+	}
+	return context->createGeometryInstance(mesh.geometry, &mesh_matl, &mesh_matl + 1);
+}
 
-	mesh_matl["ambientColorIntensity"]->setFloat(materialProps.ambientColor);
-    mesh_matl["diffuseColorIntensity"]->setFloat(materialProps.diffuseColor);
-	mesh_matl["specularColorIntensity"]->setFloat(materialProps.specularColor);
-	mesh_matl["specularPower"]->setFloat(materialProps.specularPower);
-	mesh_matl["fresnel"]->setFloat(materialProps.fresnel);
-	mesh_matl["reflectivity"]->setFloat(materialProps.reflectivity);
+/*
+	Returns the program for the entry point, compiling it the first time it is asked for
+*/
+Program GeometryCreator::GetProgram(const char* ptxFile, const char* entryPoint)
+{
+	const ProgramKey key(ptxFile, entryPoint);
+	std::map<ProgramKey, Program>::iterator cached = programCache.find(key);
+	if (cached != programCache.end())
+	{
+		return cached->second;
+	}
+
+	const char* ptx = key.first == sceneName ? scenePtx : sutil::getPtxString(projectPrefix, ptxFile);
+	Program program = context->createProgramFromPTXString(ptx, entryPoint);
+	programCache[key] = program;
+	return program;
+}
 
-    mesh.material = mesh_matl;
+/*
+	Returns a material with the given shading parameters, shared by every instance that uses them
+*/
+Material GeometryCreator::GetMaterial(const MaterialProperties& materialProps, bool castsShadows)
+{
+	const float parameters[] =
+	{
+		materialProps.ambientColor.x, materialProps.ambientColor.y, materialProps.ambientColor.z,
+		materialProps.diffuseColor.x, materialProps.diffuseColor.y, materialProps.diffuseColor.z,
+		materialProps.specularColor.x, materialProps.specularColor.y, materialProps.specularColor.z,
+		materialProps.specularPower,
+		materialProps.fresnel.x, materialProps.fresnel.y, materialProps.fresnel.z,
+		materialProps.reflectivity.x, materialProps.reflectivity.y, materialProps.reflectivity.z
+	};
+	const MaterialKey key(materialProps.closestHitProgram,
+						  std::vector<float>(parameters, parameters + sizeof(parameters) / sizeof(parameters[0])),
+						  castsShadows);
+
+	std::map<MaterialKey, Material>::iterator cached = materialCache.find(key);
+	if (cached != materialCache.end())
+	{
+		return cached->second;
+	}
+
+	Material material = context->createMaterial();
+	material->setClosestHitProgram(0, GetProgram(sceneName, materialProps.closestHitProgram));
 
-	// .obj are really small so just bump them up by default
-	Matrix4x4 xform = Matrix4x4::identity();
-	xform *= 0.5f;
-	loadMesh(meshFilePath, mesh, xform);
+	// Shadow caster program
+	if (castsShadows)
+	{
+		material->setAnyHitProgram(1, GetProgram(sceneName, "any_hit_shadow"));
+	}
 
-	return mesh.geom_instance;
+	// Link material properties to the cuda files
+	material["ambientColorIntensity"]->setFloat(materialProps.ambientColor);
+	material["diffuseColorIntensity"]->setFloat(materialProps.diffuseColor);
+	material["specularColorIntensity"]->setFloat(materialProps.specularColor);
+	material["specularPower"]->setFloat(materialProps.specularPower);
+	material["fresnel"]->setFloat(materialProps.fresnel);
+	material["reflectivity"]->setFloat(materialProps.reflectivity);
+
+	materialCache[key] = material;
+	return material;
 }
@@ -4,11 +4,20 @@
 #include <optixu/optixpp_namespace.h>
 #include <optixu/optixu_math_stream_namespace.h>
 
+// STL
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 #include <sutil.h>
 
 using namespace optix;
 
 #include "MaterialProperties.h"
+#include "MeshRegistry.h"
 
 class GeometryCreator
 {
@@ -16,7 +25,8 @@ public:
 
 	GeometryCreator(Context context, const char* projectPrefix, const char* sceneName) :
 		context(context),
-		projectPrefix(projectPrefix)
+		projectPrefix(projectPrefix),
+		sceneName(sceneName)
 	{
 		scenePtx = sutil::getPtxString(projectPrefix, sceneName);
 	};
@@ -24,10 +34,43 @@ public:
 
 	GeometryInstance CreateSphere(float radius, MaterialProperties materialProps);
 	GeometryInstance CreateBox(float3 axisLengths, MaterialProperties materialProps);
-	GeometryInstance CreateMesh(std::string meshFilePath, MaterialProperties materialProps);
+
+	// Every instance of a file shares one geometry and acceleration structure, returned in
+	// acceleration for the body's GeometryGroup. With shared false the file is loaded again.
+	// If hostBVH is given it receives the mesh's tree for the CPU tracer
+	GeometryInstance CreateMesh(std::string meshFilePath, MaterialProperties materialProps, Acceleration& acceleration, bool shared = true,
+								std::shared_ptr<const WideBVH>* hostBVH = 0);
+
+	// Weld and reorder meshes on the host before uploading them, off by default
+	static void SetOptimizeMeshes(bool optimize) { MeshRegistry::SetOptimizeMeshes(optimize); }
+
+	// Number of distinct OptiX objects created so far, for startup measurements
+	size_t GetProgramCount() const { return programCache.size(); }
+	size_t GetMaterialCount() const { return materialCache.size(); }
+	size_t GetGeometryCount() const { return sphereCache.size() + boxCache.size() + (meshRegistry ? meshRegistry->GetMeshCount() : 0); }
+	unsigned int GetMeshLoadCount() const { return meshRegistry ? meshRegistry->GetLoadCount() : 0; }
+	size_t GetMeshBufferBytes() const { return meshRegistry ? meshRegistry->GetBufferBytes() : 0; }
 
 private:
+	typedef std::pair<std::string, std::string> ProgramKey;						// PTX file, entry point
+	typedef std::tuple<std::string, std::vector<float>, bool> MaterialKey;		// Closest hit program, parameters, shadows
+	typedef std::tuple<float, float, float> BoxKey;
+
+	/*
+		Programs, materials and geometry are shared between every instance created with the same
+		parameters. Per body variables (id, velocity, spinVector) live on the GeometryInstance
+	*/
+	Program GetProgram(const char* ptxFile, const char* entryPoint);
+	Material GetMaterial(const MaterialProperties& materialProps, bool castsShadows = true);
+
 	Context context;
 	const char* projectPrefix;
+	const char* sceneName;
 	const char* scenePtx;
+
+	std::map<ProgramKey, Program> programCache;
+	std::map<MaterialKey, Material> materialCache;
+	std::map<float, Geometry> sphereCache;
+	std::map<BoxKey, Geometry> boxCache;
+	std::unique_ptr<MeshRegistry> meshRegistry;
 };
@@ -0,0 +1,475 @@
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#include "HostTracer.h"
+#include "IntersectionKernels.h"
+#include "Profiler.h"
+#include "Simd8.h"
+
+using namespace optix;
+
+namespace
+{
+	// Matches the scene_epsilon the context uses
+	const float SCENE_EPSILON = 1.e-4f;
+
+	// Packets are square tiles of the response grid
+	const unsigned int PACKET_WIDTH = 4;
+
+	float3 TransposeMultiply(const Matrix3x3& m, const float3& v)
+	{
+		return make_float3(m[0] * v.x + m[3] * v.y + m[6] * v.z,
+						   m[1] * v.x + m[4] * v.y + m[7] * v.z,
+						   m[2] * v.x + m[5] * v.y + m[8] * v.z);
+	}
+
+	IntersectionData MakeHit(unsigned int id, float t, const float3& normal)
+	{
+		IntersectionData data;
+		data.rigidBodyId = id;
+		data.t = t;
+		data.normal = normal;
+		return data;
+	}
+
+	bool CloserHit(const IntersectionData& a, const IntersectionData& b)
+	{
+		return a.t < b.t;
+	}
+
+	// Each GPU trace starts scene_epsilon past the last hit, so a ray through a shared
+	// edge only counts once. Sorts and thins the mesh hits from first on
+	void MergeMeshHits(std::vector<IntersectionData>& hits, size_t first)
+	{
+		std::sort(hits.begin() + first, hits.end(), CloserHit);
+		size_t kept = first;
+		for (size_t j = first; j < hits.size(); j++)
+		{
+			if (kept == first || hits[j].t - hits[kept - 1].t > SCENE_EPSILON)
+				hits[kept++] = hits[j];
+		}
+		hits.resize(kept);
+	}
+}
+
+HostBody HostBody::Sphere(unsigned int id, float radius, float3 position, const Matrix3x3& rotation)
+{
+	HostBody body;
+	body.shape = SPHERE;
+	body.id = id;
+	body.radius = radius;
+	body.axisLengths = make_float3(2.0f * radius);
+	body.position = position;
+	body.rotation = rotation;
+	return body;
+}
+
+HostBody HostBody::Box(unsigned int id, float3 axisLengths, float3 position, const Matrix3x3& rotation)
+{
+	HostBody body;
+	body.shape = BOX;
+	body.id = id;
+	body.radius = 0.0f;
+	body.axisLengths = axisLengths;
+	body.position = position;
+	body.rotation = rotation;
+	return body;
+}
+
+HostBody HostBody::Mesh(unsigned int id, const std::shared_ptr<const WideBVH>& mesh, float3 position, const Matrix3x3& rotation)
+{
+	HostBody body;
+	body.shape = MESH;
+	body.id = id;
+	body.radius = 0.0f;
+	body.axisLengths = make_float3(0.0f);
+	body.mesh = mesh;
+	body.position = position;
+	body.rotation = rotation;
+	return body;
+}
+
+HostCamera HostCamera::LookAt(float3 eye, float3 lookat, float3 up, float vfov, unsigned int width, unsigned int height)
+{
+	const float aspect_ratio = static_cast<float>(width) / static_cast<float>(height);
+
+	// Same as sutil::calculateCameraVariables with a vertical fov
+	HostCamera camera;
+	camera.eye = eye;
+	camera.W = lookat - eye;
+	float wlen = length(camera.W);
+	camera.U = normalize(cross(camera.W, up));
+	camera.V = normalize(cross(camera.U, camera.W));
+
+	float vlen = wlen * tanf(0.5f * vfov * M_PIf / 180.0f);
+	camera.V *= vlen;
+	camera.U *= vlen * aspect_ratio;
+
+	float3 ray_direction_1 = normalize(-0.5f*camera.U + camera.W);
+	float3 ray_direction_2 = normalize(0.5f*camera.U + camera.W);
+	camera.fov = acosf(dot(ray_direction_1, ray_direction_2));
+	return camera;
+}
+
+HostTracer::HostTracer(unsigned int width, unsigned int height, unsigned int physicsRayStep) :
+	width(width),
+	height(height),
+	physicsRayStep(physicsRayStep),
+	responseWidth((width + physicsRayStep - 1) / physicsRayStep),
+	responseHeight((height + physicsRayStep - 1) / physicsRayStep),
+	threadCount(1),
+	packetTracing(true),
+	responses(responseWidth * responseHeight)
+{
+}
+
+void HostTracer::SetThreadCount(unsigned int threads)
+{
+	threadCount = std::max(1u, threads);
+}
+
+void HostTracer::GatherIntersections(const float3& origin, const float3& direction, const std::vector<HostBody>& bodies,
+									 std::vector<IntersectionData>& hits) const
+{
+	hits.clear();
+	for (size_t i = 0; i < bodies.size(); i++)
+	{
+		const HostBody& body = bodies[i];
+
+		// Bodies are rigid, so the inverse rotation is the transpose
+		const float3 O = TransposeMultiply(body.rotation, origin - body.position);
+		const float3 D = TransposeMultiply(body.rotation, direction);
+
+		if (body.shape == HostBody::SPHERE)
+		{
+			float t1, t2;
+			if (!IntersectSphere(O, D, body.radius, false, t1, t2))
+				continue;
+
+			if (t1 > SCENE_EPSILON)
+				hits.push_back(MakeHit(body.id, t1, (O + t1*D) / body.radius));
+			if (t2 > SCENE_EPSILON)
+				hits.push_back(MakeHit(body.id, t2, (O + t2*D) / body.radius));
+		}
+		else if (body.shape == HostBody::BOX)
+		{
+			float3 t0, t1;
+			float tmin, tmax;
+			if (!IntersectBox(body.axisLengths, O, D, t0, t1, tmin, tmax))
+				continue;
+
+			// The GPU reports one of the two per trace and picks up the other on the next one
+			if (tmin > SCENE_EPSILON)
+				hits.push_back(MakeHit(body.id, tmin, BoxNormal(tmin, t0, t1)));
+			if (tmax > SCENE_EPSILON)
+				hits.push_back(MakeHit(body.id, tmax, BoxNormal(tmax, t0, t1)));
+		}
+		else
+		{
+			const size_t first = hits.size();
+			body.mesh->GatherIntersections(O, D, SCENE_EPSILON, std::numeric_limits<float>::max(), body.id, hits);
+			MergeMeshHits(hits, first);
+		}
+	}
+}
+
+/*
+	GatherIntersections for a packet. Spheres and boxes run IntersectSphere and IntersectBox
+	on eight rays at once with the same arithmetic, meshes go through the packet walk and
+	trace any rays it hands back one at a time
+*/
+void HostTracer::GatherPacketIntersections(const RayPacket& packet, const std::vector<HostBody>& bodies,
+										   std::vector<IntersectionData>* hits) const
+{
+	for (int ray = 0; ray < RayPacket::SIZE; ray++)
+		hits[ray].clear();
+
+	RayPacket local;
+	local.active = packet.active;
+	for (size_t i = 0; i < bodies.size(); i++)
+	{
+		const HostBody& body = bodies[i];
+
+		local.origin = TransposeMultiply(body.rotation, packet.origin - body.position);
+		for (int ray = 0; ray < RayPacket::SIZE; ray++)
+		{
+			const float3 D = TransposeMultiply(body.rotation,
+				make_float3(packet.directions[0][ray], packet.directions[1][ray], packet.directions[2][ray]));
+			local.directions[0][ray] = D.x;
+			local.directions[1][ray] = D.y;
+			local.directions[2][ray] = D.z;
+		}
+
+		const float3& O = local.origin;
+		if (body.shape == HostBody::MESH)
+		{
+			size_t first[RayPacket::SIZE];
+			for (int ray = 0; ray < RayPacket::SIZE; ray++)
+				first[ray] = hits[ray].size();
+
+			const float tmax = std::numeric_limits<float>::max();
+			const unsigned int single = body.mesh->GatherPacketIntersections(local, SCENE_EPSILON, tmax, body.id, hits);
+			for (int ray = 0; ray < RayPacket::SIZE; ray++)
+			{
+				if (single & (1u << ray))
+				{
+					const float3 D = make_float3(local.directions[0][ray], local.directions[1][ray], local.directions[2][ray]);
+					body.mesh->GatherIntersections(O, D, SCENE_EPSILON, tmax, body.id, hits[ray]);
+				}
+				if (packet.active & (1u << ray))
+					MergeMeshHits(hits[ray], first[ray]);
+			}
+			continue;
+		}
+
+		for (int half = 0; half < 2; half++)
+		{
+			int bits = (packet.active >> (8 * half)) & 0xff;
+			if (!bits)
+				continue;
+
+			const Float8 Dx = Float8::Load(local.directions[0] + 8 * half);
+			const Float8 Dy = Float8::Load(local.directions[1] + 8 * half);
+			const Float8 Dz = Float8::Load(local.directions[2] + 8 * half);
+
+			if (body.shape == HostBody::SPHERE)
+			{
+				const Float8 b = Float8::Set(O.x) * Dx + Float8::Set(O.y) * Dy + Float8::Set(O.z) * Dz;
+				const Float8 disc = b * b - Float8::Set(dot(O, O) - body.radius * body.radius);
+				bits &= (disc > Float8::Set(0.0f)).Bits();
+				if (!bits)
+					continue;
+
+				const Float8 minusB = Float8::Set(0.0f) - b;
+				const Float8 sdisc = Sqrt(disc);
+				float t1[8], t2[8];
+				(minusB - sdisc).Store(t1);
+				(minusB + sdisc).Store(t2);
+
+				for (int lane = 0; lane < 8; lane++)
+				{
+					if (!(bits & (1 << lane)))
+						continue;
+
+					const int ray = 8 * half + lane;
+					const float3 D = make_float3(local.directions[0][ray], local.directions[1][ray], local.directions[2][ray]);
+					if (t1[lane] > SCENE_EPSILON)
+						hits[ray].push_back(MakeHit(body.id, t1[lane], (O + t1[lane]*D) / body.radius));
+					if (t2[lane] > SCENE_EPSILON)
+						hits[ray].push_back(MakeHit(body.id, t2[lane], (O + t2[lane]*D) / body.radius));
+				}
+			}
+			else
+			{
+				const float3 boxmin = -(body.axisLengths / 2.0f);
+				const float3 boxmax = (body.axisLengths / 2.0f);
+				const Float8 t0x = Float8::Set(boxmin.x - O.x) / Dx, t1x = Float8::Set(boxmax.x - O.x) / Dx;
+				const Float8 t0y = Float8::Set(boxmin.y - O.y) / Dy, t1y = Float8::Set(boxmax.y - O.y) / Dy;
+				const Float8 t0z = Float8::Set(boxmin.z - O.z) / Dz, t1z = Float8::Set(boxmax.z - O.z) / Dz;
+				const Float8 tmin = Max(Max(Min(t0x, t1x), Min(t0y, t1y)), Min(t0z, t1z));
+				const Float8 tmax = Min(Min(Max(t0x, t1x), Max(t0y, t1y)), Max(t0z, t1z));
+				bits &= (tmin <= tmax).Bits();
+				if (!bits)
+					continue;
+
+				float t0[3][8], t1[3][8], near[8], far[8];
+				t0x.Store(t0[0]); t0y.Store(t0[1]); t0z.Store(t0[2]);
+				t1x.Store(t1[0]); t1y.Store(t1[1]); t1z.Store(t1[2]);
+				tmin.Store(near);
+				tmax.Store(far);
+
+				for (int lane = 0; lane < 8; lane++)
+				{
+					if (!(bits & (1 << lane)))
+						continue;
+
+					const int ray = 8 * half + lane;
+					const float3 slab0 = make_float3(t0[0][lane], t0[1][lane], t0[2][lane]);
+					const float3 slab1 = make_float3(t1[0][lane], t1[1][lane], t1[2][lane]);
+					if (near[lane] > SCENE_EPSILON)
+						hits[ray].push_back(MakeHit(body.id, near[lane], BoxNormal(near[lane], slab0, slab1)));
+					if (far[lane] > SCENE_EPSILON)
+						hits[ray].push_back(MakeHit(body.id, far[lane], BoxNormal(far[lane], slab0, slab1)));
+				}
+			}
+		}
+	}
+}
+
+void HostTracer::TracePhysicsRays(const HostCamera& camera, const std::vector<HostBody>& bodies, FrameStats* stats)
+{
+	PROFILE_SCOPE("HostTracePhysics");
+
+	const unsigned int threads = std::min(threadCount, responseHeight);
+	if (workerHits.size() < std::max(threads, 1u))
+		workerHits.resize(std::max(threads, 1u));
+
+	if (threads <= 1)
+	{
+		if (packetTracing)
+			TracePacketRows(0, responseHeight, camera, bodies, workerHits[0], stats);
+		else
+			TraceRows(0, responseHeight, camera, bodies, workerHits[0], stats);
+		return;
+	}
+
+	// Each worker counts into its own stats so the counters need no atomics
+	std::vector<FrameStats> threadStats(threads);
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		memset(&threadStats[i], 0, sizeof(FrameStats));
+
+		const unsigned int rowBegin = responseHeight * i / threads;
+		const unsigned int rowEnd = responseHeight * (i + 1) / threads;
+		FrameStats* workerStats = stats ? &threadStats[i] : 0;
+		HitLists* hits = &workerHits[i];
+		workers.push_back(std::thread([this, rowBegin, rowEnd, &camera, &bodies, hits, workerStats]()
+		{
+			if (packetTracing)
+				TracePacketRows(rowBegin, rowEnd, camera, bodies, *hits, workerStats);
+			else
+				TraceRows(rowBegin, rowEnd, camera, bodies, *hits, workerStats);
+		}));
+	}
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	if (stats)
+	{
+		for (unsigned int i = 0; i < threads; i++)
+			for (int slot = 0; slot < STAT_SLOT_COUNT; slot++)
+				stats->counters[slot] += threadStats[i].counters[slot];
+	}
+}
+
+float3 HostTracer::RayDirection(const HostCamera& camera, unsigned int column, unsigned int row) const
+{
+	const unsigned int x = column * physicsRayStep;
+	const unsigned int y = row * physicsRayStep;
+	const float2 d = make_float2(float(x) / width, float(y) / height) * 2.f - 1.f;
+	return normalize(d.x*camera.U + d.y*camera.V + camera.W);
+}
+
+void HostTracer::StoreResponse(unsigned int column, unsigned int row, const HostCamera& camera, const float3& direction,
+							   std::vector<IntersectionData>& hits, FrameStats* stats)
+{
+	const float theta = camera.fov * (1.0f / width);
+	const float phi = 90.0f - theta;
+
+	// At most INTERSECTION_SAMPLES, the size of the GPU's per ray list
+	std::sort(hits.begin(), hits.end(), CloserHit);
+	unsigned int dropped = 0;
+	if (hits.size() > INTERSECTION_SAMPLES)
+	{
+		dropped = static_cast<unsigned int>(hits.size()) - INTERSECTION_SAMPLES;
+		hits.resize(INTERSECTION_SAMPLES);
+	}
+	const int numIntersections = static_cast<int>(hits.size());
+
+	int pairsFound = 0;
+	IntersectionResponse& response = responses[row * responseWidth + column];
+	response = numIntersections > 0 ?
+		FindLargestOverlap(hits.data(), numIntersections, theta, phi, camera.eye, direction, pairsFound) :
+		EmptyResponse();
+
+	if (stats)
+	{
+		// One trace per hit plus the final miss
+		stats->counters[STAT_RADIANCE_RAYS] += numIntersections + dropped + 1;
+		stats->counters[STAT_PHYSICS_RAYS]++;
+		stats->counters[STAT_SAMPLE_OVERFLOWS] += dropped;
+		stats->counters[STAT_PAIRS_FOUND] += pairsFound;
+		stats->counters[STAT_HITS_HISTOGRAM + numIntersections]++;
+	}
+}
+
+void HostTracer::TraceRows(unsigned int rowBegin, unsigned int rowEnd, const HostCamera& camera, const std::vector<HostBody>& bodies,
+						   HitLists& hitLists, FrameStats* stats)
+{
+	PROFILE_SCOPE("HostTraceRows");
+
+	std::vector<IntersectionData>& hits = hitLists.rays[0];
+	hits.reserve(2 * bodies.size());
+
+	for (unsigned int row = rowBegin; row < rowEnd; row++)
+	{
+		for (unsigned int column = 0; column < responseWidth; column++)
+		{
+			const float3 direction = RayDirection(camera, column, row);
+			GatherIntersections(camera.eye, direction, bodies, hits);
+			StoreResponse(column, row, camera, direction, hits, stats);
+		}
+	}
+}
+
+/*
+	TraceRows in PACKET_WIDTH x PACKET_WIDTH tiles. Tiles hanging over the edge of the rows
+	or the grid leave those rays inactive, they still get a valid direction so the packet
+	arithmetic stays finite
+*/
+void HostTracer::TracePacketRows(unsigned int rowBegin, unsigned int rowEnd, const HostCamera& camera, const std::vector<HostBody>& bodies,
+								 HitLists& hitLists, FrameStats* stats)
+{
+	PROFILE_SCOPE("HostTracePackets");
+
+	std::vector<IntersectionData>* hits = hitLists.rays;
+	float3 directions[RayPacket::SIZE];
+
+	RayPacket packet;
+	packet.origin = camera.eye;
+	for (unsigned int rowStart = rowBegin; rowStart < rowEnd; rowStart += PACKET_WIDTH)
+	{
+		for (unsigned int columnStart = 0; columnStart < responseWidth; columnStart += PACKET_WIDTH)
+		{
+			packet.active = 0;
+			for (int ray = 0; ray < RayPacket::SIZE; ray++)
+			{
+				unsigned int row = rowStart + ray / PACKET_WIDTH;
+				unsigned int column = columnStart + ray % PACKET_WIDTH;
+				if (row < rowEnd && column < responseWidth)
+				{
+					packet.active |= 1u << ray;
+				}
+				else
+				{
+					row = rowStart;
+					column = columnStart;
+				}
+
+				directions[ray] = RayDirection(camera, column, row);
+				packet.directions[0][ray] = directions[ray].x;
+				packet.directions[1][ray] = directions[ray].y;
+				packet.directions[2][ray] = directions[ray].z;
+			}
+
+			GatherPacketIntersections(packet, bodies, hits);
+
+			for (int ray = 0; ray < RayPacket::SIZE; ray++)
+			{
+				if (packet.active & (1u << ray))
+					StoreResponse(columnStart + ray % PACKET_WIDTH, rowStart + ray / PACKET_WIDTH, camera, directions[ray], hits[ray], stats);
+			}
+		}
+	}
+}
+
+float HostTracer::TotalVolume() const
+{
+	float volume = 0.0f;
+	for (size_t i = 0; i < responses.size(); i++)
+	{
+		if (responses[i].volume > 0.00001f)
+			volume += responses[i].volume;
+	}
+	return volume;
+}
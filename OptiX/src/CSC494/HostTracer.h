@@ -0,0 +1,124 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+// STL
+#include <memory>
+#include <vector>
+
+#include "BufferStructs.h"
+#include "FrameCounters.h"
+#include "WideBVH.h"
+
+using namespace optix;
+
+/*
+	CPU version of the physics ray pass in ray_scene.cu.
+
+	Casts one physics ray every physicsRayStep pixels through the same camera model,
+	gathers every entry and exit along the ray, and runs the shared FindLargestOverlap
+	so the responses match what the GPU writes to the collisionResponse buffer.
+	Spheres and boxes are analytic, meshes are traced through a WideBVH.
+
+	By default rays are traced in 4x4 packets: all of them leave the camera, so spheres and
+	boxes are tested eight rays at a time and a mesh's tree is walked once per packet.
+	Packet and single ray tracing give the same hits.
+*/
+struct HostBody
+{
+	enum Shape
+	{
+		SPHERE,
+		BOX,
+		MESH
+	};
+
+	Shape shape;
+	unsigned int id;
+	float radius;			// SPHERE
+	float3 axisLengths;		// BOX
+	std::shared_ptr<const WideBVH> mesh;	// MESH, in object space
+	float3 position;
+	Matrix3x3 rotation;		// Object to world
+
+	static HostBody Sphere(unsigned int id, float radius, float3 position, const Matrix3x3& rotation);
+	static HostBody Box(unsigned int id, float3 axisLengths, float3 position, const Matrix3x3& rotation);
+	static HostBody Mesh(unsigned int id, const std::shared_ptr<const WideBVH>& mesh, float3 position, const Matrix3x3& rotation);
+};
+
+struct HostCamera
+{
+	float3 eye;
+	float3 U;
+	float3 V;
+	float3 W;
+	float fov;			// Same quantity Scene::UpdateCamera writes to the "fov" variable
+
+	// Mirrors Scene::UpdateCamera with a vertical field of view in degrees
+	static HostCamera LookAt(float3 eye, float3 lookat, float3 up, float vfov, unsigned int width, unsigned int height);
+};
+
+class HostTracer
+{
+public:
+	HostTracer(unsigned int width, unsigned int height, unsigned int physicsRayStep);
+
+	// Rows of physics rays are split evenly over this many threads, 1 traces on the caller
+	void SetThreadCount(unsigned int threads);
+	unsigned int GetThreadCount() const { return threadCount; }
+
+	// Trace 4x4 packets of physics rays instead of one ray at a time, on by default
+	void SetPacketTracing(bool enable) { packetTracing = enable; }
+	bool GetPacketTracing() const { return packetTracing; }
+
+	// Fills the response grid, one IntersectionResponse per physics ray.
+	// Counts are added to stats if given
+	void TracePhysicsRays(const HostCamera& camera, const std::vector<HostBody>& bodies, FrameStats* stats = 0);
+
+	const std::vector<IntersectionResponse>& GetResponses() const { return responses; }
+	unsigned int GetResponseWidth() const { return responseWidth; }
+	unsigned int GetResponseHeight() const { return responseHeight; }
+
+	// Sum of the response volumes, what Scene::ResolveCollisions reports
+	float TotalVolume() const;
+
+private:
+	// A worker's hit lists, one per ray of a packet. Kept between frames so their capacity is reused
+	struct HitLists
+	{
+		std::vector<IntersectionData> rays[RayPacket::SIZE];
+	};
+
+	// Every hit along the ray, unsorted
+	void GatherIntersections(const float3& origin, const float3& direction, const std::vector<HostBody>& bodies,
+							 std::vector<IntersectionData>& hits) const;
+
+	// Same for every active ray of the packet, hits[i] gets ray i's. Hits are left unsorted
+	void GatherPacketIntersections(const RayPacket& packet, const std::vector<HostBody>& bodies,
+								   std::vector<IntersectionData>* hits) const;
+
+	// Traces response rows [rowBegin, rowEnd)
+	void TraceRows(unsigned int rowBegin, unsigned int rowEnd, const HostCamera& camera, const std::vector<HostBody>& bodies,
+				   HitLists& hits, FrameStats* stats);
+	void TracePacketRows(unsigned int rowBegin, unsigned int rowEnd, const HostCamera& camera, const std::vector<HostBody>& bodies,
+						 HitLists& hits, FrameStats* stats);
+
+	// Physics ray through response cell (column, row), as perspective_camera computes it
+	float3 RayDirection(const HostCamera& camera, unsigned int column, unsigned int row) const;
+
+	// Writes the response of the ray through response cell (column, row) from its hits
+	void StoreResponse(unsigned int column, unsigned int row, const HostCamera& camera, const float3& direction,
+					   std::vector<IntersectionData>& hits, FrameStats* stats);
+
+	unsigned int width;
+	unsigned int height;
+	unsigned int physicsRayStep;
+	unsigned int responseWidth;
+	unsigned int responseHeight;
+	unsigned int threadCount;
+	bool packetTracing;
+	std::vector<IntersectionResponse> responses;
+	std::vector<HitLists> workerHits;		// One per thread
+};
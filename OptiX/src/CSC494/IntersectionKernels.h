@@ -0,0 +1,234 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+
+#include "BufferStructs.h"
+
+/*
+	Intersection and volume routines shared by the OptiX programs and the host.
+	The .cu programs are thin wrappers around these, so the benchmarks and any
+	CPU path time exactly the code the GPU runs.
+*/
+
+// Assume we will never have more than 5 bodies intersecting at any given point
+const int MAX_OBJECTS_INSIDE = 5;
+
+/*
+	Ray against a sphere centered at the origin. Writes both roots, returns false on a miss
+*/
+static RT_HOSTDEVICE inline bool IntersectSphere(const optix::float3& O, const optix::float3& D, float radius, bool useRobustMethod,
+												 float& t1, float& t2)
+{
+	float b = optix::dot(O, D);
+	float c = optix::dot(O, O) - radius * radius;
+	float disc = b * b - c;
+	if (disc <= 0.0f)
+	{
+		return false;
+	}
+
+	float sdisc = sqrtf(disc);
+	float root1 = (-b - sdisc);
+
+	bool do_refine = false;
+
+	float root11 = 0.0f;
+
+	if (useRobustMethod && fabsf(root1) > 10.f * radius)
+	{
+		do_refine = true;
+	}
+
+	if (do_refine)
+	{
+		// refine root1
+		optix::float3 O1 = O + root1 * D;
+		b = optix::dot(O1, D);
+		c = optix::dot(O1, O1) - radius * radius;
+		disc = b * b - c;
+
+		if (disc > 0.0f) {
+			sdisc = sqrtf(disc);
+			root11 = (-b - sdisc);
+		}
+	}
+
+	t1 = root1 + root11;
+	t2 = (-b + sdisc) + (do_refine ? root1 : 0);
+	return true;
+}
+
+/*
+	Ray against a box centered at the origin. t0 and t1 are the per axis slab distances,
+	which BoxNormal needs to recover the face that was hit
+*/
+static RT_HOSTDEVICE inline bool IntersectBox(const optix::float3& axisLengths, const optix::float3& O, const optix::float3& D,
+											  optix::float3& t0, optix::float3& t1, float& tmin, float& tmax)
+{
+	optix::float3 boxmin = -(axisLengths / 2.0f);
+	optix::float3 boxmax = (axisLengths / 2.0f);
+
+	t0 = (boxmin - O) / D;
+	t1 = (boxmax - O) / D;
+	optix::float3 tnear = optix::fminf(t0, t1);
+	optix::float3 tfar = optix::fmaxf(t0, t1);
+	tmin = optix::fmaxf(tnear);
+	tmax = optix::fminf(tfar);
+
+	return tmin <= tmax;
+}
+
+static RT_HOSTDEVICE inline optix::float3 BoxNormal(float t, const optix::float3& t0, const optix::float3& t1)
+{
+	optix::float3 neg = optix::make_float3(t == t0.x ? 1 : 0, t == t0.y ? 1 : 0, t == t0.z ? 1 : 0);
+	optix::float3 pos = optix::make_float3(t == t1.x ? 1 : 0, t == t1.y ? 1 : 0, t == t1.z ? 1 : 0);
+	return pos - neg;
+}
+
+/*
+	Branchless ray/triangle test, same formulation as optix::intersect_triangle.
+	n is the unnormalized geometric normal
+*/
+static RT_HOSTDEVICE inline bool IntersectTriangle(const optix::float3& O, const optix::float3& D, float tmin, float tmax,
+												   const optix::float3& p0, const optix::float3& p1, const optix::float3& p2,
+												   optix::float3& n, float& t, float& beta, float& gamma)
+{
+	const optix::float3 e0 = p1 - p0;
+	const optix::float3 e1 = p0 - p2;
+	n = optix::cross(e1, e0);
+
+	const optix::float3 e2 = (1.0f / optix::dot(n, D)) * (p0 - O);
+	const optix::float3 i = optix::cross(D, e2);
+
+	beta = optix::dot(i, e1);
+	gamma = optix::dot(i, e0);
+	t = optix::dot(n, e2);
+
+	return ((t < tmax) & (t > tmin) & (beta >= 0.0f) & (gamma >= 0.0f) & (beta + gamma <= 1));
+}
+
+/*
+	Volume of the frustum a single physics ray covers between entry and exit
+*/
+static RT_HOSTDEVICE inline float FrustumVolume(float theta, float phi, float entryT, float exitT)
+{
+	float a = sin(theta) * entryT / sin(phi);
+	float b = sin(theta) * exitT / sin(phi);
+	float h = exitT - entryT;
+	return 0.33 * (a*a + a * b + b * b) * h;
+}
+
+static RT_HOSTDEVICE inline IntersectionResponse EmptyResponse()
+{
+	IntersectionResponse response;
+	response.volume = 0.0f;
+	response.entryId = 0;
+	response.entryNormal = optix::make_float3(0.0f, 0.0f, 0.0f);
+	response.exitId = 0;
+	response.exitNormal = optix::make_float3(0.0f, 0.0f, 0.0f);
+	response.entryPoint = optix::make_float3(0.0f, 0.0f, 0.0f);
+	response.exitPoint = optix::make_float3(0.0f, 0.0f, 0.0f);
+	response.collisionId = 0;
+	return response;
+}
+
+/*
+	Given an ordered list of ray intersections, finds all intervals of intersections and
+	computes their volumes. Right now, just returns the largest intersection volume.
+	pairsFound is incremented once for every overlapping pair of intervals
+*/
+static RT_HOSTDEVICE inline IntersectionResponse FindLargestOverlap(const IntersectionData* intersections, int numIntersections,
+																	float theta, float phi,
+																	const optix::float3& ray_origin, const optix::float3& ray_direction,
+																	int& pairsFound)
+{
+	IntersectionResponse largestResponse = EmptyResponse();
+	IntersectionData objectsInside[MAX_OBJECTS_INSIDE];
+	int insideIndex = 0;
+
+	for (int i = 0; i < numIntersections; i++)
+	{
+		IntersectionData objEnter; // Will be set if we need it
+
+		// Check to see if we are entering this object
+		bool entering = true;
+		for (int j = 0; j < insideIndex; j++)
+		{
+			if (objectsInside[j].rigidBodyId == intersections[i].rigidBodyId)
+			{
+				objEnter = objectsInside[j];
+				entering = false;
+			}
+		}
+
+		// If entering, add it to our tracking array
+		if (entering)
+		{
+			// Check if this intersection has an exit point (ie, is valid)
+			bool isValid = false;
+			for (int j = i + 1; j < numIntersections; j++)
+			{
+				if (intersections[j].rigidBodyId == intersections[i].rigidBodyId)
+				{
+					isValid = true;
+					break;
+				}
+			}
+
+			if (isValid && insideIndex < MAX_OBJECTS_INSIDE)
+			{
+				objectsInside[insideIndex] = intersections[i];
+				insideIndex++;
+			}
+		}
+		else
+		{
+			// Otherwise, we are exiting this object, need to check for intersection volumes
+			// with any other objects we are currently inside
+			for (int j = 0; j < insideIndex; j++)
+			{
+				if (objectsInside[j].rigidBodyId != intersections[i].rigidBodyId)
+				{
+					// Compute volume
+					IntersectionData entryPoint = objectsInside[j].t < objEnter.t ? objEnter : objectsInside[j];
+					IntersectionData exitPoint = intersections[i];
+
+					float volume = FrustumVolume(theta, phi, entryPoint.t, exitPoint.t);
+					pairsFound++;
+
+					if (volume > largestResponse.volume)
+					{
+						largestResponse.volume = volume;
+						largestResponse.entryId = entryPoint.rigidBodyId;
+						largestResponse.entryNormal = entryPoint.normal;
+						largestResponse.exitId = exitPoint.rigidBodyId;
+						largestResponse.exitNormal = exitPoint.normal;
+						largestResponse.entryPoint = ray_origin + entryPoint.t * ray_direction;
+						largestResponse.exitPoint = ray_origin + exitPoint.t * ray_direction;
+						largestResponse.collisionId = objectsInside[j].rigidBodyId;
+					}
+				}
+			}
+
+			// Remove this object from our tracking array
+			bool shift = false;
+			for (int j = 0; j < insideIndex; j++)
+			{
+				if (objectsInside[j].rigidBodyId == intersections[i].rigidBodyId)
+				{
+					shift = true;
+					continue;
+				}
+
+				if (shift)
+				{
+					objectsInside[j - 1] = objectsInside[j];
+				}
+			}
+			insideIndex--;
+		}
+	}
+
+	return largestResponse;
+}
@@ -0,0 +1,148 @@
+// OptiX
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_stream_namespace.h>
+
+// STL
+#include <iostream>
+
+#include <sutil.h>
+#include <Mesh.h>
+#include <MeshBVH.h>
+#include <MeshOptimizer.h>
+#include <OptiXMesh.h>
+
+#include "MeshRegistry.h"
+#include "Profiler.h"
+
+using namespace optix;
+
+bool MeshRegistry::optimizeMeshes = false;
+
+MeshRegistry::MeshRegistry(Context context, Program intersection, Program bounds, const Matrix4x4& loadTransform) :
+	context(context),
+	intersection(intersection),
+	bounds(bounds),
+	loadTransform(loadTransform),
+	loadCount(0),
+	bufferBytes(0)
+{
+}
+
+const SharedMesh& MeshRegistry::Acquire(const std::string& path, Material material, bool hostBVH)
+{
+	std::map<std::string, SharedMesh>::iterator cached = meshes.find(path);
+	if (cached != meshes.end())
+	{
+		if (hostBVH && !cached->second.hostBVH)
+		{
+			// Uploaded without one, parse the file again on the host only
+			HostMesh hostMesh;
+			ReadHostMesh(path, hostMesh, false);
+			cached->second.hostBVH = BuildHostBVH(path, hostMesh);
+		}
+		return cached->second;
+	}
+
+	return meshes[path] = Load(path, material, hostBVH);
+}
+
+SharedMesh MeshRegistry::LoadUnique(const std::string& path, Material material, bool hostBVH)
+{
+	return Load(path, material, hostBVH);
+}
+
+/*
+	Parses the file into one host arena, optionally optimizes it, uploads it and builds
+	the acceleration structure every body using the mesh shares
+*/
+SharedMesh MeshRegistry::Load(const std::string& path, Material material, bool hostBVH)
+{
+	PROFILE_SCOPE("LoadMesh");
+	const double start = sutil::currentTime();
+
+	HostMesh hostMesh;
+	ReadHostMesh(path, hostMesh, true);
+
+	OptiXMesh mesh;
+	mesh.context = context;
+	mesh.intersection = intersection;
+	mesh.bounds = bounds;
+	mesh.material = material;
+	{
+		PROFILE_SCOPE("UploadMesh");
+		loadMesh(hostMesh, mesh);
+	}
+
+	SharedMesh shared;
+	shared.geometry = mesh.geom_instance->getGeometry();
+	shared.acceleration = context->createAcceleration("Trbvh");
+	shared.acceleration->setProperty("vertex_buffer_name", "vertex_buffer");
+	shared.acceleration->setProperty("index_buffer_name", "index_buffer");
+	shared.bboxMin = mesh.bbox_min;
+	shared.bboxMax = mesh.bbox_max;
+	shared.triangleCount = mesh.num_triangles;
+	if (hostBVH)
+	{
+		shared.hostBVH = BuildHostBVH(path, hostMesh);
+	}
+
+	const size_t vertexBytes = 3 * sizeof(float) + (hostMesh.has_normals ? 3 * sizeof(float) : 0) + (hostMesh.has_texcoords ? 2 * sizeof(float) : 0);
+	shared.bufferBytes = hostMesh.num_vertices * vertexBytes + hostMesh.num_triangles * 4 * sizeof(int32_t);
+
+	// The instance only existed to get the geometry built
+	mesh.geom_instance->destroy();
+
+	loadCount++;
+	bufferBytes += shared.bufferBytes;
+	shared.loadMs = (sutil::currentTime() - start) * 1000.0;
+	return shared;
+}
+
+/*
+	MeshLoader's steps one by one, so each shows in the profile: the scan counts what the
+	file holds, the read parses it or copies it from the mesh cache into one host arena
+*/
+void MeshRegistry::ReadHostMesh(const std::string& path, HostMesh& hostMesh, bool printOptimizeStats) const
+{
+	MeshLoader loader(path);
+	{
+		PROFILE_SCOPE("ScanMesh");
+		loader.scanMesh(hostMesh);
+	}
+	allocMeshArena(hostMesh, alignedMeshAllocator());
+	{
+		PROFILE_SCOPE("ReadMesh");
+		loader.loadMesh(hostMesh, loadTransform.getData());
+	}
+
+	if (optimizeMeshes)
+	{
+		PROFILE_SCOPE("OptimizeMesh");
+		const MeshOptimizeStats stats = optimizeMesh(hostMesh);
+		if (printOptimizeStats)
+		{
+			std::cout << path << ": ";
+			printMeshOptimizeStats(stats, std::cout);
+		}
+	}
+}
+
+/*
+	Collapses the binary BVH, which comes from the mesh cache when the file was seen before
+	with the same transform, into the eight wide tree the CPU tracer walks
+*/
+std::shared_ptr<const WideBVH> MeshRegistry::BuildHostBVH(const std::string& path, const Mesh& hostMesh) const
+{
+	PROFILE_SCOPE("BuildHostBVH");
+
+	MeshBVH bvh;
+	{
+		PROFILE_NAMED_SCOPE(timer, "BuildMeshBVH");
+		if (bvh.buildCached(path, hostMesh))
+			PROFILE_RENAME(timer, "LoadMeshBVH");
+	}
+
+	std::shared_ptr<WideBVH> wide(new WideBVH());
+	wide->Build(hostMesh, bvh);
+	return wide;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_stream_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+// STL
+#include <map>
+#include <memory>
+#include <stddef.h>
+#include <string>
+
+#include "WideBVH.h"
+
+class HostMesh;
+
+using namespace optix;
+
+/*
+	A mesh loaded once and shared by every rigidbody that uses it. The geometry and its
+	acceleration structure are never changed after loading, each body only adds its own
+	GeometryInstance (for its id, velocity and material) and Transform on top
+*/
+struct SharedMesh
+{
+	Geometry geometry;
+	Acceleration acceleration;	// Set on every body's GeometryGroup, see RigidBody
+	float3 bboxMin;
+	float3 bboxMax;
+	int triangleCount;
+	size_t bufferBytes;			// Vertex, normal, texcoord, index and material index buffers
+	double loadMs;
+	std::shared_ptr<const WideBVH> hostBVH;	// For the CPU tracer, only built when asked for
+};
+
+class MeshRegistry
+{
+public:
+	MeshRegistry(Context context, Program intersection, Program bounds, const Matrix4x4& loadTransform);
+
+	// Loads the file the first time it is asked for, later calls return the same mesh.
+	// material is only used for the throwaway instance OptiXMesh creates while loading.
+	// With hostBVH the mesh also gets a WideBVH for the CPU tracer
+	const SharedMesh& Acquire(const std::string& path, Material material, bool hostBVH = false);
+
+	// Loads a private copy that isn't registered, one file parse and BVH build per call.
+	// For comparing against the shared path
+	SharedMesh LoadUnique(const std::string& path, Material material, bool hostBVH = false);
+
+	// Weld and reorder meshes on the host before uploading them, off by default
+	static void SetOptimizeMeshes(bool optimize) { optimizeMeshes = optimize; }
+
+	size_t GetMeshCount() const { return meshes.size(); }
+	unsigned int GetLoadCount() const { return loadCount; }
+	size_t GetBufferBytes() const { return bufferBytes; }
+
+private:
+	SharedMesh Load(const std::string& path, Material material, bool hostBVH);
+	void ReadHostMesh(const std::string& path, HostMesh& hostMesh, bool printOptimizeStats) const;
+	std::shared_ptr<const WideBVH> BuildHostBVH(const std::string& path, const Mesh& hostMesh) const;
+
+	Context context;
+	Program intersection;
+	Program bounds;
+	Matrix4x4 loadTransform;
+
+	std::map<std::string, SharedMesh> meshes;
+	unsigned int loadCount;
+	size_t bufferBytes;			// Over every load, shared or unique
+
+	static bool optimizeMeshes;
+};
@@ -0,0 +1,288 @@
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "Profiler.h"
+
+std::atomic<bool> Profiler::enabled(false);
+
+namespace
+{
+	const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+	// An event as the ring holds it. The fields are atomic so a reader copying a slot the
+	// owning thread is overwriting gets a stale or new value instead of a torn one, and the
+	// copy is then dropped, see CopyEvents
+	struct Slot
+	{
+		std::atomic<const char*> name;
+		std::atomic<int64_t> start;
+		std::atomic<int64_t> duration;
+	};
+
+	struct ThreadRing
+	{
+		ThreadRing(uint32_t tid) : slots(new Slot[Profiler::RING_CAPACITY]), head(0), tid(tid) {}
+
+		std::unique_ptr<Slot[]> slots;
+		std::atomic<uint64_t> head;
+		uint32_t tid;
+		std::string threadName;
+	};
+
+	// Rings are owned by the registry rather than the thread so that events recorded by
+	// worker threads survive after the workers exit
+	struct RingRegistry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadRing>> rings;
+		std::string traceFile;
+	};
+
+	RingRegistry& Registry()
+	{
+		static RingRegistry registry;
+		return registry;
+	}
+
+	ThreadRing& LocalRing()
+	{
+		static thread_local ThreadRing* ring = 0;
+		if (!ring)
+		{
+			RingRegistry& registry = Registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.rings.emplace_back(new ThreadRing(static_cast<uint32_t>(registry.rings.size())));
+			ring = registry.rings.back().get();
+		}
+		return *ring;
+	}
+
+	// Copies the events still held by a ring, oldest first. The owning thread keeps recording
+	// meanwhile, so once copied the slots it may have reused since are dropped again: the
+	// acquire fence pairs with the release fence in Record, so a copy that saw any part of a
+	// newer event also sees head moved to that event
+	void CopyEvents(const ThreadRing& ring, std::vector<Profiler::Event>& events)
+	{
+		const uint64_t mask = Profiler::RING_CAPACITY - 1;
+		const uint64_t head = ring.head.load(std::memory_order_acquire);
+		const uint64_t first = head > Profiler::RING_CAPACITY ? head - Profiler::RING_CAPACITY : 0;
+
+		events.resize(static_cast<size_t>(head - first));
+		for (uint64_t i = first; i < head; i++)
+		{
+			const Slot& slot = ring.slots[i & mask];
+			Profiler::Event& event = events[static_cast<size_t>(i - first)];
+			event.name = slot.name.load(std::memory_order_relaxed);
+			event.start = slot.start.load(std::memory_order_relaxed);
+			event.duration = slot.duration.load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t newHead = ring.head.load(std::memory_order_relaxed);
+
+		// Index i shares its slot with i + RING_CAPACITY, which is being or has been written
+		// once head reached it
+		const uint64_t valid = newHead >= Profiler::RING_CAPACITY ? newHead - Profiler::RING_CAPACITY + 1 : 0;
+		if (valid > first)
+			events.erase(events.begin(), events.begin() + static_cast<size_t>(std::min(valid, head) - first));
+	}
+
+	std::string EscapeJson(const char* text)
+	{
+		std::string escaped;
+		for (const char* c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				escaped += '\\';
+			escaped += *c;
+		}
+		return escaped;
+	}
+
+	double Percentile(const std::vector<double>& sorted, double fraction)
+	{
+		// Nearest rank
+		size_t rank = static_cast<size_t>(fraction * sorted.size() + 0.5);
+		rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+		return sorted[rank - 1];
+	}
+}
+
+void Profiler::Enable(bool enable)
+{
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	ThreadRing& ring = LocalRing();
+	std::lock_guard<std::mutex> lock(Registry().mutex);
+	ring.threadName = name;
+}
+
+void Profiler::SetTraceFile(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(Registry().mutex);
+	Registry().traceFile = path;
+}
+
+int64_t Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void Profiler::Record(const char* name, int64_t start, int64_t end)
+{
+	ThreadRing& ring = LocalRing();
+	const uint64_t head = ring.head.load(std::memory_order_relaxed);
+
+	// Orders the previous head store before the slot writes, for CopyEvents. A compiler
+	// barrier only on x86, the stores stay plain moves
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Slot& slot = ring.slots[head & (RING_CAPACITY - 1)];
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.start.store(start, std::memory_order_relaxed);
+	slot.duration.store(end - start, std::memory_order_relaxed);
+
+	ring.head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<Profiler::StageSummary> Profiler::Summarize()
+{
+	std::map<std::string, std::vector<double>> durations;
+	{
+		RingRegistry& registry = Registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		std::vector<Event> events;
+		for (size_t i = 0; i < registry.rings.size(); i++)
+		{
+			CopyEvents(*registry.rings[i], events);
+			for (size_t e = 0; e < events.size(); e++)
+				durations[events[e].name].push_back(events[e].duration * 1.0e-6);
+		}
+	}
+
+	std::vector<StageSummary> summaries;
+	for (auto it = durations.begin(); it != durations.end(); ++it)
+	{
+		std::vector<double>& samples = it->second;
+		std::sort(samples.begin(), samples.end());
+
+		double total = 0.0;
+		for (size_t i = 0; i < samples.size(); i++)
+			total += samples[i];
+
+		StageSummary summary;
+		summary.name = it->first;
+		summary.count = samples.size();
+		summary.mean = total / samples.size();
+		summary.p50 = Percentile(samples, 0.50);
+		summary.p95 = Percentile(samples, 0.95);
+		summary.p99 = Percentile(samples, 0.99);
+		summary.max = samples.back();
+		summaries.push_back(summary);
+	}
+
+	return summaries;
+}
+
+void Profiler::PrintSummary(std::ostream& out)
+{
+	std::vector<StageSummary> summaries = Summarize();
+	if (summaries.empty())
+		return;
+
+	out << std::left << std::setw(24) << "Stage (ms)" << std::right
+		<< std::setw(8) << "count"
+		<< std::setw(10) << "mean"
+		<< std::setw(10) << "p50"
+		<< std::setw(10) << "p95"
+		<< std::setw(10) << "p99"
+		<< std::setw(10) << "max" << std::endl;
+
+	out << std::fixed << std::setprecision(3);
+	for (size_t i = 0; i < summaries.size(); i++)
+	{
+		const StageSummary& s = summaries[i];
+		out << std::left << std::setw(24) << s.name << std::right
+			<< std::setw(8) << s.count
+			<< std::setw(10) << s.mean
+			<< std::setw(10) << s.p50
+			<< std::setw(10) << s.p95
+			<< std::setw(10) << s.p99
+			<< std::setw(10) << s.max << std::endl;
+	}
+	out.unsetf(std::ios::fixed);
+}
+
+bool Profiler::ExportChromeTrace(const std::string& path)
+{
+	std::ofstream file(path.c_str());
+	if (!file.is_open())
+	{
+		std::cerr << "Profiler: could not open '" << path << "' for writing" << std::endl;
+		return false;
+	}
+
+	RingRegistry& registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	char line[512];
+	std::vector<Event> events;
+	for (size_t i = 0; i < registry.rings.size(); i++)
+	{
+		const ThreadRing& ring = *registry.rings[i];
+
+		if (!ring.threadName.empty())
+		{
+			snprintf(line, sizeof line, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",", ring.tid, EscapeJson(ring.threadName.c_str()).c_str());
+			file << line;
+			first = false;
+		}
+
+		CopyEvents(ring, events);
+		for (size_t e = 0; e < events.size(); e++)
+		{
+			const Event& event = events[e];
+			snprintf(line, sizeof line, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				first ? "" : ",", EscapeJson(event.name).c_str(), ring.tid, event.start * 1.0e-3, event.duration * 1.0e-3);
+			file << line;
+			first = false;
+		}
+	}
+	file << "\n]}\n";
+
+	return file.good();
+}
+
+void Profiler::Shutdown()
+{
+	if (!IsEnabled())
+		return;
+
+	Enable(false);
+
+	std::string traceFile;
+	{
+		std::lock_guard<std::mutex> lock(Registry().mutex);
+		traceFile = Registry().traceFile;
+	}
+
+	PrintSummary(std::cout);
+	if (!traceFile.empty() && ExportChromeTrace(traceFile))
+	{
+		std::cerr << "Wrote frame trace to '" << traceFile << "'\n";
+	}
+}
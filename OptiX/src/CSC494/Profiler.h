@@ -0,0 +1,104 @@
+#pragma once
+
+// STL
+#include <atomic>
+#include <iosfwd>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+	Scoped timers for the frame stages.
+
+	Each thread records into its own fixed size ring buffer, so recording never takes a lock
+	and old events are overwritten once the ring is full. The summary and the trace can be
+	taken while threads record, slots overwritten during the copy are left out. While the profiler is disabled a
+	timed scope costs a single relaxed atomic load. Defining CSC494_DISABLE_PROFILER removes
+	the scopes from the build entirely.
+*/
+class Profiler
+{
+public:
+	// Number of events kept per thread, must be a power of two
+	static const uint32_t RING_CAPACITY = 1u << 14;
+
+	struct Event
+	{
+		const char* name;		// Stage name, stored by pointer so it must outlive the profiler
+		int64_t start;			// Nanoseconds since the profiler epoch
+		int64_t duration;		// Nanoseconds
+	};
+
+	// Rolling percentiles over the events still held in the ring buffers, in milliseconds
+	struct StageSummary
+	{
+		std::string name;
+		size_t count;
+		double mean;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	static void Enable(bool enable);
+	static inline bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	// Names the calling thread in the exported trace
+	static void SetThreadName(const char* name);
+
+	// If set, Shutdown() writes the Chrome trace to this file
+	static void SetTraceFile(const std::string& path);
+
+	static int64_t Now();
+	static void Record(const char* name, int64_t start, int64_t end);
+
+	static std::vector<StageSummary> Summarize();
+	static void PrintSummary(std::ostream& out);
+	static bool ExportChromeTrace(const std::string& path);
+
+	// Prints the summary and writes the trace file, then stops recording
+	static void Shutdown();
+
+private:
+	static std::atomic<bool> enabled;
+};
+
+class ScopedTimer
+{
+public:
+	explicit ScopedTimer(const char* name) :
+		name(name),
+		start(Profiler::IsEnabled() ? Profiler::Now() : -1)
+	{
+	};
+	~ScopedTimer()
+	{
+		if (start >= 0)
+			Profiler::Record(name, start, Profiler::Now());
+	};
+
+	// For stages whose kind is only known once they ran
+	void SetName(const char* newName) { name = newName; }
+
+private:
+	ScopedTimer(const ScopedTimer&);
+	ScopedTimer& operator=(const ScopedTimer&);
+
+	const char* name;
+	int64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// PROFILE_NAMED_SCOPE gives the timer a name PROFILE_RENAME can refer to
+#if defined(CSC494_DISABLE_PROFILER)
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_NAMED_SCOPE(timer, name) do {} while (0)
+#define PROFILE_RENAME(timer, name) do {} while (0)
+#else
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_NAMED_SCOPE(timer, name) ScopedTimer timer(name)
+#define PROFILE_RENAME(timer, name) timer.SetName(name)
+#endif
@@ -1,12 +1,12 @@
 #include <optix.h>
 #include <optix_math.h>
 
+#include "BufferStructs.h"
+
 using namespace optix;
 
 #define FLT_MAX         1e30;
 
-const int INTERSECTION_SAMPLES = 16;
-
 static __device__ __inline__ uchar4 make_color(const float3& c)
 {
 	return make_uchar4(static_cast<unsigned char>(__saturatef(c.z)*255.99f),  /* B */
@@ -23,16 +23,10 @@ static __device__ __inline__ float3 schlick( float nDi, const float3& rgb )
   return make_float3(r, g, b);
 }
 
-struct IntersectionData
-{
-	uint rigidBodyId;
-	float t;
-	float3 normal;
-};
-
 struct PerRayData_radiance
 {
 	bool physicsRay;
+	bool physicsOnly;	// Set by physics_camera, closest hits record the intersection and skip shading
 	bool done;
 
 	float3 origin;
@@ -41,6 +35,14 @@ struct PerRayData_radiance
 	float importance;
 	int depth;
 
+	// Reflection requested by closest_hit_radiance, traced by perspective_camera's reflection loop
+	bool reflect;
+	float3 reflectOrigin;
+	float3 reflectDirection;
+	float3 reflectWeight;
+	float reflectImportance;
+	unsigned int seed;
+
 	int numIntersections;
 	IntersectionData intersections[INTERSECTION_SAMPLES];
 };
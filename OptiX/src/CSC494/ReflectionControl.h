@@ -0,0 +1,100 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+
+/*
+	How reflection rays end in closest_hit_radiance.
+
+	A reflection carries the product of the luminances of the reflectivities along its path.
+	With the cutoff every reflection below importance_cutoff is dropped, which darkens deep
+	inter-reflections. With Russian roulette those reflections survive with probability
+	importance / importance_cutoff and are scaled up by the inverse, so the expected image
+	is the one without a cutoff while the ray count per pixel stays about the same.
+*/
+enum ReflectionTermination
+{
+	REFLECTION_CUTOFF = 0,
+	REFLECTION_RUSSIAN_ROULETTE
+};
+
+/*
+	Per pixel and frame seed, tea with four rounds
+*/
+static RT_HOSTDEVICE inline unsigned int ReflectionSeed(unsigned int pixel, unsigned int frame)
+{
+	unsigned int v0 = pixel;
+	unsigned int v1 = frame;
+	unsigned int s0 = 0;
+	for (int n = 0; n < 4; n++)
+	{
+		s0 += 0x9e3779b9;
+		v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+		v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+	}
+	return v0;
+}
+
+// Uniform in [0, 1), advances seed
+static RT_HOSTDEVICE inline float ReflectionRandom(unsigned int& seed)
+{
+	seed = 1664525u * seed + 1013904223u;
+	return static_cast<float>(seed & 0x00FFFFFF) / static_cast<float>(0x01000000);
+}
+
+/*
+	Whether a reflection with the given importance leaves a hit at depth. scale multiplies
+	both the reflection's weight and its importance, it is only above one for roulette survivors
+*/
+static RT_HOSTDEVICE inline bool ContinueReflection(int termination, float importance, float importanceCutoff,
+													 int depth, int maxDepth, unsigned int& seed, float& scale)
+{
+	scale = 1.0f;
+	if (depth >= maxDepth || importance <= 0.0f)
+		return false;
+
+	if (importance > importanceCutoff)
+		return true;
+
+	if (termination != REFLECTION_RUSSIAN_ROULETTE)
+		return false;
+
+	const float survival = importance / importanceCutoff;
+	if (ReflectionRandom(seed) >= survival)
+		return false;
+
+	scale = 1.0f / survival;
+	return true;
+}
+
+/*
+	Importance cutoff for the next frame of a launch with a reflection ray budget. Doubled while
+	frames ask for more reflections than the budget, eased back toward baseCutoff once they ask
+	for under half. Only used with Russian roulette, which keeps the image unbiased at any
+	cutoff so only its noise changes. With the plain cutoff a raised cutoff would darken the image
+*/
+static RT_HOSTDEVICE inline float AdaptImportanceCutoff(float cutoff, float baseCutoff, unsigned int raysRequested,
+														unsigned int budget)
+{
+	if (budget == 0)
+		return baseCutoff;
+
+	if (raysRequested >= budget)
+		return fminf(cutoff * 2.0f, 1.0f);
+
+	if (raysRequested < budget / 2)
+		return fmaxf(cutoff * 0.8f, baseCutoff);
+
+	return cutoff;
+}
+
+/*
+	Hard limit on a frame's reflection rays for a budget, the biased fallback behind the adaptive
+	cutoff. Past it TraceReflections drops reflections outright, and which pixels lose them depends
+	on warp scheduling, so it sits well above the budget and only catches a frame that jumps
+	before the cutoff has caught up. 0 for no limit
+*/
+static RT_HOSTDEVICE inline unsigned int ReflectionRayCap(unsigned int budget)
+{
+	return budget * 2;
+}
@@ -0,0 +1,184 @@
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "ResolutionController.h"
+
+const float ResolutionController::SCALE_QUANTUM = 1.0f / 16.0f;
+
+namespace
+{
+	// A loop only grows below this fraction of its budget, and only if the larger setting is
+	// predicted to stay under GROW_LIMIT of it
+	const double GROW_THRESHOLD = 0.8;
+	const double GROW_LIMIT = 0.95;
+
+	// Growing back into a rejected setting needs this much headroom instead
+	const double REGROW_LIMIT = 0.8;
+
+	// Shrinking aims this far under the budget
+	const double SHRINK_MARGIN = 0.95;
+}
+
+void ResolutionController::Loop::Clear()
+{
+	count = 0;
+	hold = 1;
+	lastDirection = 0;
+	hasRejected = false;
+	rejected = 0.0;
+}
+
+double ResolutionController::Loop::Mean() const
+{
+	const unsigned int n = std::min(count, WINDOW);
+	double sum = 0.0;
+	for (unsigned int i = 0; i < n; i++)
+		sum += times[i];
+	return n > 0 ? sum / n : 0.0;
+}
+
+void ResolutionController::Loop::Changed(double from, double to)
+{
+	const int direction = to > from ? 1 : -1;
+	if (lastDirection != 0 && direction != lastDirection)
+		hold = std::min(hold * 2, MAX_HOLD_WINDOWS);
+	else if (direction == lastDirection)
+		hold = 1;
+
+	if (direction < 0)
+	{
+		rejected = hasRejected ? std::min(rejected, from) : from;
+		hasRejected = true;
+	}
+	else if (hasRejected && to >= rejected)
+	{
+		hasRejected = false;
+	}
+
+	lastDirection = direction;
+	count = 0;
+}
+
+double ResolutionController::Loop::GrowLimit(double to) const
+{
+	return hasRejected && to >= rejected ? REGROW_LIMIT : GROW_LIMIT;
+}
+
+ResolutionController::ResolutionController() :
+	targetMs(0.0),
+	physicsShare(0.25f),
+	minScale(0.25f),
+	maxScale(1.0f),
+	minStep(4),
+	maxStep(32),
+	scale(1.0f),
+	step(8)
+{
+	frameLoop.Clear();
+	physicsLoop.Clear();
+}
+
+void ResolutionController::SetScaleRange(float minScale, float maxScale)
+{
+	this->minScale = std::max(minScale, SCALE_QUANTUM);
+	this->maxScale = std::max(maxScale, this->minScale);
+	Reset(scale, step);
+}
+
+void ResolutionController::SetStepRange(uint32_t minStep, uint32_t maxStep)
+{
+	this->minStep = std::max(minStep, 1u);
+	this->maxStep = std::max(maxStep, this->minStep);
+	Reset(scale, step);
+}
+
+void ResolutionController::Reset(float scale, uint32_t physicsRayStep)
+{
+	this->scale = std::min(std::max(scale, minScale), maxScale);
+	step = std::min(std::max(physicsRayStep, minStep), maxStep);
+	frameLoop.Clear();
+	physicsLoop.Clear();
+}
+
+/*
+	Render time goes with the pixel count and physics time with the number of physics rays,
+	so both are predicted from the square of the scale or of the step
+*/
+bool ResolutionController::AddFrame(double frameMs, double physicsMs)
+{
+	if (!IsEnabled())
+		return false;
+
+	bool changed = false;
+
+	frameLoop.Add(frameMs);
+	if (frameLoop.Ready())
+	{
+		const double mean = frameLoop.Mean();
+		float next = scale;
+		if (mean > targetMs)
+		{
+			const float fit = static_cast<float>(scale * std::sqrt(targetMs / mean * SHRINK_MARGIN));
+			next = std::min(std::floor(fit / SCALE_QUANTUM) * SCALE_QUANTUM, scale - SCALE_QUANTUM);
+		}
+		else if (mean < targetMs * GROW_THRESHOLD)
+		{
+			const float larger = scale + SCALE_QUANTUM;
+			if (mean * (larger * larger) / (scale * scale) < targetMs * frameLoop.GrowLimit(larger))
+				next = larger;
+		}
+		next = std::min(std::max(next, minScale), maxScale);
+
+		if (next != scale)
+		{
+			frameLoop.Changed(scale, next);
+			physicsLoop.count = 0;
+			scale = next;
+			changed = true;
+		}
+	}
+
+	physicsLoop.Add(physicsMs);
+	if (physicsLoop.Ready())
+	{
+		const double budget = targetMs * physicsShare;
+		const double mean = physicsLoop.Mean();
+		uint32_t next = step;
+		if (mean > budget)
+		{
+			const uint32_t fit = static_cast<uint32_t>(std::ceil(step * std::sqrt(mean / (budget * SHRINK_MARGIN))));
+			next = std::max(fit, step + 1);
+		}
+		else if (mean < budget * GROW_THRESHOLD && step > 1)
+		{
+			const double finer = step - 1;
+			if (mean * (step * step) / (finer * finer) < budget * physicsLoop.GrowLimit(-finer))
+				next = step - 1;
+		}
+		next = std::min(std::max(next, minStep), maxStep);
+
+		if (next != step)
+		{
+			physicsLoop.Changed(-static_cast<double>(step), -static_cast<double>(next));
+			frameLoop.count = 0;
+			step = next;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+void ResolutionController::ScaledSize(uint32_t width, uint32_t height, uint32_t& renderWidth, uint32_t& renderHeight) const
+{
+	if (scale >= 1.0f)
+	{
+		renderWidth = width;
+		renderHeight = height;
+		return;
+	}
+
+	renderWidth = std::max(static_cast<uint32_t>(width * scale) / SIZE_ALIGNMENT * SIZE_ALIGNMENT, SIZE_ALIGNMENT);
+	renderHeight = std::max(static_cast<uint32_t>(height * scale) / SIZE_ALIGNMENT * SIZE_ALIGNMENT, SIZE_ALIGNMENT);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// STL
+#include <stdint.h>
+
+/*
+	Holds a frame time target by scaling the render resolution and, separately, the physics
+	ray step.
+
+	The resolution scale follows the whole frame's time, the step follows the time of the
+	physics stages (stepping the bodies and applying the responses), which have their own
+	share of the target. Each loop averages a window of frames before deciding, and starts
+	a fresh window after every change so a decision never sees frames from the old setting.
+
+	To keep from oscillating, a loop:
+	- only grows once the window is well under its budget and the predicted time at the
+	  larger setting still fits;
+	- remembers the cheapest setting it has had to shrink away from, and only grows back
+	  to it or past it once that is predicted to fit with a wide margin (REGROW_LIMIT), so
+	  noise around the budget can't flip it back and forth. A loop that does grow back
+	  that far forgets it, the cost has clearly changed;
+	- waits longer before its next change every time it reverses direction, up to
+	  MAX_HOLD_WINDOWS windows, and resets once it moves the same way twice in a row.
+*/
+class ResolutionController
+{
+public:
+	// Frames averaged per decision
+	static const unsigned int WINDOW = 16;
+
+	// Render sizes are rounded down to a multiple of this and the scale to steps of SCALE_QUANTUM
+	static const unsigned int SIZE_ALIGNMENT = 8;
+	static const float SCALE_QUANTUM;
+
+	static const unsigned int MAX_HOLD_WINDOWS = 8;
+
+	ResolutionController();
+
+	// Frame time to hold, 0 turns the controller off
+	void SetTarget(double frameMs) { targetMs = frameMs; }
+	double GetTarget() const { return targetMs; }
+	bool IsEnabled() const { return targetMs > 0.0; }
+
+	// Share of the target the physics stages may use
+	void SetPhysicsShare(float share) { physicsShare = share; }
+
+	void SetScaleRange(float minScale, float maxScale);
+	void SetStepRange(uint32_t minStep, uint32_t maxStep);
+	float GetMinScale() const { return minScale; }
+	uint32_t GetMinStep() const { return minStep; }
+
+	// Starting point, clamped to the ranges. Clears the frame history
+	void Reset(float scale, uint32_t physicsRayStep);
+
+	// Adds one frame's times. Returns true if the scale or the step changed
+	bool AddFrame(double frameMs, double physicsMs);
+
+	float GetScale() const { return scale; }
+	uint32_t GetPhysicsRayStep() const { return step; }
+
+	// The render size for a display size at the current scale
+	void ScaledSize(uint32_t width, uint32_t height, uint32_t& renderWidth, uint32_t& renderHeight) const;
+
+private:
+	struct Loop
+	{
+		double times[WINDOW];
+		unsigned int count;
+		unsigned int hold;			// Windows of frames to collect before deciding
+		int lastDirection;			// +1 after growing, -1 after shrinking, 0 before any change
+
+		// Settings are compared by cost, the scale itself and the negated step
+		bool hasRejected;
+		double rejected;			// Cheapest setting shrunk away from
+
+		void Clear();
+		void Add(double ms) { times[count++ % WINDOW] = ms; }
+		bool Ready() const { return count >= WINDOW * hold; }
+
+		// Of the last WINDOW frames
+		double Mean() const;
+
+		// Records a change between two settings and starts a new window
+		void Changed(double from, double to);
+
+		// Share of the budget the predicted time at a larger setting must stay under
+		double GrowLimit(double to) const;
+	};
+
+	double targetMs;
+	float physicsShare;
+	float minScale;
+	float maxScale;
+	uint32_t minStep;
+	uint32_t maxStep;
+
+	float scale;
+	uint32_t step;
+
+	Loop frameLoop;
+	Loop physicsLoop;
+};
@@ -9,72 +9,56 @@
 
 using namespace optix;
 
-// Update our rigid bodies data by computing a physics update
-void RigidBody::EulerStep(float deltaTime)
-{
-	ODE(deltaTime);
-}
-
 /*
-	Calculate velocity, inverse inertia, and spin vector
+	Builds the GeometryGroup and Transform above the instance, shared by both constructors
 */
-void RigidBody::CalculateAuxiliaryVariables()
+void RigidBody::Initialize(Acceleration acceleration, float3 startingPosition)
 {
-	Matrix3x3 rotation = MathHelpers::QuaternionToRotation(quaternion);
-	velocity = linearMomentum / mass;
-	inertiaInv = rotation * inertiaBodyInv * rotation.transpose();
-	spinVector = inertiaInv * angularMomentum;
+	// Create geometry group
+	geometryGroup = context->createGeometryGroup();
+	geometryGroup->setChildCount(1);
+	geometryGroup->setChild(0, geometryInstance);
+	geometryGroup->setAcceleration(acceleration);
+
+	// Set on the instance since the geometry may be shared with other bodies
+	geometryInstance["id"]->setFloat(id);
+
+	PushMotionVariables();
+
+	// Create transformation node
+	transformNode = context->createTransform();
+	transformNode->setChild(geometryGroup);
+	float identity[16] = { 1,0,0,startingPosition.x,
+						   0,1,0,startingPosition.y,
+						   0,0,1,startingPosition.z,
+						   0,0,0,1 };
+	std::copy(identity, identity + 16, transformMatrix);
+	transformNode->setMatrix(false, transformMatrix, NULL);
 
-	this->geometryInstance->getGeometry()["velocity"]->setFloat(velocity);
-	this->geometryInstance->getGeometry()["spinVector"]->setFloat(spinVector);
+	MarkGroupAsDirty();
 }
 
-/*
-	Calculate velocity, inverse inertia, and spin vector
-*/
-void RigidBody::ODE(float deltaTime)
+// Update our rigid bodies data by computing a physics update
+void RigidBody::EulerStep(float deltaTime)
 {
-	if (isStatic)
+	if (!state.EulerStep(deltaTime))
 	{
 		return;
 	}
 
-	// Apply Gravity
-	if (useGravity)
-	{
-		force += make_float3(0.0f, mass * -9.80665, 0.0f);
-	}
-
-	// Apply drag
-	force += -linearMomentum * kDrag;
-	torque += -angularMomentum * kDrag;
-
-	// Calculate derivative of the state space
-	float3 positionDot = velocity * deltaTime;
-	float3 linearMomentumDot = force * deltaTime;
-	float3 angularMomentumDot = torque * deltaTime;
-
-	float3 quaternionV = make_float3(quaternion.y, quaternion.z, quaternion.w);
-	float quaternionDotS = -dot(quaternionV, spinVector);
-	float3 quaternionDotV = quaternion.x * spinVector + cross(spinVector, quaternionV);
-	float4 quaternionDot = 0.5 * make_float4(quaternionDotS, quaternionDotV.x, quaternionDotV.y, quaternionDotV.z);
-
-	// Update rigidbody
-	position += positionDot;
-	quaternion += quaternionDot;
-	quaternion = normalize(quaternion);
-	linearMomentum += linearMomentumDot;
-	angularMomentum += angularMomentumDot;
-
 	// Pass off new trasnform to optix
 	UpdateTransformNode();
 
-	// Recalculate our derived variables
-	CalculateAuxiliaryVariables();
+	PushMotionVariables();
+}
 
-	// Zero out force vectors
-	force = make_float3(0.0f, 0.0f, 0.0f);
-	torque = make_float3(0.0f, 0.0f, 0.0f);
+/*
+	Copy velocity and spin vector to the geometry instance for the intersection programs
+*/
+void RigidBody::PushMotionVariables()
+{
+	this->geometryInstance["velocity"]->setFloat(state.GetVelocity());
+	this->geometryInstance["spinVector"]->setFloat(state.GetSpin());
 }
 
 /*
@@ -91,12 +75,8 @@ Matrix3x3 RigidBody::Star(float3 vector)
 */
 void RigidBody::UpdateTransformNode()
 {
-	Matrix3x3 rotation = MathHelpers::QuaternionToRotation(quaternion);
-	float temp[16] = {rotation[0],rotation[1],rotation[2],position.x,
-					  rotation[3],rotation[4],rotation[5],position.y,
-					  rotation[6],rotation[7],rotation[8],position.z,
-					  0,0,0,1};
-	Matrix4x4 newTransform(temp);
+	float temp[16] = { 0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,1 };
+	state.GetTransform(temp);
 	transformNode->setMatrix(false, temp, NULL);
 	MarkGroupAsDirty();
 }
@@ -107,8 +87,7 @@ void RigidBody::UpdateTransformNode()
 */
 void RigidBody::AddForceAtPosition(float3 force, float3 worldPosition)
 {
-	this->force += force;
-	this->torque += cross(worldPosition-this->position, force) * 0.01;
+	state.AddForceAtPosition(force, worldPosition);
 }
 
 /*
@@ -117,33 +96,32 @@ void RigidBody::AddForceAtPosition(float3 force, float3 worldPosition)
 */
 void RigidBody::AddImpulseAtPosition(float3 impulse, float3 worldPosition)
 {
-	this->linearMomentum += impulse;
-	this->angularMomentum += cross(worldPosition-this->position, impulse) * 0.01;
+	state.AddImpulseAtPosition(impulse, worldPosition);
 }
 
 void RigidBody::AddForce(float3 force)
 {
-	this->force += force;
+	state.AddForce(force);
 }
 
 void RigidBody::AddTorque(float3 torque)
 {
-	this->torque += torque;
+	state.AddTorque(torque);
 }
 
 void RigidBody::UseGravity(bool useGravity)
 {
-	this->useGravity = useGravity;
+	state.UseGravity(useGravity);
 }
 
 float3 RigidBody::GetVelocity()
 {
-	return velocity;
+	return state.GetVelocity();
 }
 
 float3 RigidBody::GetSpin()
 {
-	return spinVector;
+	return state.GetSpin();
 }
 
 GeometryGroup RigidBody::GetGeometryGroup()
@@ -156,7 +134,49 @@ Transform RigidBody::GetTransform()
 	return transformNode;
 }
 
+RigidBodyState& RigidBody::GetState()
+{
+	return state;
+}
+
+/*
+	Takes over a state stepped by the scheduler's physics thread, see Scene::ApplySnapshot
+*/
+void RigidBody::SetState(const RigidBodyState& newState)
+{
+	state = newState;
+	UpdateTransformNode();
+	PushMotionVariables();
+}
+
+/*
+	The id the intersection programs report the body by, its index in the scene
+*/
+void RigidBody::SetId(uint newId)
+{
+	id = newId;
+	geometryInstance["id"]->setFloat(id);
+}
+
+void RigidBody::Destroy()
+{
+	transformNode->destroy();
+	if (ownsAcceleration)
+	{
+		geometryGroup->getAcceleration()->destroy();
+	}
+	geometryGroup->destroy();
+	geometryInstance->destroy();
+}
+
+/*
+	Shared acceleration structures only hold the untransformed mesh, the scene marks its
+	top level acceleration dirty instead (see Simulation::StepBodies)
+*/
 void RigidBody::MarkGroupAsDirty()
 {
-	geometryGroup->getAcceleration()->markDirty();
+	if (ownsAcceleration)
+	{
+		geometryGroup->getAcceleration()->markDirty();
+	}
 }
@@ -8,6 +8,7 @@
 #include <sutil.h>
 
 #include "MathHelpers.h"
+#include "RigidBodyState.h"
 
 using namespace optix;
 
@@ -19,45 +20,25 @@ public:
 			  bool useGravity = true, float drag = 0.5f) :
 		context(context),
 		geometryInstance(geometryInstance),
+		ownsAcceleration(true),
 		id(id),
-		mass(mass),
-		isStatic(isStatic),
-		useGravity(useGravity),
-		kDrag(drag)
+		state(startingPosition, mass, isStatic, useGravity, drag)
 	{
-		// Create geometry group
-		geometryGroup = context->createGeometryGroup();
-		geometryGroup->setChildCount(1);
-		geometryGroup->setChild(0, geometryInstance);
-		geometryGroup->setAcceleration(context->createAcceleration(acceleration));
-
-		geometryInstance->getGeometry()["id"]->setFloat(id);
-
-		// Init state
-		inertiaBody = make_matrix3x3(Matrix4x4::identity());
-		inertiaBodyInv = MathHelpers::Matrix3Inverse(inertiaBody);
-
-		position = startingPosition;
-		quaternion = make_float4(1.0f, 0.0f, 0.0f, 0.0f);
-		linearMomentum = make_float3(0.0f, 0.0f, 0.0f);
-		angularMomentum = make_float3(0.0f, 0.0f, 0.0f);
-
-		CalculateAuxiliaryVariables();
-
-		force = make_float3(0.0f, 0.0f, 0.0f);
-		torque = make_float3(0.0f, 0.0f, 0.0f);
-
-		// Create transformation node
-		transformNode = context->createTransform();
-		transformNode->setChild(geometryGroup);
-		float identity[16] = { 1,0,0,startingPosition.x,
-							   0,1,0,startingPosition.y,
-							   0,0,1,startingPosition.z,
-							   0,0,0,1 };
-		std::copy(identity, identity + 16, transformMatrix);
-		transformNode->setMatrix(false, transformMatrix, NULL);
-
-		MarkGroupAsDirty();
+		Initialize(context->createAcceleration(acceleration), startingPosition);
+	};
+
+	// For instanced meshes: the acceleration structure is shared with every other body using
+	// the same geometry (see MeshRegistry), so moving this body never rebuilds it
+	RigidBody(Context context, const char* projectPrefix, const char* sceneName, GeometryInstance geometryInstance,
+			  uint id, float3 startingPosition, float mass, Acceleration sharedAcceleration, bool isStatic,
+			  bool useGravity = true, float drag = 0.5f) :
+		context(context),
+		geometryInstance(geometryInstance),
+		ownsAcceleration(false),
+		id(id),
+		state(startingPosition, mass, isStatic, useGravity, drag)
+	{
+		Initialize(sharedAcceleration, startingPosition);
 	};
 	~RigidBody() {};
 
@@ -73,11 +54,21 @@ public:
 
 	GeometryGroup GetGeometryGroup();
 	Transform GetTransform();
+	RigidBodyState& GetState();
+
+	// Moves the body to a state stepped elsewhere
+	void SetState(const RigidBodyState& newState);
+
+	uint GetId() const { return id; }
+	void SetId(uint newId);
+
+	// Destroys the OptiX nodes of this body alone, shared geometry and mesh accelerations stay
+	void Destroy();
 
 private:
+	void Initialize(Acceleration acceleration, float3 startingPosition);
 	void MarkGroupAsDirty();
-	void CalculateAuxiliaryVariables();
-	void ODE(float deltaTime);
+	void PushMotionVariables();
 	Matrix3x3 Star(float3 vector);
 	void UpdateTransformNode();
 
@@ -86,33 +77,13 @@ private:
 	Transform transformNode;
 	GeometryGroup geometryGroup;
 	GeometryInstance geometryInstance;
+	bool ownsAcceleration;
 
 	float transformMatrix[16];
 
-	bool isStatic;
-	float kDrag = 0.5f;
-	bool useGravity;
-
 	// Rigidbody id
 	uint id;
 
 	// Rigidbody dynamics
-	double mass;
-	Matrix3x3 inertiaBody;
-	Matrix3x3 inertiaBodyInv;
-
-	// State space variable
-	float3 position;
-	float4 quaternion;
-	float3 linearMomentum;
-	float3 angularMomentum;
-
-	// Derived members
-	Matrix3x3 inertiaInv;
-	float3 velocity;
-	float3 spinVector;
-
-	// Computed quantities
-	float3 force;
-	float3 torque;
+	RigidBodyState state;
 };
@@ -0,0 +1,164 @@
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+// STL
+#include <algorithm>
+
+#include "RigidBodyState.h"
+#include "MathHelpers.h"
+
+using namespace optix;
+
+RigidBodyState::RigidBodyState(float3 startingPosition, float mass, bool isStatic, bool useGravity, float drag) :
+	isStatic(isStatic),
+	kDrag(drag),
+	useGravity(useGravity),
+	mass(mass)
+{
+	// Init state
+	inertiaBody = make_matrix3x3(Matrix4x4::identity());
+	inertiaBodyInv = MathHelpers::Matrix3Inverse(inertiaBody);
+
+	position = startingPosition;
+	quaternion = make_float4(1.0f, 0.0f, 0.0f, 0.0f);
+	linearMomentum = make_float3(0.0f, 0.0f, 0.0f);
+	angularMomentum = make_float3(0.0f, 0.0f, 0.0f);
+
+	CalculateAuxiliaryVariables();
+
+	force = make_float3(0.0f, 0.0f, 0.0f);
+	torque = make_float3(0.0f, 0.0f, 0.0f);
+}
+
+// Update our rigid bodies data by computing a physics update
+bool RigidBodyState::EulerStep(float deltaTime)
+{
+	if (isStatic)
+	{
+		return false;
+	}
+
+	ODE(deltaTime);
+	return true;
+}
+
+/*
+	Calculate velocity, inverse inertia, and spin vector
+*/
+void RigidBodyState::CalculateAuxiliaryVariables()
+{
+	Matrix3x3 rotation = MathHelpers::QuaternionToRotation(quaternion);
+	velocity = linearMomentum / mass;
+	inertiaInv = rotation * inertiaBodyInv * rotation.transpose();
+	spinVector = inertiaInv * angularMomentum;
+}
+
+/*
+	Integrate the state space forward by one step
+*/
+void RigidBodyState::ODE(float deltaTime)
+{
+	// Apply Gravity
+	if (useGravity)
+	{
+		force += make_float3(0.0f, mass * -9.80665, 0.0f);
+	}
+
+	// Apply drag
+	force += -linearMomentum * kDrag;
+	torque += -angularMomentum * kDrag;
+
+	// Calculate derivative of the state space
+	float3 positionDot = velocity * deltaTime;
+	float3 linearMomentumDot = force * deltaTime;
+	float3 angularMomentumDot = torque * deltaTime;
+
+	float3 quaternionV = make_float3(quaternion.y, quaternion.z, quaternion.w);
+	float quaternionDotS = -dot(quaternionV, spinVector);
+	float3 quaternionDotV = quaternion.x * spinVector + cross(spinVector, quaternionV);
+	float4 quaternionDot = 0.5 * make_float4(quaternionDotS, quaternionDotV.x, quaternionDotV.y, quaternionDotV.z);
+
+	// Update rigidbody
+	position += positionDot;
+	quaternion += quaternionDot;
+	quaternion = normalize(quaternion);
+	linearMomentum += linearMomentumDot;
+	angularMomentum += angularMomentumDot;
+
+	// Recalculate our derived variables
+	CalculateAuxiliaryVariables();
+
+	// Zero out force vectors
+	force = make_float3(0.0f, 0.0f, 0.0f);
+	torque = make_float3(0.0f, 0.0f, 0.0f);
+}
+
+/*
+	Adds a force at a position relative to the center of mass.
+	The position given should be close to the surface of the object
+*/
+void RigidBodyState::AddForceAtPosition(float3 force, float3 worldPosition)
+{
+	this->force += force;
+	this->torque += cross(worldPosition-this->position, force) * 0.01;
+}
+
+/*
+	Adds an impulse at the given position.
+	The position given should be close to the surface of the object
+*/
+void RigidBodyState::AddImpulseAtPosition(float3 impulse, float3 worldPosition)
+{
+	this->linearMomentum += impulse;
+	this->angularMomentum += cross(worldPosition-this->position, impulse) * 0.01;
+}
+
+void RigidBodyState::AddForce(float3 force)
+{
+	this->force += force;
+}
+
+void RigidBodyState::AddTorque(float3 torque)
+{
+	this->torque += torque;
+}
+
+void RigidBodyState::UseGravity(bool useGravity)
+{
+	this->useGravity = useGravity;
+}
+
+bool RigidBodyState::IsStatic() const
+{
+	return isStatic;
+}
+
+float3 RigidBodyState::GetPosition() const
+{
+	return position;
+}
+
+float4 RigidBodyState::GetQuaternion() const
+{
+	return quaternion;
+}
+
+float3 RigidBodyState::GetVelocity() const
+{
+	return velocity;
+}
+
+float3 RigidBodyState::GetSpin() const
+{
+	return spinVector;
+}
+
+void RigidBodyState::GetTransform(float matrix[12]) const
+{
+	Matrix3x3 rotation = MathHelpers::QuaternionToRotation(quaternion);
+	float temp[12] = { rotation[0],rotation[1],rotation[2],position.x,
+					   rotation[3],rotation[4],rotation[5],position.y,
+					   rotation[6],rotation[7],rotation[8],position.z };
+	std::copy(temp, temp + 12, matrix);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+#include "MathHelpers.h"
+
+using namespace optix;
+
+/*
+	Rigidbody dynamics without any OptiX scene objects attached, so the
+	physics can be stepped (and benchmarked) without a context.
+	RigidBody owns one of these and pushes the result to its transform node.
+*/
+class RigidBodyState
+{
+public:
+	RigidBodyState() {};
+	RigidBodyState(float3 startingPosition, float mass, bool isStatic, bool useGravity = true, float drag = 0.5f);
+	~RigidBodyState() {};
+
+	// Returns true if the body moved
+	bool EulerStep(float deltaTime);
+	void AddForceAtPosition(float3 force, float3 worldPosition);
+	void AddImpulseAtPosition(float3 impulse, float3 worldPosition);
+	void AddForce(float3 force);
+	void AddTorque(float3 torque);
+	void UseGravity(bool useGravity);
+
+	bool IsStatic() const;
+	float3 GetPosition() const;
+	float4 GetQuaternion() const;
+	float3 GetVelocity() const;
+	float3 GetSpin() const;
+
+	// Row major 3x4 transform (rotation and position) of the body
+	void GetTransform(float matrix[12]) const;
+
+private:
+	void CalculateAuxiliaryVariables();
+	void ODE(float deltaTime);
+
+	bool isStatic;
+	float kDrag = 0.5f;
+	bool useGravity;
+
+	// Rigidbody dynamics
+	double mass;
+	Matrix3x3 inertiaBody;
+	Matrix3x3 inertiaBodyInv;
+
+	// State space variable
+	float3 position;
+	float4 quaternion;
+	float3 linearMomentum;
+	float3 angularMomentum;
+
+	// Derived members
+	Matrix3x3 inertiaInv;
+	float3 velocity;
+	float3 spinVector;
+
+	// Computed quantities
+	float3 force;
+	float3 torque;
+};
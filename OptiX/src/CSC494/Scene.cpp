@@ -8,22 +8,43 @@
 #include <optixu/optixu_math_stream_namespace.h>
 
 // STL
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <math.h>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
 #include <stdint.h>
 
 // User created headers / includes
 #include <sutil.h>
 #include <Arcball.h>
+#include <HDRLoader.h>
+#include <ImageWriter.h>
 #include "RigidBody.h"
 #include "GeometryCreator.h"
+#include "AllocationCounter.h"
 #include "BufferStructs.h"
+#include "CollisionResolver.h"
+#include "FrameCounters.h"
+#include "HostTracer.h"
 #include "MathHelpers.h"
+#include "Profiler.h"
+#include "ReflectionControl.h"
+#include "ResolutionController.h"
 #include "Scene.h"
+#include "Scheduler.h"
+#include "Simulation.h"
+#include "StartupGraph.h"
+#include "Telemetry.h"
+#include "TripleBuffer.h"
 
 using namespace optix;
 
@@ -33,10 +54,19 @@ using namespace optix;
 const char* const PROJECT_NAME = "CSC494";
 const char* const SCENE_NAME = "ray_scene.cu";
 
-Context      context;
+// The bodies, the context and the launches, see Simulation.h. Everything else here is the
+// window and the ways of driving it
+std::unique_ptr<Simulation> simulation;
+
+// What the simulation counts and logs into, see SetCounterFile and SetTelemetryFile. Only one
+// thread produces into each: the GLUT thread, or the collision thread in multi-rate mode
+FrameCounters frame_counters;
+Telemetry    telemetry;
+
 uint32_t     width = 1080u;
 uint32_t     height = 720u;
 bool         use_pbo = true;
+bool         headless = false;			// No window or GL context, see RunHeadless
 unsigned	 frame_count = 0;
 double		 last_update_time = 0;
 
@@ -45,10 +75,55 @@ double		 last_update_time = 0;
 // the performance of the program will increase
 uint32_t	 physicsRayStep = 8;
 
-const char*  scene_ptx;
+// Scales the simulation's launch size and physics grid down once it has a frame target
+ResolutionController resolution;
+
+// Reflections, see ReflectionControl.h
+ReflectionTermination reflection_termination = REFLECTION_CUTOFF;
+uint32_t     reflection_ray_budget = 0;
+
+// Multi-rate mode, see SetSchedule. The physics thread steps its own copy of the body states
+// and hands the latest ones to the collision pass and to rendering, the collision pass hands
+// its responses back. Launches from either thread hold context_mutex since OptiX contexts
+// aren't thread safe; the handoffs themselves never wait
+struct BodySnapshot
+{
+	unsigned int tick;			// Physics ticks stepped, 0 for the starting states
+	std::vector<RigidBodyState> bodies;
+};
 
-// Geometry
-std::vector<RigidBody> sceneRigidBodies;
+struct ResponseSnapshot
+{
+	float k;
+	std::vector<IntersectionResponse> responses;
+};
+
+double       physics_hz = 0.0;			// 0 runs everything in the GLUT idle callback
+double       collision_hz = 0.0;
+double       render_hz = 0.0;			// 0 for no window
+double       run_seconds = 0.0;
+Scheduler    scheduler;
+TickClock    render_clock;
+std::mutex   context_mutex;
+std::vector<RigidBodyState> physics_bodies;		// Physics thread only
+unsigned int physics_tick = 0;
+unsigned int applied_tick = 0;					// Snapshot the simulation's bodies are at, under context_mutex
+TripleBuffer<BodySnapshot> bodies_for_collision;
+TripleBuffer<BodySnapshot> bodies_for_render;
+TripleBuffer<ResponseSnapshot> collision_responses;
+std::atomic<float> contact_volume(0.0f);
+
+// Frames recorded to disk by a writer thread, see SetRecording
+std::unique_ptr<FrameRecorder> recorder;
+
+// Host side loading that runs alongside context creation, see Setup
+StartupGraph startup;
+std::unique_ptr<HDRLoader> environment_map;
+
+// Shapes of the procedural scene for the CPU tracer
+std::vector<HostBody>  sceneHostBodies;
+unsigned int sceneMeshLoads = 0;		// Mesh files parsed for the procedural scene
+size_t       sceneMeshBufferBytes = 0;
 
 // Camera state
 float3       camera_up;
@@ -61,112 +136,183 @@ sutil::Arcball arcball;
 int2       mouse_prev_pos;
 int        mouse_button;
 
-Buffer Scene::GetOutputBuffer()
+static bool IsScheduled()
 {
-	return context["output_buffer"]->getBuffer();
+	return physics_hz > 0.0;
 }
 
-Buffer Scene::GetResponseBuffer()
+// Sweeps keep the size and step they were configured with, the multi-rate mode has no single frame to hold
+static bool IsScalingResolution()
 {
-	return context["collisionResponse"]->getBuffer();
+	return resolution.IsEnabled() && !headless && !IsScheduled();
+}
+
+// The counters take heap allocations from the hook linked into this executable
+static void EnableCounters(bool enable)
+{
+	frame_counters.SetAllocationCounter(AllocationCounter::Count);
+	frame_counters.Enable(enable);
+	AllocationCounter::Enable(enable);
+}
+
+static RTcontext CurrentContext()
+{
+	return simulation ? simulation->GetContext()->get() : 0;
+}
+
+Buffer Scene::GetOutputBuffer()
+{
+	return simulation->GetOutputBuffer();
 }
 
 void Scene::Setup(int argc, char** argv, std::string out_file, bool use_pbo)
 {
 	try
 	{
-		GlutInitialize(&argc, argv);
+		// Compile the device programs and decode the environment map while GLUT starts up.
+		// The simulation asks for the same PTX later and gets it from getPtxString's cache
+		const char* const deviceSources[] = { SCENE_NAME, "sphere_model.cu", "box.cu", "triangle_mesh.cu" };
+		for (size_t i = 0; i < sizeof(deviceSources) / sizeof(deviceSources[0]); i++)
+		{
+			const char* source = deviceSources[i];
+			startup.Add(std::string("Compile ") + source, [source]()
+			{
+				sutil::getPtxString(PROJECT_NAME, source);
+			});
+		}
+		startup.Add("DecodeEnvironment", []()
+		{
+			environment_map.reset(new HDRLoader(std::string(sutil::samplesDir()) + "/data/Rathaus.hdr"));
+		});
+		startup.Start(std::max(2u, std::thread::hardware_concurrency()) - 1);
+
+		if (!headless)
+		{
+			startup.RunInline("Window", [&argc, argv]()
+			{
+				GlutInitialize(&argc, argv);
 
 #ifndef __APPLE__
-		glewInit();
+				glewInit();
 #endif
+			});
+		}
 
 		// Load PTX source
-		scene_ptx = sutil::getPtxString(PROJECT_NAME, SCENE_NAME);
+		{
+			PROFILE_SCOPE("LoadPTX");
+			startup.Wait(std::string("Compile ") + SCENE_NAME);
+		}
 
-		CreateContext();
-		CreateScene();
+		startup.RunInline("Context", [this]() { CreateSimulation("NoAccel"); });
+		startup.RunInline("Scene", [this]()
+		{
+			startup.WaitAll();
+			CreateScene();
+		});
 		SetupCamera();
 
-		context->validate();
+		startup.RunInline("Validate", []() { simulation->GetContext()->validate(); });
+		startup.PrintTimeline(std::cout);
 
 		if (out_file.empty())
 		{
-			GlutRun();
+			if (IsScheduled())
+				StartSchedule();
+
+			if (headless)
+			{
+				std::this_thread::sleep_for(std::chrono::duration<double>(run_seconds));
+				DestroyContext();
+			}
+			else
+			{
+				GlutRun();
+			}
 		}
 		else
 		{
 			UpdateCamera();
-			context->launch(0, width, height);
+			simulation->Render(true);
+			if (frame_counters.IsEnabled())
+				frame_counters.EndFrame();
 			sutil::displayBufferPPM(out_file.c_str(), GetOutputBuffer());
 			DestroyContext();
 		}
 	}
-	SUTIL_CATCH(context->get())
+	SUTIL_CATCH(CurrentContext())
 }
 
-void Scene::CreateContext()
+/*
+	An empty simulation at the window size, displayed through a GL buffer unless headless
+*/
+void Scene::CreateSimulation(const char* acceleration)
 {
-	context = Context::create();
-	context->setRayTypeCount(2);				// The number of types of rays (shading, shadowing)
-	context->setEntryPointCount(1);				// Entry points, one for each ray generation algorithm (used for multipass rendering)
-	context->setStackSize(4640);				// Allocated stack for each thread of execution
-
-	context["scene_epsilon"]->setFloat(1.e-4f); // Min distance to check along the ray
-	context["radiance_ray_type"]->setUint(0);	// Index of the radiance ray
-    context["shadow_ray_type"]->setUint(1);		// Index of the shadow ray
-
 	last_update_time = sutil::currentTime();	// Initialize time
 
 	// Output buffers
-	GLuint vbo = 0;
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, 4 * width * height, 0, GL_STREAM_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	Buffer buffer = sutil::createOutputBuffer(context, RT_FORMAT_UNSIGNED_BYTE4, width, height, use_pbo);
-	context["output_buffer"]->set(buffer);
-
-	// Ray generation program
-	Program ray_gen_program = context->createProgramFromPTXString(scene_ptx, "perspective_camera");
-	context->setRayGenerationProgram(0, ray_gen_program);
+	if (!headless)
+	{
+		GLuint vbo = 0;
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, 4 * width * height, 0, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
-	// Set scene ray variables
-	context["importance_cutoff"]->setFloat(0.01f);
-	context["max_depth"]->setInt(100);
+	SimulationOptions options;
+	options.width = width;
+	options.height = height;
+	options.physicsRayStep = physicsRayStep;
+	options.minPhysicsRayStep = IsScalingResolution() ? resolution.GetMinStep() : physicsRayStep;
+	options.acceleration = acceleration;
+	options.reflectionTermination = static_cast<ReflectionTermination>(reflection_termination);
+	options.reflectionRayBudget = reflection_ray_budget;
+	if (use_pbo)
+	{
+		options.createGLBuffer = sutil::createOutputBuffer;
+		options.resizeGLBuffer = sutil::resizeBuffer;
+	}
+	options.counters = &frame_counters;
+	options.telemetry = &telemetry;
 
-	// Miss program
-	context->setMissProgram(0, context->createProgramFromPTXString(scene_ptx, "miss"));
-	const std::string texpath = std::string(sutil::samplesDir()) + "/data/Rathaus.hdr";
-    context["envmap"]->setTextureSampler(sutil::loadTexture(context, texpath, make_float3(1.0, 1.0, 1.0)));
+	{
+		PROFILE_SCOPE("LoadTexture");
+		startup.Wait("DecodeEnvironment");
+		options.environment = environment_map.get();
+	}
 
-	// Exception program
-	Program exception_program = context->createProgramFromPTXString(scene_ptx, "exception");
-	context->setExceptionProgram(0, exception_program);
-	context["bad_color"]->setFloat(0.0f, 1.0f, 0.0f);
+	simulation.reset(new Simulation(options));
+	environment_map.reset();
 
-	float importance_cutoff = 0.01;
-	int max_depth = 100;
+	resolution.Reset(1.0f, physicsRayStep);
+	ApplyRenderSize();
 }
 
 void Scene::DestroyContext()
 {
-	Scene instance = Scene::Get();
+	// Before anything the tick threads use goes away
+	if (scheduler.IsRunning())
+	{
+		scheduler.Stop();
+		scheduler.PrintStats(std::cout);
+	}
 
-	if (instance.context)
+	Profiler::Shutdown();
+	Get().CloseLogs();
+
+	if (recorder)
 	{
-		instance.context->destroy();
-		instance.context = 0;
+		std::cout << "Recorded " << recorder->framesRecorded() << " frames, dropped " << recorder->framesDropped() << std::endl;
+		recorder.reset();
 	}
+
+	simulation.reset();
 }
 
 void Scene::CreateScene()
 {
-	GeometryCreator geometryCreator(context, PROJECT_NAME, SCENE_NAME);
-
-	// Create root scene group
-	Group sceneGroup = context->createGroup();
+	PROFILE_SCOPE("CreateScene");
 
 	MaterialProperties mat1 = MaterialProperties("closest_hit_radiance", make_float3(0.0f, 0.0f, 0.0f), make_float3(0.3f, 0.3f, 0.3f), make_float3(0.9f, 0.9f, 0.9f), 88.0f, make_float3(0.2f, 0.2f, 0.2f), make_float3(0.3f, 0.3f, 0.3f));
 	MaterialProperties mat2 = MaterialProperties("closest_hit_radiance", make_float3(0.1f, 0.1f, 0.1f), make_float3(0.8f, 0.2f, 0.8f), make_float3(0.8f, 0.9f, 0.8f), 88.0f, make_float3(0.2f, 0.2f, 0.2f), make_float3(0.1f, 0.1f, 0.1f));
@@ -177,90 +323,103 @@ void Scene::CreateScene()
 	MaterialProperties mat7 = MaterialProperties("closest_hit_radiance", make_float3(0.0f, 0.0f, 0.0f), make_float3(0.5f, 0.5f, 0.1f), make_float3(0.0f, 0.0f, 0.9f), 1.0f, make_float3(0.5f, 0.5f, 0.5f), make_float3(0.0f, 0.0f, 0.7f));
 
 	// Create rigidbodies
-	GeometryInstance sphereInstance = geometryCreator.CreateSphere(3.0f, mat1);
-	RigidBody rigidBody(context, PROJECT_NAME, SCENE_NAME, sphereInstance, 0, make_float3(0.0f, 4.0, 15.0f), 2.0f, "NoAccel", false, false);
-	rigidBody.AddForce(make_float3(0.0f, 0.0f, -450.0f));
-	sceneRigidBodies.push_back(rigidBody);
+	unsigned int id = simulation->AddSphere(3.0f, mat1, make_float3(0.0f, 4.0, 15.0f), 2.0f);
+	simulation->GetBody(id).AddForce(make_float3(0.0f, 0.0f, -450.0f));
 
-	GeometryInstance boxInstance = geometryCreator.CreateBox(make_float3(3.0f, 3.0f, 3.0f), mat2);
-	rigidBody = RigidBody(context, PROJECT_NAME, SCENE_NAME, boxInstance, 1, make_float3(0.5f, 6.0f, -15.0f), 1.0f, "NoAccel", false, false);
-	rigidBody.AddTorque(make_float3(1.16f, -0.01f, -0.07f));
-	rigidBody.AddForce(make_float3(0.0f, 0.0f, 150.0f));
-	sceneRigidBodies.push_back(rigidBody);
+	id = simulation->AddBox(make_float3(3.0f, 3.0f, 3.0f), mat2, make_float3(0.5f, 6.0f, -15.0f), 1.0f);
+	simulation->GetBody(id).AddTorque(make_float3(1.16f, -0.01f, -0.07f));
+	simulation->GetBody(id).AddForce(make_float3(0.0f, 0.0f, 150.0f));
 
-	GeometryInstance box2Instance = geometryCreator.CreateBox(make_float3(3.0f, 3.0f, 3.0f), mat3);
-	rigidBody = RigidBody(context, PROJECT_NAME, SCENE_NAME, box2Instance, 2, make_float3(-5.5f, 1.0f, 0.0f), 1.0f, "NoAccel", false, false);
-	rigidBody.AddTorque(make_float3(0.1f, 0.03f, -0.04f));
-	rigidBody.AddForce(make_float3(55.0f, 0.0f, 0.0f));
-	sceneRigidBodies.push_back(rigidBody);
+	id = simulation->AddBox(make_float3(3.0f, 3.0f, 3.0f), mat3, make_float3(-5.5f, 1.0f, 0.0f), 1.0f);
+	simulation->GetBody(id).AddTorque(make_float3(0.1f, 0.03f, -0.04f));
+	simulation->GetBody(id).AddForce(make_float3(55.0f, 0.0f, 0.0f));
 
-	GeometryInstance sphere2Instance = geometryCreator.CreateSphere(2.0f, mat4);
-	rigidBody = RigidBody(context, PROJECT_NAME, SCENE_NAME, sphere2Instance, 3, make_float3(0.0f, 10.0f, 0.0f), 1.0f, "NoAccel", false, false);
-	rigidBody.AddForce(make_float3(0.0f, -120.0f, 0.0f));
-	sceneRigidBodies.push_back(rigidBody);
+	id = simulation->AddSphere(2.0f, mat4, make_float3(0.0f, 10.0f, 0.0f), 1.0f);
+	simulation->GetBody(id).AddForce(make_float3(0.0f, -120.0f, 0.0f));
 
-	GeometryInstance box3Instance = geometryCreator.CreateBox(make_float3(3.0f, 3.0f, 3.0f), mat5);
-	rigidBody = RigidBody(context, PROJECT_NAME, SCENE_NAME, box3Instance, 4, make_float3(-15.0f, 2.0f, 0.0f), 1.0f, "NoAccel", false, false);
-	rigidBody.AddTorque(make_float3(-0.1f, -0.03f, 0.04f));
-	rigidBody.AddForce(make_float3(155.0f, 0.0f, 0.0f));
-	sceneRigidBodies.push_back(rigidBody);
+	id = simulation->AddBox(make_float3(3.0f, 3.0f, 3.0f), mat5, make_float3(-15.0f, 2.0f, 0.0f), 1.0f);
+	simulation->GetBody(id).AddTorque(make_float3(-0.1f, -0.03f, 0.04f));
+	simulation->GetBody(id).AddForce(make_float3(155.0f, 0.0f, 0.0f));
 
-	GeometryInstance sphere3Instance = geometryCreator.CreateSphere(4.0f, mat6);
-	rigidBody = RigidBody(context, PROJECT_NAME, SCENE_NAME, sphere3Instance, 5, make_float3(20.0f, 20.0f, 20.0f), 4.0f, "NoAccel", false, false);
-	rigidBody.AddForce(make_float3(-600.0f, -500.0f, -500.0f) * 2.0f);
-	sceneRigidBodies.push_back(rigidBody);
+	id = simulation->AddSphere(4.0f, mat6, make_float3(20.0f, 20.0f, 20.0f), 4.0f);
+	simulation->GetBody(id).AddForce(make_float3(-600.0f, -500.0f, -500.0f) * 2.0f);
 
-	GeometryInstance box4Instance = geometryCreator.CreateBox(make_float3(3.0f, 3.0f, 3.0f), mat7);
-	rigidBody = RigidBody(context, PROJECT_NAME, SCENE_NAME, box4Instance, 6, make_float3(0.5f, -45.0f, 0.0f), 1.0f, "NoAccel", false, false);
-	rigidBody.AddTorque(make_float3(0.16f, -0.01f, -1.07f));
-	rigidBody.AddForce(make_float3(0.0f, 450.0f, 0.0f));
-	sceneRigidBodies.push_back(rigidBody);
-
-	// Set up scene group
-	sceneGroup->setChildCount(sceneRigidBodies.size());
-	for (uint i = 0; i < sceneRigidBodies.size(); i++)
-	{
-		sceneGroup->setChild(i, sceneRigidBodies[i].GetTransform());
-	}
-	sceneGroup->setAcceleration(context->createAcceleration("NoAccel"));
-
-	context["top_object"]->set(sceneGroup);
-	context["top_shadower"]->set(sceneGroup);
+	id = simulation->AddBox(make_float3(3.0f, 3.0f, 3.0f), mat7, make_float3(0.5f, -45.0f, 0.0f), 1.0f);
+	simulation->GetBody(id).AddTorque(make_float3(0.16f, -0.01f, -1.07f));
+	simulation->GetBody(id).AddForce(make_float3(0.0f, 450.0f, 0.0f));
+}
 
-	CreateLights();
+/*
+	Random spheres and boxes spread through a cube that grows with the body count,
+	used by the scalability sweep. Gravity is off so the cloud stays in view.
+	With a mesh every body is an instance of it instead, loaded once unless shareMeshes is false
+*/
+void Scene::CreateProceduralScene(unsigned int bodyCount, unsigned int seed, const std::string& mesh, bool shareMeshes)
+{
+	PROFILE_SCOPE("CreateScene");
 
-	// Create collision response buffer
-	// Each pixel stores the volume of intersection between the pair of rigidbodies
-	Buffer response_buffer = context->createBuffer( RT_BUFFER_INPUT_OUTPUT );
-    response_buffer->setFormat( RT_FORMAT_USER );
-    response_buffer->setElementSize( sizeof( IntersectionResponse ) );
+	MaterialProperties palette[] =
+	{
+		MaterialProperties("closest_hit_radiance", make_float3(0.0f, 0.0f, 0.0f), make_float3(0.3f, 0.3f, 0.3f), make_float3(0.9f, 0.9f, 0.9f), 88.0f, make_float3(0.2f, 0.2f, 0.2f), make_float3(0.3f, 0.3f, 0.3f)),
+		MaterialProperties("closest_hit_radiance", make_float3(0.1f, 0.1f, 0.1f), make_float3(0.8f, 0.2f, 0.8f), make_float3(0.8f, 0.9f, 0.8f), 88.0f, make_float3(0.2f, 0.2f, 0.2f), make_float3(0.1f, 0.1f, 0.1f)),
+		MaterialProperties("closest_hit_radiance", make_float3(0.1f, 0.1f, 0.1f), make_float3(0.3f, 0.7f, 0.5f), make_float3(0.9f, 0.9f, 0.9f), 88.0f, make_float3(0.0f, 0.0f, 0.0f), make_float3(0.0f, 0.0f, 0.0f)),
+		MaterialProperties("closest_hit_radiance", make_float3(0.0f, 0.0f, 0.0f), make_float3(0.5f, 0.4f, 0.1f), make_float3(0.9f, 0.9f, 0.9f), 30.0f, make_float3(0.1f, 0.1f, 0.1f), make_float3(0.1f, 0.1f, 0.1f))
+	};
+	const int paletteSize = sizeof(palette) / sizeof(palette[0]);
+
+	// Sizes come from a short list so bodies share geometry the way a real scene would.
+	// Keeps the density roughly constant, about one body per 6x6x6 cell
+	const float extent = 6.0f * cbrtf(static_cast<float>(bodyCount));
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> spread(-0.5f * extent, 0.5f * extent);
+	std::uniform_real_distribution<float> push(-100.0f, 100.0f);
+
+	sceneHostBodies.clear();
+	for (unsigned int i = 0; i < bodyCount; i++)
+	{
+		const float3 position = make_float3(spread(rng), spread(rng), spread(rng));
+		const MaterialProperties& material = palette[i % paletteSize];
 
-	uint32_t physicsBufferWidth = width / physicsRayStep;
-	uint32_t physicsBufferHeight = height / physicsRayStep;
-    response_buffer->setSize(physicsBufferWidth, physicsBufferHeight);
+		unsigned int id;
+		if (!mesh.empty())
+		{
+			std::shared_ptr<const WideBVH> hostBVH;
+			id = simulation->AddMesh(mesh, material, position, 1.0f, false, shareMeshes, &hostBVH);
+			sceneHostBodies.push_back(HostBody::Mesh(id, hostBVH, position, Matrix3x3::identity()));
+		}
+		else if (unit(rng) < 0.5f)
+		{
+			const float radius = 0.5f + 0.25f * static_cast<int>(unit(rng) * 6.0f);
+			id = simulation->AddSphere(radius, material, position, radius);
+			sceneHostBodies.push_back(HostBody::Sphere(id, radius, position, Matrix3x3::identity()));
+		}
+		else
+		{
+			const float3 axisLengths = make_float3(1.0f + static_cast<int>(unit(rng) * 3.0f));
+			id = simulation->AddBox(axisLengths, material, position, 1.0f);
+			sceneHostBodies.push_back(HostBody::Box(id, axisLengths, position, Matrix3x3::identity()));
+		}
 
-	context["physicsRayStep"]->setInt(physicsRayStep);
-	context["physicsBufferWidth"]->setInt(physicsBufferWidth);
-	context["physicsBufferHeight"]->setInt(physicsBufferHeight);
-	context["collisionResponse"]->set(response_buffer);
-}
+		simulation->GetBody(id).AddForce(make_float3(push(rng), push(rng), push(rng)));
+	}
 
-void Scene::CreateLights()
-{
-	Light lights[] =
+	const GeometryCreator& geometryCreator = simulation->GetGeometryCreator();
+	std::cerr << "Created " << bodyCount << " bodies from " << geometryCreator.GetGeometryCount() << " geometries, "
+			  << geometryCreator.GetMaterialCount() << " materials and " << geometryCreator.GetProgramCount() << " programs" << std::endl;
+	if (!mesh.empty())
 	{
-        { make_float3( -20.0f, 20.0f, 0.0f ), make_float3( 1.0f, 1.0f, 1.0f ), 1 }
-    };
-
-    Buffer light_buffer = context->createBuffer( RT_BUFFER_INPUT );
-    light_buffer->setFormat( RT_FORMAT_USER );
-    light_buffer->setElementSize( sizeof( Light ) );
-    light_buffer->setSize( sizeof(lights)/sizeof(lights[0]) );
-    memcpy(light_buffer->map(), lights, sizeof(lights));
-    light_buffer->unmap();
+		std::cerr << "Loaded '" << mesh << "' " << geometryCreator.GetMeshLoadCount() << " times, "
+				  << geometryCreator.GetMeshBufferBytes() / 1024 << " KB of mesh buffers" << std::endl;
+	}
+	sceneMeshLoads = geometryCreator.GetMeshLoadCount();
+	sceneMeshBufferBytes = geometryCreator.GetMeshBufferBytes();
 
-	context["ambientLightColor"]->setFloat( 0.31f, 0.33f, 0.28f );
-    context["lights"]->set( light_buffer );
+	camera_eye = normalize(make_float3(-7.0f, 9.2f, 6.0f)) * extent * 1.5f;
+	camera_lookat = make_float3(0.0f, 0.0f, 0.0f);
+	camera_up = make_float3(0.0f, 1.0f, 0.0f);
+	camera_rotate = Matrix4x4::identity();
 }
 
 void Scene::SetupCamera()
@@ -274,18 +433,22 @@ void Scene::SetupCamera()
 
 void Scene::UpdateGeometry()
 {
+	PROFILE_SCOPE("UpdateGeometry");
+
 	float updateTime = sutil::currentTime() - last_update_time;
 	float deltaTime = std::fmin(updateTime, 0.1f); // For numerical stability
-	for (auto i = sceneRigidBodies.begin(); i != sceneRigidBodies.end(); ++i)
-	{
-		i->EulerStep(deltaTime);
-	}
+	simulation->StepBodies(deltaTime);
 
 	last_update_time = sutil::currentTime();
 }
 
+/*
+	Applies the arcball rotation to the camera and hands it to the simulation
+*/
 void Scene::UpdateCamera()
 {
+	PROFILE_SCOPE("UpdateCamera");
+
 	const float vfov = 60.0f;
 	const float aspect_ratio = static_cast<float>(width) /
 		static_cast<float>(height);
@@ -307,55 +470,319 @@ void Scene::UpdateCamera()
 	camera_lookat = make_float3(trans*make_float4(camera_lookat, 1.0f));
 	camera_up = make_float3(trans*make_float4(camera_up, 0.0f));
 
-	sutil::calculateCameraVariables(
-		camera_eye, camera_lookat, camera_up, vfov, aspect_ratio,
-		camera_u, camera_v, camera_w, true);
-
 	camera_rotate = Matrix4x4::identity();
 
-	context["eye"]->setFloat(camera_eye);
-	context["U"]->setFloat(camera_u);
-	context["V"]->setFloat(camera_v);
-	context["W"]->setFloat(camera_w);
+	simulation->SetCamera(camera_eye, camera_lookat, camera_up, vfov);
+}
+
+void Scene::SetReflectionControl(ReflectionTermination termination, unsigned int rayBudget)
+{
+	reflection_termination = termination;
+	reflection_ray_budget = rayBudget;
+}
+
+void Scene::SetSchedule(double physicsHz, double collisionHz, double renderHz, double runSeconds)
+{
+	physics_hz = physicsHz;
+	collision_hz = collisionHz;
+	render_hz = renderHz;
+	run_seconds = runSeconds;
+
+	if (render_hz <= 0.0)
+	{
+		headless = true;
+		use_pbo = false;
+	}
+}
+
+void Scene::SetRecording(const std::string& path)
+{
+	FrameRecorder::Format format;
+	if (!FrameRecorder::formatFromPath(path, format))
+	{
+		std::cerr << "Recording: '" << path << "' is not a .ppm, .pfm or .y4m file" << std::endl;
+		return;
+	}
+	recorder.reset(new FrameRecorder(path, format));
+}
+
+void Scene::SetCounterFile(const std::string& path)
+{
+	EnableCounters(true);
+	frame_counters.SetCsvFile(path);
+}
+
+void Scene::SetTelemetryFile(const std::string& path)
+{
+	telemetry.Open(path);
+}
+
+void Scene::CloseLogs()
+{
+	frame_counters.Shutdown();
+	telemetry.Shutdown();
+}
+
+void Scene::SetFrameTarget(double frameMs)
+{
+	resolution.SetTarget(frameMs);
+	resolution.SetStepRange(std::max(physicsRayStep / 2, 1u), physicsRayStep * 4);
+}
+
+/*
+	Sizes the launch for the window and the resolution controller
+*/
+void Scene::ApplyRenderSize()
+{
+	uint32_t renderWidth = width;
+	uint32_t renderHeight = height;
+	if (IsScalingResolution())
+	{
+		resolution.ScaledSize(width, height, renderWidth, renderHeight);
+		simulation->SetPhysicsRayStep(resolution.GetPhysicsRayStep());
+	}
+
+	simulation->SetRenderSize(renderWidth, renderHeight);
+}
+
+/*
+	Moves the simulation's bodies to a snapshot from the physics thread, unless they are there
+	already. Call with context_mutex held
+*/
+void Scene::ApplySnapshot(const std::vector<RigidBodyState>& states, unsigned int tick)
+{
+	if (tick == applied_tick)
+		return;
+
+	simulation->SetBodyStates(states);
+	applied_tick = tick;
+}
 
-	float3 ray_direction_1 = normalize(-0.5*camera_u + camera_w);
-	float3 ray_direction_2 = normalize(0.5*camera_u + camera_w);
-	float fov = acos(dot(ray_direction_1, ray_direction_2));
+/*
+	Starts the physics and collision threads from the simulation's current states. Rendering,
+	if any, stays on the GLUT thread with render_clock, see GlutIdle
+*/
+void Scene::StartSchedule()
+{
+	UpdateCamera();
+	simulation->SetRenderCounters(false);
+
+	physics_bodies.clear();
+	for (size_t i = 0; i < simulation->GetBodyCount(); i++)
+	{
+		physics_bodies.push_back(simulation->GetBody(static_cast<unsigned int>(i)).GetState());
+	}
+
+	BodySnapshot start;
+	start.tick = 0;
+	start.bodies = physics_bodies;
+	bodies_for_collision.Fill(start);
+	bodies_for_render.Fill(start);
+	physics_tick = 0;
+	applied_tick = 0;
+
+	scheduler.AddTask("Physics", physics_hz, [this]() { PhysicsTick(); }, true);
+	scheduler.AddTask("Collision", collision_hz, [this]() { CollisionTick(); });
+	scheduler.Start();
+
+	render_clock = TickClock(render_hz);
+	render_clock.Start();
+}
 
-	context["fov"]->setFloat(fov);
+/*
+	One fixed step of every body. The latest responses are applied once, when they arrive
+*/
+void Scene::PhysicsTick()
+{
+	PROFILE_SCOPE("PhysicsTick");
+
+	if (collision_responses.Update())
+	{
+		const ResponseSnapshot& snapshot = collision_responses.Front();
+		const float volume = CollisionResolver::ApplyResponses(snapshot.responses.data(), snapshot.responses.size(), snapshot.k,
+															   physics_bodies);
+		contact_volume.store(volume, std::memory_order_relaxed);
+	}
+
+	const float deltaTime = static_cast<float>(1.0 / physics_hz);
+	for (auto i = physics_bodies.begin(); i != physics_bodies.end(); ++i)
+	{
+		i->EulerStep(deltaTime);
+	}
+	physics_tick++;
+
+	BodySnapshot& forCollision = bodies_for_collision.Back();
+	forCollision.tick = physics_tick;
+	forCollision.bodies = physics_bodies;
+	bodies_for_collision.Publish();
+
+	if (!headless)
+	{
+		BodySnapshot& forRender = bodies_for_render.Back();
+		forRender.tick = physics_tick;
+		forRender.bodies = physics_bodies;
+		bodies_for_render.Publish();
+	}
 }
 
-void Scene::ResolveCollisions()
+/*
+	Traces the physics rays against the latest body states and hands the responses to the
+	physics thread. Skipped while physics hasn't stepped since the last pass
+*/
+void Scene::CollisionTick()
 {
-	Buffer responseBuffer = GetResponseBuffer();
-	float volume = 0.0f;
-	float k = 100.0f;
+	PROFILE_SCOPE("CollisionTick");
+
+	if (!bodies_for_collision.Update())
+		return;
+
+	const BodySnapshot& snapshot = bodies_for_collision.Front();
+	ResponseSnapshot& result = collision_responses.Back();
+	{
+		std::lock_guard<std::mutex> lock(context_mutex);
+		ApplySnapshot(snapshot.bodies, snapshot.tick);
+		simulation->TracePhysics();
+
+		result.k = simulation->ResponseConstant();
+		simulation->ReadResponses(result.responses);
+	}
 
-	IntersectionResponse* responseData = (IntersectionResponse*)responseBuffer->map();
-	int physicsPixels = width * height / physicsRayStep / physicsRayStep;
-	for(uint i = 0; i < physicsPixels; i++)
+	if (telemetry.IsEnabled())
 	{
-		IntersectionResponse response = responseData[i];
-		if (responseData[i].volume > 0.00001f)
+		TelemetryBody* bodies = telemetry.BeginFrame(snapshot.tick, result.responses.data(), result.responses.size(), snapshot.bodies.size());
+		if (bodies)
 		{
-			float volumeConstraint = response.volume;
+			for (size_t i = 0; i < snapshot.bodies.size(); i++)
+				Telemetry::SetBody(bodies[i], static_cast<unsigned int>(i), snapshot.bodies[i]);
+			telemetry.CommitFrame();
+		}
+	}
 
-			// Apply force at collision entry
-			sceneRigidBodies[response.entryId].AddImpulseAtPosition(-response.entryNormal * volumeConstraint * k, response.entryPoint);
-			int otherId = response.collisionId == response.entryId ? response.exitId : response.collisionId;
-			sceneRigidBodies[otherId].AddImpulseAtPosition(response.entryNormal * volumeConstraint * k, response.entryPoint);
+	if (frame_counters.IsEnabled())
+	{
+		unsigned int responsePixels = 0;
+		for (size_t i = 0; i < result.responses.size(); i++)
+		{
+			if (result.responses[i].volume > 0.00001f)
+				responsePixels++;
+		}
+		frame_counters.Add(STAT_RESPONSE_PIXELS, responsePixels);
+		frame_counters.EndFrame();
+	}
 
-			// Apply force at collision exit
-			sceneRigidBodies[response.exitId].AddImpulseAtPosition(-response.exitNormal * volumeConstraint * k, response.exitPoint);
-			otherId = response.collisionId;
-			sceneRigidBodies[otherId].AddImpulseAtPosition(response.exitNormal * volumeConstraint * k, response.exitPoint);
+	collision_responses.Publish();
+}
 
-			volume += response.volume;
+SweepResult Scene::RunHeadless(const SweepConfig& config)
+{
+	SweepResult result;
+
+	width = config.width;
+	height = config.height;
+	physicsRayStep = config.physicsRayStep;
+	use_pbo = false;
+	headless = true;
+
+	const bool countersWereEnabled = frame_counters.IsEnabled();
+	EnableCounters(true);
+
+	try
+	{
+		double start = sutil::currentTime();
+
+		// A flat list stops scaling well past a few dozen bodies
+		CreateSimulation("Trbvh");
+		Context context = simulation->GetContext();
+		const RTsize deviceFreeBefore = context->getAvailableDeviceMemory(0);
+		CreateProceduralScene(config.bodies, config.seed, config.mesh, config.shareMeshes);
+		context->validate();
+		result.setupMs = (sutil::currentTime() - start) * 1000.0;
+
+		HostTracer tracer(width, height, physicsRayStep);
+		tracer.SetThreadCount(config.threads);
+		std::vector<HostBody> hostBodies = sceneHostBodies;
+
+		for (unsigned int frame = 0; frame < config.frames; frame++)
+		{
+			double t0 = sutil::currentTime();
+			simulation->StepBodies(1.0f / 60.0f);
+			double t1 = sutil::currentTime();
+			UpdateCamera();
+			double t2 = sutil::currentTime();
+			simulation->Render(true);
+			double t3 = sutil::currentTime();
+			simulation->ResolveCollisions();
+			double t4 = sutil::currentTime();
+
+			// Same pass on the CPU against the post-launch poses
+			for (size_t i = 0; i < hostBodies.size(); i++)
+			{
+				const RigidBodyState& state = simulation->GetBody(static_cast<unsigned int>(i)).GetState();
+				hostBodies[i].position = state.GetPosition();
+				hostBodies[i].rotation = MathHelpers::QuaternionToRotation(state.GetQuaternion());
+			}
+
+			FrameStats cpuStats;
+			memset(&cpuStats, 0, sizeof(cpuStats));
+			tracer.TracePhysicsRays(HostCamera::LookAt(camera_eye, camera_lookat, camera_up, 60.0f, width, height), hostBodies, &cpuStats);
+			double t5 = sutil::currentTime();
+
+			frame_counters.EndFrame();
+			const FrameStats gpuStats = frame_counters.Latest();
+
+			const std::vector<IntersectionResponse>& responses = tracer.GetResponses();
+			unsigned int cpuResponsePixels = 0;
+			for (size_t i = 0; i < responses.size(); i++)
+			{
+				if (responses[i].volume > 0.00001f)
+					cpuResponsePixels++;
+			}
+
+			result.physicsMs += (t1 - t0) * 1000.0;
+			result.cameraMs += (t2 - t1) * 1000.0;
+			result.launchMs += (t3 - t2) * 1000.0;
+			result.resolveMs += (t4 - t3) * 1000.0;
+			result.cpuTraceMs += (t5 - t4) * 1000.0;
+			result.gpuResponsePixels += gpuStats.Get(STAT_RESPONSE_PIXELS);
+			result.gpuPairs += gpuStats.Get(STAT_PAIRS_FOUND);
+			result.cpuResponsePixels += cpuResponsePixels;
+			result.cpuPairs += cpuStats.Get(STAT_PAIRS_FOUND);
+		}
+
+		if (config.frames > 0)
+		{
+			const double frames = config.frames;
+			result.physicsMs /= frames;
+			result.cameraMs /= frames;
+			result.launchMs /= frames;
+			result.resolveMs /= frames;
+			result.cpuTraceMs /= frames;
+			result.gpuResponsePixels /= frames;
+			result.gpuPairs /= frames;
+			result.cpuResponsePixels /= frames;
+			result.cpuPairs /= frames;
 		}
+
+		result.residentBytes = SweepRunner::CurrentResidentBytes();
+		result.optixHostBytes = context->getUsedHostMemory();
+
+		// Acceleration structures are built by the first launch, so this covers them
+		const RTsize deviceFreeAfter = context->getAvailableDeviceMemory(0);
+		result.deviceBytes = deviceFreeBefore > deviceFreeAfter ? deviceFreeBefore - deviceFreeAfter : 0;
+		result.meshLoads = sceneMeshLoads;
+		result.meshBufferBytes = sceneMeshBufferBytes;
+
+		// Leaves the profiler and counter files alone, unlike DestroyContext
+		sceneHostBodies.clear();
+		sceneMeshLoads = 0;
+		sceneMeshBufferBytes = 0;
+		context = 0;
+		simulation.reset();
 	}
-	responseBuffer->unmap();
+	SUTIL_CATCH(CurrentContext())
 
-	DisplayGUI(volume);
+	EnableCounters(countersWereEnabled);
+	return result;
 }
 
 /*
@@ -379,13 +806,16 @@ void Scene::DisplayGUI(float volume)
 	snprintf(volumeText, sizeof volumeText, "%f", volume);
 	sutil::displayText(volumeText, 25, height-65);
 
-	// Display frames per second
-	sutil::displayFps(frame_count++);
-
-	if (volume > 0.0f)
+	if (IsScalingResolution())
 	{
-		std::cout << volume << std::endl;
+		char renderText[64];
+		snprintf(renderText, sizeof renderText, "Render %ux%u, physics step %u", simulation->GetRenderWidth(), simulation->GetRenderHeight(),
+				 simulation->GetPhysicsRayStep());
+		sutil::displayText(renderText, 25, height-85);
 	}
+
+	// Display frames per second
+	sutil::displayFps(frame_count++);
 }
 
 void Scene::GlutInitialize(int* argc, char** argv)
@@ -415,7 +845,7 @@ void Scene::GlutRun()
 
 	// GLUT callbacks
 	glutDisplayFunc(Scene::GlutDisplay);
-	glutIdleFunc(Scene::GlutDisplay);
+	glutIdleFunc(IsScheduled() ? Scene::GlutIdle : Scene::GlutDisplay);
 	glutReshapeFunc(Scene::GlutResize);
 	glutKeyboardFunc(Scene::GlutKeyboardPress);
 	glutMouseFunc(Scene::GlutMousePress);
@@ -425,26 +855,111 @@ void Scene::GlutRun()
 	glutMainLoop();
 }
 
+/*
+	Renders when render_clock is due. Sleeps a millisecond at most in between so input stays responsive
+*/
+void Scene::GlutIdle()
+{
+	if (!render_clock.IsDue())
+	{
+		const TickClock::Clock::time_point wake = TickClock::Clock::now() + std::chrono::milliseconds(1);
+		std::this_thread::sleep_until(std::min(render_clock.Next(), wake));
+		return;
+	}
+
+	render_clock.Advance();
+	GlutDisplay();
+}
+
 void Scene::GlutDisplay()
 {
-	Scene instance = Scene::Get();
+	PROFILE_SCOPE("Frame");
+
+	Scene& instance = Scene::Get();
+
+	if (IsScheduled())
+	{
+		instance.RenderScheduledFrame();
+		return;
+	}
+
+	const double frameStart = sutil::currentTime();
 	instance.UpdateGeometry();
+	const double geometryEnd = sutil::currentTime();
 	instance.UpdateCamera();
 
-	instance.context->launch(0, width, height);
+	// The physics rays ride along with the render launch
+	simulation->Render(true);
+
+	if (recorder)
+	{
+		PROFILE_SCOPE("Record");
+		recorder->record(simulation->GetOutputBuffer());
+	}
 
-	Buffer renderBuffer = instance.GetOutputBuffer();
-	sutil::displayBufferGL(renderBuffer);
+	{
+		PROFILE_SCOPE("DisplayBuffer");
+		Buffer renderBuffer = simulation->GetOutputBuffer();
+		sutil::displayBufferGL(renderBuffer);
+	}
 
-	instance.ResolveCollisions();
+	const double resolveStart = sutil::currentTime();
+	const float volume = simulation->ResolveCollisions();
+	const double resolveEnd = sutil::currentTime();
+	instance.DisplayGUI(volume);
 
-	glutSwapBuffers();
+	if (frame_counters.IsEnabled())
+		frame_counters.EndFrame();
+
+	// Swapping waits for vsync, so the controller only sees the frame's own work
+	const double frameMs = (sutil::currentTime() - frameStart) * 1000.0;
+	const double physicsMs = ((geometryEnd - frameStart) + (resolveEnd - resolveStart)) * 1000.0;
+	if (IsScalingResolution() && resolution.AddFrame(frameMs, physicsMs))
+		instance.ApplyRenderSize();
+
+	{
+		PROFILE_SCOPE("SwapBuffers");
+		glutSwapBuffers();
+	}
 }
 
-void Scene::GlutKeyboardPress(unsigned char k, int x, int y)
+/*
+	Renders the latest states from the physics thread, stepping and collisions happen on their own threads
+*/
+void Scene::RenderScheduledFrame()
 {
-	Scene instance = Scene::Get();
+	bodies_for_render.Update();
+	const BodySnapshot& snapshot = bodies_for_render.Front();
+
+	{
+		std::lock_guard<std::mutex> lock(context_mutex);
+		ApplySnapshot(snapshot.bodies, snapshot.tick);
+		UpdateCamera();
+		simulation->Render(false);
+
+		if (recorder)
+		{
+			PROFILE_SCOPE("Record");
+			recorder->record(simulation->GetOutputBuffer());
+		}
+
+		{
+			PROFILE_SCOPE("DisplayBuffer");
+			Buffer renderBuffer = simulation->GetOutputBuffer();
+			sutil::displayBufferGL(renderBuffer);
+		}
+	}
+
+	DisplayGUI(contact_volume.load(std::memory_order_relaxed));
 
+	{
+		PROFILE_SCOPE("SwapBuffers");
+		glutSwapBuffers();
+	}
+}
+
+void Scene::GlutKeyboardPress(unsigned char k, int x, int y)
+{
 	switch (k)
 	{
 		case('q'):
@@ -457,7 +972,18 @@ void Scene::GlutKeyboardPress(unsigned char k, int x, int y)
 		{
 			const std::string outputImage = std::string(PROJECT_NAME) + ".ppm";
 			std::cerr << "Saving current frame to '" << outputImage << "'\n";
-			sutil::displayBufferPPM(outputImage.c_str(), instance.GetOutputBuffer());
+			std::lock_guard<std::mutex> lock(context_mutex);
+			sutil::displayBufferPPM(outputImage.c_str(), simulation->GetOutputBuffer());
+			break;
+		}
+		case('p'):
+		{
+			Profiler::PrintSummary(std::cout);
+			break;
+		}
+		case('c'):
+		{
+			FrameCounters::Print(frame_counters.Latest(), std::cout);
 			break;
 		}
 	}
@@ -502,7 +1028,7 @@ void Scene::GlutMouseMotion(int x, int y)
 
 void Scene::GlutResize(int w, int h)
 {
-	Scene instance = Scene::Get();
+	Scene& instance = Scene::Get();
 
 	if (w == (int)width && h == (int)height) return;
 
@@ -510,7 +1036,10 @@ void Scene::GlutResize(int w, int h)
 	height = h;
 	sutil::ensureMinimumSize(width, height);
 
-	sutil::resizeBuffer(instance.GetOutputBuffer(), width, height);
+	{
+		std::lock_guard<std::mutex> lock(context_mutex);
+		instance.ApplyRenderSize();
+	}
 
 	glViewport(0, 0, width, height);
 
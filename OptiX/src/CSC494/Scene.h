@@ -22,8 +22,9 @@
 #include <sutil.h>
 #include <Arcball.h>
 #include "RigidBody.h"
-#include "GeometryCreator.h"
 #include "BufferStructs.h"
+#include "ReflectionControl.h"
+#include "SweepRunner.h"
 
 using namespace optix;
 
@@ -38,30 +39,63 @@ public:
 
 	void Setup(int argc, char** argv, std::string out_file, bool use_pbo);
 
+	// Builds a procedural scene without a window and times a fixed number of frames
+	SweepResult RunHeadless(const SweepConfig& config);
+
+	// How reflections end and the reflection rays allowed per frame, 0 for no limit. Call before Setup
+	void SetReflectionControl(ReflectionTermination termination, unsigned int rayBudget);
+
+	// Scales the render size and the physics ray step to hold this frame time, 0 to render at
+	// the window size. Call before Setup
+	void SetFrameTarget(double frameMs);
+
+	// Steps the physics at physicsHz and traces the physics rays at collisionHz, each on a thread
+	// of its own, and renders at renderHz. The latest body states are handed over without locks,
+	// so a slow render frame doesn't slow the simulation down. A renderHz of 0 opens no window
+	// and stops after runSeconds. Call before Setup
+	void SetSchedule(double physicsHz, double collisionHz, double renderHz, double runSeconds);
+
+	// Counts rays, hits and collision pixels per frame and appends them to path as CSV, or logs
+	// every frame's contacts and body states to path (see Telemetry.h). Call before Setup
+	void SetCounterFile(const std::string& path);
+	void SetTelemetryFile(const std::string& path);
+
+	// Flushes and closes the counter and telemetry files, done by the window's teardown too
+	void CloseLogs();
+
+	// Records every displayed frame to numbered .ppm or .pfm images or a .y4m stream, frames
+	// the writer thread can't keep up with are dropped. Call before Setup
+	void SetRecording(const std::string& path);
+
 	Buffer GetOutputBuffer();
-	Buffer GetResponseBuffer();
 
 private:
 	Scene() {}
 
-	void CreateContext();
+	void CreateSimulation(const char* acceleration);
 	void CreateScene();
-	void CreateLights();
+	void CreateProceduralScene(unsigned int bodyCount, unsigned int seed, const std::string& mesh = std::string(), bool shareMeshes = true);
 	void SetupCamera();
 	void UpdateGeometry();
 	void UpdateCamera();
-	void ResolveCollisions();
+	void ApplyRenderSize();
 	void DisplayGUI(float volume);
 
+	// Multi-rate mode, see SetSchedule
+	void ApplySnapshot(const std::vector<RigidBodyState>& states, unsigned int tick);
+	void StartSchedule();
+	void PhysicsTick();
+	void CollisionTick();
+	void RenderScheduledFrame();
+
 	// Static callbacks for GLUT
 	static void DestroyContext();
 	static void GlutInitialize(int* argc, char** argv);
 	static void GlutRun();
+	static void GlutIdle();
 	static void GlutDisplay();
 	static void GlutKeyboardPress(unsigned char k, int x, int y);
 	static void GlutMousePress(int button, int state, int x, int y);
 	static void GlutMouseMotion(int x, int y);
 	static void GlutResize(int w, int h);
-
-	Context context;
 };
@@ -0,0 +1,155 @@
+// STL
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "Profiler.h"
+#include "Scheduler.h"
+
+TickClock::TickClock(double hz) :
+	hz(hz),
+	period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / hz))),
+	next(Clock::now())
+{
+}
+
+void TickClock::Start()
+{
+	next = Clock::now();
+}
+
+unsigned int TickClock::Advance()
+{
+	const Clock::time_point now = Clock::now();
+	unsigned int missed = 0;
+	if (now - next >= period)
+		missed = static_cast<unsigned int>((now - next) / period);
+
+	next += period * (missed + 1);
+	return missed;
+}
+
+Scheduler::Scheduler() :
+	running(false),
+	stopping(false)
+{
+}
+
+Scheduler::~Scheduler()
+{
+	Stop();
+}
+
+void Scheduler::AddTask(const std::string& name, double hz, Tick tick, bool catchUp)
+{
+	std::unique_ptr<Task> task(new Task());
+	task->name = name;
+	task->tick = tick;
+	task->clock = TickClock(hz);
+	task->catchUp = catchUp;
+	task->ticks = 0;
+	task->skipped = 0;
+	task->totalMs = 0.0;
+	task->maxMs = 0.0;
+	tasks.push_back(std::move(task));
+}
+
+void Scheduler::Start()
+{
+	if (running)
+		return;
+
+	stopping = false;
+	running = true;
+	for (size_t i = 0; i < tasks.size(); i++)
+		tasks[i]->thread = std::thread(&Scheduler::Run, this, std::ref(*tasks[i]));
+}
+
+void Scheduler::Stop()
+{
+	if (!running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	stopChanged.notify_all();
+
+	for (size_t i = 0; i < tasks.size(); i++)
+		tasks[i]->thread.join();
+	running = false;
+}
+
+/*
+	Sleeps until the task's next tick is due, or the scheduler stops
+*/
+void Scheduler::Run(Task& task)
+{
+	Profiler::SetThreadName(task.name.c_str());
+
+	task.clock.Start();
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (stopChanged.wait_until(lock, task.clock.Next(), [this]() { return stopping; }))
+				break;
+		}
+
+		const unsigned int missed = task.clock.Advance();
+		const unsigned int runs = task.catchUp ? std::min(missed + 1, MAX_CATCH_UP) : 1;
+		task.skipped += missed + 1 - runs;
+
+		for (unsigned int i = 0; i < runs; i++)
+		{
+			const int64_t start = Profiler::Now();
+			task.tick();
+			const double ms = (Profiler::Now() - start) / 1.0e6;
+
+			task.ticks++;
+			task.totalMs += ms;
+			task.maxMs = std::max(task.maxMs, ms);
+		}
+	}
+}
+
+std::vector<Scheduler::TaskStats> Scheduler::Stats() const
+{
+	std::vector<TaskStats> stats;
+	for (size_t i = 0; i < tasks.size(); i++)
+	{
+		const Task& task = *tasks[i];
+
+		TaskStats entry;
+		entry.name = task.name;
+		entry.hz = task.clock.GetRate();
+		entry.ticks = task.ticks;
+		entry.skipped = task.skipped;
+		entry.meanMs = task.ticks > 0 ? task.totalMs / task.ticks : 0.0;
+		entry.maxMs = task.maxMs;
+		stats.push_back(entry);
+	}
+	return stats;
+}
+
+void Scheduler::PrintStats(std::ostream& out) const
+{
+	const std::vector<TaskStats> stats = Stats();
+
+	out << std::left << std::setw(16) << "Task" << std::right
+		<< std::setw(10) << "hz" << std::setw(10) << "ticks" << std::setw(10) << "skipped" << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::endl;
+
+	out << std::fixed << std::setprecision(2);
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		const TaskStats& entry = stats[i];
+		out << std::left << std::setw(16) << entry.name << std::right
+			<< std::setw(10) << entry.hz
+			<< std::setw(10) << entry.ticks
+			<< std::setw(10) << entry.skipped
+			<< std::setw(12) << entry.meanMs
+			<< std::setw(12) << entry.maxMs << std::endl;
+	}
+	out.unsetf(std::ios::fixed);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// STL
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+/*
+	Deadlines of a loop that runs at a fixed rate. Ticks are due every 1 / hz seconds from
+	Start(); Advance() moves past the tick that was due and reports the ones the loop was
+	too late for, so it never tries to run a burst of stale ticks.
+*/
+class TickClock
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	explicit TickClock(double hz = 60.0);
+
+	double GetRate() const { return hz; }
+	double GetPeriod() const { return 1.0 / hz; }
+
+	// The first tick is due now
+	void Start();
+
+	Clock::time_point Next() const { return next; }
+	bool IsDue() const { return Clock::now() >= next; }
+
+	// Returns the ticks missed since the one that was due
+	unsigned int Advance();
+
+private:
+	double hz;
+	Clock::duration period;
+	Clock::time_point next;
+};
+
+/*
+	Runs each task on a thread of its own at the task's rate, from Start() to Stop().
+
+	A task that falls behind either skips the ticks it missed, or with catchUp runs them back
+	to back (up to MAX_CATCH_UP at a time) so that a fixed time step keeps pace with the wall
+	clock. Tasks share nothing through the scheduler, they hand data to each other themselves.
+*/
+class Scheduler
+{
+public:
+	typedef std::function<void()> Tick;
+
+	static const unsigned int MAX_CATCH_UP = 4;
+
+	struct TaskStats
+	{
+		std::string name;
+		double hz;
+		uint64_t ticks;
+		uint64_t skipped;		// Ticks missed and not run
+		double meanMs;
+		double maxMs;
+	};
+
+	Scheduler();
+	~Scheduler();
+
+	// Before Start()
+	void AddTask(const std::string& name, double hz, Tick tick, bool catchUp = false);
+
+	void Start();
+
+	// Waits for the running ticks to finish
+	void Stop();
+	bool IsRunning() const { return running; }
+
+	// Read after Stop()
+	std::vector<TaskStats> Stats() const;
+	void PrintStats(std::ostream& out) const;
+
+private:
+	Scheduler(const Scheduler&);
+	Scheduler& operator=(const Scheduler&);
+
+	struct Task
+	{
+		std::string name;
+		Tick tick;
+		TickClock clock;
+		bool catchUp;
+		std::thread thread;
+
+		// Task thread only
+		uint64_t ticks;
+		uint64_t skipped;
+		double totalMs;
+		double maxMs;
+	};
+
+	void Run(Task& task);
+
+	std::vector<std::unique_ptr<Task>> tasks;
+	bool running;
+
+	bool stopping;
+	std::mutex mutex;
+	std::condition_variable stopChanged;
+};
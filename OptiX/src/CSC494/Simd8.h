@@ -0,0 +1,158 @@
+#pragma once
+
+// STL
+#include <cmath>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD8_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD8_SSE2 1
+#endif
+
+/*
+	Eight floats processed together, for the CPU tracer's wide BVH.
+
+	One AVX2 register when the compiler targets it (CSC494_AVX2 in CMake), otherwise a
+	pair of SSE2 registers, otherwise plain arrays. Comparisons return a Mask8 whose
+	Bits() has bit i set for lane i.
+*/
+struct Float8;
+struct Mask8;
+
+#if defined(SIMD8_AVX2)
+
+struct Float8
+{
+	__m256 v;
+
+	static Float8 Set(float x) { Float8 r; r.v = _mm256_set1_ps(x); return r; }
+	static Float8 Load(const float* p) { Float8 r; r.v = _mm256_loadu_ps(p); return r; }
+
+	// Eight unsigned bytes widened to floats
+	static Float8 LoadBytes(const uint8_t* p)
+	{
+		Float8 r;
+		r.v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+		return r;
+	}
+
+	void Store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+struct Mask8
+{
+	__m256 v;
+
+	int Bits() const { return _mm256_movemask_ps(v); }
+};
+
+inline Float8 operator+(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_add_ps(a.v, b.v); return r; }
+inline Float8 operator-(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_sub_ps(a.v, b.v); return r; }
+inline Float8 operator*(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_mul_ps(a.v, b.v); return r; }
+inline Float8 operator/(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_div_ps(a.v, b.v); return r; }
+inline Float8 Min(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_min_ps(a.v, b.v); return r; }
+inline Float8 Max(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_max_ps(a.v, b.v); return r; }
+inline Float8 Sqrt(const Float8& a) { Float8 r; r.v = _mm256_sqrt_ps(a.v); return r; }
+
+inline Mask8 operator<(const Float8& a, const Float8& b) { Mask8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); return r; }
+inline Mask8 operator<=(const Float8& a, const Float8& b) { Mask8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); return r; }
+inline Mask8 operator>(const Float8& a, const Float8& b) { Mask8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); return r; }
+inline Mask8 operator>=(const Float8& a, const Float8& b) { Mask8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); return r; }
+inline Mask8 operator&(const Mask8& a, const Mask8& b) { Mask8 r; r.v = _mm256_and_ps(a.v, b.v); return r; }
+
+#elif defined(SIMD8_SSE2)
+
+struct Float8
+{
+	__m128 lo;
+	__m128 hi;
+
+	static Float8 Set(float x) { Float8 r; r.lo = r.hi = _mm_set1_ps(x); return r; }
+	static Float8 Load(const float* p) { Float8 r; r.lo = _mm_loadu_ps(p); r.hi = _mm_loadu_ps(p + 4); return r; }
+
+	static Float8 LoadBytes(const uint8_t* p)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+		Float8 r;
+		r.lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+		r.hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero));
+		return r;
+	}
+
+	void Store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+};
+
+struct Mask8
+{
+	__m128 lo;
+	__m128 hi;
+
+	int Bits() const { return _mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4); }
+};
+
+#define SIMD8_BINARY(name, type, intrinsic) \
+	inline type name(const Float8& a, const Float8& b) { type r; r.lo = intrinsic(a.lo, b.lo); r.hi = intrinsic(a.hi, b.hi); return r; }
+
+SIMD8_BINARY(operator+, Float8, _mm_add_ps)
+SIMD8_BINARY(operator-, Float8, _mm_sub_ps)
+SIMD8_BINARY(operator*, Float8, _mm_mul_ps)
+SIMD8_BINARY(operator/, Float8, _mm_div_ps)
+SIMD8_BINARY(Min, Float8, _mm_min_ps)
+SIMD8_BINARY(Max, Float8, _mm_max_ps)
+SIMD8_BINARY(operator<, Mask8, _mm_cmplt_ps)
+SIMD8_BINARY(operator<=, Mask8, _mm_cmple_ps)
+SIMD8_BINARY(operator>, Mask8, _mm_cmpgt_ps)
+SIMD8_BINARY(operator>=, Mask8, _mm_cmpge_ps)
+
+#undef SIMD8_BINARY
+
+inline Float8 Sqrt(const Float8& a) { Float8 r; r.lo = _mm_sqrt_ps(a.lo); r.hi = _mm_sqrt_ps(a.hi); return r; }
+inline Mask8 operator&(const Mask8& a, const Mask8& b) { Mask8 r; r.lo = _mm_and_ps(a.lo, b.lo); r.hi = _mm_and_ps(a.hi, b.hi); return r; }
+
+#else
+
+struct Float8
+{
+	float v[8];
+
+	static Float8 Set(float x) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = x; return r; }
+	static Float8 Load(const float* p) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = p[i]; return r; }
+	static Float8 LoadBytes(const uint8_t* p) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = p[i]; return r; }
+
+	void Store(float* p) const { for (int i = 0; i < 8; i++) p[i] = v[i]; }
+};
+
+struct Mask8
+{
+	int bits;
+
+	int Bits() const { return bits; }
+};
+
+#define SIMD8_ARITHMETIC(name, expression) \
+	inline Float8 name(const Float8& a, const Float8& b) { Float8 r; for (int i = 0; i < 8; i++) { const float x = a.v[i]; const float y = b.v[i]; r.v[i] = (expression); } return r; }
+#define SIMD8_COMPARE(name, op) \
+	inline Mask8 name(const Float8& a, const Float8& b) { Mask8 r; r.bits = 0; for (int i = 0; i < 8; i++) r.bits |= (a.v[i] op b.v[i]) << i; return r; }
+
+SIMD8_ARITHMETIC(operator+, x + y)
+SIMD8_ARITHMETIC(operator-, x - y)
+SIMD8_ARITHMETIC(operator*, x * y)
+SIMD8_ARITHMETIC(operator/, x / y)
+SIMD8_ARITHMETIC(Min, x < y ? x : y)
+SIMD8_ARITHMETIC(Max, x > y ? x : y)
+SIMD8_COMPARE(operator<, <)
+SIMD8_COMPARE(operator<=, <=)
+SIMD8_COMPARE(operator>, >)
+SIMD8_COMPARE(operator>=, >=)
+
+#undef SIMD8_ARITHMETIC
+#undef SIMD8_COMPARE
+
+inline Float8 Sqrt(const Float8& a) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = sqrtf(a.v[i]); return r; }
+inline Mask8 operator&(const Mask8& a, const Mask8& b) { Mask8 r; r.bits = a.bits & b.bits; return r; }
+
+#endif
@@ -0,0 +1,521 @@
+// OptiX
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_stream_namespace.h>
+
+// STL
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+#include <stdexcept>
+
+#include <sutil.h>
+#include <HDRLoader.h>
+#include <ImageWriter.h>
+#include "FrameCounters.h"
+#include "GeometryCreator.h"
+#include "Profiler.h"
+#include "Simulation.h"
+#include "Telemetry.h"
+
+namespace
+{
+	// The device programs are built under the application's name, see CMakeLists.txt
+	const char* const PROJECT_NAME = "CSC494";
+	const char* const SCENE_NAME = "ray_scene.cu";
+
+	// Launch entry points, the physics one traces the physics rays alone
+	const unsigned int ENTRY_RENDER = 0;
+	const unsigned int ENTRY_PHYSICS = 1;
+
+	const float IMPORTANCE_CUTOFF = 0.01f;
+	const int MAX_DEPTH = 100;
+}
+
+SimulationOptions::SimulationOptions() :
+	width(1080u),
+	height(720u),
+	physicsRayStep(8),
+	minPhysicsRayStep(8),
+	acceleration("NoAccel"),
+	reflectionTermination(REFLECTION_CUTOFF),
+	reflectionRayBudget(0),
+	environment(0),
+	environmentMap(std::string(sutil::samplesDir()) + "/data/Rathaus.hdr"),
+	createGLBuffer(0),
+	resizeGLBuffer(0),
+	counters(0),
+	telemetry(0)
+{
+}
+
+Simulation::Simulation(const SimulationOptions& options) :
+	counters(options.counters),
+	telemetry(options.telemetry),
+	resizeGLBuffer(options.resizeGLBuffer),
+	renderWidth(options.width),
+	renderHeight(options.height),
+	physicsRayStep(options.physicsRayStep),
+	basePhysicsRayStep(options.physicsRayStep),
+	physicsBufferWidth(0),
+	physicsBufferHeight(0),
+	physicsInRender(true),
+	renderCounters(true),
+	collectStats(false),
+	reflectionRayBudget(options.reflectionTermination == REFLECTION_RUSSIAN_ROULETTE ? options.reflectionRayBudget : 0),
+	reflectionCutoff(IMPORTANCE_CUTOFF),
+	launchCount(0),
+	contactsCurrent(false)
+{
+	CreateContext(options);
+	geometryCreator.reset(new GeometryCreator(context, PROJECT_NAME, SCENE_NAME));
+}
+
+Simulation::~Simulation()
+{
+	bodies.clear();
+	geometryCreator.reset();
+	group = 0;
+	acceleration = 0;
+	outputBuffer = 0;
+	responseBuffer = 0;
+	frameStats = 0;
+	reflectionRayCount = 0;
+	frameNumberVariable = 0;
+	collectStatsVariable = 0;
+	physicsInRenderVariable = 0;
+	importanceCutoffVariable = 0;
+
+	if (context)
+	{
+		context->destroy();
+		context = 0;
+	}
+}
+
+/*
+	The context, its programs and every buffer the launches use. The scene starts out empty
+*/
+void Simulation::CreateContext(const SimulationOptions& options)
+{
+	PROFILE_SCOPE("CreateContext");
+
+	const char* scenePtx = sutil::getPtxString(PROJECT_NAME, SCENE_NAME);
+
+	context = Context::create();
+	context->setRayTypeCount(2);				// The number of types of rays (shading, shadowing)
+	context->setEntryPointCount(2);				// Entry points, one for each ray generation algorithm (used for multipass rendering)
+	context->setStackSize(4640);				// Allocated stack for each thread of execution
+
+	context["scene_epsilon"]->setFloat(1.e-4f); // Min distance to check along the ray
+	context["radiance_ray_type"]->setUint(0);	// Index of the radiance ray
+	context["shadow_ray_type"]->setUint(1);		// Index of the shadow ray
+
+	if (options.createGLBuffer)
+		outputBuffer = options.createGLBuffer(context, RT_FORMAT_UNSIGNED_BYTE4, renderWidth, renderHeight, true);
+	else
+		outputBuffer = context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_UNSIGNED_BYTE4, renderWidth, renderHeight);
+	context["output_buffer"]->set(outputBuffer);
+
+	// Ray generation programs
+	context->setRayGenerationProgram(ENTRY_RENDER, context->createProgramFromPTXString(scenePtx, "perspective_camera"));
+	context->setRayGenerationProgram(ENTRY_PHYSICS, context->createProgramFromPTXString(scenePtx, "physics_camera"));
+	physicsInRenderVariable = context["physicsInRender"];
+	physicsInRenderVariable->setInt(1);
+
+	// Scene ray variables
+	importanceCutoffVariable = context["importance_cutoff"];
+	importanceCutoffVariable->setFloat(IMPORTANCE_CUTOFF);
+	context["max_depth"]->setInt(MAX_DEPTH);
+	context["reflection_termination"]->setInt(options.reflectionTermination);
+	context["reflection_ray_cap"]->setUint(ReflectionRayCap(reflectionRayBudget));
+	frameNumberVariable = context["frame_number"];
+	frameNumberVariable->setUint(0u);
+
+	reflectionRayCount = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, 1);
+	memset(reflectionRayCount->map(), 0, sizeof(unsigned int));
+	reflectionRayCount->unmap();
+	context["reflectionRayCount"]->set(reflectionRayCount);
+
+	// Miss program
+	context->setMissProgram(0, context->createProgramFromPTXString(scenePtx, "miss"));
+	{
+		PROFILE_SCOPE("LoadTexture");
+		if (options.environment)
+			context["envmap"]->setTextureSampler(loadHDRTexture(context, *options.environment, make_float3(1.0, 1.0, 1.0)));
+		else
+			context["envmap"]->setTextureSampler(sutil::loadTexture(context, options.environmentMap, make_float3(1.0, 1.0, 1.0)));
+	}
+
+	// Exception program
+	Program exceptionProgram = context->createProgramFromPTXString(scenePtx, "exception");
+	context->setExceptionProgram(ENTRY_RENDER, exceptionProgram);
+	context->setExceptionProgram(ENTRY_PHYSICS, exceptionProgram);
+	context["bad_color"]->setFloat(0.0f, 1.0f, 0.0f);
+
+	// Top object, the bodies' transforms are added to it as they are created
+	group = context->createGroup();
+	acceleration = context->createAcceleration(options.acceleration);
+	group->setAcceleration(acceleration);
+	context["top_object"]->set(group);
+	context["top_shadower"]->set(group);
+
+	CreateLights();
+
+	// Collision response buffer
+	// Each pixel stores the volume of intersection between the pair of rigidbodies
+	responseBuffer = context->createBuffer(RT_BUFFER_INPUT_OUTPUT);
+	responseBuffer->setFormat(RT_FORMAT_USER);
+	responseBuffer->setElementSize(sizeof(IntersectionResponse));
+
+	// Sized for the finest step there will be, see ApplySizes
+	const uint32_t minStep = std::min(options.minPhysicsRayStep, options.physicsRayStep);
+	responseBuffer->setSize((renderWidth + minStep - 1) / minStep, (renderHeight + minStep - 1) / minStep);
+	context["collisionResponse"]->set(responseBuffer);
+	ApplySizes();
+
+	// Per frame work counters, see FrameCounters
+	frameStats = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, STAT_SLOT_COUNT);
+	memset(frameStats->map(), 0, STAT_SLOT_COUNT * sizeof(unsigned int));
+	frameStats->unmap();
+	context["frameStats"]->set(frameStats);
+	collectStatsVariable = context["collectStats"];
+	collectStats = IsCounting();
+	collectStatsVariable->setInt(collectStats ? 1 : 0);
+}
+
+void Simulation::CreateLights()
+{
+	Light lights[] =
+	{
+		{ make_float3( -20.0f, 20.0f, 0.0f ), make_float3( 1.0f, 1.0f, 1.0f ), 1 }
+	};
+
+	Buffer lightBuffer = context->createBuffer(RT_BUFFER_INPUT);
+	lightBuffer->setFormat(RT_FORMAT_USER);
+	lightBuffer->setElementSize(sizeof(Light));
+	lightBuffer->setSize(sizeof(lights) / sizeof(lights[0]));
+	memcpy(lightBuffer->map(), lights, sizeof(lights));
+	lightBuffer->unmap();
+
+	context["ambientLightColor"]->setFloat(0.31f, 0.33f, 0.28f);
+	context["lights"]->set(lightBuffer);
+}
+
+unsigned int Simulation::AddSphere(float radius, const MaterialProperties& material, float3 position, float mass, bool isStatic)
+{
+	return AddBody(geometryCreator->CreateSphere(radius, material), position, mass, isStatic, Acceleration());
+}
+
+unsigned int Simulation::AddBox(float3 axisLengths, const MaterialProperties& material, float3 position, float mass, bool isStatic)
+{
+	return AddBody(geometryCreator->CreateBox(axisLengths, material), position, mass, isStatic, Acceleration());
+}
+
+unsigned int Simulation::AddMesh(const std::string& path, const MaterialProperties& material, float3 position, float mass, bool isStatic,
+								 bool shareMesh, std::shared_ptr<const WideBVH>* hostBVH)
+{
+	Acceleration meshAcceleration;
+	GeometryInstance instance = geometryCreator->CreateMesh(path, material, meshAcceleration, shareMesh, hostBVH);
+	return AddBody(instance, position, mass, isStatic, meshAcceleration);
+}
+
+/*
+	Bodies without a shared acceleration get a NoAccel one of their own, a single primitive
+	gains nothing from a tree
+*/
+unsigned int Simulation::AddBody(GeometryInstance instance, float3 position, float mass, bool isStatic, Acceleration sharedAcceleration)
+{
+	const unsigned int id = static_cast<unsigned int>(bodies.size());
+	if (sharedAcceleration)
+		bodies.push_back(RigidBody(context, PROJECT_NAME, SCENE_NAME, instance, id, position, mass, sharedAcceleration, isStatic, false));
+	else
+		bodies.push_back(RigidBody(context, PROJECT_NAME, SCENE_NAME, instance, id, position, mass, "NoAccel", isStatic, false));
+
+	group->addChild(bodies.back().GetTransform());
+	acceleration->markDirty();
+	return id;
+}
+
+/*
+	Group::removeChild moves the last child into the removed one's place, the bodies follow it
+*/
+void Simulation::RemoveBody(unsigned int id)
+{
+	if (id >= bodies.size())
+		throw std::out_of_range("Simulation::RemoveBody: no body " + std::to_string(id));
+
+	const unsigned int last = static_cast<unsigned int>(bodies.size()) - 1;
+
+	group->removeChild(id);
+	bodies[id].Destroy();
+	if (id != last)
+	{
+		bodies[id] = bodies[last];
+		bodies[id].SetId(id);
+	}
+	bodies.pop_back();
+
+	acceleration->markDirty();
+	contactsCurrent = false;
+	contacts.clear();
+}
+
+void Simulation::SetBodyStates(const std::vector<RigidBodyState>& states)
+{
+	for (size_t i = 0; i < bodies.size(); i++)
+	{
+		bodies[i].SetState(states[i]);
+	}
+	acceleration->markDirty();
+}
+
+void Simulation::SetCamera(float3 eye, float3 lookat, float3 up, float vfov)
+{
+	const float aspectRatio = static_cast<float>(renderWidth) / static_cast<float>(renderHeight);
+
+	float3 u, v, w;
+	sutil::calculateCameraVariables(eye, lookat, up, vfov, aspectRatio, u, v, w, true);
+
+	context["eye"]->setFloat(eye);
+	context["U"]->setFloat(u);
+	context["V"]->setFloat(v);
+	context["W"]->setFloat(w);
+
+	float3 rayDirection1 = normalize(-0.5*u + w);
+	float3 rayDirection2 = normalize(0.5*u + w);
+	context["fov"]->setFloat(acos(dot(rayDirection1, rayDirection2)));
+}
+
+float Simulation::Step(float deltaTime)
+{
+	StepBodies(deltaTime);
+	TracePhysics();
+	const float volume = ResolveCollisions();
+
+	if (IsCounting())
+		counters->EndFrame();
+	return volume;
+}
+
+void Simulation::StepBodies(float deltaTime)
+{
+	PROFILE_SCOPE("StepBodies");
+
+	for (auto i = bodies.begin(); i != bodies.end(); ++i)
+	{
+		i->EulerStep(deltaTime);
+	}
+
+	// Bodies with shared mesh accelerations don't mark anything dirty themselves
+	acceleration->markDirty();
+}
+
+bool Simulation::IsCounting() const
+{
+	return counters && counters->IsEnabled();
+}
+
+/*
+	Launches that don't count still need the programs told so, the variable is only set on a change
+*/
+void Simulation::SetCollectStats(bool collect)
+{
+	if (collect != collectStats)
+	{
+		collectStats = collect;
+		collectStatsVariable->setInt(collectStats ? 1 : 0);
+	}
+}
+
+void Simulation::BeginCounters()
+{
+	counters->BeginFrame();
+	memset(frameStats->map(0, RT_BUFFER_MAP_WRITE_DISCARD), 0, STAT_SLOT_COUNT * sizeof(unsigned int));
+	frameStats->unmap();
+}
+
+void Simulation::EndCounters()
+{
+	counters->Accumulate(static_cast<const unsigned int*>(frameStats->map(0, RT_BUFFER_MAP_READ)));
+	frameStats->unmap();
+}
+
+/*
+	Traces the physics rays alone over the physics buffer, counted as a frame of its own
+*/
+void Simulation::TracePhysics()
+{
+	const bool countLaunch = IsCounting();
+	SetCollectStats(countLaunch);
+	if (countLaunch)
+		BeginCounters();
+
+	frameNumberVariable->setUint(launchCount++);
+	{
+		PROFILE_SCOPE("LaunchPhysics");
+		context->launch(ENTRY_PHYSICS, physicsBufferWidth, physicsBufferHeight);
+	}
+
+	if (countLaunch)
+		EndCounters();
+}
+
+/*
+	Launch the frame, clearing and reading back the GPU counters around it when they are enabled.
+	Under a reflection ray budget the next frame's importance cutoff follows this frame's ray count
+*/
+void Simulation::Render(bool tracePhysics)
+{
+	const bool countLaunch = IsCounting() && renderCounters;
+	SetCollectStats(countLaunch);
+	if (countLaunch)
+		BeginCounters();
+
+	if (tracePhysics != physicsInRender)
+	{
+		physicsInRender = tracePhysics;
+		physicsInRenderVariable->setInt(physicsInRender ? 1 : 0);
+	}
+
+	if (reflectionRayBudget > 0)
+	{
+		memset(reflectionRayCount->map(0, RT_BUFFER_MAP_WRITE_DISCARD), 0, sizeof(unsigned int));
+		reflectionRayCount->unmap();
+	}
+	frameNumberVariable->setUint(launchCount++);
+
+	{
+		PROFILE_SCOPE("Launch");
+		context->launch(ENTRY_RENDER, renderWidth, renderHeight);
+	}
+
+	if (countLaunch)
+		EndCounters();
+
+	if (reflectionRayBudget > 0)
+	{
+		const unsigned int traced = *static_cast<const unsigned int*>(reflectionRayCount->map(0, RT_BUFFER_MAP_READ));
+		reflectionRayCount->unmap();
+		reflectionCutoff = AdaptImportanceCutoff(reflectionCutoff, IMPORTANCE_CUTOFF, traced, reflectionRayBudget);
+		importanceCutoffVariable->setFloat(reflectionCutoff);
+	}
+}
+
+void Simulation::ReadImage(unsigned char* rgb)
+{
+	const void* pixels = outputBuffer->map(0, RT_BUFFER_MAP_READ);
+	convertToRGB8(pixels, outputBuffer->getFormat(), renderWidth, renderHeight, false, rgb);
+	outputBuffer->unmap();
+}
+
+/*
+	Copies the grid in use out of the response buffer, which is only mapped for the copy
+*/
+void Simulation::ReadResponses(std::vector<IntersectionResponse>& responses)
+{
+	responses.resize(static_cast<size_t>(physicsBufferWidth) * physicsBufferHeight);
+
+	// Its rows are strided by the buffer's width
+	RTsize capacityWidth, capacityHeight;
+	responseBuffer->getSize(capacityWidth, capacityHeight);
+
+	const IntersectionResponse* responseData = (const IntersectionResponse*)responseBuffer->map(0, RT_BUFFER_MAP_READ);
+	for (uint32_t y = 0; y < physicsBufferHeight; y++)
+	{
+		memcpy(responses.data() + y * physicsBufferWidth, responseData + y * capacityWidth,
+			   physicsBufferWidth * sizeof(IntersectionResponse));
+	}
+	responseBuffer->unmap();
+}
+
+/*
+	Each response stands for step x step pixels, so a coarser step pushes harder per response
+*/
+float Simulation::ResponseConstant() const
+{
+	const float stepScale = static_cast<float>(physicsRayStep) / basePhysicsRayStep;
+	return 100.0f * stepScale * stepScale;
+}
+
+/*
+	Apply the collision response buffer to the rigidbodies and return the total intersection volume
+*/
+float Simulation::ResolveCollisions()
+{
+	PROFILE_SCOPE("ResolveCollisions");
+
+	ReadResponses(responses);
+	contactsCurrent = false;
+
+	// Before the responses push the bodies, so the log has the states that produced the contacts
+	if (telemetry && telemetry->IsEnabled())
+	{
+		TelemetryBody* logged = telemetry->BeginFrame(launchCount - 1, responses.data(), responses.size(), bodies.size());
+		if (logged)
+		{
+			for (size_t i = 0; i < bodies.size(); i++)
+				Telemetry::SetBody(logged[i], static_cast<unsigned int>(i), bodies[i].GetState());
+			telemetry->CommitFrame();
+		}
+	}
+
+	unsigned int responsePixels = 0;
+	const float volume = CollisionResolver::ApplyResponses(responses.data(), responses.size(), ResponseConstant(), bodies, &responsePixels);
+
+	if (IsCounting())
+		counters->Add(STAT_RESPONSE_PIXELS, responsePixels);
+
+	return volume;
+}
+
+const std::vector<PairContact>& Simulation::GetContacts()
+{
+	if (!contactsCurrent)
+	{
+		CollisionResolver::ReduceContacts(responses.data(), responses.size(), contacts, contactPairs);
+		contactsCurrent = true;
+	}
+	return contacts;
+}
+
+void Simulation::SetRenderSize(uint32_t width, uint32_t height)
+{
+	if (width != renderWidth || height != renderHeight)
+	{
+		renderWidth = width;
+		renderHeight = height;
+		if (resizeGLBuffer)
+			resizeGLBuffer(outputBuffer, renderWidth, renderHeight);
+		else
+			outputBuffer->setSize(renderWidth, renderHeight);
+	}
+	ApplySizes();
+}
+
+void Simulation::SetPhysicsRayStep(uint32_t step)
+{
+	physicsRayStep = step;
+	ApplySizes();
+}
+
+/*
+	The physics grid for the launch size and step. The response buffer only grows
+*/
+void Simulation::ApplySizes()
+{
+	// Rounded up so the last physics ray of a row or column has a pixel when the size isn't a multiple of the step
+	physicsBufferWidth = (renderWidth + physicsRayStep - 1) / physicsRayStep;
+	physicsBufferHeight = (renderHeight + physicsRayStep - 1) / physicsRayStep;
+
+	RTsize capacityWidth, capacityHeight;
+	responseBuffer->getSize(capacityWidth, capacityHeight);
+	if (physicsBufferWidth > capacityWidth || physicsBufferHeight > capacityHeight)
+	{
+		responseBuffer->setSize(std::max<RTsize>(physicsBufferWidth, capacityWidth),
+								std::max<RTsize>(physicsBufferHeight, capacityHeight));
+	}
+
+	context["physicsRayStep"]->setInt(physicsRayStep);
+	context["physicsBufferWidth"]->setInt(physicsBufferWidth);
+	context["physicsBufferHeight"]->setInt(physicsBufferHeight);
+}
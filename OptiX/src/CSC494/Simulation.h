@@ -0,0 +1,204 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_stream_namespace.h>
+
+// STL
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BufferStructs.h"
+#include "CollisionResolver.h"
+#include "MaterialProperties.h"
+#include "ReflectionControl.h"
+#include "RigidBody.h"
+
+using namespace optix;
+
+class FrameCounters;
+class GeometryCreator;
+class HDRLoader;
+class Telemetry;
+class WideBVH;
+
+struct SimulationOptions
+{
+	SimulationOptions();
+
+	// Launch size. The physics rays are cast from the camera over the same view, one for
+	// every physicsRayStep x physicsRayStep pixels
+	uint32_t width;
+	uint32_t height;
+	uint32_t physicsRayStep;			// The response constant is tuned for this step
+	uint32_t minPhysicsRayStep;			// Finest step SetPhysicsRayStep will be asked for, sizes the response buffer
+
+	// Top level acceleration over the bodies. NoAccel is fine for a handful, Trbvh scales
+	std::string acceleration;
+
+	ReflectionTermination reflectionTermination;
+	uint32_t reflectionRayBudget;		// Reflection rays per frame, 0 for no limit. Russian roulette only
+
+	// Decoded environment map to use, else environmentMap is loaded from disk
+	const HDRLoader* environment;
+	std::string environmentMap;
+
+	// Output buffer backed by a GL pixel buffer for display, made and resized by these:
+	// sutil::createOutputBuffer and sutil::resizeBuffer from sutil_sdk. Both need a current GL
+	// context. Left null the output is a plain OptiX buffer and the library never touches GL
+	Buffer (*createGLBuffer)(Context context, RTformat format, unsigned width, unsigned height, bool usePbo);
+	void (*resizeGLBuffer)(Buffer buffer, unsigned width, unsigned height);
+
+	// Where the launches count and the resolved frames are logged, neither if null. Both take
+	// one producer thread, so simulations stepped on different threads need their own
+	FrameCounters* counters;
+	Telemetry* telemetry;
+};
+
+/*
+	One rigid body scene with its own OptiX context: bodies, camera, the physics ray collision
+	pass and the radiance render, without a window. Any number of instances can exist side by
+	side, each used from one thread at a time. Nothing is shared between them: an instance
+	only writes to the FrameCounters and Telemetry its options name.
+
+	Step() is the whole update: it integrates the bodies, traces the physics rays and applies
+	their responses. The parts are public too, for callers that schedule them on their own
+	(Render() can carry the physics rays along, see the GLUT front end in Scene.cpp).
+
+	Bodies are numbered in the order they are added, the GPU programs and CollisionResolver
+	index them by that id. Removing a body moves the last body into its id.
+*/
+class Simulation
+{
+public:
+	explicit Simulation(const SimulationOptions& options = SimulationOptions());
+	~Simulation();
+
+	// Bodies, returning the new body's id. Primitives of the same size and material share their
+	// geometry, meshes share one loaded copy per file unless shareMesh is false. hostBVH, if
+	// given, receives the mesh's tree for the CPU tracer
+	unsigned int AddSphere(float radius, const MaterialProperties& material, float3 position, float mass, bool isStatic = false);
+	unsigned int AddBox(float3 axisLengths, const MaterialProperties& material, float3 position, float mass, bool isStatic = false);
+	unsigned int AddMesh(const std::string& path, const MaterialProperties& material, float3 position, float mass, bool isStatic = false,
+						 bool shareMesh = true, std::shared_ptr<const WideBVH>* hostBVH = 0);
+	// Throws std::out_of_range for an id with no body
+	void RemoveBody(unsigned int id);
+
+	size_t GetBodyCount() const { return bodies.size(); }
+	RigidBody& GetBody(unsigned int id) { return bodies[id]; }
+
+	// Moves every body to a state stepped somewhere else, one per body in id order
+	void SetBodyStates(const std::vector<RigidBodyState>& states);
+
+	void SetCamera(float3 eye, float3 lookat, float3 up, float vfov = 60.0f);
+
+	// Integrates deltaTime, traces the physics rays and applies the responses. Returns the
+	// intersection volume found
+	float Step(float deltaTime);
+
+	// The parts of Step()
+	void StepBodies(float deltaTime);
+	void TracePhysics();
+	float ResolveCollisions();
+
+	// Launches the radiance render. With tracePhysics the physics rays ride along in the same
+	// launch and ResolveCollisions() can follow without TracePhysics()
+	void Render(bool tracePhysics = false);
+
+	// The last render as top down 8 bit RGB, width x height x 3 bytes
+	void ReadImage(unsigned char* rgb);
+	Buffer GetOutputBuffer() { return outputBuffer; }
+
+	// The physics rays' responses, physics buffer width x height of them
+	void ReadResponses(std::vector<IntersectionResponse>& responses);
+
+	// Impulse per unit of volume at the current step
+	float ResponseConstant() const;
+
+	// Contacts per pair of bodies from the responses ResolveCollisions() last applied
+	const std::vector<PairContact>& GetContacts();
+
+	// Render() launches count into the options' FrameCounters, on by default. Turn off when
+	// another thread counts its TracePhysics() launches
+	void SetRenderCounters(bool count) { renderCounters = count; }
+
+	// A GL output buffer keeps its pixel buffer's capacity and the response buffer only grows,
+	// so scaling down and back up doesn't reallocate
+	void SetRenderSize(uint32_t width, uint32_t height);
+	void SetPhysicsRayStep(uint32_t step);
+
+	uint32_t GetRenderWidth() const { return renderWidth; }
+	uint32_t GetRenderHeight() const { return renderHeight; }
+	uint32_t GetPhysicsRayStep() const { return physicsRayStep; }
+	uint32_t GetPhysicsBufferWidth() const { return physicsBufferWidth; }
+	uint32_t GetPhysicsBufferHeight() const { return physicsBufferHeight; }
+
+	// Shared geometry, materials and meshes created so far
+	const GeometryCreator& GetGeometryCreator() const { return *geometryCreator; }
+
+	Context GetContext() { return context; }
+
+private:
+	Simulation(const Simulation&);
+	Simulation& operator=(const Simulation&);
+
+	void CreateContext(const SimulationOptions& options);
+	void CreateLights();
+	unsigned int AddBody(GeometryInstance instance, float3 position, float mass, bool isStatic, Acceleration sharedAcceleration);
+	void ApplySizes();
+
+	// There are counters and they are enabled, which can change between launches
+	bool IsCounting() const;
+
+	// Tells the programs whether this launch counts
+	void SetCollectStats(bool collect);
+
+	// Clears the GPU counters before a launch that counts and adds them to the frame after it
+	void BeginCounters();
+	void EndCounters();
+
+	Context context;
+	FrameCounters* counters;
+	Telemetry* telemetry;
+	std::unique_ptr<GeometryCreator> geometryCreator;
+
+	std::vector<RigidBody> bodies;
+	Group group;
+	Acceleration acceleration;
+
+	Buffer outputBuffer;
+	void (*resizeGLBuffer)(Buffer buffer, unsigned width, unsigned height);
+	Buffer responseBuffer;
+	Buffer frameStats;
+	Buffer reflectionRayCount;
+
+	// Looked up once, a per frame lookup builds a std::string from the name and the longer names allocate
+	Variable frameNumberVariable;
+	Variable collectStatsVariable;
+	Variable physicsInRenderVariable;
+	Variable importanceCutoffVariable;
+
+	uint32_t renderWidth;
+	uint32_t renderHeight;
+	uint32_t physicsRayStep;
+	uint32_t basePhysicsRayStep;
+	uint32_t physicsBufferWidth;
+	uint32_t physicsBufferHeight;
+	bool physicsInRender;
+	bool renderCounters;
+	bool collectStats;		// Last value given to collectStatsVariable
+
+	// With a non zero budget the importance cutoff is raised while frames run out of
+	// reflection rays and lowered back after, see ReflectionControl.h
+	uint32_t reflectionRayBudget;
+	float reflectionCutoff;
+	unsigned int launchCount;
+
+	std::vector<IntersectionResponse> responses;
+	std::vector<PairContact> contacts;
+	std::unordered_map<uint64_t, size_t> contactPairs;
+	bool contactsCurrent;
+};
@@ -0,0 +1,229 @@
+// STL
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "Profiler.h"
+#include "StartupGraph.h"
+
+StartupGraph::StartupGraph() :
+	epoch(0),
+	remaining(0)
+{
+}
+
+StartupGraph::~StartupGraph()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			// Anything not started yet is dropped, running tasks finish
+			if (nodes[i].state == PENDING)
+			{
+				nodes[i].state = DONE;
+				remaining--;
+			}
+		}
+	}
+	changed.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void StartupGraph::Add(const std::string& name, Task task, const std::vector<std::string>& dependencies)
+{
+	Node node;
+	node.name = name;
+	node.task = task;
+	node.state = PENDING;
+	node.worker = 0;
+	node.start = 0;
+	node.end = 0;
+
+	// Unknown names count as done
+	for (size_t i = 0; i < dependencies.size(); i++)
+	{
+		const size_t dependency = Find(dependencies[i]);
+		if (dependency < nodes.size())
+			node.dependencies.push_back(dependency);
+	}
+
+	nodes.push_back(node);
+	remaining++;
+}
+
+void StartupGraph::Start(unsigned int threads)
+{
+	epoch = Profiler::Now();
+
+	threads = std::max(1u, std::min(threads, static_cast<unsigned int>(nodes.size())));
+	for (unsigned int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&StartupGraph::WorkerLoop, this, i));
+}
+
+void StartupGraph::Wait(const std::string& name)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	const size_t index = Find(name);
+	if (index == nodes.size())
+		return;
+
+	changed.wait(lock, [this, index]() { return nodes[index].state == DONE; });
+
+	if (nodes[index].error)
+		std::rethrow_exception(nodes[index].error);
+}
+
+void StartupGraph::WaitAll()
+{
+	for (size_t i = 0; i < nodes.size(); i++)
+		Wait(nodes[i].name);
+}
+
+void StartupGraph::RunInline(const std::string& name, Task task)
+{
+	const int64_t start = Profiler::Now();
+	task();
+	const int64_t end = Profiler::Now();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	TimelineEntry entry;
+	entry.name = name;
+	entry.worker = MAIN_THREAD;
+	entry.startMs = (start - epoch) * 1e-6;
+	entry.endMs = (end - epoch) * 1e-6;
+	inlineEntries.push_back(entry);
+
+	// The profiler stores the name by pointer, so it gets the stored entry's and not the caller's
+	if (Profiler::IsEnabled())
+		Profiler::Record(inlineEntries.back().name.c_str(), start, end);
+}
+
+void StartupGraph::WorkerLoop(unsigned int worker)
+{
+	std::ostringstream threadName;
+	threadName << "startup " << worker;
+	Profiler::SetThreadName(threadName.str().c_str());
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (remaining > 0)
+	{
+		const size_t index = NextReady();
+		if (index == nodes.size())
+		{
+			changed.wait(lock);
+			continue;
+		}
+
+		Node& node = nodes[index];
+		node.state = RUNNING;
+		node.worker = worker;
+
+		// A failed dependency fails everything after it without running
+		for (size_t i = 0; i < node.dependencies.size() && !node.error; i++)
+			node.error = nodes[node.dependencies[i]].error;
+
+		if (!node.error)
+		{
+			Task task = node.task;
+			lock.unlock();
+
+			const int64_t start = Profiler::Now();
+			std::exception_ptr error;
+			try
+			{
+				task();
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			const int64_t end = Profiler::Now();
+
+			if (Profiler::IsEnabled())
+				Profiler::Record(node.name.c_str(), start, end);
+
+			lock.lock();
+			node.start = start;
+			node.end = end;
+			node.error = error;
+		}
+
+		node.state = DONE;
+		remaining--;
+		changed.notify_all();
+	}
+}
+
+size_t StartupGraph::NextReady() const
+{
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].state != PENDING)
+			continue;
+
+		bool ready = true;
+		for (size_t j = 0; j < nodes[i].dependencies.size() && ready; j++)
+			ready = nodes[nodes[i].dependencies[j]].state == DONE;
+
+		if (ready)
+			return i;
+	}
+	return nodes.size();
+}
+
+size_t StartupGraph::Find(const std::string& name) const
+{
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].name == name)
+			return i;
+	}
+	return nodes.size();
+}
+
+std::vector<StartupGraph::TimelineEntry> StartupGraph::Timeline() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<TimelineEntry> timeline(inlineEntries.begin(), inlineEntries.end());
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].state != DONE || nodes[i].end == 0)
+			continue;
+
+		TimelineEntry entry;
+		entry.name = nodes[i].name;
+		entry.worker = nodes[i].worker;
+		entry.startMs = (nodes[i].start - epoch) * 1e-6;
+		entry.endMs = (nodes[i].end - epoch) * 1e-6;
+		timeline.push_back(entry);
+	}
+
+	std::sort(timeline.begin(), timeline.end(), [](const TimelineEntry& a, const TimelineEntry& b) { return a.startMs < b.startMs; });
+	return timeline;
+}
+
+void StartupGraph::PrintTimeline(std::ostream& out) const
+{
+	const std::vector<TimelineEntry> timeline = Timeline();
+
+	out << std::left << std::setw(24) << "Startup task" << std::right
+		<< std::setw(8) << "worker" << std::setw(12) << "start ms" << std::setw(12) << "end ms" << std::setw(12) << "took ms" << std::endl;
+
+	out << std::fixed << std::setprecision(2);
+	for (size_t i = 0; i < timeline.size(); i++)
+	{
+		const TimelineEntry& entry = timeline[i];
+		out << std::left << std::setw(24) << entry.name << std::right
+			<< std::setw(8) << (entry.worker == MAIN_THREAD ? std::string("main") : std::to_string(entry.worker))
+			<< std::setw(12) << entry.startMs
+			<< std::setw(12) << entry.endMs
+			<< std::setw(12) << entry.endMs - entry.startMs << std::endl;
+	}
+	out.unsetf(std::ios::fixed);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// STL
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+	Runs the host side startup work (PTX compilation, image decoding, mesh parsing) on worker
+	threads while the main thread sets up GLUT and the OptiX context.
+
+	Tasks are added with the names of the tasks they depend on, then Start() launches the
+	workers and the main thread calls Wait() right before it needs a result. Tasks must not
+	call into the OptiX context, it isn't safe to use from more than one thread.
+*/
+class StartupGraph
+{
+public:
+	typedef std::function<void()> Task;
+
+	static const unsigned int MAIN_THREAD = ~0u;
+
+	struct TimelineEntry
+	{
+		std::string name;
+		unsigned int worker;	// MAIN_THREAD for RunInline
+		double startMs;			// Since Start()
+		double endMs;
+	};
+
+	StartupGraph();
+	~StartupGraph();
+
+	// Must be called before Start()
+	void Add(const std::string& name, Task task, const std::vector<std::string>& dependencies = std::vector<std::string>());
+
+	void Start(unsigned int threads);
+
+	// Blocks until the task has run and rethrows anything it threw.
+	// Returns straight away for names that were never added
+	void Wait(const std::string& name);
+	void WaitAll();
+
+	// Runs on the calling thread and adds it to the timeline, for the main thread's own steps
+	void RunInline(const std::string& name, Task task);
+
+	std::vector<TimelineEntry> Timeline() const;
+	void PrintTimeline(std::ostream& out) const;
+
+private:
+	enum TaskState
+	{
+		PENDING,
+		RUNNING,
+		DONE
+	};
+
+	struct Node
+	{
+		std::string name;
+		Task task;
+		std::vector<size_t> dependencies;
+		TaskState state;
+		unsigned int worker;
+		int64_t start;
+		int64_t end;
+		std::exception_ptr error;
+	};
+
+	StartupGraph(const StartupGraph&);
+	StartupGraph& operator=(const StartupGraph&);
+
+	void WorkerLoop(unsigned int worker);
+
+	// Index of a pending task whose dependencies are done, or nodes.size(). Called with the lock held
+	size_t NextReady() const;
+	size_t Find(const std::string& name) const;
+
+	std::vector<Node> nodes;
+	std::deque<TimelineEntry> inlineEntries;	// Never moved, the profiler keeps pointers to their names
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable changed;
+	int64_t epoch;
+	size_t remaining;
+};
@@ -0,0 +1,176 @@
+// STL
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "Scene.h"
+#include "SweepRunner.h"
+
+std::vector<SweepConfig> SweepRunner::DefaultSweep(unsigned int frames)
+{
+	SweepConfig base;
+	base.frames = frames;
+	base.threads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<SweepConfig> configs;
+	configs.push_back(base);
+
+	const unsigned int bodies[] = { 16, 64, 1024, 4096 };
+	for (size_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); i++)
+	{
+		SweepConfig config = base;
+		config.bodies = bodies[i];
+		configs.push_back(config);
+	}
+
+	const unsigned int resolutions[][2] = { { 540, 360 }, { 1920, 1080 } };
+	for (size_t i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+	{
+		SweepConfig config = base;
+		config.width = resolutions[i][0];
+		config.height = resolutions[i][1];
+		configs.push_back(config);
+	}
+
+	const unsigned int steps[] = { 2, 4, 16 };
+	for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+	{
+		SweepConfig config = base;
+		config.physicsRayStep = steps[i];
+		configs.push_back(config);
+	}
+
+	for (unsigned int threads = 1; threads < base.threads * 2; threads *= 2)
+	{
+		if (threads == base.threads)
+			continue;
+
+		SweepConfig config = base;
+		config.threads = threads;
+		configs.push_back(config);
+	}
+
+	return configs;
+}
+
+std::vector<SweepConfig> SweepRunner::InstancingSweep(unsigned int frames, const std::string& mesh, unsigned int instances)
+{
+	SweepConfig shared;
+	shared.frames = frames;
+	shared.threads = std::max(1u, std::thread::hardware_concurrency());
+	shared.bodies = instances;
+	shared.mesh = mesh;
+
+	SweepConfig unique = shared;
+	unique.shareMeshes = false;
+
+	std::vector<SweepConfig> configs;
+	configs.push_back(shared);
+	configs.push_back(unique);
+	return configs;
+}
+
+bool SweepRunner::ParseConfig(const std::string& spec, SweepConfig& config)
+{
+	unsigned int bodies, width, height, step, threads;
+	if (sscanf(spec.c_str(), "%u,%ux%u,%u,%u", &bodies, &width, &height, &step, &threads) != 5)
+		return false;
+
+	if (width == 0 || height == 0 || step == 0)
+		return false;
+
+	config.bodies = bodies;
+	config.width = width;
+	config.height = height;
+	config.physicsRayStep = step;
+	config.threads = std::max(1u, threads);
+	return true;
+}
+
+void SweepRunner::WriteCsvHeader(std::ostream& out)
+{
+	out << "bodies,width,height,physics_ray_step,threads,frames,mesh,shared_meshes,"
+		<< "setup_ms,physics_ms,camera_ms,launch_ms,resolve_ms,cpu_trace_ms,"
+		<< "resident_mb,optix_host_mb,device_mb,mesh_loads,mesh_buffer_mb,"
+		<< "gpu_response_pixels,gpu_pairs,cpu_response_pixels,cpu_pairs" << std::endl;
+}
+
+void SweepRunner::WriteCsvRow(std::ostream& out, const SweepConfig& config, const SweepResult& result)
+{
+	const double mb = 1.0 / (1024.0 * 1024.0);
+	out << config.bodies << "," << config.width << "," << config.height << "," << config.physicsRayStep << ","
+		<< config.threads << "," << config.frames << "," << config.mesh << "," << (config.shareMeshes ? 1 : 0) << ","
+		<< result.setupMs << "," << result.physicsMs << "," << result.cameraMs << "," << result.launchMs << ","
+		<< result.resolveMs << "," << result.cpuTraceMs << ","
+		<< result.residentBytes * mb << "," << result.optixHostBytes * mb << "," << result.deviceBytes * mb << ","
+		<< result.meshLoads << "," << result.meshBufferBytes * mb << ","
+		<< result.gpuResponsePixels << "," << result.gpuPairs << "," << result.cpuResponsePixels << "," << result.cpuPairs
+		<< std::endl;
+}
+
+int SweepRunner::Run(const std::vector<SweepConfig>& configs, const std::string& path)
+{
+	bool newFile = true;
+	{
+		std::ifstream existing(path.c_str());
+		newFile = !existing.good() || existing.peek() == std::ifstream::traits_type::eof();
+	}
+
+	std::ofstream csv(path.c_str(), std::ios::app);
+	if (!csv.is_open())
+	{
+		std::cerr << "Could not open '" << path << "' for writing" << std::endl;
+		return 1;
+	}
+
+	if (newFile)
+		WriteCsvHeader(csv);
+
+	for (size_t i = 0; i < configs.size(); i++)
+	{
+		const SweepConfig& config = configs[i];
+		std::cerr << "Sweep " << i + 1 << "/" << configs.size() << ": " << config.bodies << " bodies, "
+				  << config.width << "x" << config.height << ", step " << config.physicsRayStep << ", "
+				  << config.threads << " threads";
+		if (!config.mesh.empty())
+			std::cerr << ", " << (config.shareMeshes ? "shared" : "unshared") << " '" << config.mesh << "'";
+		std::cerr << std::endl;
+
+		SweepResult result = Scene::Get().RunHeadless(config);
+		WriteCsvRow(csv, config, result);
+	}
+
+	return 0;
+}
+
+size_t SweepRunner::CurrentResidentBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	long pages = 0;
+	long resident = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (!statm)
+		return 0;
+	if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(statm);
+	return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// STL
+#include <iosfwd>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/*
+	Scalability sweep over procedurally generated scenes.
+
+	Each configuration builds a headless scene (see Scene::RunHeadless), runs a fixed
+	number of frames and reports the mean time of every stage, memory use and contact
+	counts as one CSV row. Configurations are run one per process with --sweep-config,
+	or all of DefaultSweep() in a loop with --sweep.
+*/
+struct SweepConfig
+{
+	unsigned int bodies = 256;
+	unsigned int width = 1080;
+	unsigned int height = 720;
+	unsigned int physicsRayStep = 8;
+	unsigned int threads = 1;		// Worker threads for the CPU physics ray pass
+	unsigned int frames = 120;
+	unsigned int seed = 494;
+	std::string mesh;				// Every body is an instance of this file instead of a sphere or box
+	bool shareMeshes = true;		// Load the mesh once for all bodies, or once per body
+};
+
+struct SweepResult
+{
+	// Mean milliseconds per frame unless noted
+	double setupMs = 0.0;			// Context and scene creation, once
+	double physicsMs = 0.0;
+	double cameraMs = 0.0;
+	double launchMs = 0.0;
+	double resolveMs = 0.0;
+	double cpuTraceMs = 0.0;
+
+	size_t residentBytes = 0;		// Process resident set after the last frame
+	size_t optixHostBytes = 0;		// Host memory OptiX reports for the context
+	size_t deviceBytes = 0;			// Device memory taken by the scene, on device 0
+	unsigned int meshLoads = 0;		// Mesh files parsed and uploaded
+	size_t meshBufferBytes = 0;		// Vertex and index buffers over every load
+
+	// Mean contacts per frame
+	double gpuResponsePixels = 0.0;
+	double gpuPairs = 0.0;
+	double cpuResponsePixels = 0.0;
+	double cpuPairs = 0.0;
+};
+
+class SweepRunner
+{
+public:
+	// Varies one parameter at a time around the default configuration
+	static std::vector<SweepConfig> DefaultSweep(unsigned int frames);
+
+	// The same number of mesh instances with and without sharing, for startup time and memory
+	static std::vector<SweepConfig> InstancingSweep(unsigned int frames, const std::string& mesh, unsigned int instances = 1000);
+
+	// Parses "<bodies>,<width>x<height>,<physicsRayStep>,<threads>"
+	static bool ParseConfig(const std::string& spec, SweepConfig& config);
+
+	static void WriteCsvHeader(std::ostream& out);
+	static void WriteCsvRow(std::ostream& out, const SweepConfig& config, const SweepResult& result);
+
+	// Runs every configuration and appends the rows to path, writing the header for a new file
+	static int Run(const std::vector<SweepConfig>& configs, const std::string& path);
+
+	static size_t CurrentResidentBytes();
+};
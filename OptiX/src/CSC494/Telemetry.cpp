@@ -0,0 +1,179 @@
+// STL
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ByteRing.h"
+#include "RigidBodyState.h"
+#include "Telemetry.h"
+
+static_assert(sizeof(TelemetryFrame) == 20, "TelemetryFrame is part of the log format");
+static_assert(sizeof(TelemetryContact) == 64, "TelemetryContact is part of the log format");
+static_assert(sizeof(TelemetryBody) == 56, "TelemetryBody is part of the log format");
+
+namespace
+{
+	// What the queue holds per frame, followed by the responses and the bodies
+	struct QueuedFrame
+	{
+		TelemetryFrame header;
+		uint32_t responseCount;
+	};
+
+	void WriteFrame(std::ofstream& log, const QueuedFrame& queued, std::vector<TelemetryContact>& contacts,
+					std::unordered_map<uint64_t, size_t>& pairs)
+	{
+		const IntersectionResponse* responses = reinterpret_cast<const IntersectionResponse*>(&queued + 1);
+		const TelemetryBody* bodies = reinterpret_cast<const TelemetryBody*>(responses + queued.responseCount);
+		CollisionResolver::ReduceContacts(responses, queued.responseCount, contacts, pairs);
+
+		TelemetryFrame header = queued.header;
+		header.contactCount = static_cast<uint32_t>(contacts.size());
+
+		const uint32_t type = TELEMETRY_FRAME;
+		const uint32_t length = static_cast<uint32_t>(sizeof(type) + sizeof(header) + contacts.size() * sizeof(TelemetryContact)
+													  + header.bodyCount * sizeof(TelemetryBody));
+		log.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		log.write(reinterpret_cast<const char*>(&type), sizeof(type));
+		log.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if (!contacts.empty())
+			log.write(reinterpret_cast<const char*>(contacts.data()), contacts.size() * sizeof(TelemetryContact));
+		log.write(reinterpret_cast<const char*>(bodies), header.bodyCount * sizeof(TelemetryBody));
+	}
+}
+
+Telemetry::Telemetry() :
+	enabled(false),
+	stopping(false),
+	dropped(0)
+{
+}
+
+Telemetry::~Telemetry()
+{
+	Shutdown();
+}
+
+void Telemetry::WriterLoop()
+{
+	std::vector<TelemetryContact> contacts;
+	std::unordered_map<uint64_t, size_t> pairs;
+
+	for (;;)
+	{
+		size_t bytes;
+		const void* message = queue->Front(bytes);
+		if (!message)
+		{
+			// Everything the producer queued before stopping is visible once stopping is
+			if (!stopping.load(std::memory_order_acquire))
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			message = queue->Front(bytes);
+			if (!message)
+				break;
+		}
+
+		WriteFrame(log, *static_cast<const QueuedFrame*>(message), contacts, pairs);
+		queue->Pop();
+	}
+
+	log.flush();
+}
+
+bool Telemetry::Open(const std::string& path, size_t queueBytes)
+{
+	log.open(path.c_str(), std::ios::out | std::ios::binary);
+	if (!log.is_open())
+	{
+		std::cerr << "Telemetry: could not open '" << path << "' for writing" << std::endl;
+		return false;
+	}
+
+	const uint32_t fileHeader[2] = { TELEMETRY_MAGIC, TELEMETRY_VERSION };
+	log.write(reinterpret_cast<const char*>(fileHeader), sizeof(fileHeader));
+
+	queue.reset(new ByteRing(queueBytes));
+	start = std::chrono::steady_clock::now();
+	stopping.store(false);
+	dropped = 0;
+	writer = std::thread(&Telemetry::WriterLoop, this);
+	enabled = true;
+	return true;
+}
+
+bool Telemetry::IsEnabled() const
+{
+	return enabled;
+}
+
+TelemetryBody* Telemetry::BeginFrame(unsigned int frame, const IntersectionResponse* responses, size_t responseCount,
+									 size_t bodyCount)
+{
+	const size_t bytes = sizeof(QueuedFrame) + responseCount * sizeof(IntersectionResponse) + bodyCount * sizeof(TelemetryBody);
+	QueuedFrame* queued = static_cast<QueuedFrame*>(queue->Reserve(bytes));
+	if (!queued)
+	{
+		dropped++;
+		return 0;
+	}
+
+	queued->header.frame = frame;
+	queued->header.time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	queued->header.contactCount = 0;
+	queued->header.bodyCount = static_cast<uint32_t>(bodyCount);
+	queued->header.droppedFrames = dropped;
+	queued->responseCount = static_cast<uint32_t>(responseCount);
+	dropped = 0;
+
+	IntersectionResponse* queuedResponses = reinterpret_cast<IntersectionResponse*>(queued + 1);
+	memcpy(queuedResponses, responses, responseCount * sizeof(IntersectionResponse));
+	return reinterpret_cast<TelemetryBody*>(queuedResponses + responseCount);
+}
+
+void Telemetry::CommitFrame()
+{
+	queue->Commit();
+}
+
+void Telemetry::SetBody(TelemetryBody& body, unsigned int id, const RigidBodyState& state)
+{
+	const optix::float3 position = state.GetPosition();
+	const optix::float4 quaternion = state.GetQuaternion();
+	const optix::float3 velocity = state.GetVelocity();
+	const optix::float3 spin = state.GetSpin();
+
+	body.id = id;
+	body.position[0] = position.x;
+	body.position[1] = position.y;
+	body.position[2] = position.z;
+	body.quaternion[0] = quaternion.x;
+	body.quaternion[1] = quaternion.y;
+	body.quaternion[2] = quaternion.z;
+	body.quaternion[3] = quaternion.w;
+	body.velocity[0] = velocity.x;
+	body.velocity[1] = velocity.y;
+	body.velocity[2] = velocity.z;
+	body.spin[0] = spin.x;
+	body.spin[1] = spin.y;
+	body.spin[2] = spin.z;
+}
+
+void Telemetry::Shutdown()
+{
+	if (!enabled)
+		return;
+
+	stopping.store(true, std::memory_order_release);
+	writer.join();
+	log.close();
+	queue.reset();
+	enabled = false;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// STL
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+#include "BufferStructs.h"
+#include "CollisionResolver.h"
+
+/*
+	Opt in binary log of every frame's contacts and body states.
+
+	The physics loop hands a frame over with BeginFrame() and CommitFrame(): the response grid
+	is copied into a lock free queue as it is and the body states are written straight into it,
+	nothing else happens on the calling thread. A writer thread reduces the responses to one
+	TelemetryContact per colliding pair and appends the frame to the log. Frames that find the
+	queue full are dropped and counted in the next frame that gets through.
+
+	The log starts with TELEMETRY_MAGIC and TELEMETRY_VERSION as two uint32s, followed by
+	records. Each record is a uint32 length of what follows it, a uint32 TelemetryRecordType
+	and the payload, little endian, so a reader can skip record types it doesn't know.
+	A TELEMETRY_FRAME payload is a TelemetryFrame, its contacts, then its bodies.
+*/
+const uint32_t TELEMETRY_MAGIC = 0x54435343;	// "CSCT"
+const uint32_t TELEMETRY_VERSION = 1;
+
+enum TelemetryRecordType
+{
+	TELEMETRY_FRAME = 1
+};
+
+struct TelemetryFrame
+{
+	uint32_t frame;
+	float time;					// Seconds since the log was opened
+	uint32_t contactCount;
+	uint32_t bodyCount;
+	uint32_t droppedFrames;		// Frames dropped since the previous record
+};
+
+// Contacts are logged as CollisionResolver::ReduceContacts sums them up
+typedef PairContact TelemetryContact;
+
+struct TelemetryBody
+{
+	uint32_t id;
+	float position[3];
+	float quaternion[4];			// Scalar first, as RigidBodyState keeps it
+	float velocity[3];
+	float spin[3];
+};
+
+class ByteRing;
+class RigidBodyState;
+
+/*
+	One log with its queue and writer thread. The queue takes a single producer, so each thread
+	that logs frames needs a Telemetry of its own. A Simulation logs into the one its options name.
+*/
+class Telemetry
+{
+public:
+	Telemetry();
+	~Telemetry();
+
+	// Starts the writer thread. queueBytes bounds the frames in flight
+	bool Open(const std::string& path, size_t queueBytes = 32u << 20);
+	bool IsEnabled() const;
+
+	// Queues the frame's responses and returns room for bodyCount body states, filled before
+	// CommitFrame(). Null if the queue is full, the frame is then dropped
+	TelemetryBody* BeginFrame(unsigned int frame, const IntersectionResponse* responses, size_t responseCount,
+							  size_t bodyCount);
+	void CommitFrame();
+
+	static void SetBody(TelemetryBody& body, unsigned int id, const RigidBodyState& state);
+
+	// Writes the queued frames and closes the log
+	void Shutdown();
+
+private:
+	Telemetry(const Telemetry&);
+	Telemetry& operator=(const Telemetry&);
+
+	void WriterLoop();
+
+	bool enabled;
+	std::unique_ptr<ByteRing> queue;
+	std::thread writer;
+	std::atomic<bool> stopping;
+	std::chrono::steady_clock::time_point start;
+	std::ofstream log;
+
+	// Producer only
+	uint32_t dropped;
+};
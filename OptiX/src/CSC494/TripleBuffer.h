@@ -0,0 +1,63 @@
+#pragma once
+
+// STL
+#include <atomic>
+
+/*
+	Hands the latest value from one thread to another without locks or waiting.
+
+	The producer fills Back() and publishes it, the consumer picks up the newest published
+	value with Update() and reads it through Front(). Values published in between are
+	skipped, so a slow consumer always sees the latest one and never holds the producer up.
+	The three slots keep their storage, vectors in T stop allocating once they are warm.
+*/
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() :
+		back(0),
+		middle(1),
+		front(2)
+	{
+	};
+
+	// Producer side
+	T& Back() { return slots[back]; }
+
+	void Publish()
+	{
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Consumer side. True if a value was published since the last call, Front() is then that value
+	bool Update()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	const T& Front() const { return slots[front]; }
+	T& Front() { return slots[front]; }
+
+	// Same value in every slot, before either side starts
+	void Fill(const T& value)
+	{
+		for (int i = 0; i < 3; i++)
+			slots[i] = value;
+	}
+
+private:
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer& operator=(const TripleBuffer&);
+
+	static const unsigned int INDEX = 3;
+	static const unsigned int FRESH = 4;
+
+	T slots[3];
+	unsigned int back;					// Producer only
+	std::atomic<unsigned int> middle;	// Slot index, with FRESH while it holds an unread value
+	unsigned int front;					// Consumer only
+};
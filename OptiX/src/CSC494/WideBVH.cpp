@@ -0,0 +1,683 @@
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <Mesh.h>
+#include <MeshBVH.h>
+
+#include "Profiler.h"
+#include "Simd8.h"
+#include "WideBVH.h"
+
+namespace
+{
+	// Binary subtrees this small become one leaf of a single block
+	const int32_t LEAF_TRIANGLES = 8;
+
+	// A leaf's block count is a byte
+	const size_t MAX_LEAF_BLOCKS = 255;
+
+	// The binary tree is at most 64 deep and every wide level pushes at most 7 children
+	const int STACK_SIZE = 64 * 8;
+
+	struct StackEntry
+	{
+		int32_t child;
+		int32_t blockCount;		// 0 for nodes
+		float t;				// Entry distance into the child's box
+	};
+
+	struct PacketEntry
+	{
+		int32_t child;
+		int32_t blockCount;
+		unsigned int rays;		// Rays of the packet that enter the child's box
+	};
+
+	// Boxes the packet only grazes to within rounding are still opened, so the interval test
+	// never drops a child one of its rays enters
+	const float PACKET_PADDING = 1.0f + 1.0e-5f;
+
+	float HalfArea(const float* lo, const float* hi)
+	{
+		const float dx = hi[0] - lo[0];
+		const float dy = hi[1] - lo[1];
+		const float dz = hi[2] - lo[2];
+		return dx * dy + dy * dz + dz * dx;
+	}
+
+	// Reciprocal that stays finite for axis aligned rays, so 0 * inverse is never NaN
+	float SafeInverse(float d)
+	{
+		const float tiny = 1e-20f;
+		return 1.0f / (fabsf(d) < tiny ? (d < 0.0f ? -tiny : tiny) : d);
+	}
+
+	// 2^exponent for a normal float exponent, without going through ldexpf
+	float PowerOfTwo(int exponent)
+	{
+		const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+		float result;
+		memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	IntersectionData MakeHit(const TriangleBlock& block, int lane, float t, unsigned int bodyId)
+	{
+		IntersectionData data;
+		data.rigidBodyId = bodyId;
+		data.t = t;
+		data.normal = normalize(make_float3(block.n[0][lane], block.n[1][lane], block.n[2][lane]));
+		return data;
+	}
+
+	int LowestBit(unsigned int bits)
+	{
+		int bit = 0;
+		while (!(bits & (1u << bit)))
+			bit++;
+		return bit;
+	}
+
+	// IntersectTriangle, eight triangles at a time. Returns the lanes hit in (tmin, tmax)
+	int IntersectBlock(const TriangleBlock& block, const Float8* O, const Float8* D, float tmin, float tmax, Float8& t)
+	{
+		const Float8 zero = Float8::Set(0.0f);
+		const Float8 one = Float8::Set(1.0f);
+
+		const Float8 nx = Float8::Load(block.n[0]), ny = Float8::Load(block.n[1]), nz = Float8::Load(block.n[2]);
+		const Float8 inv = one / (nx * D[0] + ny * D[1] + nz * D[2]);
+		const Float8 e2x = inv * (Float8::Load(block.p0[0]) - O[0]);
+		const Float8 e2y = inv * (Float8::Load(block.p0[1]) - O[1]);
+		const Float8 e2z = inv * (Float8::Load(block.p0[2]) - O[2]);
+		const Float8 ix = D[1] * e2z - D[2] * e2y;
+		const Float8 iy = D[2] * e2x - D[0] * e2z;
+		const Float8 iz = D[0] * e2y - D[1] * e2x;
+		const Float8 beta = ix * Float8::Load(block.e1[0]) + iy * Float8::Load(block.e1[1]) + iz * Float8::Load(block.e1[2]);
+		const Float8 gamma = ix * Float8::Load(block.e0[0]) + iy * Float8::Load(block.e0[1]) + iz * Float8::Load(block.e0[2]);
+		t = nx * e2x + ny * e2y + nz * e2z;
+
+		return ((t < Float8::Set(tmax)) & (t > Float8::Set(tmin)) & (beta >= zero) & (gamma >= zero) &
+				(beta + gamma <= one)).Bits();
+	}
+
+	struct ClosestHit
+	{
+		unsigned int bodyId;
+		IntersectionData* hit;
+		bool found;
+
+		void operator()(const TriangleBlock& block, int bits, const float* t, float& tmax)
+		{
+			for (int lane = 0; lane < 8; lane++)
+			{
+				if ((bits & (1 << lane)) && t[lane] < tmax)
+				{
+					tmax = t[lane];
+					*hit = MakeHit(block, lane, t[lane], bodyId);
+					found = true;
+				}
+			}
+		}
+	};
+
+	struct AllHits
+	{
+		unsigned int bodyId;
+		std::vector<IntersectionData>* hits;
+
+		void operator()(const TriangleBlock& block, int bits, const float* t, float&)
+		{
+			for (int lane = 0; lane < 8; lane++)
+			{
+				if (bits & (1 << lane))
+					hits->push_back(MakeHit(block, lane, t[lane], bodyId));
+			}
+		}
+	};
+}
+
+/*
+	Turns the binary tree into wide nodes top down. Each wide node starts from one
+	binary node and keeps opening its largest child until it has eight
+*/
+struct WideBVH::Collapse
+{
+	const Mesh& mesh;
+	const MeshBVH& bvh;
+	WideBVH& wide;
+	std::vector<int32_t> subtreeTriangles;
+
+	Collapse(const Mesh& mesh, const MeshBVH& bvh, WideBVH& wide) :
+		mesh(mesh),
+		bvh(bvh),
+		wide(wide)
+	{
+		// Children always come after their parent in the depth first array
+		const std::vector<MeshBVHNode>& nodes = bvh.nodes();
+		subtreeTriangles.resize(nodes.size());
+		for (size_t i = nodes.size(); i-- > 0;)
+		{
+			const MeshBVHNode& node = nodes[i];
+			subtreeTriangles[i] = node.isLeaf() ? node.count : subtreeTriangles[i + 1] + subtreeTriangles[node.offset];
+		}
+	}
+
+	bool IsLeaf(int32_t index) const
+	{
+		return bvh.nodes()[index].isLeaf() || subtreeTriangles[index] <= LEAF_TRIANGLES;
+	}
+
+	int32_t Node(int32_t binaryRoot)
+	{
+		const std::vector<MeshBVHNode>& nodes = bvh.nodes();
+
+		std::vector<int32_t> children(1, binaryRoot);
+		while (children.size() < 8)
+		{
+			int best = -1;
+			float bestArea = -1.0f;
+			for (size_t i = 0; i < children.size(); i++)
+			{
+				const MeshBVHNode& node = nodes[children[i]];
+				const float area = HalfArea(node.bbox_min, node.bbox_max);
+				if (!IsLeaf(children[i]) && area > bestArea)
+				{
+					best = static_cast<int>(i);
+					bestArea = area;
+				}
+			}
+			if (best < 0)
+				break;
+
+			const int32_t opened = children[best];
+			children[best] = opened + 1;
+			children.push_back(nodes[opened].offset);
+		}
+
+		const int32_t index = static_cast<int32_t>(wide.nodes.size());
+		wide.nodes.push_back(WideBVHNode());
+		SetFrame(index, nodes[binaryRoot].bbox_min, nodes[binaryRoot].bbox_max);
+		wide.nodes[index].childCount = static_cast<uint8_t>(children.size());
+
+		for (size_t i = 0; i < children.size(); i++)
+		{
+			const MeshBVHNode& child = nodes[children[i]];
+			SetChildBounds(index, static_cast<int>(i), child.bbox_min, child.bbox_max);
+
+			if (IsLeaf(children[i]))
+			{
+				std::vector<int32_t> triangles;
+				GatherTriangles(children[i], triangles);
+				SetLeaf(index, static_cast<int>(i), triangles.data(), triangles.size());
+			}
+			else
+			{
+				const int32_t childIndex = Node(children[i]);
+				wide.nodes[index].children[i] = childIndex;
+			}
+		}
+		return index;
+	}
+
+	void GatherTriangles(int32_t binaryRoot, std::vector<int32_t>& triangles) const
+	{
+		const std::vector<MeshBVHNode>& nodes = bvh.nodes();
+		std::vector<int32_t> stack(1, binaryRoot);
+		while (!stack.empty())
+		{
+			const MeshBVHNode& node = nodes[stack.back()];
+			const int32_t index = stack.back();
+			stack.pop_back();
+			if (node.isLeaf())
+			{
+				triangles.insert(triangles.end(), bvh.triangles().begin() + node.offset, bvh.triangles().begin() + node.offset + node.count);
+			}
+			else
+			{
+				stack.push_back(node.offset);
+				stack.push_back(index + 1);
+			}
+		}
+	}
+
+	void SetLeaf(int32_t index, int slot, const int32_t* triangles, size_t count)
+	{
+		const size_t blockCount = (count + 7) / 8;
+		if (blockCount > MAX_LEAF_BLOCKS)
+		{
+			// Only happens when the binary build hit its depth limit
+			const int32_t childIndex = LeafNode(triangles, count);
+			wide.nodes[index].children[slot] = childIndex;
+			return;
+		}
+
+		TriangleBlock empty;
+		memset(&empty, 0, sizeof(empty));
+		std::fill(empty.triangles, empty.triangles + 8, -1);
+
+		const size_t first = wide.blocks.size();
+		wide.blocks.resize(first + blockCount, empty);
+		for (size_t i = 0; i < count; i++)
+			SetTriangle(wide.blocks[first + i / 8], static_cast<int>(i % 8), triangles[i]);
+
+		wide.nodes[index].children[slot] = ~static_cast<int32_t>(first);
+		wide.nodes[index].blockCounts[slot] = static_cast<uint8_t>(blockCount);
+	}
+
+	// A node whose children split one oversized leaf into runs of triangles
+	int32_t LeafNode(const int32_t* triangles, size_t count)
+	{
+		const size_t run = MAX_LEAF_BLOCKS * 8;
+		const size_t slots = std::min<size_t>(8, (count + run - 1) / run);
+
+		float lo[3], hi[3];
+		TriangleBounds(triangles, count, lo, hi);
+
+		const int32_t index = static_cast<int32_t>(wide.nodes.size());
+		wide.nodes.push_back(WideBVHNode());
+		SetFrame(index, lo, hi);
+		wide.nodes[index].childCount = static_cast<uint8_t>(slots);
+
+		for (size_t i = 0; i < slots; i++)
+		{
+			// The last slot takes whatever is left, nesting again if it has to
+			const size_t begin = i * run;
+			const size_t size = i + 1 == slots ? count - begin : run;
+			TriangleBounds(triangles + begin, size, lo, hi);
+			SetChildBounds(index, static_cast<int>(i), lo, hi);
+			SetLeaf(index, static_cast<int>(i), triangles + begin, size);
+		}
+		return index;
+	}
+
+	void TriangleBounds(const int32_t* triangles, size_t count, float* lo, float* hi) const
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			lo[k] = std::numeric_limits<float>::max();
+			hi[k] = -std::numeric_limits<float>::max();
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				const float* p = mesh.positions + mesh.tri_indices[triangles[i] * 3 + j] * 3;
+				for (int k = 0; k < 3; k++)
+				{
+					lo[k] = std::min(lo[k], p[k]);
+					hi[k] = std::max(hi[k], p[k]);
+				}
+			}
+		}
+	}
+
+	void SetTriangle(TriangleBlock& block, int lane, int32_t triangle) const
+	{
+		const float* p0 = mesh.positions + mesh.tri_indices[triangle * 3 + 0] * 3;
+		const float* p1 = mesh.positions + mesh.tri_indices[triangle * 3 + 1] * 3;
+		const float* p2 = mesh.positions + mesh.tri_indices[triangle * 3 + 2] * 3;
+
+		const float3 e0 = make_float3(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+		const float3 e1 = make_float3(p0[0] - p2[0], p0[1] - p2[1], p0[2] - p2[2]);
+		const float3 n = cross(e1, e0);
+
+		for (int k = 0; k < 3; k++)
+		{
+			block.p0[k][lane] = p0[k];
+			block.e0[k][lane] = (&e0.x)[k];
+			block.e1[k][lane] = (&e1.x)[k];
+			block.n[k][lane] = (&n.x)[k];
+		}
+		block.triangles[lane] = triangle;
+	}
+
+	// Picks the smallest power of two per axis that spans the box in 255 steps
+	void SetFrame(int32_t index, const float* lo, const float* hi)
+	{
+		WideBVHNode& node = wide.nodes[index];
+		memset(&node, 0, sizeof(node));
+		for (int k = 0; k < 3; k++)
+		{
+			int exponent;
+			frexpf((hi[k] - lo[k]) / 255.0f, &exponent);
+			node.origin[k] = lo[k];
+			node.exponent[k] = static_cast<int8_t>(std::max(-126, std::min(127, exponent)));
+		}
+	}
+
+	// Rounds outwards, checking against the same arithmetic traversal does
+	void SetChildBounds(int32_t index, int slot, const float* lo, const float* hi)
+	{
+		WideBVHNode& node = wide.nodes[index];
+		for (int k = 0; k < 3; k++)
+		{
+			const float scale = PowerOfTwo(node.exponent[k]);
+			int lower = std::max(0, std::min(255, static_cast<int>(floorf((lo[k] - node.origin[k]) / scale))));
+			int upper = std::max(0, std::min(255, static_cast<int>(ceilf((hi[k] - node.origin[k]) / scale))));
+			while (lower > 0 && node.origin[k] + lower * scale > lo[k])
+				lower--;
+			while (upper < 255 && node.origin[k] + upper * scale < hi[k])
+				upper++;
+			node.lower[k][slot] = static_cast<uint8_t>(lower);
+			node.upper[k][slot] = static_cast<uint8_t>(upper);
+		}
+	}
+};
+
+WideBVH::WideBVH() :
+	triangleCount(0)
+{
+}
+
+void WideBVH::Build(const Mesh& mesh, const MeshBVH& bvh)
+{
+	PROFILE_SCOPE("BuildWideBVH");
+
+	nodes.clear();
+	blocks.clear();
+	triangleCount = bvh.triangles().size();
+	if (bvh.nodes().empty())
+		return;
+
+	Collapse collapse(mesh, bvh, *this);
+	collapse.Node(0);
+}
+
+void WideBVH::Build(const Mesh& mesh)
+{
+	MeshBVH bvh;
+	{
+		PROFILE_SCOPE("BuildMeshBVH");
+		bvh.build(mesh);
+	}
+	Build(mesh, bvh);
+}
+
+/*
+	Walks every child box the ray enters, nearest first, and hands each triangle block's
+	hit lanes to the visitor, which may pull tmax in
+*/
+template<typename Visitor>
+void WideBVH::Traverse(const float3& origin, const float3& direction, float tmin, float& tmax, Visitor& visitor) const
+{
+	if (nodes.empty())
+		return;
+
+	const float O[3] = { origin.x, origin.y, origin.z };
+	const float D[3] = { direction.x, direction.y, direction.z };
+	const float inverse[3] = { SafeInverse(D[0]), SafeInverse(D[1]), SafeInverse(D[2]) };
+
+	const Float8 O8[3] = { Float8::Set(O[0]), Float8::Set(O[1]), Float8::Set(O[2]) };
+	const Float8 D8[3] = { Float8::Set(D[0]), Float8::Set(D[1]), Float8::Set(D[2]) };
+
+	StackEntry stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize].child = 0;
+	stack[stackSize].blockCount = 0;
+	stack[stackSize].t = tmin;
+	stackSize++;
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.t > tmax)
+			continue;
+
+		if (entry.blockCount == 0)
+		{
+			const WideBVHNode& node = nodes[entry.child];
+
+			// t = (origin + q * scale - O) / D, as q * a + b per axis
+			Float8 tNear = Float8::Set(tmin);
+			Float8 tFar = Float8::Set(tmax);
+			for (int k = 0; k < 3; k++)
+			{
+				const Float8 a = Float8::Set(PowerOfTwo(node.exponent[k]) * inverse[k]);
+				const Float8 b = Float8::Set((node.origin[k] - O[k]) * inverse[k]);
+				const Float8 tLower = Float8::LoadBytes(node.lower[k]) * a + b;
+				const Float8 tUpper = Float8::LoadBytes(node.upper[k]) * a + b;
+				const bool negative = inverse[k] < 0.0f;
+				tNear = Max(tNear, negative ? tUpper : tLower);
+				tFar = Min(tFar, negative ? tLower : tUpper);
+			}
+
+			int bits = (tNear <= tFar).Bits() & ((1 << node.childCount) - 1);
+			if (!bits)
+				continue;
+
+			float t[8];
+			tNear.Store(t);
+
+			// Push farthest first so the nearest child is popped next
+			StackEntry hits[8];
+			int hitCount = 0;
+			for (; bits; bits &= bits - 1)
+			{
+				const int lane = LowestBit(bits);
+
+				StackEntry child;
+				child.child = node.children[lane];
+				child.blockCount = node.children[lane] < 0 ? node.blockCounts[lane] : 0;
+				child.t = t[lane];
+
+				int i = hitCount++;
+				for (; i > 0 && hits[i - 1].t < child.t; i--)
+					hits[i] = hits[i - 1];
+				hits[i] = child;
+			}
+			for (int i = 0; i < hitCount; i++)
+				stack[stackSize++] = hits[i];
+			continue;
+		}
+
+		const int32_t first = ~entry.child;
+		for (int32_t b = first; b < first + entry.blockCount; b++)
+		{
+			const TriangleBlock& block = blocks[b];
+
+			Float8 t;
+			const int bits = IntersectBlock(block, O8, D8, tmin, tmax, t);
+			if (bits)
+			{
+				float tValues[8];
+				t.Store(tValues);
+				visitor(block, bits, tValues, tmax);
+			}
+		}
+	}
+}
+
+bool WideBVH::Intersect(const float3& origin, const float3& direction, float tmin, float tmax, unsigned int bodyId,
+						IntersectionData& hit) const
+{
+	ClosestHit visitor = { bodyId, &hit, false };
+	Traverse(origin, direction, tmin, tmax, visitor);
+	return visitor.found;
+}
+
+void WideBVH::GatherIntersections(const float3& origin, const float3& direction, float tmin, float tmax, unsigned int bodyId,
+								  std::vector<IntersectionData>& hits) const
+{
+	AllHits visitor = { bodyId, &hits };
+	Traverse(origin, direction, tmin, tmax, visitor);
+}
+
+/*
+	Each node's child boxes are first tested against the packet as a whole: with one origin and
+	direction signs shared, the interval of inverse directions bounds every ray's slab distances.
+	Only children that pass are tested ray by ray, with the same arithmetic as Traverse
+*/
+unsigned int WideBVH::GatherPacketIntersections(const RayPacket& packet, float tmin, float tmax, unsigned int bodyId,
+												std::vector<IntersectionData>* hits) const
+{
+	if (nodes.empty() || !packet.active)
+		return 0;
+
+	const int reference = LowestBit(packet.active);
+	bool negative[3];
+	float inverseMin[3];
+	float inverseMax[3];
+	for (int k = 0; k < 3; k++)
+	{
+		negative[k] = SafeInverse(packet.directions[k][reference]) < 0.0f;
+		inverseMin[k] = std::numeric_limits<float>::max();
+		inverseMax[k] = -std::numeric_limits<float>::max();
+	}
+
+	float inverse[3][RayPacket::SIZE];
+	unsigned int coherent = 0;
+	for (int ray = 0; ray < RayPacket::SIZE; ray++)
+	{
+		bool same = (packet.active & (1u << ray)) != 0;
+		for (int k = 0; k < 3 && same; k++)
+		{
+			inverse[k][ray] = SafeInverse(packet.directions[k][ray]);
+			same = (inverse[k][ray] < 0.0f) == negative[k];
+		}
+
+		if (!same)
+			continue;
+
+		coherent |= 1u << ray;
+		for (int k = 0; k < 3; k++)
+		{
+			inverseMin[k] = std::min(inverseMin[k], inverse[k][ray]);
+			inverseMax[k] = std::max(inverseMax[k], inverse[k][ray]);
+		}
+	}
+
+	// A single coherent ray gains nothing from the packet walk
+	if (!(coherent & (coherent - 1)))
+		return packet.active;
+
+	// Lanes left out still go through the arithmetic, keep them finite
+	for (int ray = 0; ray < RayPacket::SIZE; ray++)
+	{
+		if (!(coherent & (1u << ray)))
+		{
+			for (int k = 0; k < 3; k++)
+				inverse[k][ray] = inverse[k][reference];
+		}
+	}
+
+	const float O[3] = { packet.origin.x, packet.origin.y, packet.origin.z };
+	const Float8 O8[3] = { Float8::Set(O[0]), Float8::Set(O[1]), Float8::Set(O[2]) };
+
+	PacketEntry stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize].child = 0;
+	stack[stackSize].blockCount = 0;
+	stack[stackSize].rays = coherent;
+	stackSize++;
+
+	while (stackSize > 0)
+	{
+		const PacketEntry entry = stack[--stackSize];
+
+		if (entry.blockCount == 0)
+		{
+			const WideBVHNode& node = nodes[entry.child];
+
+			// Box planes relative to the origin, scaled by whichever end of the inverse
+			// direction interval gives the earliest entry and the latest exit
+			Float8 entryT = Float8::Set(tmin);
+			Float8 exitT = Float8::Set(tmax);
+			for (int k = 0; k < 3; k++)
+			{
+				const Float8 scale = Float8::Set(PowerOfTwo(node.exponent[k]));
+				const Float8 offset = Float8::Set(node.origin[k] - O[k]);
+				const Float8 lower = Float8::LoadBytes(node.lower[k]) * scale + offset;
+				const Float8 upper = Float8::LoadBytes(node.upper[k]) * scale + offset;
+				const Float8 nearPlane = negative[k] ? upper : lower;
+				const Float8 farPlane = negative[k] ? lower : upper;
+				const Float8 lo = Float8::Set(inverseMin[k]);
+				const Float8 hi = Float8::Set(inverseMax[k]);
+				entryT = Max(entryT, Min(nearPlane * lo, nearPlane * hi));
+				exitT = Min(exitT, Max(farPlane * lo, farPlane * hi));
+			}
+
+			int children = (entryT <= exitT * Float8::Set(PACKET_PADDING)).Bits() & ((1 << node.childCount) - 1);
+			if (!children)
+				continue;
+
+			// t = q * a + b per ray, eight rays at a time
+			Float8 a[2][3];
+			Float8 b[2][3];
+			for (int half = 0; half < 2; half++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					const Float8 inv = Float8::Load(inverse[k] + 8 * half);
+					a[half][k] = Float8::Set(PowerOfTwo(node.exponent[k])) * inv;
+					b[half][k] = Float8::Set(node.origin[k] - O[k]) * inv;
+				}
+			}
+
+			for (; children; children &= children - 1)
+			{
+				const int lane = LowestBit(children);
+
+				unsigned int rays = 0;
+				for (int half = 0; half < 2; half++)
+				{
+					if (!((entry.rays >> (8 * half)) & 0xff))
+						continue;
+
+					Float8 tNear = Float8::Set(tmin);
+					Float8 tFar = Float8::Set(tmax);
+					for (int k = 0; k < 3; k++)
+					{
+						const Float8 tLower = Float8::Set(node.lower[k][lane]) * a[half][k] + b[half][k];
+						const Float8 tUpper = Float8::Set(node.upper[k][lane]) * a[half][k] + b[half][k];
+						tNear = Max(tNear, negative[k] ? tUpper : tLower);
+						tFar = Min(tFar, negative[k] ? tLower : tUpper);
+					}
+					rays |= static_cast<unsigned int>((tNear <= tFar).Bits()) << (8 * half);
+				}
+
+				rays &= entry.rays;
+				if (!rays)
+					continue;
+
+				PacketEntry child;
+				child.child = node.children[lane];
+				child.blockCount = node.children[lane] < 0 ? node.blockCounts[lane] : 0;
+				child.rays = rays;
+				stack[stackSize++] = child;
+			}
+			continue;
+		}
+
+		const int32_t first = ~entry.child;
+		for (unsigned int rays = entry.rays; rays; rays &= rays - 1)
+		{
+			const int ray = LowestBit(rays);
+			const Float8 D8[3] =
+			{
+				Float8::Set(packet.directions[0][ray]),
+				Float8::Set(packet.directions[1][ray]),
+				Float8::Set(packet.directions[2][ray])
+			};
+
+			AllHits visitor = { bodyId, &hits[ray] };
+			for (int32_t b = first; b < first + entry.blockCount; b++)
+			{
+				const TriangleBlock& block = blocks[b];
+
+				Float8 t;
+				const int bits = IntersectBlock(block, O8, D8, tmin, tmax, t);
+				if (bits)
+				{
+					float tValues[8];
+					t.Store(tValues);
+					visitor(block, bits, tValues, tmax);
+				}
+			}
+		}
+	}
+
+	return packet.active & ~coherent;
+}
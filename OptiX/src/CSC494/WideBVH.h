@@ -0,0 +1,102 @@
+#pragma once
+
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+
+// STL
+#include <stdint.h>
+#include <vector>
+
+#include "BufferStructs.h"
+
+struct Mesh;
+class MeshBVH;
+
+using namespace optix;
+
+/*
+	Eight children per node, for the CPU tracer's mesh bodies.
+
+	Child bounds are stored as bytes relative to the node's box, scaled by a power of two
+	per axis and rounded outwards, so a node and all its child boxes fit in two cache lines.
+	A child is either another node or a run of triangle blocks.
+*/
+struct WideBVHNode
+{
+	float origin[3];			// Lower corner of the node's box
+	int8_t exponent[3];			// Child bound units are 2^exponent on each axis
+	uint8_t childCount;
+	uint8_t lower[3][8];		// Per axis, per child
+	uint8_t upper[3][8];
+	int32_t children[8];		// Node index, or ~first block for leaves
+	uint8_t blockCounts[8];		// Triangle blocks in a leaf child
+};
+
+/*
+	Eight triangles in structure of arrays form, laid out for IntersectTriangle in
+	IntersectionKernels.h: p0, e0 = p1 - p0, e1 = p0 - p2 and n = cross(e1, e0).
+	Unused lanes have a zero normal and never hit
+*/
+struct TriangleBlock
+{
+	float p0[3][8];
+	float e0[3][8];
+	float e1[3][8];
+	float n[3][8];
+	int32_t triangles[8];		// Index into the mesh, -1 for unused lanes
+};
+
+/*
+	Up to sixteen rays leaving one point, the way a 4x4 tile of physics rays leaves the camera.
+	Directions are stored per axis so eight of them load at once
+*/
+struct RayPacket
+{
+	static const int SIZE = 16;
+
+	float3 origin;
+	float directions[3][SIZE];
+	unsigned int active;		// Bit i set if ray i is traced
+};
+
+class WideBVH
+{
+public:
+	WideBVH();
+
+	// Collapses a binary BVH of the mesh, the mesh isn't needed after this
+	void Build(const Mesh& mesh, const MeshBVH& bvh);
+
+	// Builds the binary BVH first, with the default options
+	void Build(const Mesh& mesh);
+
+	// Closest hit in (tmin, tmax), reported the way triangle_mesh.cu does with
+	// the object space geometric normal
+	bool Intersect(const float3& origin, const float3& direction, float tmin, float tmax, unsigned int bodyId,
+				   IntersectionData& hit) const;
+
+	// Appends every hit in (tmin, tmax) in no particular order
+	void GatherIntersections(const float3& origin, const float3& direction, float tmin, float tmax, unsigned int bodyId,
+							 std::vector<IntersectionData>& hits) const;
+
+	// Appends every hit in (tmin, tmax) of each active ray to hits[ray], walking the tree once
+	// for the packet and skipping children the whole packet misses. Rays that don't share
+	// direction signs with the rest can't be bounded together, they are left alone and
+	// returned as a mask for the caller to trace one at a time
+	unsigned int GatherPacketIntersections(const RayPacket& packet, float tmin, float tmax, unsigned int bodyId,
+										   std::vector<IntersectionData>* hits) const;
+
+	size_t GetNodeCount() const { return nodes.size(); }
+	size_t GetBlockCount() const { return blocks.size(); }
+	size_t GetTriangleCount() const { return triangleCount; }
+
+private:
+	struct Collapse;
+
+	template<typename Visitor>
+	void Traverse(const float3& origin, const float3& direction, float tmin, float& tmax, Visitor& visitor) const;
+
+	std::vector<WideBVHNode> nodes;
+	std::vector<TriangleBlock> blocks;
+	size_t triangleCount;
+};
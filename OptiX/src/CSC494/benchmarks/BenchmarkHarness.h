@@ -0,0 +1,109 @@
+#pragma once
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+	Minimal timing harness for the host micro benchmarks.
+
+	Each benchmark body runs a fixed batch of operations. The batch is repeated until
+	a minimum time has elapsed, several trials are taken and the median is reported,
+	so a single noisy trial does not show up as a regression.
+*/
+struct BenchmarkResult
+{
+	std::string name;
+	std::string unit;		// What one operation is, ie "rays"
+	double nsPerOp;
+	double opsPerSecond;
+};
+
+class BenchmarkHarness
+{
+public:
+	BenchmarkHarness(double minSecondsPerTrial = 0.1, int trials = 5) :
+		minSecondsPerTrial(minSecondsPerTrial),
+		trials(trials)
+	{
+	};
+
+	// Only run benchmarks whose name contains filter
+	void SetFilter(const std::string& filter) { this->filter = filter; }
+
+	// body() performs opsPerBatch operations and returns something derived from them,
+	// which is accumulated into a sink so the work cannot be optimized away
+	template<typename Body>
+	void Run(const std::string& name, const std::string& unit, size_t opsPerBatch, Body body)
+	{
+		if (!filter.empty() && name.find(filter) == std::string::npos)
+			return;
+
+		// Warm up caches and the branch predictor
+		sink = sink + body();
+
+		std::vector<double> trialNsPerOp;
+		for (int trial = 0; trial < trials; trial++)
+		{
+			size_t batches = 0;
+			double elapsed = 0.0;
+			const auto start = std::chrono::steady_clock::now();
+			while (elapsed < minSecondsPerTrial)
+			{
+				sink = sink + body();
+				batches++;
+				elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			trialNsPerOp.push_back(elapsed * 1.0e9 / (double(batches) * opsPerBatch));
+		}
+
+		std::sort(trialNsPerOp.begin(), trialNsPerOp.end());
+		BenchmarkResult result;
+		result.name = name;
+		result.unit = unit;
+		result.nsPerOp = trialNsPerOp[trialNsPerOp.size() / 2];
+		result.opsPerSecond = 1.0e9 / result.nsPerOp;
+		results.push_back(result);
+	}
+
+	void PrintTable(std::ostream& out) const
+	{
+		out << std::left << std::setw(32) << "Benchmark" << std::right
+			<< std::setw(14) << "ns/op"
+			<< std::setw(18) << "ops/s" << "  unit" << std::endl;
+		out << std::fixed;
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const BenchmarkResult& r = results[i];
+			out << std::left << std::setw(32) << r.name << std::right
+				<< std::setw(14) << std::setprecision(2) << r.nsPerOp
+				<< std::setw(18) << std::setprecision(0) << r.opsPerSecond
+				<< "  " << r.unit << std::endl;
+		}
+		out.unsetf(std::ios::fixed);
+	}
+
+	void PrintCsv(std::ostream& out) const
+	{
+		out << "name,unit,ns_per_op,ops_per_second" << std::endl;
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const BenchmarkResult& r = results[i];
+			out << r.name << "," << r.unit << "," << r.nsPerOp << "," << r.opsPerSecond << std::endl;
+		}
+	}
+
+	// Read back so the accumulated results have an observable use
+	double Sink() const { return sink; }
+
+private:
+	double minSecondsPerTrial;
+	int trials;
+	std::string filter;
+	std::vector<BenchmarkResult> results;
+	volatile double sink = 0.0;
+};
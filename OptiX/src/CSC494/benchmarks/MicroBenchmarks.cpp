@@ -0,0 +1,490 @@
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// User created headers
+#include <FrameMemory.h>
+#include <ImageWriter.h>
+#include "AllocationCounter.h"
+#include "BenchmarkHarness.h"
+#include "BufferStructs.h"
+#include "CollisionResolver.h"
+#include "HostTracer.h"
+#include "IntersectionKernels.h"
+#include "MathHelpers.h"
+#include "RigidBodyState.h"
+
+using namespace optix;
+
+/*
+	Host micro benchmarks for the intersection kernels, the CPU tracer and the physics primitives.
+	All inputs come from fixed seeds so numbers are comparable between releases.
+*/
+
+namespace
+{
+	const unsigned int SEED = 494;
+	const size_t RAY_COUNT = 4096;
+
+	// Physics buffer size of the default 1080x720 window with a ray step of 8
+	const int RESPONSE_GRID_WIDTH = 1080 / 8;
+	const int RESPONSE_GRID_HEIGHT = 720 / 8;
+	const int SCENE_BODIES = 7;
+
+	// The scalability sweep's default configuration, see SweepConfig
+	const unsigned int SWEEP_BODIES = 256;
+	const unsigned int SWEEP_WIDTH = 1080;
+	const unsigned int SWEEP_HEIGHT = 720;
+	const unsigned int SWEEP_RAY_STEP = 8;
+
+	struct Ray
+	{
+		float3 origin;
+		float3 direction;
+	};
+
+	float3 RandomFloat3(std::mt19937& rng, float lo, float hi)
+	{
+		std::uniform_real_distribution<float> dist(lo, hi);
+		float x = dist(rng);
+		float y = dist(rng);
+		float z = dist(rng);
+		return make_float3(x, y, z);
+	}
+
+	float3 RandomDirection(std::mt19937& rng)
+	{
+		float3 d;
+		do
+		{
+			d = RandomFloat3(rng, -1.0f, 1.0f);
+		} while (dot(d, d) < 1.0e-4f || dot(d, d) > 1.0f);
+		return normalize(d);
+	}
+
+	// Rays starting on a shell around the origin aimed near the center, so roughly
+	// half of them hit an object of the given size
+	std::vector<Ray> MakeRays(std::mt19937& rng, float shellRadius, float targetSpread)
+	{
+		std::vector<Ray> rays(RAY_COUNT);
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			rays[i].origin = RandomDirection(rng) * shellRadius;
+			float3 target = RandomFloat3(rng, -targetSpread, targetSpread);
+			rays[i].direction = normalize(target - rays[i].origin);
+		}
+		return rays;
+	}
+
+	// A sorted list of entry/exit hits along one physics ray, as closest_hit_radiance would record it
+	std::vector<IntersectionData> MakeIntersectionList(std::mt19937& rng)
+	{
+		std::uniform_int_distribution<int> bodyCount(2, 4);
+		std::uniform_real_distribution<float> start(1.0f, 20.0f);
+		std::uniform_real_distribution<float> length(0.5f, 6.0f);
+
+		std::vector<IntersectionData> list;
+		const int bodies = bodyCount(rng);
+		for (int body = 0; body < bodies; body++)
+		{
+			IntersectionData entry;
+			entry.rigidBodyId = body;
+			entry.t = start(rng);
+			entry.normal = RandomDirection(rng);
+
+			IntersectionData exit = entry;
+			exit.t = entry.t + length(rng);
+			exit.normal = RandomDirection(rng);
+
+			list.push_back(entry);
+			list.push_back(exit);
+		}
+
+		std::sort(list.begin(), list.end(), [](const IntersectionData& a, const IntersectionData& b) { return a.t < b.t; });
+		return list;
+	}
+
+	std::vector<IntersectionResponse> MakeResponseGrid(std::mt19937& rng, float hitFraction)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_int_distribution<int> body(0, SCENE_BODIES - 1);
+
+		std::vector<IntersectionResponse> grid(RESPONSE_GRID_WIDTH * RESPONSE_GRID_HEIGHT, EmptyResponse());
+		for (size_t i = 0; i < grid.size(); i++)
+		{
+			if (unit(rng) >= hitFraction)
+				continue;
+
+			IntersectionResponse& response = grid[i];
+			response.volume = unit(rng) * 0.01f + 0.0001f;
+			response.entryId = body(rng);
+			response.exitId = body(rng);
+			response.collisionId = body(rng);
+			response.entryNormal = RandomDirection(rng);
+			response.exitNormal = RandomDirection(rng);
+			response.entryPoint = RandomFloat3(rng, -10.0f, 10.0f);
+			response.exitPoint = RandomFloat3(rng, -10.0f, 10.0f);
+		}
+		return grid;
+	}
+
+	std::vector<RigidBodyState> MakeBodies(std::mt19937& rng, int count)
+	{
+		std::vector<RigidBodyState> bodies;
+		for (int i = 0; i < count; i++)
+		{
+			RigidBodyState body(RandomFloat3(rng, -20.0f, 20.0f), 1.0f + i % 4, false, true);
+			body.AddForce(RandomFloat3(rng, -100.0f, 100.0f));
+			body.AddTorque(RandomFloat3(rng, -1.0f, 1.0f));
+			bodies.push_back(body);
+		}
+		return bodies;
+	}
+
+	// Same layout as Scene::CreateProceduralScene, spheres and boxes in a cube that grows with the count
+	std::vector<HostBody> MakeProceduralScene(std::mt19937& rng, unsigned int count, float& extent)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		extent = 6.0f * cbrtf(static_cast<float>(count));
+		std::uniform_real_distribution<float> spread(-0.5f * extent, 0.5f * extent);
+
+		std::vector<HostBody> bodies;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const float3 position = make_float3(spread(rng), spread(rng), spread(rng));
+			if (unit(rng) < 0.5f)
+				bodies.push_back(HostBody::Sphere(i, 0.5f + 0.25f * static_cast<int>(unit(rng) * 6.0f), position, Matrix3x3::identity()));
+			else
+				bodies.push_back(HostBody::Box(i, make_float3(1.0f + static_cast<int>(unit(rng) * 3.0f)), position, Matrix3x3::identity()));
+		}
+		return bodies;
+	}
+
+	void PrintUsageAndExit(const std::string& argv0)
+	{
+		std::cerr << "\nUsage: " << argv0 << " [options]\n";
+		std::cerr <<
+			"Options:\n"
+			"  -h | --help         Print this usage message and exit.\n"
+			"  -f | --filter       Only run benchmarks whose name contains the given string.\n"
+			"  -t | --time         Minimum seconds per trial (default 0.1).\n"
+			"  -c | --csv          Print results as CSV.\n"
+			<< std::endl;
+
+		exit(1);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	double minTime = 0.1;
+	bool csv = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+
+		if (arg == "-h" || arg == "--help")
+		{
+			PrintUsageAndExit(argv[0]);
+		}
+		else if ((arg == "-f" || arg == "--filter") && i + 1 < argc)
+		{
+			filter = argv[++i];
+		}
+		else if ((arg == "-t" || arg == "--time") && i + 1 < argc)
+		{
+			minTime = atof(argv[++i]);
+		}
+		else if (arg == "-c" || arg == "--csv")
+		{
+			csv = true;
+		}
+		else
+		{
+			std::cerr << "Unknown option '" << arg << "'\n";
+			PrintUsageAndExit(argv[0]);
+		}
+	}
+
+	BenchmarkHarness harness(minTime);
+	harness.SetFilter(filter);
+	std::mt19937 rng(SEED);
+
+	// Intersection kernels
+	{
+		const std::vector<Ray> rays = MakeRays(rng, 30.0f, 4.0f);
+		harness.Run("IntersectSphere", "rays", rays.size(), [&rays]()
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				float t1, t2;
+				if (IntersectSphere(rays[i].origin, rays[i].direction, 3.0f, false, t1, t2))
+					sum += t1 + t2;
+			}
+			return sum;
+		});
+
+		harness.Run("IntersectSphereRobust", "rays", rays.size(), [&rays]()
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				float t1, t2;
+				if (IntersectSphere(rays[i].origin, rays[i].direction, 3.0f, true, t1, t2))
+					sum += t1 + t2;
+			}
+			return sum;
+		});
+
+		harness.Run("IntersectBox", "rays", rays.size(), [&rays]()
+		{
+			const float3 axisLengths = make_float3(3.0f, 3.0f, 3.0f);
+			float sum = 0.0f;
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				float3 t0, t1;
+				float tmin, tmax;
+				if (IntersectBox(axisLengths, rays[i].origin, rays[i].direction, t0, t1, tmin, tmax))
+					sum += BoxNormal(tmin > 0 ? tmin : tmax, t0, t1).x + tmin;
+			}
+			return sum;
+		});
+	}
+
+	{
+		const std::vector<Ray> rays = MakeRays(rng, 30.0f, 1.0f);
+		std::vector<float3> vertices(RAY_COUNT * 3);
+		for (size_t i = 0; i < vertices.size(); i++)
+			vertices[i] = RandomFloat3(rng, -3.0f, 3.0f);
+
+		harness.Run("IntersectTriangle", "rays", rays.size(), [&rays, &vertices]()
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				float3 n;
+				float t, beta, gamma;
+				if (IntersectTriangle(rays[i].origin, rays[i].direction, 0.0f, 1.0e30f,
+									  vertices[3 * i], vertices[3 * i + 1], vertices[3 * i + 2], n, t, beta, gamma))
+					sum += t;
+			}
+			return sum;
+		});
+	}
+
+	// Per physics ray volume computation
+	{
+		const size_t LIST_COUNT = 1024;
+		std::vector<std::vector<IntersectionData>> lists;
+		for (size_t i = 0; i < LIST_COUNT; i++)
+			lists.push_back(MakeIntersectionList(rng));
+
+		const float theta = 1.047f / 1080.0f;
+		const float phi = 90.0f - theta;
+		const float3 eye = make_float3(-21.0f, 27.6f, 18.0f);
+		const float3 direction = normalize(make_float3(0.0f, 4.0f, 0.0f) - eye);
+
+		harness.Run("FindLargestOverlap", "rays", lists.size(), [&]()
+		{
+			float sum = 0.0f;
+			int pairsFound = 0;
+			for (size_t i = 0; i < lists.size(); i++)
+			{
+				IntersectionResponse response = FindLargestOverlap(lists[i].data(), static_cast<int>(lists[i].size()), theta, phi, eye, direction, pairsFound);
+				sum += response.volume;
+			}
+			return sum + pairsFound;
+		});
+	}
+
+	// CPU physics ray pass over the sweep's default scene, one ray at a time and in packets
+	{
+		float extent;
+		const std::vector<HostBody> bodies = MakeProceduralScene(rng, SWEEP_BODIES, extent);
+		const float3 eye = normalize(make_float3(-7.0f, 9.2f, 6.0f)) * extent * 1.5f;
+		const HostCamera camera = HostCamera::LookAt(eye, make_float3(0.0f), make_float3(0.0f, 1.0f, 0.0f), 60.0f, SWEEP_WIDTH, SWEEP_HEIGHT);
+
+		const bool packets[] = { false, true };
+		for (size_t p = 0; p < sizeof(packets) / sizeof(packets[0]); p++)
+		{
+			HostTracer tracer(SWEEP_WIDTH, SWEEP_HEIGHT, SWEEP_RAY_STEP);
+			tracer.SetPacketTracing(packets[p]);
+
+			const std::string name = packets[p] ? "HostTracer/packets" : "HostTracer/single";
+			harness.Run(name, "rays", tracer.GetResponses().size(), [&tracer, &camera, &bodies]()
+			{
+				tracer.TracePhysicsRays(camera, bodies);
+				return tracer.TotalVolume();
+			});
+		}
+	}
+
+	// Math helpers
+	{
+		std::vector<float4> quaternions(RAY_COUNT);
+		for (size_t i = 0; i < quaternions.size(); i++)
+			quaternions[i] = normalize(make_float4(RandomFloat3(rng, -1.0f, 1.0f), 1.0f));
+
+		harness.Run("QuaternionToRotation", "ops", quaternions.size(), [&quaternions]()
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < quaternions.size(); i++)
+				sum += MathHelpers::QuaternionToRotation(quaternions[i])[4];
+			return sum;
+		});
+
+		std::vector<Matrix3x3> matrices(RAY_COUNT);
+		for (size_t i = 0; i < matrices.size(); i++)
+		{
+			// Rotation scaled by a random diagonal, always invertible
+			Matrix3x3 scale = make_matrix3x3(Matrix4x4::identity());
+			float3 s = RandomFloat3(rng, 0.5f, 2.0f);
+			scale[0] = s.x;
+			scale[4] = s.y;
+			scale[8] = s.z;
+			matrices[i] = MathHelpers::QuaternionToRotation(quaternions[i]) * scale;
+		}
+
+		harness.Run("Matrix3Inverse", "ops", matrices.size(), [&matrices]()
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < matrices.size(); i++)
+				sum += MathHelpers::Matrix3Inverse(matrices[i])[0];
+			return sum;
+		});
+	}
+
+	// Rigidbody integration
+	{
+		const int BODY_COUNT = 64;
+		const std::vector<RigidBodyState> initial = MakeBodies(rng, BODY_COUNT);
+		std::vector<RigidBodyState> bodies = initial;
+		int steps = 0;
+
+		harness.Run("RigidBodyState::EulerStep", "steps", BODY_COUNT, [&]()
+		{
+			// Restart periodically so the state stays in a sane range
+			if (++steps % 4096 == 0)
+				bodies = initial;
+
+			float sum = 0.0f;
+			for (size_t i = 0; i < bodies.size(); i++)
+			{
+				bodies[i].AddForceAtPosition(make_float3(0.0f, 1.0f, 0.0f), bodies[i].GetPosition() + make_float3(1.0f, 0.0f, 0.0f));
+				bodies[i].EulerStep(1.0f / 60.0f);
+				sum += bodies[i].GetPosition().y;
+			}
+			return sum;
+		});
+	}
+
+	// Collision response over a full physics buffer
+	{
+		const float fractions[] = { 0.01f, 0.1f, 0.5f };
+		for (size_t f = 0; f < sizeof(fractions) / sizeof(fractions[0]); f++)
+		{
+			const std::vector<IntersectionResponse> grid = MakeResponseGrid(rng, fractions[f]);
+			std::vector<RigidBodyState> bodies = MakeBodies(rng, SCENE_BODIES);
+
+			const std::string name = "ResolveCollisions/hit" + std::to_string(int(fractions[f] * 100.0f)) + "%";
+			harness.Run(name, "pixels", grid.size(), [&grid, &bodies]()
+			{
+				return CollisionResolver::ApplyResponses(grid.data(), grid.size(), 100.0f, bodies);
+			});
+		}
+	}
+
+	// Output buffer conversion for saved and recorded frames, at the default window size
+	{
+		const int width = 1080;
+		const int height = 720;
+		std::uniform_real_distribution<float> channel(0.0f, 1.0f);
+		std::vector<unsigned char> bgra(4 * width * height);
+		std::vector<float> rgba(4 * width * height);
+		for (size_t i = 0; i < rgba.size(); i++)
+		{
+			rgba[i] = channel(rng);
+			bgra[i] = static_cast<unsigned char>(rgba[i] * 255.0f);
+		}
+		std::vector<unsigned char> rgb(3 * width * height);
+
+		harness.Run("ConvertToRGB8/bgra", "pixels", width * height, [&]()
+		{
+			convertToRGB8(bgra.data(), RT_FORMAT_UNSIGNED_BYTE4, width, height, false, rgb.data());
+			return rgb[0];
+		});
+		harness.Run("ConvertToRGB8/float4_srgb", "pixels", width * height, [&]()
+		{
+			convertToRGB8(rgba.data(), RT_FORMAT_FLOAT4, width, height, true, rgb.data());
+			return rgb[0];
+		});
+	}
+
+	// Host side of a frame: trace, copy the responses out as Simulation::ResolveCollisions does and
+	// apply them, and take a PPM sized pooled buffer. Once the first frames have grown the vectors
+	// and the pool, frames should not touch the heap. HeadlessCheck does the same for real frames
+	bool steadyState = true;
+	{
+		float extent;
+		const std::vector<HostBody> bodies = MakeProceduralScene(rng, SWEEP_BODIES, extent);
+		const float3 eye = normalize(make_float3(-7.0f, 9.2f, 6.0f)) * extent * 1.5f;
+		const HostCamera camera = HostCamera::LookAt(eye, make_float3(0.0f), make_float3(0.0f, 1.0f, 0.0f), 60.0f, SWEEP_WIDTH, SWEEP_HEIGHT);
+		std::vector<RigidBodyState> physicsBodies = MakeBodies(rng, SWEEP_BODIES);
+
+		// Spawning worker threads allocates, so one thread
+		HostTracer tracer(SWEEP_WIDTH, SWEEP_HEIGHT, SWEEP_RAY_STEP);
+		tracer.SetThreadCount(1);
+
+		std::vector<IntersectionResponse> responses;
+		const unsigned int WARM_UP_FRAMES = 4;
+		unsigned int frames = 0;
+		uint64_t steadyAllocations = 0;
+
+		AllocationCounter::Enable(true);
+		harness.Run("FrameMemory/steady_state", "frames", 1, [&]()
+		{
+			const uint64_t allocationsBefore = AllocationCounter::Count();
+
+			tracer.TracePhysicsRays(camera, bodies);
+			const std::vector<IntersectionResponse>& traced = tracer.GetResponses();
+			responses.assign(traced.begin(), traced.end());
+			const float volume = CollisionResolver::ApplyResponses(responses.data(), responses.size(), 100.0f, physicsBodies);
+
+			PooledArray<unsigned char> pix(SWEEP_WIDTH * SWEEP_HEIGHT * 3);
+			memset(pix.data(), 0, pix.size());
+
+			if (++frames > WARM_UP_FRAMES)
+				steadyAllocations += AllocationCounter::Count() - allocationsBefore;
+			return volume + pix[0];
+		});
+		AllocationCounter::Enable(false);
+
+		if (steadyAllocations > 0)
+		{
+			std::cerr << "FrameMemory/steady_state: " << steadyAllocations << " heap allocations over "
+					  << frames - WARM_UP_FRAMES << " steady state frames" << std::endl;
+			steadyState = false;
+		}
+	}
+
+	if (csv)
+		harness.PrintCsv(std::cout);
+	else
+		harness.PrintTable(std::cout);
+
+	// The harness keeps its sink in a volatile, so the timed work stays without reading it here
+	return steadyState ? 0 : 1;
+}
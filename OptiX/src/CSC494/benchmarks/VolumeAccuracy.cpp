@@ -0,0 +1,426 @@
+// OptiX
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// User created headers
+#include "HostTracer.h"
+#include "MathHelpers.h"
+
+using namespace optix;
+
+/*
+	Accuracy versus cost of the ray based volume estimate.
+
+	Places sphere/sphere and box/box pairs with known overlap volumes at a grid of
+	rotations, overlap depths and camera distances, runs the CPU physics ray pass at
+	several strides and resolutions, and reports the relative error of the summed
+	response volume against the analytic one.
+
+	Each physics ray stands in for physicsRayStep^2 pixels but the frustum slice in
+	FrustumVolume is one pixel wide, so both the raw sum (what ResolveCollisions sees)
+	and the stride corrected sum (raw * step^2) are reported.
+
+	The corrected sum is also off by a near constant factor: the callers of
+	FindLargestOverlap pass the pixel angles theta and phi in degrees and FrustumVolume
+	takes their sines as radians. That factor is reported as the systematic bias, and
+	the settings are ranked again by their error once it is divided out, which is what
+	a retuned response constant would see.
+*/
+
+namespace
+{
+	const unsigned int SEED = 494;
+	const float VFOV = 60.0f;
+
+	struct Resolution
+	{
+		unsigned int width;
+		unsigned int height;
+	};
+
+	struct Pose
+	{
+		std::vector<HostBody> bodies;
+		float volume;		// Analytic overlap volume
+	};
+
+	struct Row
+	{
+		std::string shape;
+		Resolution resolution;
+		float distance;
+		unsigned int step;
+		unsigned int raysPerFrame;
+		double msPerFrame;
+		double meanRawError;
+		double meanCorrectedError;
+		double maxCorrectedError;
+		double meanCorrectedRatio;	// Estimate over analytic volume, shows systematic bias
+		double meanUnbiasedError;	// Corrected error with the bias over every row divided out
+		double maxUnbiasedError;
+		std::vector<double> ratios;	// Corrected estimate over analytic volume per pose
+	};
+
+	Matrix3x3 RandomRotation(std::mt19937& rng)
+	{
+		std::normal_distribution<float> normal(0.0f, 1.0f);
+		float a = normal(rng);
+		float b = normal(rng);
+		float c = normal(rng);
+		float d = normal(rng);
+		return MathHelpers::QuaternionToRotation(normalize(make_float4(a, b, c, d)));
+	}
+
+	// Lens shaped intersection of two spheres whose centers are distance apart
+	float SphereOverlapVolume(float r1, float r2, float distance)
+	{
+		if (distance >= r1 + r2)
+			return 0.0f;
+		if (distance <= fabsf(r1 - r2))
+		{
+			float r = std::min(r1, r2);
+			return 4.0f / 3.0f * M_PIf * r * r * r;
+		}
+
+		float sum = r1 + r2 - distance;
+		float diff = r1 - r2;
+		return M_PIf * sum * sum * (distance * distance + 2.0f * distance * (r1 + r2) - 3.0f * diff * diff) / (12.0f * distance);
+	}
+
+	// Two boxes with the same rotation, offset is the center difference in their shared local frame
+	float BoxOverlapVolume(float3 a, float3 b, float3 offset)
+	{
+		float x = std::max(0.0f, 0.5f * (a.x + b.x) - fabsf(offset.x));
+		float y = std::max(0.0f, 0.5f * (a.y + b.y) - fabsf(offset.y));
+		float z = std::max(0.0f, 0.5f * (a.z + b.z) - fabsf(offset.z));
+		return x * y * z;
+	}
+
+	// Sphere pairs as in the demo scene (radius 3 and 2), at three overlap depths
+	std::vector<Pose> MakeSpherePoses(std::mt19937& rng, int rotations)
+	{
+		const float r1 = 3.0f;
+		const float r2 = 2.0f;
+		const float separations[] = { 0.4f, 0.6f, 0.8f };
+
+		std::vector<Pose> poses;
+		for (int i = 0; i < rotations; i++)
+		{
+			const Matrix3x3 rotation = RandomRotation(rng);
+			const float3 axis = rotation * make_float3(1.0f, 0.0f, 0.0f);
+			for (size_t s = 0; s < sizeof(separations) / sizeof(separations[0]); s++)
+			{
+				const float distance = separations[s] * (r1 + r2);
+
+				Pose pose;
+				pose.bodies.push_back(HostBody::Sphere(0, r1, -axis * (0.5f * distance), rotation));
+				pose.bodies.push_back(HostBody::Sphere(1, r2, axis * (0.5f * distance), rotation));
+				pose.volume = SphereOverlapVolume(r1, r2, distance);
+				poses.push_back(pose);
+			}
+		}
+		return poses;
+	}
+
+	// Box pairs under a shared rotation with a random offset in their local frame
+	std::vector<Pose> MakeBoxPoses(std::mt19937& rng, int rotations)
+	{
+		const float3 a = make_float3(3.0f, 3.0f, 3.0f);
+		const float3 b = make_float3(2.0f, 3.0f, 4.0f);
+		const float separations[] = { 0.4f, 0.6f, 0.8f };
+		std::uniform_real_distribution<float> jitter(0.0f, 0.3f);
+
+		std::vector<Pose> poses;
+		for (int i = 0; i < rotations; i++)
+		{
+			const Matrix3x3 rotation = RandomRotation(rng);
+			for (size_t s = 0; s < sizeof(separations) / sizeof(separations[0]); s++)
+			{
+				const float3 reach = 0.5f * (a + b);
+				const float3 offset = make_float3(separations[s] * reach.x,
+												  jitter(rng) * reach.y,
+												  jitter(rng) * reach.z);
+				const float3 worldOffset = rotation * offset;
+
+				Pose pose;
+				pose.bodies.push_back(HostBody::Box(0, a, -0.5f * worldOffset, rotation));
+				pose.bodies.push_back(HostBody::Box(1, b, 0.5f * worldOffset, rotation));
+				pose.volume = BoxOverlapVolume(a, b, offset);
+				poses.push_back(pose);
+			}
+		}
+		return poses;
+	}
+
+	Row Measure(const std::string& shape, const std::vector<Pose>& poses, Resolution resolution, float distance, unsigned int step)
+	{
+		// Same viewing direction as the demo scene camera
+		const float3 eye = normalize(make_float3(-7.0f, 9.2f, 6.0f)) * distance;
+		const HostCamera camera = HostCamera::LookAt(eye, make_float3(0.0f), make_float3(0.0f, 1.0f, 0.0f), VFOV, resolution.width, resolution.height);
+
+		HostTracer tracer(resolution.width, resolution.height, step);
+
+		Row row;
+		row.shape = shape;
+		row.resolution = resolution;
+		row.distance = distance;
+		row.step = step;
+		row.raysPerFrame = tracer.GetResponseWidth() * tracer.GetResponseHeight();
+		row.meanRawError = 0.0;
+		row.meanCorrectedError = 0.0;
+		row.maxCorrectedError = 0.0;
+		row.meanCorrectedRatio = 0.0;
+		row.meanUnbiasedError = 0.0;
+		row.maxUnbiasedError = 0.0;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < poses.size(); i++)
+		{
+			tracer.TracePhysicsRays(camera, poses[i].bodies);
+
+			const double raw = tracer.TotalVolume();
+			const double corrected = raw * step * step;
+			const double rawError = fabs(raw - poses[i].volume) / poses[i].volume;
+			const double correctedError = fabs(corrected - poses[i].volume) / poses[i].volume;
+
+			row.meanRawError += rawError;
+			row.meanCorrectedError += correctedError;
+			row.maxCorrectedError = std::max(row.maxCorrectedError, correctedError);
+			row.meanCorrectedRatio += corrected / poses[i].volume;
+			row.ratios.push_back(corrected / poses[i].volume);
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		row.msPerFrame = seconds * 1.0e3 / poses.size();
+		row.meanRawError /= poses.size();
+		row.meanCorrectedError /= poses.size();
+		row.meanCorrectedRatio /= poses.size();
+		return row;
+	}
+
+	// Mean corrected ratio over every row, the scale FrustumVolume's degrees give every estimate
+	double SystematicBias(const std::vector<Row>& rows)
+	{
+		double sum = 0.0;
+		size_t count = 0;
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			for (size_t j = 0; j < rows[i].ratios.size(); j++)
+				sum += rows[i].ratios[j];
+			count += rows[i].ratios.size();
+		}
+		return count > 0 ? sum / count : 1.0;
+	}
+
+	void RemoveBias(std::vector<Row>& rows, double bias)
+	{
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			Row& r = rows[i];
+			for (size_t j = 0; j < r.ratios.size(); j++)
+			{
+				const double error = fabs(r.ratios[j] / bias - 1.0);
+				r.meanUnbiasedError += error;
+				r.maxUnbiasedError = std::max(r.maxUnbiasedError, error);
+			}
+			if (!r.ratios.empty())
+				r.meanUnbiasedError /= r.ratios.size();
+		}
+	}
+
+	void PrintBias(const std::vector<Row>& rows, double bias, std::ostream& out)
+	{
+		double lowest = rows.empty() ? bias : rows[0].meanCorrectedRatio;
+		double highest = lowest;
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			lowest = std::min(lowest, rows[i].meanCorrectedRatio);
+			highest = std::max(highest, rows[i].meanCorrectedRatio);
+		}
+
+		out << "\nSystematic bias: the corrected estimate averages " << bias << " times the analytic volume"
+			<< " (rows from " << lowest << " to " << highest << ")." << std::endl;
+		out << "FrustumVolume is given theta and phi in degrees and takes their sines as radians." << std::endl;
+	}
+
+	void PrintTable(const std::vector<Row>& rows, std::ostream& out)
+	{
+		out << std::left << std::setw(8) << "shape" << std::right
+			<< std::setw(11) << "resolution"
+			<< std::setw(10) << "distance"
+			<< std::setw(6) << "step"
+			<< std::setw(10) << "rays"
+			<< std::setw(12) << "ms/frame"
+			<< std::setw(12) << "raw err"
+			<< std::setw(12) << "corr err"
+			<< std::setw(12) << "corr max"
+			<< std::setw(12) << "corr ratio"
+			<< std::setw(12) << "unbias err"
+			<< std::setw(12) << "unbias max" << std::endl;
+
+		out << std::fixed;
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			const Row& r = rows[i];
+			const std::string resolution = std::to_string(r.resolution.width) + "x" + std::to_string(r.resolution.height);
+			out << std::left << std::setw(8) << r.shape << std::right
+				<< std::setw(11) << resolution
+				<< std::setw(10) << std::setprecision(1) << r.distance
+				<< std::setw(6) << r.step
+				<< std::setw(10) << r.raysPerFrame
+				<< std::setw(12) << std::setprecision(3) << r.msPerFrame
+				<< std::setw(12) << std::setprecision(4) << r.meanRawError
+				<< std::setw(12) << r.meanCorrectedError
+				<< std::setw(12) << r.maxCorrectedError
+				<< std::setw(12) << r.meanCorrectedRatio
+				<< std::setw(12) << r.meanUnbiasedError
+				<< std::setw(12) << r.maxUnbiasedError << std::endl;
+		}
+		out.unsetf(std::ios::fixed);
+	}
+
+	void PrintCsv(const std::vector<Row>& rows, std::ostream& out)
+	{
+		out << "shape,width,height,distance,step,rays,ms_per_frame,mean_raw_error,mean_corrected_error,max_corrected_error,mean_corrected_ratio,mean_unbiased_error,max_unbiased_error" << std::endl;
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			const Row& r = rows[i];
+			out << r.shape << "," << r.resolution.width << "," << r.resolution.height << "," << r.distance << "," << r.step << ","
+				<< r.raysPerFrame << "," << r.msPerFrame << "," << r.meanRawError << "," << r.meanCorrectedError << ","
+				<< r.maxCorrectedError << "," << r.meanCorrectedRatio << "," << r.meanUnbiasedError << "," << r.maxUnbiasedError << std::endl;
+		}
+	}
+
+	// For every shape and distance, the setting with the fewest rays whose mean error is within tolerance
+	void PrintCheapest(const std::vector<Row>& rows, double Row::*error, const std::string& title, double tolerance, std::ostream& out)
+	{
+		out << "\nCheapest setting with " << title << " <= " << tolerance << std::endl;
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			// Only visit each (shape, distance) once
+			bool seen = false;
+			for (size_t j = 0; j < i; j++)
+				seen |= rows[j].shape == rows[i].shape && rows[j].distance == rows[i].distance;
+			if (seen)
+				continue;
+
+			const Row* best = 0;
+			for (size_t j = i; j < rows.size(); j++)
+			{
+				const Row& r = rows[j];
+				if (r.shape != rows[i].shape || r.distance != rows[i].distance || r.*error > tolerance)
+					continue;
+				if (!best || r.raysPerFrame < best->raysPerFrame)
+					best = &r;
+			}
+
+			out << "  " << rows[i].shape << " at " << rows[i].distance << ": ";
+			if (best)
+				out << best->resolution.width << "x" << best->resolution.height << " step " << best->step
+					<< " (" << best->raysPerFrame << " rays, error " << best->*error << ")" << std::endl;
+			else
+				out << "none" << std::endl;
+		}
+	}
+
+	void PrintUsageAndExit(const std::string& argv0)
+	{
+		std::cerr << "\nUsage: " << argv0 << " [options]\n";
+		std::cerr <<
+			"Options:\n"
+			"  -h | --help         Print this usage message and exit.\n"
+			"  -r | --rotations    Random rotations per shape pair (default 8).\n"
+			"  -t | --tolerance    Relative error used to pick the cheapest setting (default 0.1).\n"
+			"  -c | --csv          Print results as CSV.\n"
+			<< std::endl;
+
+		exit(1);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int rotations = 8;
+	double tolerance = 0.1;
+	bool csv = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+
+		if (arg == "-h" || arg == "--help")
+		{
+			PrintUsageAndExit(argv[0]);
+		}
+		else if ((arg == "-r" || arg == "--rotations") && i + 1 < argc)
+		{
+			rotations = std::max(1, atoi(argv[++i]));
+		}
+		else if ((arg == "-t" || arg == "--tolerance") && i + 1 < argc)
+		{
+			tolerance = atof(argv[++i]);
+		}
+		else if (arg == "-c" || arg == "--csv")
+		{
+			csv = true;
+		}
+		else
+		{
+			std::cerr << "Unknown option '" << arg << "'\n";
+			PrintUsageAndExit(argv[0]);
+		}
+	}
+
+	std::mt19937 rng(SEED);
+	const std::vector<Pose> spheres = MakeSpherePoses(rng, rotations);
+	const std::vector<Pose> boxes = MakeBoxPoses(rng, rotations);
+
+	const Resolution resolutions[] = { { 1080, 720 }, { 540, 360 } };
+	const float distances[] = { 15.0f, 30.0f, 60.0f };
+	const unsigned int steps[] = { 1, 2, 4, 8, 16 };
+
+	std::vector<Row> rows;
+	for (int shape = 0; shape < 2; shape++)
+	{
+		for (size_t d = 0; d < sizeof(distances) / sizeof(distances[0]); d++)
+		{
+			for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++)
+			{
+				for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++)
+				{
+					rows.push_back(shape == 0 ?
+						Measure("sphere", spheres, resolutions[r], distances[d], steps[s]) :
+						Measure("box", boxes, resolutions[r], distances[d], steps[s]));
+				}
+			}
+		}
+	}
+
+	const double bias = SystematicBias(rows);
+	RemoveBias(rows, bias);
+
+	if (csv)
+	{
+		PrintCsv(rows, std::cout);
+	}
+	else
+	{
+		PrintTable(rows, std::cout);
+		PrintBias(rows, bias, std::cout);
+		PrintCheapest(rows, &Row::meanCorrectedError, "mean corrected error", tolerance, std::cout);
+		PrintCheapest(rows, &Row::meanUnbiasedError, "mean error once the bias is divided out", tolerance, std::cout);
+	}
+
+	return 0;
+}
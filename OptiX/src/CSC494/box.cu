@@ -34,6 +34,7 @@
 #include <optixu/optixu_aabb_namespace.h>
 
 #include "RayStructs.h"
+#include "IntersectionKernels.h"
 
 using namespace optix;
 
@@ -51,33 +52,19 @@ rtDeclareVariable(float, id, , );
 rtDeclareVariable(float3, geometric_normal, attribute geometric_normal, );
 rtDeclareVariable(float3, shading_normal, attribute shading_normal, );
 
-static __device__ float3 boxnormal(float t, float3 t0, float3 t1)
-{
-	float3 neg = make_float3(t == t0.x ? 1 : 0, t == t0.y ? 1 : 0, t == t0.z ? 1 : 0);
-	float3 pos = make_float3(t == t1.x ? 1 : 0, t == t1.y ? 1 : 0, t == t1.z ? 1 : 0);
-	return pos - neg;
-}
-
 RT_PROGRAM void box_intersect(int)
 {
-	float3 boxmin = -(axisLengths / 2.0f);
-	float3 boxmax = (axisLengths / 2.0f);
-
-	float3 t0 = (boxmin - ray.origin) / ray.direction;
-	float3 t1 = (boxmax - ray.origin) / ray.direction;
-	float3 near = fminf(t0, t1);
-	float3 far = fmaxf(t0, t1);
-	float tmin = fmaxf(near);
-	float tmax = fminf(far);
+	float3 t0, t1;
+	float tmin, tmax;
 
-	if (tmin <= tmax) 
+	if (IntersectBox(axisLengths, ray.origin, ray.direction, t0, t1, tmin, tmax)) 
 	{
 		if (tmin > 0 && rtPotentialIntersection(tmin)) 
 		{
 			IntersectionData data;
 			data.rigidBodyId = id;
 			data.t = tmin;
-			data.normal = boxnormal(tmin, t0, t1);
+			data.normal = BoxNormal(tmin, t0, t1);
 			intersectionData = data;
 
 			shading_normal = geometric_normal = data.normal;
@@ -88,7 +75,7 @@ RT_PROGRAM void box_intersect(int)
 			IntersectionData data;
 			data.rigidBodyId = id;
 			data.t = tmax;
-			data.normal = boxnormal(tmax, t0, t1);
+			data.normal = BoxNormal(tmax, t0, t1);
 			intersectionData = data;
 
 			shading_normal = geometric_normal = data.normal;
@@ -1,5 +1,7 @@
 #include "RayStructs.h"
 #include "BufferStructs.h"
+#include "IntersectionKernels.h"
+#include "ReflectionControl.h"
 
 // Ray data
 rtDeclareVariable(PerRayData_radiance, prd_radiance, rtPayload, );
@@ -14,6 +16,12 @@ rtDeclareVariable(rtObject, top_shadower, , );
 rtDeclareVariable(float, closestHitDist, rtIntersectionDistance, );
 rtDeclareVariable(float, importance_cutoff, , );
 rtDeclareVariable(int, max_depth, , );
+rtDeclareVariable(int, reflection_termination, , );
+rtDeclareVariable(unsigned int, frame_number, , );
+
+// Reflection rays asked for so far this frame, launches stop reflecting past a non zero budget
+rtBuffer<unsigned int, 1> reflectionRayCount;
+rtDeclareVariable(unsigned int, reflection_ray_cap, , );	// See ReflectionRayCap, 0 for no limit
 
 // Camera variables
 rtDeclareVariable(float3, eye, , );
@@ -27,10 +35,15 @@ rtDeclareVariable(float, fov, , );
 rtBuffer<uchar4, 2> output_buffer;
 rtBuffer<IntersectionResponse, 2> collisionResponse;
 
+// Frame statistics, only written when collectStats is non zero
+rtBuffer<unsigned int, 1> frameStats;
+rtDeclareVariable(int, collectStats, , );
+
 // Rigidbody variables
 rtDeclareVariable(int, physicsRayStep, , );
 rtDeclareVariable(int, physicsBufferWidth, , );
 rtDeclareVariable(int, physicsBufferHeight, , );
+rtDeclareVariable(int, physicsInRender, , );		// 0 when physics_camera traces the physics rays on its own
 
 // Volumetric variables
 rtDeclareVariable(IntersectionData, intersectionData, attribute intersectionData, );
@@ -54,141 +67,97 @@ rtDeclareVariable(float,   specularPower, , );
 // Scene values
 rtTextureSampler<float4, 2> envmap;
 
-void ClearResponseBuffer()
+static __device__ __inline__ void CountStat(unsigned int slot, unsigned int value = 1)
+{
+	if (collectStats)
+		atomicAdd(&frameStats[slot], value);
+}
+
+void ClearResponseBuffer(uint2 cell)
 {
-	IntersectionResponse data;
-	data.volume = 0.0f;
-	data.entryId = 0;
-	data.entryNormal = make_float3(0.0f,0.0f,0.0f);
-	data.exitId = 0;
-	data.exitNormal = make_float3(0.0f,0.0f,0.0f);
-	data.entryPoint = make_float3(0.0f,0.0f,0.0f);
-	data.exitPoint = make_float3(0.0f,0.0f,0.0f);
-	collisionResponse[make_uint2(launch_index.x / physicsRayStep, launch_index.y / physicsRayStep)] = data;
+	collisionResponse[cell] = EmptyResponse();
 }
 
 // Given an ordered list of ray intersections, finds all intervals of intersections and
 // computes their volumes.
-void CheckIntersectionOverlap(PerRayData_radiance prd, float3 ray_origin, float3 ray_direction, float3& result)
+void CheckIntersectionOverlap(uint2 cell, PerRayData_radiance prd, float3 ray_origin, float3 ray_direction, float3& result)
 {
-	// Right now, just store the largest intersection volume into the buffer
-	IntersectionResponse largestResponse;
-	largestResponse.volume = 0.0f;
-	largestResponse.entryId = 0;
-	largestResponse.entryNormal = make_float3(0.0, 0.0, 0.0);
-	largestResponse.exitId = 0;
-	largestResponse.exitNormal = make_float3(0.0, 0.0, 0.0);
-	largestResponse.entryPoint = make_float3(0.0, 0.0, 0.0);
-	largestResponse.exitPoint = make_float3(0.0, 0.0, 0.0);
-	largestResponse.collisionId = 0;
-	IntersectionData objectsInside[5]; // Assume we will never have more than 5 bodies intersecting at any given point
-	int insideIndex = 0;
+	if (prd.numIntersections == 0)
+		return;
 
 	float2 screen = make_float2(output_buffer.size());
 	float fovDelta = 1.0 / screen.x;
 	float theta = fov * fovDelta;
 	float phi = 90.0 - theta;
 
-	// Debugging
-	float largestT = 0.0;
-
-	for (int i = 0; i < prd.numIntersections; i++)
-	{
-		IntersectionData objEnter; // Will be set if we need it
-
-		// Check to see if we are entering this object
-		bool entering = true;
-		for (int j = 0; j < insideIndex; j++)
-		{
-			if (objectsInside[j].rigidBodyId == prd.intersections[i].rigidBodyId)
-			{
-				objEnter = objectsInside[j];
-				entering = false;
-			}
-		}
+	// Right now, just store the largest intersection volume into the buffer
+	int pairsFound = 0;
+	IntersectionResponse largestResponse = FindLargestOverlap(prd.intersections, prd.numIntersections, theta, phi, ray_origin, ray_direction, pairsFound);
+	if (pairsFound > 0)
+		CountStat(STAT_PAIRS_FOUND, pairsFound);
 
-		// If entering, add it to our tracking array
-		if (entering)
-		{
-			// Check if this intersection has an exit point (ie, is valid)
-			bool isValid = false;
-			for (int j = i + 1; j < prd.numIntersections; j++)
-			{
-				if (prd.intersections[j].rigidBodyId == prd.intersections[i].rigidBodyId)
-				{
-					isValid = true;
-					break;
-				}
-			}
+	collisionResponse[cell] = largestResponse;
+}
 
-			if (isValid)
-			{
-				objectsInside[insideIndex] = prd.intersections[i];
-				insideIndex++;
-			}
-		}
-		else
+/*
+	Follows the chain of reflections requested by the camera ray's first hit, one bounce at a time,
+	so the stack holds a single radiance payload whatever the depth
+*/
+static __device__ __inline__ void TraceReflections(const PerRayData_radiance& prd, float3& result)
+{
+	bool reflect = prd.reflect;
+	float3 origin = prd.reflectOrigin;
+	float3 direction = prd.reflectDirection;
+	float3 weight = prd.reflectWeight;
+	float importance = prd.reflectImportance;
+	unsigned int seed = prd.seed;
+	int depth = 0;
+
+	PerRayData_radiance bounce;
+	bounce.physicsRay = false;
+	bounce.physicsOnly = false;
+
+	while (reflect)
+	{
+		// Counts what the frame asks for, the cutoff adapts to it. Breaking off is the biased fallback
+		if (reflection_ray_cap > 0 && atomicAdd(&reflectionRayCount[0], 1u) >= reflection_ray_cap)
 		{
-			// Otherwise, we are exiting this object, need to check for intersection volumes
-			// with any other objects we are currently inside
-			for (int j = 0; j < insideIndex; j++)
-			{
-				if (objectsInside[j].rigidBodyId != prd.intersections[i].rigidBodyId)
-				{
-					// Compute volume
-					IntersectionData entryPoint = objectsInside[j].t < objEnter.t ? objEnter : objectsInside[j];
-					IntersectionData exitPoint = prd.intersections[i];
-					
-					float a = sin(theta) * entryPoint.t/ sin(phi);
-					float b = sin(theta) * exitPoint.t/ sin(phi);
-					float h = exitPoint.t - entryPoint.t;
-					float volume = 0.33 * (a*a + a * b + b * b) * h;
-
-					if (volume > largestResponse.volume)
-					{
-						largestResponse.volume = volume;
-						largestResponse.entryId = entryPoint.rigidBodyId;
-						largestResponse.entryNormal = entryPoint.normal;
-						largestResponse.exitId = exitPoint.rigidBodyId;
-						largestResponse.exitNormal = exitPoint.normal;
-						largestResponse.entryPoint = ray_origin + entryPoint.t * ray_direction;
-						largestResponse.exitPoint = ray_origin + exitPoint.t * ray_direction;
-						largestResponse.collisionId = objectsInside[j].rigidBodyId;
-					}
-				}
-			}
-
-			// Remove this object from our tracking array
-			bool shift = false;
-			for (int j = 0; j < insideIndex; j++)
-			{
-				if (objectsInside[j].rigidBodyId == prd.intersections[i].rigidBodyId)
-				{
-					shift = true;
-					continue;
-				}
-
-				if (shift)
-				{
-					objectsInside[j - 1] = objectsInside[j];
-				}
-			}
-			insideIndex--;
+			CountStat(STAT_REFLECTIONS_OVER_BUDGET);
+			break;
 		}
 
-		// Finally, assign our biggest response to the buffer
-		collisionResponse[make_uint2(launch_index.x / physicsRayStep, launch_index.y / physicsRayStep)] = largestResponse;
-		
+		depth++;
+		bounce.done = false;
+		bounce.result = make_float3(0.0, 0.0, 0.0);
+		bounce.importance = importance;
+		bounce.depth = depth;
+		bounce.reflect = false;
+		bounce.seed = seed;
+		bounce.numIntersections = 0;
+
+		optix::Ray refl_ray(origin, direction, radiance_ray_type, scene_epsilon);
+		rtTrace(top_object, refl_ray, bounce);
+		CountStat(STAT_REFLECTION_RAYS);
+		CountStat(STAT_REFLECTION_DEPTHS + min(depth, REFLECTION_DEPTH_BUCKETS) - 1);
+		result += weight * bounce.result;
+
+		reflect = bounce.reflect;
+		origin = bounce.reflectOrigin;
+		direction = bounce.reflectDirection;
+		weight *= bounce.reflectWeight;
+		importance = bounce.reflectImportance;
+		seed = bounce.seed;
 	}
 }
 
 RT_PROGRAM void perspective_camera()
 {
 	// Determine if we are going to use this ray for volume intersections
-	bool isPhysicsRay = (launch_index.x % physicsRayStep == 0 && launch_index.y % physicsRayStep == 0);
+	bool isPhysicsRay = physicsInRender && (launch_index.x % physicsRayStep == 0 && launch_index.y % physicsRayStep == 0);
+	const uint2 cell = make_uint2(launch_index.x / physicsRayStep, launch_index.y / physicsRayStep);
 
 	if (isPhysicsRay)
-		ClearResponseBuffer();
+		ClearResponseBuffer(cell);
 
 	size_t2 screen = output_buffer.size();
 
@@ -201,6 +170,7 @@ RT_PROGRAM void perspective_camera()
 
 	PerRayData_radiance prd;
 	prd.physicsRay = isPhysicsRay;
+	prd.physicsOnly = false;
 	prd.done = false;
 
 	prd.origin = eye;
@@ -209,12 +179,16 @@ RT_PROGRAM void perspective_camera()
 	prd.importance = 1.0;
 	prd.depth = 0;
 
+	prd.reflect = false;
+	prd.seed = ReflectionSeed(launch_index.y * screen.x + launch_index.x, frame_number);
+
 	prd.numIntersections = 0;
 
 	for (;;)
 	{
 		optix::Ray ray(ray_origin, ray_direction, radiance_ray_type, scene_epsilon);
 		rtTrace(top_object, ray, prd);
+		CountStat(STAT_RADIANCE_RAYS);
 		result += prd.result;
 
 		if (prd.done || !isPhysicsRay)
@@ -227,11 +201,66 @@ RT_PROGRAM void perspective_camera()
 	}
 
 	if (isPhysicsRay)
-		CheckIntersectionOverlap(prd, eye, ray_direction, result);
+	{
+		CountStat(STAT_PHYSICS_RAYS);
+		CountStat(STAT_HITS_HISTOGRAM + prd.numIntersections);
+		CheckIntersectionOverlap(cell, prd, eye, ray_direction, result);
+	}
+
+	TraceReflections(prd, result);
 
 	output_buffer[launch_index] = make_color(result);
 }
 
+/*
+	The physics rays of perspective_camera without the image, launched over the physics buffer
+	so the collision pass can run at a rate of its own. The rays are physics only, so the closest
+	hits record their intersections and return without shading
+*/
+RT_PROGRAM void physics_camera()
+{
+	const uint2 cell = launch_index;
+	ClearResponseBuffer(cell);
+
+	size_t2 screen = output_buffer.size();
+
+	float2 d = make_float2(cell.x * physicsRayStep, cell.y * physicsRayStep) / make_float2(screen) * 2.f - 1.f;
+	float3 ray_origin = eye;
+	float3 ray_direction = normalize(d.x*U + d.y*V + W);
+
+	float3 result = make_float3( 0.0f );
+
+	PerRayData_radiance prd;
+	prd.physicsRay = true;
+	prd.physicsOnly = true;
+	prd.done = false;
+
+	prd.origin = eye;
+
+	prd.result = make_float3(0.0, 0.0, 0.0);
+	prd.importance = 1.0;
+	prd.depth = 0;
+
+	prd.reflect = false;
+	prd.seed = ReflectionSeed(cell.y * physicsRayStep * screen.x + cell.x * physicsRayStep, frame_number);
+
+	prd.numIntersections = 0;
+
+	while (!prd.done)
+	{
+		optix::Ray ray(ray_origin, ray_direction, radiance_ray_type, scene_epsilon);
+		rtTrace(top_object, ray, prd);
+		CountStat(STAT_RADIANCE_RAYS);
+
+		prd.depth++;
+		ray_origin = prd.origin;
+	}
+
+	CountStat(STAT_PHYSICS_RAYS);
+	CountStat(STAT_HITS_HISTOGRAM + prd.numIntersections);
+	CheckIntersectionOverlap(cell, prd, eye, ray_direction, result);
+}
+
 // Closest hit shading for the spheres
 RT_PROGRAM void closest_hit_radiance()
 {
@@ -244,8 +273,22 @@ RT_PROGRAM void closest_hit_radiance()
 	data.t = prd_radiance.numIntersections == 0 ? intersectionData.t : intersectionData.t + prd_radiance.intersections[prd_radiance.numIntersections - 1].t;
 	data.normal = intersectionData.normal;
 
-	prd_radiance.intersections[prd_radiance.numIntersections] = data;
-	prd_radiance.numIntersections++;
+	// Keep tracing past a full sample list so the ray still terminates, but drop the hit
+	if (prd_radiance.numIntersections < INTERSECTION_SAMPLES)
+	{
+		prd_radiance.intersections[prd_radiance.numIntersections] = data;
+		prd_radiance.numIntersections++;
+	}
+	else
+	{
+		CountStat(STAT_SAMPLE_OVERFLOWS);
+		prd_radiance.result = make_float3(0.0, 0.0, 0.0);
+		return;
+	}
+
+	// Nothing reads the colour of a physics only ray, so no lights, shadow rays or reflection
+	if (prd_radiance.physicsOnly)
+		return;
 
 	// Only shade first object we come in contact with, so no transparency
 	// for now, but possible to implement later
@@ -255,6 +298,8 @@ RT_PROGRAM void closest_hit_radiance()
 		return;
 	}
 
+	prd_radiance.reflect = false;
+
 	float3 world_geo_normal = normalize(rtTransformNormal(
 										RT_OBJECT_TO_WORLD,
 										geometric_normal));
@@ -285,6 +330,7 @@ RT_PROGRAM void closest_hit_radiance()
 			float Ldist = length(light.pos - hit_point);
 			optix::Ray shadow_ray(hit_point, L, shadow_ray_type, scene_epsilon, Ldist );
 			rtTrace(top_shadower, shadow_ray, shadow_prd);
+			CountStat(STAT_SHADOW_RAYS);
 			float light_attenuation = shadow_prd.attenuation;
 
 			if (light_attenuation > 0.0f)
@@ -307,25 +353,17 @@ RT_PROGRAM void closest_hit_radiance()
 	float3 r = schlick(-dot(ffnormal, ray.direction), fresnel);
 	float importance = prd_radiance.importance * optix::luminance(reflectivity);
 
-	// reflection ray
-	if (importance > importance_cutoff && prd_radiance.depth < max_depth) 
+	// Reflection ray, left to perspective_camera to trace
+	float scale;
+	if (ContinueReflection(reflection_termination, importance, importance_cutoff, prd_radiance.depth, max_depth,
+						   prd_radiance.seed, scale))
 	{
-		PerRayData_radiance refl_prd;
-		refl_prd.importance = importance;
-		refl_prd.depth = prd_radiance.depth+1;
-
-		refl_prd.physicsRay = false;
-
-		refl_prd.result = make_float3(0.0, 0.0, 0.0);
-		refl_prd.importance = importance;
-		refl_prd.depth = prd_radiance.depth+1;
-
-		refl_prd.numIntersections = 0;
-
 		float3 R = reflect(ray.direction, ffnormal);
-		optix::Ray refl_ray( hit_point + 0.001 * R, R, radiance_ray_type, scene_epsilon );
-		rtTrace(top_object, refl_ray, refl_prd);
-		color += r * refl_prd.result;
+		prd_radiance.reflect = true;
+		prd_radiance.reflectOrigin = hit_point + 0.001 * R;
+		prd_radiance.reflectDirection = R;
+		prd_radiance.reflectWeight = r * scale;
+		prd_radiance.reflectImportance = importance * scale;
 	}
 
 	prd_radiance.result = color;
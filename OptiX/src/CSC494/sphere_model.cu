@@ -30,6 +30,7 @@
 
 #include <optix_world.h>
 #include "RayStructs.h"
+#include "IntersectionKernels.h"
 
 using namespace optix;
 
@@ -55,48 +56,18 @@ void intersect_sphere(void)
 	float3 O = ray.origin;
 	float3 D = ray.direction;
 
-	float b = dot(O, D);
-	float c = dot(O, O) - radius * radius;
-	float disc = b * b - c;
-	if (disc > 0.0f) {
-		float sdisc = sqrtf(disc);
-		float root1 = (-b - sdisc);
-
-		bool do_refine = false;
-
-		float root11 = 0.0f;
-
-		if (use_robust_method && fabsf(root1) > 10.f * radius) 
-		{
-			do_refine = true;
-		}
-
-		if (do_refine) 
-		{
-			// refine root1
-			float3 O1 = O + root1 * ray.direction;
-			b = dot(O1, D);
-			c = dot(O1, O1) - radius * radius;
-			disc = b * b - c;
-
-			if (disc > 0.0f) {
-				sdisc = sqrtf(disc);
-				root11 = (-b - sdisc);
-			}
-		}
-
-		float t1 = root1 + root11;
-		float t2 = (-b + sdisc) + (do_refine ? root1 : 0);
-
+	float t1, t2;
+	if (IntersectSphere(O, D, radius, use_robust_method, t1, t2))
+	{
 		if (rtPotentialIntersection(t1))
 		{
 			IntersectionData entryData;
 			entryData.rigidBodyId = id;
 			entryData.t = t1;
-			entryData.normal = (O + (root1 + root11)*D) / radius;
+			entryData.normal = (O + t1*D) / radius;
 			intersectionData = entryData;
 
-			shading_normal = geometric_normal = (O + (root1 + root11)*D) / radius;
+			shading_normal = geometric_normal = entryData.normal;
 			rtReportIntersection(0);
 		}
 
@@ -108,7 +79,7 @@ void intersect_sphere(void)
 			exitData.normal = (O + t2*D)/radius;
 			intersectionData = exitData;
 
-			shading_normal = geometric_normal = (O + t2*D)/radius;
+			shading_normal = geometric_normal = exitData.normal;
 			rtReportIntersection(0);
 		}
 	}
@@ -0,0 +1,116 @@
+// STL
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "Simulation.h"
+
+/*
+	Runs a Simulation with no window or GL context: steps two overlapping spheres, checks the
+	physics rays report their contact and reads back the rendered image, then counts the heap
+	allocations of steady state frames. Built against CSC494Simulation alone, so it also shows
+	the library links without GL or GLUT. Exits non-zero if any check fails.
+*/
+
+namespace
+{
+	unsigned int g_failures = 0;
+
+	void Check(bool passed, const char* what)
+	{
+		std::cout << (passed ? "pass  " : "FAIL  ") << what << std::endl;
+		if (!passed)
+			g_failures++;
+	}
+
+	bool RemoveThrows(Simulation& simulation, unsigned int id)
+	{
+		try
+		{
+			simulation.RemoveBody(id);
+		}
+		catch (const std::out_of_range&)
+		{
+			return true;
+		}
+		return false;
+	}
+}
+
+int main()
+{
+	SimulationOptions options;
+	options.width = 128;
+	options.height = 128;
+	options.physicsRayStep = 4;
+	options.minPhysicsRayStep = 4;
+
+	Simulation simulation(options);
+	simulation.SetCamera(make_float3(0.0f, 0.0f, 10.0f), make_float3(0.0f, 0.0f, 0.0f), make_float3(0.0f, 1.0f, 0.0f));
+
+	// A radius apart along x, the overlap faces the camera
+	const MaterialProperties material("closest_hit_radiance", make_float3(0.0f, 0.0f, 0.0f), make_float3(0.8f, 0.2f, 0.2f), make_float3(0.9f, 0.9f, 0.9f), 88.0f, make_float3(0.0f, 0.0f, 0.0f), make_float3(0.0f, 0.0f, 0.0f));
+	simulation.AddSphere(2.0f, material, make_float3(-1.0f, 0.0f, 0.0f), 1.0f);
+	simulation.AddSphere(2.0f, material, make_float3(1.0f, 0.0f, 0.0f), 1.0f);
+
+	const float volume = simulation.Step(1.0f / 60.0f);
+	Check(volume > 0.0f, "step finds an intersection volume");
+
+	const std::vector<PairContact>& contacts = simulation.GetContacts();
+	Check(!contacts.empty(), "overlapping bodies are in contact");
+
+	// One entry per order the rays met the two bodies in, either way round is the same pair
+	bool betweenTheTwo = true;
+	for (size_t i = 0; i < contacts.size(); i++)
+		betweenTheTwo = betweenTheTwo && contacts[i].bodyA + contacts[i].bodyB == 1 && contacts[i].samples > 0;
+	Check(betweenTheTwo, "contacts are between the two bodies");
+
+	simulation.Render();
+	std::vector<unsigned char> image(options.width * options.height * 3);
+	simulation.ReadImage(image.data());
+
+	// The centre sees the spheres, the corner the environment
+	const unsigned char* centre = &image[((options.height / 2) * options.width + options.width / 2) * 3];
+	const unsigned char* corner = &image[0];
+	Check(centre[0] != corner[0] || centre[1] != corner[1] || centre[2] != corner[2], "image shows the bodies");
+
+	// Steady state: once the first frames have sized the response vector, resolving
+	// a frame's collisions must not touch the heap. The OptiX launch inside TracePhysics() may
+	// allocate in the driver, so whole Step()s are reported rather than checked
+	const unsigned int WARM_UP_FRAMES = 4;
+	const unsigned int MEASURED_FRAMES = 16;
+	for (unsigned int i = 0; i < WARM_UP_FRAMES; i++)
+		simulation.Step(1.0f / 60.0f);
+
+	uint64_t resolveAllocations = 0;
+	uint64_t stepAllocations = 0;
+	for (unsigned int i = 0; i < MEASURED_FRAMES; i++)
+	{
+		simulation.StepBodies(1.0f / 60.0f);
+		simulation.TracePhysics();
+
+		AllocationCounter::Enable(true);
+		const uint64_t beforeResolve = AllocationCounter::Count();
+		simulation.ResolveCollisions();
+		resolveAllocations += AllocationCounter::Count() - beforeResolve;
+
+		const uint64_t beforeStep = AllocationCounter::Count();
+		simulation.Step(1.0f / 60.0f);
+		stepAllocations += AllocationCounter::Count() - beforeStep;
+		AllocationCounter::Enable(false);
+	}
+
+	std::cout << "      " << resolveAllocations << " allocations in " << MEASURED_FRAMES << " ResolveCollisions(), "
+		<< stepAllocations << " in " << MEASURED_FRAMES << " Step()" << std::endl;
+	Check(resolveAllocations == 0, "steady state ResolveCollisions() makes no heap allocations");
+
+	// Out of range ids throw, including on an empty simulation where the last index would wrap
+	const bool outOfRangeThrows = RemoveThrows(simulation, 2);
+	simulation.RemoveBody(1);
+	simulation.RemoveBody(0);
+	Check(outOfRangeThrows && RemoveThrows(simulation, 0), "removing a missing body throws");
+
+	std::cout << (g_failures == 0 ? "All checks passed" : "Some checks failed") << std::endl;
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+// STL
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sutil/Mesh.h>
+#include <sutil/MappedFile.h>
+#include <sutil/MeshBVH.h>
+
+/*
+	Builds MeshBVH trees over a generated triangle soup and checks their closest hits match
+	testing every triangle, that every thread count builds the same tree and that a saved tree
+	loads back the same and is rejected under another key. The soup is large enough for the
+	parallel subtree builds. Exits non-zero if any check fails.
+*/
+
+namespace
+{
+	unsigned int g_failures = 0;
+
+	void Check(bool passed, const std::string& what)
+	{
+		std::cout << (passed ? "pass  " : "FAIL  ") << what << std::endl;
+		if (!passed)
+			g_failures++;
+	}
+
+	// Small triangles scattered through [-1, 1]^3
+	void MakeSoup(Mesh& mesh, int triangles, std::mt19937& rng)
+	{
+		memset(&mesh, 0, sizeof(mesh));
+		mesh.num_vertices = triangles * 3;
+		mesh.num_triangles = triangles;
+		mesh.num_materials = 1;
+		allocMesh(mesh);
+
+		std::uniform_real_distribution<float> centre(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> offset(-0.05f, 0.05f);
+		for (int i = 0; i < triangles; i++)
+		{
+			const float c[3] = { centre(rng), centre(rng), centre(rng) };
+			for (int v = 0; v < 3; v++)
+			{
+				for (int axis = 0; axis < 3; axis++)
+					mesh.positions[(i * 3 + v) * 3 + axis] = c[axis] + offset(rng);
+				mesh.tri_indices[i * 3 + v] = i * 3 + v;
+			}
+			mesh.mat_indices[i] = 0;
+		}
+	}
+
+	// Moller-Trumbore written the way MeshBVH tests its leaves, so the same triangle gives the same t
+	bool HitTriangle(const Mesh& mesh, int32_t triangle, const float* origin, const float* direction, float tmax, float& t)
+	{
+		const float* p0 = mesh.positions + mesh.tri_indices[triangle * 3 + 0] * 3;
+		const float* p1 = mesh.positions + mesh.tri_indices[triangle * 3 + 1] * 3;
+		const float* p2 = mesh.positions + mesh.tri_indices[triangle * 3 + 2] * 3;
+
+		const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		const float pv[3] = { direction[1] * e2[2] - direction[2] * e2[1],
+							  direction[2] * e2[0] - direction[0] * e2[2],
+							  direction[0] * e2[1] - direction[1] * e2[0] };
+		const float det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+		if (det == 0.0f)
+			return false;
+
+		const float invDet = 1.0f / det;
+		const float tv[3] = { origin[0] - p0[0], origin[1] - p0[1], origin[2] - p0[2] };
+		const float u = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+
+		const float qv[3] = { tv[1] * e1[2] - tv[2] * e1[1],
+							  tv[2] * e1[0] - tv[0] * e1[2],
+							  tv[0] * e1[1] - tv[1] * e1[0] };
+		const float v = (direction[0] * qv[0] + direction[1] * qv[1] + direction[2] * qv[2]) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		const float hitT = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) * invDet;
+		if (hitT <= 0.0f || hitT >= tmax)
+			return false;
+
+		t = hitT;
+		return true;
+	}
+
+	bool SameTree(const MeshBVH& a, const MeshBVH& b)
+	{
+		return a.nodes().size() == b.nodes().size() && a.triangles() == b.triangles() &&
+			memcmp(a.nodes().data(), b.nodes().data(), a.nodes().size() * sizeof(MeshBVHNode)) == 0;
+	}
+
+	struct Ray
+	{
+		float origin[3];
+		float direction[3];
+	};
+
+	// From a sphere around the soup toward points inside and a little past it, so some miss
+	std::vector<Ray> MakeRays(int count, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> target(-1.3f, 1.3f);
+		std::vector<Ray> rays(count);
+		for (int i = 0; i < count; i++)
+		{
+			float o[3] = { unit(rng), unit(rng), unit(rng) };
+			const float length = std::sqrt(o[0] * o[0] + o[1] * o[1] + o[2] * o[2]) + 1e-6f;
+			const float p[3] = { target(rng), target(rng), target(rng) };
+			float d[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				o[axis] = o[axis] / length * 3.0f;
+				d[axis] = p[axis] - o[axis];
+			}
+			const float dLength = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				rays[i].origin[axis] = o[axis];
+				rays[i].direction[axis] = d[axis] / dLength;
+			}
+		}
+		return rays;
+	}
+
+	// Closest hits of the tree against every triangle, the t must match exactly
+	bool MatchesBruteForce(const MeshBVH& bvh, const Mesh& mesh, const std::vector<Ray>& rays, int& hits)
+	{
+		hits = 0;
+		for (size_t r = 0; r < rays.size(); r++)
+		{
+			bool expected = false;
+			float closest = 1e30f;
+			for (int32_t i = 0; i < mesh.num_triangles; i++)
+			{
+				float t;
+				if (HitTriangle(mesh, i, rays[r].origin, rays[r].direction, closest, t))
+				{
+					closest = t;
+					expected = true;
+				}
+			}
+
+			MeshBVHHit hit;
+			const bool found = bvh.intersect(mesh, rays[r].origin, rays[r].direction, 0.0f, 1e30f, hit);
+			if (found != expected || (found && hit.t != closest))
+				return false;
+			if (found)
+				hits++;
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	const std::string directory = "mesh_bvh_check";
+	makeDirectory(directory);
+
+	std::mt19937 rng(494);
+	Mesh mesh;
+	MakeSoup(mesh, 60000, rng);
+	const std::vector<Ray> rays = MakeRays(500, rng);
+
+	MeshBVHBuildOptions options;
+	options.threads = 1;
+	MeshBVH serial;
+	serial.build(mesh, options);
+	Check(!serial.nodes().empty() && serial.triangles().size() == static_cast<size_t>(mesh.num_triangles),
+		  "tree holds every triangle once");
+
+	int hits = 0;
+	Check(MatchesBruteForce(serial, mesh, rays, hits), "closest hits match every triangle tested");
+	Check(hits > 0 && hits < static_cast<int>(rays.size()), "rays both hit and miss");
+
+	bool sameForThreads = true;
+	const unsigned threadCounts[] = { 2, 3, 8, 0 };
+	for (unsigned i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++)
+	{
+		MeshBVHBuildOptions threaded = options;
+		threaded.threads = threadCounts[i];
+		MeshBVH tree;
+		tree.build(mesh, threaded);
+		sameForThreads = sameForThreads && SameTree(serial, tree) &&
+			MeshBVH::key(mesh, threaded) == MeshBVH::key(mesh, options);
+	}
+	Check(sameForThreads, "every thread count builds the same tree under the same key");
+
+	const std::string path = directory + "/soup.bvh";
+	const uint64_t key = MeshBVH::key(mesh, options);
+	Check(serial.save(path, key), "tree saves");
+
+	MeshBVH loaded;
+	Check(loaded.load(path, key) && SameTree(serial, loaded), "saved tree loads back the same");
+	Check(MatchesBruteForce(loaded, mesh, rays, hits), "loaded tree finds the same hits");
+
+	MeshBVH rejected;
+	Check(!rejected.load(path, key + 1), "another key is rejected");
+
+	// A different build option is a different key, so a stale tree is never used
+	MeshBVHBuildOptions wider = options;
+	wider.max_leaf_size = 8;
+	Check(MeshBVH::key(mesh, wider) != key && !rejected.load(path, MeshBVH::key(mesh, wider)),
+		  "other build options are rejected");
+
+	freeMesh(mesh);
+
+	std::cout << (g_failures == 0 ? "All checks passed" : "Some checks failed") << std::endl;
+	return g_failures == 0 ? 0 : 1;
+}
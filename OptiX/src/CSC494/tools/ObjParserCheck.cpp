@@ -0,0 +1,240 @@
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sutil/Mesh.h>
+#include <sutil/MappedFile.h>
+#include <sutil/ObjChunkParser.h>
+#include <sutil/tinyobjloader/tiny_obj_loader.h>
+
+/*
+	Loads OBJ files with the chunked parser and with tinyobj, merged the way MeshLoader
+	merges its shapes, and checks both give the same vertices, triangles and bounds.
+	Runs over generated files covering groups, unreferenced and out of order vertices,
+	split attribute indices and files large enough for several chunks, then over any
+	files given on the command line. Exits non-zero if any check fails.
+*/
+
+namespace
+{
+	unsigned int g_failures = 0;
+
+	void Check(bool passed, const std::string& what)
+	{
+		std::cout << (passed ? "pass  " : "FAIL  ") << what << std::endl;
+		if (!passed)
+			g_failures++;
+	}
+
+	// tinyobj and the parser round decimals separately, only files from elsewhere differ
+	bool Same(const float* a, const float* b, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (std::fabs(a[i] - b[i]) > 1e-6f * std::max(1.0f, std::fabs(a[i])))
+				return false;
+		}
+		return true;
+	}
+
+	// Zero counts and the empty bounds MeshLoader starts from
+	void ClearMesh(Mesh& mesh)
+	{
+		memset(&mesh, 0, sizeof(mesh));
+		std::fill(mesh.bbox_min, mesh.bbox_min + 3, 1e16f);
+		std::fill(mesh.bbox_max, mesh.bbox_max + 3, -1e16f);
+	}
+
+	// The baseline: tinyobj's shapes concatenated as MeshLoader::loadMeshOBJ does
+	bool LoadTinyObj(const std::string& path, Mesh& mesh)
+	{
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string err;
+		if (!tinyobj::LoadObj(shapes, materials, err, path.c_str()))
+			return false;
+
+		bool normals = true;
+		bool texcoords = true;
+		for (size_t i = 0; i < shapes.size(); i++)
+		{
+			mesh.num_vertices += static_cast<int32_t>(shapes[i].mesh.positions.size() / 3);
+			mesh.num_triangles += static_cast<int32_t>(shapes[i].mesh.indices.size() / 3);
+			normals = normals && !shapes[i].mesh.normals.empty();
+			texcoords = texcoords && !shapes[i].mesh.texcoords.empty();
+		}
+		mesh.has_normals = normals && !shapes.empty();
+		mesh.has_texcoords = texcoords && !shapes.empty();
+		mesh.num_materials = 1;
+		allocMesh(mesh);
+
+		int32_t vertexOffset = 0;
+		int32_t triangleOffset = 0;
+		for (size_t i = 0; i < shapes.size(); i++)
+		{
+			const tinyobj::mesh_t& shape = shapes[i].mesh;
+			for (size_t v = 0; v < shape.positions.size(); v += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					mesh.bbox_min[k] = std::min(mesh.bbox_min[k], shape.positions[v + k]);
+					mesh.bbox_max[k] = std::max(mesh.bbox_max[k], shape.positions[v + k]);
+				}
+			}
+			std::copy(shape.positions.begin(), shape.positions.end(), mesh.positions + vertexOffset * 3);
+			if (mesh.has_normals)
+				std::copy(shape.normals.begin(), shape.normals.end(), mesh.normals + vertexOffset * 3);
+			if (mesh.has_texcoords)
+				std::copy(shape.texcoords.begin(), shape.texcoords.end(), mesh.texcoords + vertexOffset * 2);
+			for (size_t t = 0; t < shape.indices.size(); t++)
+				mesh.tri_indices[triangleOffset * 3 + t] = static_cast<int32_t>(shape.indices[t]) + vertexOffset;
+
+			vertexOffset += static_cast<int32_t>(shape.positions.size() / 3);
+			triangleOffset += static_cast<int32_t>(shape.indices.size() / 3);
+		}
+		return true;
+	}
+
+	void Compare(const std::string& path, const std::string& name, bool mustParse)
+	{
+		Mesh baseline;
+		ClearMesh(baseline);
+		if (!LoadTinyObj(path, baseline))
+		{
+			Check(false, name + ": tinyobj loads");
+			return;
+		}
+
+		// Several threads even for small files so chunk borders fall inside groups
+		ObjChunkParser parser;
+		if (!parser.parse(path, 4))
+		{
+			// MeshLoader falls back to tinyobj, which is the baseline itself
+			Check(!mustParse, name + ": left to tinyobj");
+			freeMesh(baseline);
+			return;
+		}
+
+		Mesh mesh;
+		ClearMesh(mesh);
+		parser.scan(mesh);
+		allocMesh(mesh);
+		parser.load(mesh);
+
+		Check(mesh.num_vertices == baseline.num_vertices && mesh.num_triangles == baseline.num_triangles,
+			  name + ": same vertex and triangle counts");
+		Check(mesh.has_normals == baseline.has_normals && mesh.has_texcoords == baseline.has_texcoords,
+			  name + ": same attributes");
+
+		if (mesh.num_vertices == baseline.num_vertices && mesh.num_triangles == baseline.num_triangles)
+		{
+			Check(Same(mesh.positions, baseline.positions, mesh.num_vertices * 3) &&
+				  (!mesh.has_normals || Same(mesh.normals, baseline.normals, mesh.num_vertices * 3)) &&
+				  (!mesh.has_texcoords || Same(mesh.texcoords, baseline.texcoords, mesh.num_vertices * 2)),
+				  name + ": same vertices in the same order");
+			Check(std::equal(mesh.tri_indices, mesh.tri_indices + mesh.num_triangles * 3, baseline.tri_indices),
+				  name + ": same triangles");
+		}
+		Check(Same(mesh.bbox_min, baseline.bbox_min, 3) && Same(mesh.bbox_max, baseline.bbox_max, 3),
+			  name + ": same bounds");
+
+		freeMesh(mesh);
+		freeMesh(baseline);
+	}
+
+	std::string WriteFile(const std::string& directory, const std::string& name, const std::string& contents)
+	{
+		const std::string path = directory + "/" + name;
+		std::ofstream file(path.c_str(), std::ios::binary);
+		file << contents;
+		return path;
+	}
+
+	// One group per row of quads, with a far away unreferenced vertex per row
+	std::string GroupedGrid(int size)
+	{
+		std::ostringstream obj;
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+				obj << "v " << x << " " << y << " 0\n";
+			obj << "v " << 1000 + y << " 1000 1000\n";
+		}
+
+		const int row = size + 1;
+		for (int y = 0; y + 1 < size; y++)
+		{
+			obj << "g row" << y << "\n";
+			for (int x = 0; x + 1 < size; x++)
+			{
+				const int corner = y * row + x + 1;
+				obj << "f " << corner << " " << corner + 1 << " " << corner + row + 1 << " " << corner + row << "\n";
+			}
+		}
+		return obj.str();
+	}
+
+	// Separate triangles whose vertices come first in file order, the parser's direct path
+	std::string TriangleSoup(int triangles)
+	{
+		std::ostringstream obj;
+		for (int i = 0; i < triangles; i++)
+		{
+			obj << "v " << i << " 0 0\nv " << i << " 1 0\nv " << i << " 0 1\n";
+			obj << "vn 1 0 0\nvn 1 0 0\nvn 1 0 0\n";
+			obj << "f " << i * 3 + 1 << "//" << i * 3 + 1 << " " << i * 3 + 2 << "//" << i * 3 + 2 << " " << i * 3 + 3 << "//" << i * 3 + 3 << "\n";
+		}
+		return obj.str();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string directory = "obj_parser_check";
+	makeDirectory(directory);
+
+	Compare(WriteFile(directory, "groups.obj",
+					  "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nv 5 5 5\n"
+					  "g a\nf 1 2 3\n"
+					  "g b\nf 2 4 3\n"),
+			"groups and an unreferenced vertex", true);
+
+	Compare(WriteFile(directory, "first_use.obj",
+					  "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n"
+					  "f 4 2 3\nf 2 1 3\n"),
+			"vertices first used out of file order", true);
+
+	Compare(WriteFile(directory, "objects.obj",
+					  "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n"
+					  "vn 0 0 1\nvn 0 0 1\nvn 0 0 1\nvn 0 0 1\n"
+					  "o first\nf 1//1 2//2 3//3\n"
+					  "o second\nf 2//2 4//4 3//3\n"),
+			"objects sharing vertices", true);
+
+	Compare(WriteFile(directory, "split_indices.obj",
+					  "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n"
+					  "vt 0 0\nvt 1 1\n"
+					  "vn 0 0 1\nvn 0 0 -1\n"
+					  "f 1/1/1 2/2/1 3/1/2\nf 2/2/1 4/2/2 3/1/2\n"),
+			"separate v, vt and vn indices", true);
+
+	Compare(WriteFile(directory, "quads.obj",
+					  "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 0\nv 2 1 0\n"
+					  "f 1 2 3 4\nf 2 5 6 3\n"),
+			"quads", true);
+
+	Compare(WriteFile(directory, "grouped_grid.obj", GroupedGrid(400)), "grouped grid over several chunks", true);
+	Compare(WriteFile(directory, "soup.obj", TriangleSoup(100000)), "triangle soup over several chunks", true);
+
+	for (int i = 1; i < argc; i++)
+		Compare(argv[i], argv[i], false);
+
+	std::cout << (g_failures == 0 ? "All checks passed" : "Some checks failed") << std::endl;
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// STL
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sutil/MappedFile.h>
+#include <sutil/PtxDiskCache.h>
+
+/*
+	Checks the PTX disk cache with a stub compiler, without CUDA: a second request is a hit,
+	changing the compiler version, a header, an option or the source misses, a damaged entry
+	is recompiled and a failed compile is never stored. Exits non-zero if any check fails.
+*/
+
+namespace
+{
+	unsigned int g_compiles = 0;
+	unsigned int g_failures = 0;
+
+	// "PTX" that records what it was compiled from, so a wrong hit would show
+	bool StubCompile(const std::string& source, std::string& ptx, std::string& log)
+	{
+		g_compiles++;
+		if (source.find("#error") != std::string::npos)
+		{
+			log = "stub: #error";
+			return false;
+		}
+		ptx = "// stub ptx\n" + source;
+		return true;
+	}
+
+	void Check(bool passed, const char* what)
+	{
+		std::cout << (passed ? "pass  " : "FAIL  ") << what << std::endl;
+		if (!passed)
+			g_failures++;
+	}
+
+	void WriteFile(const std::string& path, const std::string& contents)
+	{
+		std::ofstream file(path.c_str(), std::ios::binary);
+		file << contents;
+	}
+
+	// Compiles through the cache and reports whether the stub compiler ran
+	bool Compiles(const PtxDiskCache& cache, const std::string& source, const std::vector<std::string>& includes,
+				  const std::vector<std::string>& options, std::string& ptx)
+	{
+		const unsigned int before = g_compiles;
+		std::string log;
+		bool fromCache = false;
+		cache.getOrCompile(source, includes, options, StubCompile, ptx, log, &fromCache);
+		return g_compiles != before && !fromCache;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string directory = argc > 1 ? argv[1] : "ptx_cache_check";
+	makeDirectory(directory);
+
+	// A fresh header pair each run, entries from earlier runs are keyed by other contents
+	const std::string headerDir = directory + "/include";
+	makeDirectory(headerDir);
+	const std::string run = std::to_string(static_cast<unsigned long long>(std::hash<std::string>()(directory) ^ std::chrono::steady_clock::now().time_since_epoch().count()));
+	WriteFile(headerDir + "/outer.h", "#include \"inner.h\"\n// outer " + run + "\n");
+	WriteFile(headerDir + "/inner.h", "// inner " + run + "\n");
+
+	const std::string source = "#include <outer.h>\nextern \"C\" __global__ void k() {}\n";
+	const std::vector<std::string> searchDirs(1, headerDir);
+	std::vector<std::string> options;
+	options.push_back("-arch=compute_30");
+
+	const PtxDiskCache cache(directory, "nvrtc 9.0");
+	std::string ptx;
+
+	std::vector<std::string> includes = PtxDiskCache::collectIncludes(source, searchDirs);
+	Check(includes.size() == 2, "follows nested includes");
+
+	Check(Compiles(cache, source, includes, options, ptx), "first request compiles");
+	Check(ptx == "// stub ptx\n" + source, "returns the compiled ptx");
+	Check(!Compiles(cache, source, includes, options, ptx), "second request is a hit");
+	Check(ptx == "// stub ptx\n" + source, "hit returns the same ptx");
+
+	const PtxDiskCache upgraded(directory, "nvrtc 9.1");
+	Check(Compiles(upgraded, source, includes, options, ptx), "new compiler version misses");
+	Check(!Compiles(upgraded, source, includes, options, ptx), "new compiler version then hits");
+
+	WriteFile(headerDir + "/inner.h", "// inner changed " + run + "\n");
+	includes = PtxDiskCache::collectIncludes(source, searchDirs);
+	Check(Compiles(cache, source, includes, options, ptx), "nested header change misses");
+
+	std::vector<std::string> otherOptions = options;
+	otherOptions.push_back("-lineinfo");
+	Check(Compiles(cache, source, includes, otherOptions, ptx), "option change misses");
+
+	const std::string otherSource = source + "// edited\n";
+	Check(Compiles(cache, otherSource, includes, options, ptx), "source change misses");
+
+	// Cut the entry short, as a crash mid write without the rename would
+	const uint64_t key = PtxDiskCache::hashKey(cache.compiler(), source, includes, options);
+	WriteFile(cache.entryPath(key), "PTXC");
+	Check(Compiles(cache, source, includes, options, ptx), "damaged entry recompiles");
+	Check(!Compiles(cache, source, includes, options, ptx), "rewritten entry hits");
+
+	const std::string broken = source + "#error\n";
+	Compiles(cache, broken, includes, options, ptx);
+	Check(Compiles(cache, broken, includes, options, ptx), "failed compile is not stored");
+
+	const PtxDiskCache disabled("", "nvrtc 9.0");
+	Compiles(disabled, source, includes, options, ptx);
+	Check(Compiles(disabled, source, includes, options, ptx), "empty directory always compiles");
+
+	std::cout << (g_failures == 0 ? "All checks passed" : "Some checks failed") << std::endl;
+	return g_failures == 0 ? 0 : 1;
+}
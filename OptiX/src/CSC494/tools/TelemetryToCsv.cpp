@@ -0,0 +1,137 @@
+// STL
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Telemetry.h"
+
+/*
+	Converts a telemetry log (see Telemetry.h) to two CSV files, one row per contact and one
+	per body state, both keyed by frame.
+*/
+
+namespace
+{
+	void PrintUsageAndExit(const char* argv0)
+	{
+		std::cerr << "\nUsage: " << argv0 << " <telemetry log> <output prefix>\n";
+		std::cerr <<
+			"Writes <output prefix>_contacts.csv and <output prefix>_bodies.csv.\n"
+			<< std::endl;
+
+		exit(1);
+	}
+
+	template<typename T>
+	const T* Read(const std::vector<char>& record, size_t& offset, size_t count = 1)
+	{
+		const T* p = reinterpret_cast<const T*>(record.data() + offset);
+		offset += sizeof(T) * count;
+		return offset <= record.size() ? p : 0;
+	}
+
+	void WriteFloats(std::ostream& out, const float* values, int count)
+	{
+		for (int i = 0; i < count; i++)
+			out << "," << values[i];
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+		PrintUsageAndExit(argv[0]);
+
+	std::ifstream log(argv[1], std::ios::in | std::ios::binary);
+	if (!log.is_open())
+	{
+		std::cerr << "Could not open '" << argv[1] << "'" << std::endl;
+		return 1;
+	}
+
+	uint32_t fileHeader[2];
+	if (!log.read(reinterpret_cast<char*>(fileHeader), sizeof(fileHeader)) || fileHeader[0] != TELEMETRY_MAGIC)
+	{
+		std::cerr << "'" << argv[1] << "' is not a telemetry log" << std::endl;
+		return 1;
+	}
+	if (fileHeader[1] != TELEMETRY_VERSION)
+	{
+		std::cerr << "Telemetry log version " << fileHeader[1] << ", expected " << TELEMETRY_VERSION << std::endl;
+		return 1;
+	}
+
+	const std::string prefix = argv[2];
+	std::ofstream contacts((prefix + "_contacts.csv").c_str());
+	std::ofstream bodies((prefix + "_bodies.csv").c_str());
+	if (!contacts.is_open() || !bodies.is_open())
+	{
+		std::cerr << "Could not write '" << prefix << "_contacts.csv' or '" << prefix << "_bodies.csv'" << std::endl;
+		return 1;
+	}
+
+	contacts << "frame,time,body_a,body_b,samples,volume,"
+		"entry_normal_x,entry_normal_y,entry_normal_z,entry_point_x,entry_point_y,entry_point_z,"
+		"exit_normal_x,exit_normal_y,exit_normal_z,exit_point_x,exit_point_y,exit_point_z\n";
+	bodies << "frame,time,body,position_x,position_y,position_z,quaternion_s,quaternion_x,quaternion_y,quaternion_z,"
+		"velocity_x,velocity_y,velocity_z,spin_x,spin_y,spin_z\n";
+
+	unsigned int frames = 0;
+	unsigned int dropped = 0;
+	std::vector<char> record;
+	uint32_t length;
+	while (log.read(reinterpret_cast<char*>(&length), sizeof(length)))
+	{
+		record.resize(length);
+		if (!log.read(record.data(), length))
+		{
+			// The writer was stopped partway through a record
+			std::cerr << "Truncated record after frame " << frames << ", stopping" << std::endl;
+			break;
+		}
+
+		size_t offset = 0;
+		const uint32_t* type = Read<uint32_t>(record, offset);
+		if (!type || *type != TELEMETRY_FRAME)
+			continue;
+
+		const TelemetryFrame* frame = Read<TelemetryFrame>(record, offset);
+		const TelemetryContact* frameContacts = frame ? Read<TelemetryContact>(record, offset, frame->contactCount) : 0;
+		const TelemetryBody* frameBodies = frameContacts ? Read<TelemetryBody>(record, offset, frame->bodyCount) : 0;
+		if (!frameBodies)
+		{
+			std::cerr << "Malformed frame record after frame " << frames << ", skipped" << std::endl;
+			continue;
+		}
+
+		for (uint32_t i = 0; i < frame->contactCount; i++)
+		{
+			const TelemetryContact& contact = frameContacts[i];
+			contacts << frame->frame << "," << frame->time << "," << contact.bodyA << "," << contact.bodyB << ","
+					 << contact.samples << "," << contact.volume;
+			WriteFloats(contacts, contact.entryNormal, 3);
+			WriteFloats(contacts, contact.entryPoint, 3);
+			WriteFloats(contacts, contact.exitNormal, 3);
+			WriteFloats(contacts, contact.exitPoint, 3);
+			contacts << "\n";
+		}
+
+		for (uint32_t i = 0; i < frame->bodyCount; i++)
+		{
+			const TelemetryBody& body = frameBodies[i];
+			bodies << frame->frame << "," << frame->time << "," << body.id;
+			WriteFloats(bodies, body.position, 3);
+			WriteFloats(bodies, body.quaternion, 4);
+			WriteFloats(bodies, body.velocity, 3);
+			WriteFloats(bodies, body.spin, 3);
+			bodies << "\n";
+		}
+
+		frames++;
+		dropped += frame->droppedFrames;
+	}
+
+	std::cout << frames << " frames converted, " << dropped << " dropped while recording" << std::endl;
+	return 0;
+}
@@ -36,6 +36,7 @@
 
 #include <optix_world.h>
 #include "RayStructs.h"
+#include "IntersectionKernels.h"
 
 using namespace optix;
 
@@ -71,7 +72,7 @@ void meshIntersect( int primIdx )
   // Intersect ray with triangle
   float3 n;
   float  t, beta, gamma;
-  if( intersect_triangle( ray, p0, p1, p2, n, t, beta, gamma ) ) {
+  if( IntersectTriangle( ray.origin, ray.direction, ray.tmin, ray.tmax, p0, p1, p2, n, t, beta, gamma ) ) {
 
     if(  rtPotentialIntersection( t ) ) 
 	{
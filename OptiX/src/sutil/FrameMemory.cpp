@@ -0,0 +1,96 @@
+#include <sutil/FrameMemory.h>
+
+namespace
+{
+
+int sizeClass( size_t bytes )
+{
+    int c = 0;
+    while( ( static_cast<size_t>( 1 ) << ( HostPool::MIN_CLASS_BITS + c ) ) < bytes )
+    {
+        if( ++c == HostPool::CLASS_COUNT )
+            throw std::bad_alloc();
+    }
+    return c;
+}
+
+size_t classBytes( int c )
+{
+    return static_cast<size_t>( 1 ) << ( HostPool::MIN_CLASS_BITS + c );
+}
+
+} // namespace
+
+
+HostPool::HostPool()
+    : m_cachedBytes( 0 )
+{
+    for( int c = 0; c < CLASS_COUNT; ++c )
+        m_free[c] = 0;
+}
+
+
+HostPool::~HostPool()
+{
+    trim();
+}
+
+
+void* HostPool::acquire( size_t bytes )
+{
+    const int c = sizeClass( bytes );
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if( FreeBlock* block = m_free[c] )
+        {
+            m_free[c] = block->next;
+            m_cachedBytes -= classBytes( c );
+            return block;
+        }
+    }
+    return ::operator new( classBytes( c ) );
+}
+
+
+void HostPool::release( void* block, size_t bytes )
+{
+    if( !block )
+        return;
+
+    const int c = sizeClass( bytes );
+    FreeBlock* freeBlock = static_cast<FreeBlock*>( block );
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    freeBlock->next = m_free[c];
+    m_free[c] = freeBlock;
+    m_cachedBytes += classBytes( c );
+}
+
+
+void HostPool::trim()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for( int c = 0; c < CLASS_COUNT; ++c )
+    {
+        while( FreeBlock* block = m_free[c] )
+        {
+            m_free[c] = block->next;
+            ::operator delete( block );
+        }
+    }
+    m_cachedBytes = 0;
+}
+
+
+size_t HostPool::cachedBytes() const
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_cachedBytes;
+}
+
+
+HostPool& hostPool()
+{
+    static HostPool pool;
+    return pool;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <sutilapi.h>
+
+#include <stddef.h>
+#include <mutex>
+#include <new>
+
+//-----------------------------------------------------------------------------
+//
+// Host memory for per frame temporaries, so a steady state frame doesn't
+// touch the heap
+//
+//-----------------------------------------------------------------------------
+
+// Free lists of power of two blocks. A released block goes back on its class'
+// list and is handed out again for any request of that class; the lists are
+// threaded through the free blocks themselves so releasing never allocates.
+// Safe to share between threads
+class SUTILCLASSAPI HostPool
+{
+public:
+    static const int MIN_CLASS_BITS = 8;     // 256 byte blocks and up
+    static const int CLASS_COUNT    = 32;
+
+    SUTILAPI HostPool();
+    SUTILAPI ~HostPool();
+
+    // Block of at least bytes, aligned for any type
+    SUTILAPI void* acquire( size_t bytes );
+
+    // bytes must be the size the block was acquired with
+    SUTILAPI void release( void* block, size_t bytes );
+
+    // Frees every cached block
+    SUTILAPI void trim();
+
+    SUTILAPI size_t cachedBytes() const;
+
+private:
+    HostPool( const HostPool& );
+    HostPool& operator=( const HostPool& );
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    FreeBlock*         m_free[CLASS_COUNT];
+    size_t             m_cachedBytes;
+    mutable std::mutex m_mutex;
+};
+
+// Pool shared by the whole process
+SUTILAPI HostPool& hostPool();
+
+// Plain data array drawn from hostPool() and returned to it on destruction
+template<typename T>
+class PooledArray
+{
+public:
+    explicit PooledArray( size_t count )
+        : m_ptr( static_cast<T*>( hostPool().acquire( count * sizeof( T ) ) ) ),
+          m_count( count )
+    {
+    }
+
+    ~PooledArray() { hostPool().release( m_ptr, m_count * sizeof( T ) ); }
+
+    T*       data()       { return m_ptr; }
+    const T* data() const { return m_ptr; }
+    size_t   size() const { return m_count; }
+
+    T&       operator[]( size_t i )       { return m_ptr[i]; }
+    const T& operator[]( size_t i ) const { return m_ptr[i]; }
+
+private:
+    PooledArray( const PooledArray& );
+    PooledArray& operator=( const PooledArray& );
+
+    T*     m_ptr;
+    size_t m_count;
+};
@@ -233,6 +233,14 @@ float* HDRLoader::raster()const
 optix::TextureSampler loadHDRTexture( optix::Context context,
                                       const std::string& filename,
                                       const optix::float3& default_color )
+{
+  HDRLoader hdr( filename );
+  return loadHDRTexture( context, hdr, default_color );
+}
+
+optix::TextureSampler loadHDRTexture( optix::Context context,
+                                      const HDRLoader& hdr,
+                                      const optix::float3& default_color )
 {
   // Create tex sampler and populate with default values
   optix::TextureSampler sampler = context->createTextureSampler();
@@ -245,8 +253,7 @@ optix::TextureSampler loadHDRTexture( optix::Context context,
   sampler->setMipLevelCount( 1u );
   sampler->setArraySize( 1u );
 
-  // Read in HDR, set texture buffer to empty buffer if fails
-  HDRLoader hdr( filename );
+  // Set texture buffer to empty buffer if the HDR failed to load
   if ( hdr.failed() ) {
 
     // Create buffer with single texel set to default_color
@@ -46,6 +46,13 @@ SUTILAPI optix::TextureSampler loadHDRTexture( optix::Context context,
                                                const std::string& hdr_filename,
                                                const optix::float3& default_color );
 
+class HDRLoader;
+
+// Same as above for an image that was already decoded, e.g. on a worker thread.
+SUTILAPI optix::TextureSampler loadHDRTexture( optix::Context context,
+                                               const HDRLoader& hdr,
+                                               const optix::float3& default_color );
+
 
 //-----------------------------------------------------------------------------
 //
@@ -0,0 +1,629 @@
+#include <sutil/ImageWriter.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <cctype>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#  include <tmmintrin.h>
+#  define IMAGEWRITER_SSSE3 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define IMAGEWRITER_SSE2 1
+#endif
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+//
+// Gamma lookup
+//
+// The reference is static_cast<int>( std::pow( c, 1/2.2 ) * 255 ), what
+// displayBufferPPM used per channel. The table is indexed by the exponent and the
+// top 8 mantissa bits of c; across one entry the result moves by less than one,
+// so the entry's value plus one threshold test reproduces the reference exactly
+//
+//------------------------------------------------------------------------------
+
+const uint32_t GAMMA_MIN_BITS  = 107u << 23;    // 2^-20, anything smaller comes out as 0
+const uint32_t GAMMA_ONE_BITS  = 127u << 23;
+const int      GAMMA_SHIFT     = 15;
+const size_t   GAMMA_ENTRIES   = ( GAMMA_ONE_BITS - GAMMA_MIN_BITS ) >> GAMMA_SHIFT;
+
+inline uint32_t floatBits( float f )
+{
+    uint32_t bits;
+    memcpy( &bits, &f, sizeof( bits ) );
+    return bits;
+}
+
+inline float bitsFloat( uint32_t bits )
+{
+    float f;
+    memcpy( &f, &bits, sizeof( f ) );
+    return f;
+}
+
+inline int gammaReference( float c )
+{
+    const int P = static_cast<int>( std::pow( c, 1.0f / 2.2f ) * 255.0f );
+    return P < 0 ? 0 : P > 0xff ? 0xff : P;
+}
+
+struct GammaTable
+{
+    unsigned char entries[GAMMA_ENTRIES];
+    float         thresholds[257];      // Smallest input giving at least v, thresholds[256] is never reached
+
+    GammaTable()
+    {
+        for( size_t i = 0; i < GAMMA_ENTRIES; ++i )
+            entries[i] = static_cast<unsigned char>( gammaReference( bitsFloat( GAMMA_MIN_BITS + ( static_cast<uint32_t>( i ) << GAMMA_SHIFT ) ) ) );
+
+        thresholds[0] = 0.0f;
+        for( int v = 1; v <= 255; ++v )
+        {
+            // Walk from the analytic inverse to the first float that reaches v
+            float c = std::pow( v / 255.0f, 2.2f );
+            while( c > 0.0f && gammaReference( c ) >= v )
+                c = bitsFloat( floatBits( c ) - 1 );
+            while( gammaReference( c ) < v )
+                c = bitsFloat( floatBits( c ) + 1 );
+            thresholds[v] = c;
+        }
+        thresholds[256] = 2.0f;
+    }
+};
+
+const GammaTable& gammaTable()
+{
+    static const GammaTable table;
+    return table;
+}
+
+inline unsigned char gammaEncode( const GammaTable& table, float c )
+{
+    const uint32_t bits = floatBits( c );
+    if( bits < GAMMA_MIN_BITS )                 // Also 0, negatives are above GAMMA_ONE_BITS
+        return 0;
+    if( bits >= GAMMA_ONE_BITS )
+        return bits < 0x7f800000u ? 0xff : 0;   // [1, inf], negatives and NaN
+    const unsigned char v = table.entries[( bits - GAMMA_MIN_BITS ) >> GAMMA_SHIFT];
+    return c >= table.thresholds[v + 1] ? v + 1 : v;
+}
+
+inline unsigned char linearEncode( float c )
+{
+    const int P = static_cast<int>( c * 255.0f );
+    return static_cast<unsigned char>( P < 0 ? 0 : P > 0xff ? 0xff : P );
+}
+
+
+//------------------------------------------------------------------------------
+//
+// Row conversion. The vector loops stop while a full 16 byte store still fits in
+// the destination row and leave the rest to the scalar tail
+//
+//------------------------------------------------------------------------------
+
+// 4 byte pixels to 3 byte ones, taking channels in order r, g, b of the source
+void packRow( const unsigned char* src, unsigned char* dst, int width, int r, int g, int b )
+{
+    int i = 0;
+#if defined(IMAGEWRITER_SSSE3)
+    const __m128i shuffle = _mm_setr_epi8( r, g, b, 4 + r, 4 + g, 4 + b, 8 + r, 8 + g, 8 + b, 12 + r, 12 + g, 12 + b,
+                                           -1, -1, -1, -1 );
+    for( ; i + 6 <= width; i += 4 )
+    {
+        const __m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + 4 * i ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( dst + 3 * i ), _mm_shuffle_epi8( p, shuffle ) );
+    }
+#elif defined(IMAGEWRITER_SSE2)
+    // Swap the outer channels in the register when asked, then each pixel is one
+    // 4 byte store overlapping the next pixel's first byte
+    if( r == 2 && g == 1 && b == 0 )
+    {
+        const __m128i ga = _mm_set1_epi32( 0xff00ff00 );
+        const __m128i low = _mm_set1_epi32( 0x000000ff );
+        for( ; i + 6 <= width; i += 4 )
+        {
+            const __m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + 4 * i ) );
+            const __m128i swapped = _mm_or_si128( _mm_and_si128( p, ga ),
+                                                  _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p, 16 ), low ),
+                                                                _mm_slli_epi32( _mm_and_si128( p, low ), 16 ) ) );
+            uint32_t pixels[4];
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( pixels ), swapped );
+            memcpy( dst + 3 * i + 0, &pixels[0], 4 );
+            memcpy( dst + 3 * i + 3, &pixels[1], 4 );
+            memcpy( dst + 3 * i + 6, &pixels[2], 4 );
+            memcpy( dst + 3 * i + 9, &pixels[3], 4 );
+        }
+    }
+    else if( r == 0 && g == 1 && b == 2 )
+    {
+        for( ; i + 2 <= width; ++i )
+            memcpy( dst + 3 * i, src + 4 * i, 4 );
+    }
+#endif
+    for( ; i < width; ++i )
+    {
+        dst[3 * i + 0] = src[4 * i + r];
+        dst[3 * i + 1] = src[4 * i + g];
+        dst[3 * i + 2] = src[4 * i + b];
+    }
+}
+
+// count floats to bytes, c * 255 truncated and clamped
+void linearRow( const float* src, unsigned char* dst, size_t count )
+{
+    size_t i = 0;
+#if defined(IMAGEWRITER_SSSE3) || defined(IMAGEWRITER_SSE2)
+    const __m128 scale = _mm_set1_ps( 255.0f );
+    for( ; i + 16 <= count; i += 16 )
+    {
+        const __m128i a = _mm_cvttps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i + 0 ), scale ) );
+        const __m128i b = _mm_cvttps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i + 4 ), scale ) );
+        const __m128i c = _mm_cvttps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i + 8 ), scale ) );
+        const __m128i d = _mm_cvttps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i + 12 ), scale ) );
+        // Out of range and NaN convert to INT_MIN, which saturates to 0 like the scalar clamp
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( dst + i ),
+                          _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) ) );
+    }
+#endif
+    for( ; i < count; ++i )
+        dst[i] = linearEncode( src[i] );
+}
+
+void gammaRow( const GammaTable& table, const float* src, unsigned char* dst, size_t count )
+{
+    for( size_t i = 0; i < count; ++i )
+        dst[i] = gammaEncode( table, src[i] );
+}
+
+void encodeRow( const GammaTable* table, const float* src, unsigned char* dst, size_t count )
+{
+    if( table )
+        gammaRow( *table, src, dst, count );
+    else
+        linearRow( src, dst, count );
+}
+
+} // namespace
+
+
+size_t imagePixelBytes( RTformat format )
+{
+    switch( format )
+    {
+        case RT_FORMAT_UNSIGNED_BYTE4: return 4;
+        case RT_FORMAT_FLOAT:          return sizeof( float );
+        case RT_FORMAT_FLOAT3:         return 3 * sizeof( float );
+        case RT_FORMAT_FLOAT4:         return 4 * sizeof( float );
+        default:                       return 0;
+    }
+}
+
+
+bool convertToRGB8( const void* src, RTformat format, int width, int height, bool srgb, unsigned char* dst )
+{
+    const GammaTable* table = srgb ? &gammaTable() : 0;
+    const size_t srcRowBytes = imagePixelBytes( format ) * width;
+    const size_t dstRowBytes = 3 * static_cast<size_t>( width );
+    if( srcRowBytes == 0 )
+        return false;
+
+    for( int j = height - 1; j >= 0; --j )
+    {
+        const unsigned char* srcRow = static_cast<const unsigned char*>( src ) + srcRowBytes * j;
+        unsigned char* dstRow = dst + dstRowBytes * ( height - 1 - j );
+
+        switch( format )
+        {
+            case RT_FORMAT_UNSIGNED_BYTE4:
+                packRow( srcRow, dstRow, width, 2, 1, 0 );
+                break;
+
+            case RT_FORMAT_FLOAT:
+            {
+                const float* f = reinterpret_cast<const float*>( srcRow );
+                for( int i = 0; i < width; ++i )
+                {
+                    const unsigned char v = table ? gammaEncode( *table, f[i] ) : linearEncode( f[i] );
+                    dstRow[3 * i + 0] = v;
+                    dstRow[3 * i + 1] = v;
+                    dstRow[3 * i + 2] = v;
+                }
+                break;
+            }
+
+            case RT_FORMAT_FLOAT3:
+                encodeRow( table, reinterpret_cast<const float*>( srcRow ), dstRow, dstRowBytes );
+                break;
+
+            case RT_FORMAT_FLOAT4:
+            {
+                // Encoded with alpha in chunks, then compacted like byte pixels
+                const float* f = reinterpret_cast<const float*>( srcRow );
+                unsigned char rgba[4 * 64];
+                for( int i = 0; i < width; i += 64 )
+                {
+                    const int chunk = width - i < 64 ? width - i : 64;
+                    encodeRow( table, f + 4 * i, rgba, 4 * chunk );
+                    packRow( rgba, dstRow + 3 * i, chunk, 0, 1, 2 );
+                }
+                break;
+            }
+
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+
+bool convertToRGBF( const void* src, RTformat format, int width, int height, float* dst )
+{
+    const size_t count = static_cast<size_t>( width ) * height;
+    switch( format )
+    {
+        case RT_FORMAT_UNSIGNED_BYTE4:
+        {
+            const unsigned char* p = static_cast<const unsigned char*>( src );
+            for( size_t i = 0; i < count; ++i, p += 4, dst += 3 )
+            {
+                dst[0] = p[2] * ( 1.0f / 255.0f );
+                dst[1] = p[1] * ( 1.0f / 255.0f );
+                dst[2] = p[0] * ( 1.0f / 255.0f );
+            }
+            return true;
+        }
+
+        case RT_FORMAT_FLOAT:
+        {
+            const float* p = static_cast<const float*>( src );
+            for( size_t i = 0; i < count; ++i, dst += 3 )
+                dst[0] = dst[1] = dst[2] = p[i];
+            return true;
+        }
+
+        case RT_FORMAT_FLOAT3:
+            memcpy( dst, src, count * 3 * sizeof( float ) );
+            return true;
+
+        case RT_FORMAT_FLOAT4:
+        {
+            const float* p = static_cast<const float*>( src );
+            for( size_t i = 0; i < count; ++i, p += 4, dst += 3 )
+            {
+                dst[0] = p[0];
+                dst[1] = p[1];
+                dst[2] = p[2];
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+
+bool writePPM( const char* filename, const unsigned char* rgb, int width, int height )
+{
+    FILE* file = fopen( filename, "wb" );
+    if( !file )
+        return false;
+
+    fprintf( file, "P6\n%d %d\n255\n", width, height );
+    const size_t bytes = 3 * static_cast<size_t>( width ) * height;
+    const bool written = fwrite( rgb, 1, bytes, file ) == bytes;
+    return fclose( file ) == 0 && written;
+}
+
+
+bool writePFM( const char* filename, const float* rgb, int width, int height )
+{
+    FILE* file = fopen( filename, "wb" );
+    if( !file )
+        return false;
+
+    // A negative scale marks little endian data
+    const uint16_t order = 1;
+    const bool littleEndian = *reinterpret_cast<const unsigned char*>( &order ) == 1;
+    fprintf( file, "PF\n%d %d\n%s\n", width, height, littleEndian ? "-1.0" : "1.0" );
+    const size_t count = 3 * static_cast<size_t>( width ) * height;
+    const bool written = fwrite( rgb, sizeof( float ), count, file ) == count;
+    return fclose( file ) == 0 && written;
+}
+
+
+//------------------------------------------------------------------------------
+//
+// FrameRecorder
+//
+//------------------------------------------------------------------------------
+
+bool FrameRecorder::formatFromPath( const std::string& path, Format& format )
+{
+    const size_t dot = path.find_last_of( '.' );
+    if( dot == std::string::npos )
+        return false;
+
+    std::string extension = path.substr( dot + 1 );
+    for( size_t i = 0; i < extension.size(); ++i )
+        extension[i] = static_cast<char>( tolower( extension[i] ) );
+
+    if( extension == "ppm" )
+        format = FORMAT_PPM;
+    else if( extension == "pfm" )
+        format = FORMAT_PFM;
+    else if( extension == "y4m" )
+        format = FORMAT_Y4M;
+    else
+        return false;
+    return true;
+}
+
+
+bool FrameRecorder::isFramePattern( const std::string& pattern )
+{
+    unsigned int conversions = 0;
+    for( size_t i = 0; i < pattern.size(); ++i )
+    {
+        if( pattern[i] != '%' )
+            continue;
+
+        if( ++i < pattern.size() && pattern[i] == '%' )
+            continue;
+
+        // %[0][width]u or d, nothing else
+        if( i < pattern.size() && pattern[i] == '0' )
+            ++i;
+        while( i < pattern.size() && isdigit( static_cast<unsigned char>( pattern[i] ) ) )
+            ++i;
+        if( i == pattern.size() || ( pattern[i] != 'u' && pattern[i] != 'd' ) )
+            return false;
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
+
+FrameRecorder::FrameRecorder( const std::string& path, Format format, unsigned int ringSize )
+    : m_pattern( path ),
+      m_format( format ),
+      m_srgb( false ),
+      m_fps( 60 ),
+      m_waitWhenFull( false ),
+      m_slots( ringSize > 0 ? ringSize : 1 ),
+      m_head( 0 ),
+      m_tail( 0 ),
+      m_queued( 0 ),
+      m_stopping( false ),
+      m_recorded( 0 ),
+      m_dropped( 0 ),
+      m_stream( 0 ),
+      m_streamWidth( 0 ),
+      m_streamHeight( 0 ),
+      m_failed( false )
+{
+    // The pattern becomes a snprintf format, so anything but a single frame number conversion
+    // is taken literally and the number goes before the extension
+    if( m_format != FORMAT_Y4M && !isFramePattern( m_pattern ) )
+    {
+        std::string literal;
+        for( size_t i = 0; i < m_pattern.size(); ++i )
+        {
+            literal += m_pattern[i];
+            if( m_pattern[i] == '%' )
+                literal += '%';
+        }
+
+        const size_t slash = literal.find_last_of( "/\\" );
+        const size_t dot = literal.find_last_of( '.' );
+        const bool hasExtension = dot != std::string::npos && ( slash == std::string::npos || dot > slash );
+        literal.insert( hasExtension ? dot : literal.size(), "_%05u" );
+        m_pattern = literal;
+    }
+
+    m_writer = std::thread( &FrameRecorder::writerLoop, this );
+}
+
+
+FrameRecorder::~FrameRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stopping = true;
+    }
+    m_queuedChanged.notify_all();
+    m_writer.join();
+
+    if( m_stream )
+        fclose( m_stream );
+}
+
+
+bool FrameRecorder::record( optix::Buffer buffer )
+{
+    RTsize width, height;
+    buffer->getSize( width, height );
+    const RTformat format = buffer->getFormat();
+
+    const void* data = buffer->map( 0, RT_BUFFER_MAP_READ );
+    const bool recorded = record( data, format, static_cast<unsigned int>( width ), static_cast<unsigned int>( height ) );
+    buffer->unmap();
+    return recorded;
+}
+
+
+bool FrameRecorder::record( const void* data, RTformat format, unsigned int width, unsigned int height )
+{
+    const size_t pixelBytes = imagePixelBytes( format );
+    if( pixelBytes == 0 )
+    {
+        std::cerr << "FrameRecorder: unsupported buffer format" << std::endl;
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        if( m_queued == m_slots.size() )
+        {
+            if( !m_waitWhenFull )
+            {
+                ++m_dropped;
+                return false;
+            }
+            m_queuedChanged.wait( lock, [this]() { return m_queued < m_slots.size(); } );
+        }
+    }
+
+    // The head slot isn't queued, so the writer won't touch it until it is
+    Slot& slot = m_slots[m_head];
+    const size_t bytes = pixelBytes * width * height;
+    if( slot.data.size() < bytes )
+        slot.data.resize( bytes );
+    memcpy( &slot.data[0], data, bytes );
+    slot.format = format;
+    slot.width = width;
+    slot.height = height;
+    slot.frame = m_recorded++;
+    m_head = ( m_head + 1 ) % m_slots.size();
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        ++m_queued;
+    }
+    m_queuedChanged.notify_all();
+    return true;
+}
+
+
+void FrameRecorder::flush()
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_queuedChanged.wait( lock, [this]() { return m_queued == 0; } );
+}
+
+
+void FrameRecorder::writerLoop()
+{
+    for( ;; )
+    {
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_queuedChanged.wait( lock, [this]() { return m_queued > 0 || m_stopping; } );
+            if( m_queued == 0 )
+                return;
+        }
+
+        write( m_slots[m_tail] );
+        m_tail = ( m_tail + 1 ) % m_slots.size();
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            --m_queued;
+        }
+        m_queuedChanged.notify_all();
+    }
+}
+
+
+void FrameRecorder::write( const Slot& slot )
+{
+    if( m_failed )
+        return;
+
+    if( m_format == FORMAT_Y4M )
+    {
+        writeY4M( slot );
+        return;
+    }
+
+    char filename[1024];
+    snprintf( filename, sizeof( filename ), m_pattern.c_str(), slot.frame );
+
+    const size_t count = 3 * static_cast<size_t>( slot.width ) * slot.height;
+    bool written;
+    if( m_format == FORMAT_PFM )
+    {
+        if( m_rgbf.size() < count )
+            m_rgbf.resize( count );
+        convertToRGBF( &slot.data[0], slot.format, slot.width, slot.height, &m_rgbf[0] );
+        written = writePFM( filename, &m_rgbf[0], slot.width, slot.height );
+    }
+    else
+    {
+        if( m_rgb.size() < count )
+            m_rgb.resize( count );
+        convertToRGB8( &slot.data[0], slot.format, slot.width, slot.height, m_srgb, &m_rgb[0] );
+        written = writePPM( filename, &m_rgb[0], slot.width, slot.height );
+    }
+
+    if( !written )
+    {
+        std::cerr << "FrameRecorder: could not write '" << filename << "', recording stopped" << std::endl;
+        m_failed = true;
+    }
+}
+
+
+/*
+    BT.601 limited range, one Y, U and V plane per frame. Frames that don't match
+    the stream's size are resampled to it by the nearest pixel
+*/
+void FrameRecorder::writeY4M( const Slot& slot )
+{
+    if( !m_stream )
+    {
+        m_stream = fopen( m_pattern.c_str(), "wb" );
+        if( !m_stream )
+        {
+            std::cerr << "FrameRecorder: could not open '" << m_pattern << "', recording stopped" << std::endl;
+            m_failed = true;
+            return;
+        }
+        m_streamWidth = slot.width;
+        m_streamHeight = slot.height;
+        fprintf( m_stream, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", m_streamWidth, m_streamHeight, m_fps );
+    }
+
+    const size_t count = 3 * static_cast<size_t>( slot.width ) * slot.height;
+    if( m_rgb.size() < count )
+        m_rgb.resize( count );
+    convertToRGB8( &slot.data[0], slot.format, slot.width, slot.height, m_srgb, &m_rgb[0] );
+
+    const size_t plane = static_cast<size_t>( m_streamWidth ) * m_streamHeight;
+    if( m_yuv.size() < 3 * plane )
+        m_yuv.resize( 3 * plane );
+    unsigned char* Y = &m_yuv[0];
+    unsigned char* U = Y + plane;
+    unsigned char* V = U + plane;
+
+    for( unsigned int y = 0; y < m_streamHeight; ++y )
+    {
+        const unsigned int sy = y * slot.height / m_streamHeight;
+        for( unsigned int x = 0; x < m_streamWidth; ++x )
+        {
+            const unsigned int sx = x * slot.width / m_streamWidth;
+            const unsigned char* p = &m_rgb[3 * ( static_cast<size_t>( sy ) * slot.width + sx )];
+            const int r = p[0], g = p[1], b = p[2];
+            const size_t i = static_cast<size_t>( y ) * m_streamWidth + x;
+            Y[i] = static_cast<unsigned char>( ( ( 66 * r + 129 * g + 25 * b + 128 ) >> 8 ) + 16 );
+            U[i] = static_cast<unsigned char>( ( ( -38 * r - 74 * g + 112 * b + 128 ) >> 8 ) + 128 );
+            V[i] = static_cast<unsigned char>( ( ( 112 * r - 94 * g - 18 * b + 128 ) >> 8 ) + 128 );
+        }
+    }
+
+    fputs( "FRAME\n", m_stream );
+    if( fwrite( &m_yuv[0], 1, 3 * plane, m_stream ) != 3 * plane )
+    {
+        std::cerr << "FrameRecorder: could not write '" << m_pattern << "', recording stopped" << std::endl;
+        m_failed = true;
+    }
+}
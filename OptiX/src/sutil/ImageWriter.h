@@ -0,0 +1,125 @@
+#pragma once
+
+#include <sutilapi.h>
+#include <optixu/optixpp_namespace.h>
+
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Saving output buffers: pixel conversion, PPM/PFM files and an asynchronous
+// recorder for frame sequences
+//
+//-----------------------------------------------------------------------------
+
+// Bytes per pixel of the formats below, 0 for any other format
+SUTILAPI size_t imagePixelBytes( RTformat format );
+
+// Converts a bottom up UNSIGNED_BYTE4 (BGRA), FLOAT, FLOAT3 or FLOAT4 buffer to
+// top down 8 bit RGB. Float channels are gamma corrected when srgb is set, with
+// the same rounding as std::pow( c, 1/2.2 ). Returns false for other formats
+SUTILAPI bool convertToRGB8( const void* src, RTformat format, int width, int height, bool srgb, unsigned char* dst );
+
+// Same buffers to bottom up float RGB, the row order PFM uses. Bytes are scaled
+// to [0, 1] as they are
+SUTILAPI bool convertToRGBF( const void* src, RTformat format, int width, int height, float* dst );
+
+// Binary P6 and PF files. Return false if the file can't be written
+SUTILAPI bool writePPM( const char* filename, const unsigned char* rgb, int width, int height );
+SUTILAPI bool writePFM( const char* filename, const float* rgb, int width, int height );
+
+// Records frames from the render loop without waiting on the disk. record()
+// copies the buffer into a free slot of a fixed ring and returns; a writer
+// thread converts the slot and writes it out. When every slot is still queued
+// the frame is dropped, unless waitWhenFull is set.
+//
+// record() must always be called from the same thread
+class SUTILCLASSAPI FrameRecorder
+{
+public:
+    enum Format
+    {
+        FORMAT_PPM,     // Numbered 8 bit images
+        FORMAT_PFM,     // Numbered float images
+        FORMAT_Y4M      // One uncompressed 4:4:4 stream, sized by its first frame
+    };
+
+    // From the extension of path, .ppm, .pfm or .y4m
+    SUTILAPI static bool formatFromPath( const std::string& path, Format& format );
+
+    // Image sequences take a printf pattern with one frame number conversion, frame_%05u.ppm
+    // (%u or %d with an optional zero padded width, %% for a literal percent sign). Any other
+    // path is used literally with the number added before the extension, frame_00000.ppm
+    SUTILAPI FrameRecorder( const std::string& path, Format format, unsigned int ringSize = 4 );
+
+    // Writes every queued frame first
+    SUTILAPI ~FrameRecorder();
+
+    // Set before the first frame
+    void setSrgbConversion( bool srgb )         { m_srgb = srgb; }
+    void setFrameRate( unsigned int fps )       { m_fps = fps; }
+    void setWaitWhenFull( bool waitWhenFull )   { m_waitWhenFull = waitWhenFull; }
+
+    // Return false if the frame was dropped
+    SUTILAPI bool record( optix::Buffer buffer );
+    SUTILAPI bool record( const void* data, RTformat format, unsigned int width, unsigned int height );
+
+    // Blocks until the queued frames are written
+    SUTILAPI void flush();
+
+    unsigned int framesRecorded() const { return m_recorded; }
+    unsigned int framesDropped()  const { return m_dropped; }
+
+private:
+    FrameRecorder( const FrameRecorder& );
+    FrameRecorder& operator=( const FrameRecorder& );
+
+    struct Slot
+    {
+        std::vector<unsigned char> data;    // Keeps its capacity, so recording doesn't allocate once the ring is warm
+        RTformat                   format;
+        unsigned int               width;
+        unsigned int               height;
+        unsigned int               frame;
+    };
+
+    // Exactly one %u or %d conversion, safe to hand to snprintf with the frame number
+    static bool isFramePattern( const std::string& pattern );
+
+    void writerLoop();
+    void write( const Slot& slot );
+    void writeY4M( const Slot& slot );
+
+    std::string       m_pattern;
+    Format            m_format;
+    bool              m_srgb;
+    unsigned int      m_fps;
+    bool              m_waitWhenFull;
+
+    std::vector<Slot> m_slots;
+    size_t            m_head;           // Next slot to fill, only the recording thread moves it
+    size_t            m_tail;           // Next slot to write, only the writer moves it
+    size_t            m_queued;
+    bool              m_stopping;
+    std::mutex              m_mutex;
+    std::condition_variable m_queuedChanged;
+
+    unsigned int      m_recorded;
+    unsigned int      m_dropped;
+
+    // Writer thread only
+    std::vector<unsigned char> m_rgb;
+    std::vector<float>         m_rgbf;
+    std::vector<unsigned char> m_yuv;
+    FILE*             m_stream;
+    unsigned int      m_streamWidth;
+    unsigned int      m_streamHeight;
+    bool              m_failed;
+
+    std::thread       m_writer;
+};
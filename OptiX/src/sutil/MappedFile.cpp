@@ -0,0 +1,169 @@
+#include <sutil/MappedFile.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#if defined(_WIN32)
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN 1
+#    endif
+#    include <windows.h>
+#    include <direct.h>
+#    include <process.h>
+#    include <sys/stat.h>
+#    include <sys/types.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <sys/types.h>
+#    include <unistd.h>
+#endif
+
+namespace
+{
+
+bool renameReplacing( const std::string& from, const std::string& to )
+{
+#if defined(_WIN32)
+    return MoveFileExA( from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+    return rename( from.c_str(), to.c_str() ) == 0;
+#endif
+}
+
+int processId()
+{
+#if defined(_WIN32)
+    return _getpid();
+#else
+    return static_cast<int>( getpid() );
+#endif
+}
+
+} // namespace
+
+
+MappedFile::MappedFile( const std::string& filename )
+    : m_data( NULL )
+    , m_size( 0 )
+    , m_file( NULL )
+    , m_mapping( NULL )
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file == INVALID_HANDLE_VALUE )
+        return;
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx( file, &size ) || size.QuadPart == 0 )
+        return;
+
+    m_mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( !m_mapping )
+        return;
+
+    m_data = MapViewOfFile( static_cast<HANDLE>( m_mapping ), FILE_MAP_READ, 0, 0, 0 );
+    if( m_data )
+        m_size = static_cast<size_t>( size.QuadPart );
+#else
+    const int fd = open( filename.c_str(), O_RDONLY );
+    if( fd < 0 )
+        return;
+
+    struct stat st;
+    if( fstat( fd, &st ) == 0 && st.st_size > 0 )
+    {
+        void* data = mmap( NULL, static_cast<size_t>( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( data != MAP_FAILED )
+        {
+            m_data = data;
+            m_size = static_cast<size_t>( st.st_size );
+        }
+    }
+    close( fd );
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(_WIN32)
+    if( m_data )
+        UnmapViewOfFile( m_data );
+    if( m_mapping )
+        CloseHandle( static_cast<HANDLE>( m_mapping ) );
+    if( m_file )
+        CloseHandle( static_cast<HANDLE>( m_file ) );
+#else
+    if( m_data )
+        munmap( m_data, m_size );
+#endif
+}
+
+bool getFileStamp( const std::string& filename, FileStamp& stamp )
+{
+#if defined(_WIN32)
+    struct _stat64 st;
+    if( _stat64( filename.c_str(), &st ) != 0 )
+        return false;
+#else
+    struct stat st;
+    if( stat( filename.c_str(), &st ) != 0 )
+        return false;
+#endif
+    stamp.size  = static_cast<uint64_t>( st.st_size );
+    stamp.mtime = static_cast<int64_t>( st.st_mtime );
+    return true;
+}
+
+void makeDirectory( const std::string& directory )
+{
+#if defined(_WIN32)
+    _mkdir( directory.c_str() );
+#else
+    mkdir( directory.c_str(), 0755 );
+#endif
+}
+
+bool writeFileAtomic( const std::string& path, const void* const* buffers, const size_t* sizes, size_t count )
+{
+    std::ostringstream temp_path;
+    temp_path << path << ".tmp" << processId() << "_" << reinterpret_cast<uintptr_t>( buffers );
+
+    {
+        std::ofstream file( temp_path.str().c_str(), std::ios::binary | std::ios::trunc );
+        if( !file.good() )
+            return false;
+
+        for( size_t i = 0; i < count; ++i )
+            file.write( static_cast<const char*>( buffers[i] ), sizes[i] );
+
+        if( !file.good() )
+        {
+            file.close();
+            remove( temp_path.str().c_str() );
+            return false;
+        }
+    }
+
+    // Readers see either the old file or the complete new one
+    if( !renameReplacing( temp_path.str(), path ) )
+    {
+        remove( temp_path.str().c_str() );
+        return false;
+    }
+    return true;
+}
+
+uint64_t hashBytes( const void* data, size_t size, uint64_t hash )
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>( data );
+    for( size_t i = 0; i < size; ++i )
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
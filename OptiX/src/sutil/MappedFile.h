@@ -0,0 +1,52 @@
+#pragma once
+
+#include <sutilapi.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//-----------------------------------------------------------------------------
+//
+// Small file helpers shared by the on-disk caches
+//
+//-----------------------------------------------------------------------------
+
+// Read only view of a whole file. data() is NULL if the file is missing or empty
+class SUTILCLASSAPI MappedFile
+{
+public:
+    SUTILAPI explicit MappedFile( const std::string& filename );
+    SUTILAPI ~MappedFile();
+
+    const char* data() const { return static_cast<const char*>( m_data ); }
+    size_t      size() const { return m_size; }
+
+private:
+    MappedFile( const MappedFile& );
+    MappedFile& operator=( const MappedFile& );
+
+    void*  m_data;
+    size_t m_size;
+    void*  m_file;      // HANDLEs on Windows
+    void*  m_mapping;
+};
+
+struct FileStamp
+{
+    uint64_t size;
+    int64_t  mtime;     // Seconds since the epoch
+};
+
+// Returns false if the file doesn't exist
+SUTILAPI bool getFileStamp( const std::string& filename, FileStamp& stamp );
+
+// Creates one directory level, existing directories are fine
+SUTILAPI void makeDirectory( const std::string& directory );
+
+// Writes the buffers to a temporary file next to path and renames it over path,
+// so readers never see a partially written file
+SUTILAPI bool writeFileAtomic( const std::string& path, const void* const* buffers, const size_t* sizes, size_t count );
+
+// 64 bit FNV-1a, pass the previous result as hash to chain
+SUTILAPI uint64_t hashBytes( const void* data, size_t size, uint64_t hash = 14695981039346656037ULL );
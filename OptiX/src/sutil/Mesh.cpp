@@ -31,15 +31,25 @@
 #include <optixu/optixu_math_stream_namespace.h>
 
 #include "Mesh.h" 
+#include "MeshCache.h"
+#include "ObjChunkParser.h"
+#include "PlyBinaryReader.h"
 #include "rply-1.01/rply.h"
 #include "tinyobjloader/tiny_obj_loader.h"
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <locale>
+#include <memory>
+#include <new>
 #include <stdexcept>
 #include <stdint.h>
 #include <vector>
 
+#if defined(_WIN32)
+#  include <malloc.h>
+#endif
+
 //------------------------------------------------------------------------------
 //
 // Helpers 
@@ -55,6 +65,70 @@ void clearMesh( Mesh& mesh )
 }
 
 
+const size_t ARENA_ALIGNMENT = 64;
+
+size_t alignArena( size_t offset )
+{
+  return ( offset + ARENA_ALIGNMENT - 1 ) & ~( ARENA_ALIGNMENT - 1 );
+}
+
+// Byte offsets of each array inside an arena, in Mesh member order
+struct ArenaLayout
+{
+  size_t positions;
+  size_t normals;
+  size_t texcoords;
+  size_t tri_indices;
+  size_t mat_indices;
+  size_t mat_params;
+  size_t size;
+};
+
+ArenaLayout arenaLayout( const Mesh& mesh )
+{
+  const size_t num_vertices  = static_cast<size_t>( mesh.num_vertices );
+  const size_t num_triangles = static_cast<size_t>( mesh.num_triangles );
+
+  ArenaLayout layout;
+  layout.positions   = 0;
+  layout.normals     = alignArena( layout.positions   + 3*num_vertices*sizeof( float ) );
+  layout.texcoords   = alignArena( layout.normals     + ( mesh.has_normals   ? 3*num_vertices*sizeof( float ) : 0 ) );
+  layout.tri_indices = alignArena( layout.texcoords   + ( mesh.has_texcoords ? 2*num_vertices*sizeof( float ) : 0 ) );
+  layout.mat_indices = alignArena( layout.tri_indices + 3*num_triangles*sizeof( int32_t ) );
+  layout.mat_params  = alignArena( layout.mat_indices + 1*num_triangles*sizeof( int32_t ) );
+  layout.size        = alignArena( layout.mat_params  + mesh.num_materials*sizeof( MaterialParams ) );
+  return layout;
+}
+
+
+class AlignedMeshAllocator : public MeshAllocator
+{
+public:
+  void* allocate( size_t size, size_t alignment )
+  {
+#if defined(_WIN32)
+    void* ptr = _aligned_malloc( size, alignment );
+#else
+    void* ptr = 0;
+    if( posix_memalign( &ptr, alignment, size ) != 0 )
+      ptr = 0;
+#endif
+    if( !ptr )
+      throw std::bad_alloc();
+    return ptr;
+  }
+
+  void deallocate( void* ptr )
+  {
+#if defined(_WIN32)
+    _aligned_free( ptr );
+#else
+    free( ptr );
+#endif
+  }
+};
+
+
 bool checkValid( const Mesh& mesh )
 {
   if( mesh.num_vertices  == 0 )
@@ -303,6 +377,8 @@ public:
 
   void loadMeshOBJ( Mesh& mesh );
   void loadMeshPLY( Mesh& mesh );
+
+  bool mapMesh( Mesh& mesh );
 private:
   enum FileType
   {
@@ -315,6 +391,15 @@ private:
   
   std::vector<tinyobj::shape_t>       m_shapes;
   std::vector<tinyobj::material_t>    m_materials;
+
+  // Set when the file parsed with the threaded OBJ parser, tinyobj handles the rest
+  std::unique_ptr<ObjChunkParser>     m_obj_parser;
+
+  // Set when the file is a binary PLY the bulk reader handles, rply handles the rest
+  std::unique_ptr<PlyBinaryReader>    m_ply_reader;
+
+  // Binary copy from an earlier load, null if missing or out of date
+  std::unique_ptr<MeshCacheFile>      m_cache;
 };
 
 
@@ -327,6 +412,13 @@ MeshLoader::Impl::Impl( const std::string& filename )
      m_filetype = PLY;
    else 
      m_filetype = UNKNOWN;
+
+   if( m_filetype != UNKNOWN )
+   {
+     m_cache.reset( new MeshCacheFile( m_filename ) );
+     if( !m_cache->valid() )
+       m_cache.reset();
+   }
 }
 
 
@@ -334,7 +426,9 @@ void MeshLoader::Impl::scanMesh( Mesh& mesh )
 {
   clearMesh( mesh );
 
-  if( m_filetype == OBJ )
+  if( m_cache )
+    m_cache->scan( mesh );
+  else if( m_filetype == OBJ )
     scanMeshOBJ( mesh );
   else if( m_filetype == PLY )
     scanMeshPLY( mesh );
@@ -356,19 +450,54 @@ void MeshLoader::Impl::loadMesh( Mesh& mesh, const float* load_xform )
   mesh.bbox_min[0] = mesh.bbox_min[1] = mesh.bbox_min[2] =  1e16f;
   mesh.bbox_max[0] = mesh.bbox_max[1] = mesh.bbox_max[2] = -1e16f;
 
-  if( m_filetype == OBJ )
-    loadMeshOBJ( mesh );
-  else if( m_filetype == PLY )
-    loadMeshPLY( mesh );
+  if( m_cache )
+  {
+    m_cache->copyTo( mesh );
+  }
   else
-    throw std::runtime_error( "MeshLoader: Unsupported file type for '" + m_filename + "'" );
+  {
+    if( m_filetype == OBJ )
+      loadMeshOBJ( mesh );
+    else if( m_filetype == PLY )
+      loadMeshPLY( mesh );
+    else
+      throw std::runtime_error( "MeshLoader: Unsupported file type for '" + m_filename + "'" );
+
+    // Next load skips parsing. The cache holds the mesh before the load transform
+    MeshCacheFile::write( m_filename, mesh );
+  }
 
   applyLoadXForm( mesh, load_xform );
 }
 
 
+bool MeshLoader::Impl::mapMesh( Mesh& mesh )
+{
+  clearMesh( mesh );
+
+  if( !m_cache )
+    return false;
+
+  m_cache->map( mesh );
+  return true;
+}
+
+
 void MeshLoader::Impl::scanMeshPLY( Mesh& mesh )
 {
+  if( !m_ply_reader )
+  {
+    std::unique_ptr<PlyBinaryReader> reader( new PlyBinaryReader );
+    if( reader->parse( m_filename ) )
+      m_ply_reader.swap( reader );
+  }
+
+  if( m_ply_reader )
+  {
+    m_ply_reader->scan( mesh );
+    return;
+  }
+
   p_ply ply = ply_open( m_filename.c_str(), 0 );                       
 
   if( !ply )
@@ -392,28 +521,35 @@ void MeshLoader::Impl::scanMeshPLY( Mesh& mesh )
 
 void MeshLoader::Impl::loadMeshPLY( Mesh& mesh )
 {
-  p_ply ply = ply_open( m_filename.c_str(), 0 );                       
+  if( m_ply_reader )
+  {
+    m_ply_reader->load( mesh );
+  }
+  else
+  {
+    p_ply ply = ply_open( m_filename.c_str(), 0 );                       
 
-  if( !ply )
-    throw std::runtime_error( "MeshLoader: Unable to open '" + m_filename + "'" );
+    if( !ply )
+      throw std::runtime_error( "MeshLoader: Unable to open '" + m_filename + "'" );
 
-  if( !ply_read_header( ply ) )
-    throw std::runtime_error( "MeshLoader: Unable to read PLY header '" + m_filename + "'" );
-  
-  PlyData ply_data = {0};
-  ply_data.mesh = &mesh;
-
-  ply_set_read_cb( ply, "vertex", "x",  plyLoadVertex, &ply_data, 0 );
-  ply_set_read_cb( ply, "vertex", "y",  plyLoadVertex, &ply_data, 1 );
-  ply_set_read_cb( ply, "vertex", "z",  plyLoadVertex, &ply_data, 2 );
-  ply_set_read_cb( ply, "vertex", "nx", plyLoadVertex, &ply_data, 3 );
-  ply_set_read_cb( ply, "vertex", "ny", plyLoadVertex, &ply_data, 4 );
-  ply_set_read_cb( ply, "vertex", "nz", plyLoadVertex, &ply_data, 5 );
-  ply_set_read_cb( ply, "face", "vertex_indices", plyLoadFace, &ply_data, 0);
-
-  if( !ply_read( ply ) ) 
-    throw std::runtime_error( "MeshLoader: Error parsing ply file (" + m_filename + ")" );
-  ply_close( ply );
+    if( !ply_read_header( ply ) )
+      throw std::runtime_error( "MeshLoader: Unable to read PLY header '" + m_filename + "'" );
+    
+    PlyData ply_data = {0};
+    ply_data.mesh = &mesh;
+
+    ply_set_read_cb( ply, "vertex", "x",  plyLoadVertex, &ply_data, 0 );
+    ply_set_read_cb( ply, "vertex", "y",  plyLoadVertex, &ply_data, 1 );
+    ply_set_read_cb( ply, "vertex", "z",  plyLoadVertex, &ply_data, 2 );
+    ply_set_read_cb( ply, "vertex", "nx", plyLoadVertex, &ply_data, 3 );
+    ply_set_read_cb( ply, "vertex", "ny", plyLoadVertex, &ply_data, 4 );
+    ply_set_read_cb( ply, "vertex", "nz", plyLoadVertex, &ply_data, 5 );
+    ply_set_read_cb( ply, "face", "vertex_indices", plyLoadFace, &ply_data, 0);
+
+    if( !ply_read( ply ) ) 
+      throw std::runtime_error( "MeshLoader: Error parsing ply file (" + m_filename + ")" );
+    ply_close( ply );
+  }
 
 
   // Fill in default white matte material
@@ -434,6 +570,19 @@ void MeshLoader::Impl::loadMeshPLY( Mesh& mesh )
 
 void MeshLoader::Impl::scanMeshOBJ( Mesh& mesh )
 {
+  if( !m_obj_parser && m_shapes.empty() )
+  {
+    std::unique_ptr<ObjChunkParser> parser( new ObjChunkParser );
+    if( parser->parse( m_filename ) )
+      m_obj_parser.swap( parser );
+  }
+
+  if( m_obj_parser )
+  {
+    m_obj_parser->scan( mesh );
+    return;
+  }
+
   if( m_shapes.empty() )
   {
     std::string err;
@@ -504,6 +653,12 @@ void MeshLoader::Impl::scanMeshOBJ( Mesh& mesh )
 
 void MeshLoader::Impl::loadMeshOBJ( Mesh& mesh )
 {
+  if( m_obj_parser )
+  {
+    m_obj_parser->load( mesh );
+    return;
+  }
+
   uint32_t vrt_offset = 0;
   uint32_t tri_offset = 0;
   for( std::vector<tinyobj::shape_t>::const_iterator it = m_shapes.begin();
@@ -662,11 +817,64 @@ SUTILAPI void allocMesh( Mesh& mesh )
   mesh.mat_indices = new int32_t[ 1*mesh.num_triangles ]; 
 
   mesh.mat_params  = new MaterialParams[ mesh.num_materials ];
+
+  mesh.arena           = 0;
+  mesh.arena_allocator = 0;
+}
+
+
+SUTILAPI MeshAllocator& alignedMeshAllocator()
+{
+  static AlignedMeshAllocator allocator;
+  return allocator;
+}
+
+
+SUTILAPI size_t meshArenaSize( const Mesh& mesh )
+{
+  return arenaLayout( mesh ).size;
+}
+
+
+SUTILAPI void allocMeshArena( Mesh& mesh, MeshAllocator& allocator )
+{
+  if( mesh.num_vertices == 0 || mesh.num_triangles == 0 )
+  {
+    clearMesh( mesh );
+    return;
+  }
+
+  const ArenaLayout layout = arenaLayout( mesh );
+  char* arena = static_cast<char*>( allocator.allocate( layout.size, ARENA_ALIGNMENT ) );
+
+  mesh.arena           = arena;
+  mesh.arena_allocator = &allocator;
+
+  mesh.positions   = reinterpret_cast<float*>  ( arena + layout.positions );
+  mesh.normals     = mesh.has_normals   ? reinterpret_cast<float*>( arena + layout.normals )   : 0;
+  mesh.texcoords   = mesh.has_texcoords ? reinterpret_cast<float*>( arena + layout.texcoords ) : 0;
+  mesh.tri_indices = reinterpret_cast<int32_t*>( arena + layout.tri_indices );
+  mesh.mat_indices = reinterpret_cast<int32_t*>( arena + layout.mat_indices );
+
+  // MaterialParams holds strings, so these are constructed in place
+  mesh.mat_params  = reinterpret_cast<MaterialParams*>( arena + layout.mat_params );
+  for( int32_t i = 0; i < mesh.num_materials; ++i )
+    new ( &mesh.mat_params[i] ) MaterialParams();
 }
 
 
 SUTILAPI void freeMesh( Mesh& mesh )
 {
+  if( mesh.arena )
+  {
+    for( int32_t i = 0; i < mesh.num_materials; ++i )
+      mesh.mat_params[i].~MaterialParams();
+
+    mesh.arena_allocator->deallocate( mesh.arena );
+    clearMesh( mesh );
+    return;
+  }
+
   delete [] mesh.positions;
   delete [] mesh.normals;
   delete [] mesh.texcoords;
@@ -707,6 +915,12 @@ void MeshLoader::loadMesh( Mesh& mesh, const float* load_xform )
   p_impl->loadMesh( mesh, load_xform );
 }
 
+
+bool MeshLoader::mapMesh( Mesh& mesh )
+{
+  return p_impl->mapMesh( mesh );
+}
+
 //------------------------------------------------------------------------------
 //
 // Mesh Loader convenience  functions
@@ -721,3 +935,12 @@ void loadMesh( const std::string& filename, Mesh& mesh, const float* xform )
     allocMesh( mesh );
     loader.loadMesh( mesh, xform );
 }
+
+
+void loadMesh( const std::string& filename, Mesh& mesh, MeshAllocator& allocator, const float* xform )
+{
+    MeshLoader loader( filename );
+    loader.scanMesh( mesh );
+    allocMeshArena( mesh, allocator );
+    loader.loadMesh( mesh, xform );
+}
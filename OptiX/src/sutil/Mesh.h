@@ -56,6 +56,21 @@ struct MaterialParams
 };
 
 
+//------------------------------------------------------------------------------
+//
+// Allocator for mesh arenas. Implement this to put loaded meshes straight into
+// pooled or mapped memory
+//
+//------------------------------------------------------------------------------
+class MeshAllocator
+{
+public:
+  virtual ~MeshAllocator() {}
+  virtual void* allocate( size_t size, size_t alignment ) = 0;
+  virtual void  deallocate( void* ptr ) = 0;
+};
+
+
 //------------------------------------------------------------------------------
 //
 // Mesh data structure
@@ -82,6 +97,9 @@ struct Mesh
 
   int32_t             num_materials;
   MaterialParams*     mat_params;     // Material params
+
+  void*               arena;          // Block holding all arrays if allocated by allocMeshArena
+  MeshAllocator*      arena_allocator;
 };
 
 //------------------------------------------------------------------------------
@@ -94,7 +112,17 @@ struct Mesh
 // Assumes num_vertices, has_normals, has_texcoords, num_triangles initialized.
 SUTILAPI void allocMesh( Mesh& mesh );
 
-// Calls std lib delete on non-null arrays in mesh
+// Aligned heap allocation, the default for allocMeshArena
+SUTILAPI MeshAllocator& alignedMeshAllocator();
+
+// Allocates all arrays from one block, each starting on a cache line, so
+// many small meshes don't fragment the heap. Same assumptions as allocMesh
+SUTILAPI void allocMeshArena( Mesh& mesh, MeshAllocator& allocator = alignedMeshAllocator() );
+
+// Bytes allocMeshArena asks for
+SUTILAPI size_t meshArenaSize( const Mesh& mesh );
+
+// Calls std lib delete on non-null arrays in mesh, or releases its arena
 SUTILAPI void freeMesh( Mesh& mesh );
 
 SUTILAPI void printMaterialInfo( const MaterialParams& mat, std::ostream& out = std::cout );
@@ -114,6 +142,11 @@ public:
   SUTILAPI void scanMesh( Mesh& mesh );
   SUTILAPI void loadMesh( Mesh& mesh, const float* load_xform=0 );
 
+  // Points mesh straight at the binary cache written by an earlier loadMesh, no
+  // parsing or copying. Returns false if there is no up to date cache entry.
+  // The arrays stay valid while the loader lives and must not be freed.
+  SUTILAPI bool mapMesh( Mesh& mesh );
+
 private:
   class Impl;
   Impl* p_impl;
@@ -130,6 +163,9 @@ private:
 // Load mesh using std lib new for allocations
 SUTILAPI void loadMesh( const std::string& filename, Mesh& mesh, const float* load_xform=0 );
 
+// Load mesh into a single arena from allocator
+SUTILAPI void loadMesh( const std::string& filename, Mesh& mesh, MeshAllocator& allocator, const float* load_xform=0 );
+
 
 
 //------------------------------------------------------------------------------
@@ -141,11 +177,19 @@ SUTILAPI void loadMesh( const std::string& filename, Mesh& mesh, const float* lo
 class HostMesh : public Mesh
 {
 public:
+  // Empty, for callers running the MeshLoader steps themselves
+  HostMesh() : Mesh() {}
+
   HostMesh( const std::string& filename, const float* xform=0 )
   { 
     loadMesh( filename, *this, xform ); 
   }
 
+  HostMesh( const std::string& filename, MeshAllocator& allocator, const float* xform=0 )
+  { 
+    loadMesh( filename, *this, allocator, xform ); 
+  }
+
   ~HostMesh()
   {
     freeMesh( *this );
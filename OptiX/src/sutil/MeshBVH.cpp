@@ -0,0 +1,634 @@
+#include <sutil/MeshBVH.h>
+#include <sutil/MappedFile.h>
+#include <sutil/MeshCache.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#    include <emmintrin.h>
+#    define BVH_SSE2 1
+#endif
+
+namespace
+{
+
+const char     BVH_MAGIC[8]  = { 'O', 'P', 'T', 'X', 'B', 'V', 'H', '0' };
+const uint32_t BVH_VERSION   = 1;
+const int      MAX_BINS      = 64;
+
+// Deeper nodes are made leaves whatever their size, so traversal never
+// needs more stack than this
+const int      MAX_DEPTH     = 64;
+
+// Nodes smaller than this are never handed to another thread
+const int32_t  PARALLEL_MIN_TRIANGLES = 16 * 1024;
+
+struct MeshBVHHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t key;
+    int32_t  num_nodes;
+    int32_t  num_triangles;
+};
+
+// Bounds of one triangle, partitioned in place while building
+struct PrimRef
+{
+    float   lo[3];
+    int32_t triangle;
+    float   hi[3];
+    int32_t pad;
+};
+
+// Only the first three lanes mean anything, the fourth is there so whole
+// PrimRef halves can be loaded at once
+struct Bounds
+{
+#if defined(BVH_SSE2)
+    __m128 lo;
+    __m128 hi;
+
+    void reset()
+    {
+        lo = _mm_set1_ps(  std::numeric_limits<float>::max() );
+        hi = _mm_set1_ps( -std::numeric_limits<float>::max() );
+    }
+
+    void grow( const float* plo, const float* phi )
+    {
+        lo = _mm_min_ps( lo, _mm_loadu_ps( plo ) );
+        hi = _mm_max_ps( hi, _mm_loadu_ps( phi ) );
+    }
+
+    void grow( const Bounds& other )
+    {
+        lo = _mm_min_ps( lo, other.lo );
+        hi = _mm_max_ps( hi, other.hi );
+    }
+
+    void store( float* plo, float* phi ) const
+    {
+        float l[4], h[4];
+        _mm_storeu_ps( l, lo );
+        _mm_storeu_ps( h, hi );
+        std::copy( l, l + 3, plo );
+        std::copy( h, h + 3, phi );
+    }
+#else
+    float lo[4];
+    float hi[4];
+
+    void reset()
+    {
+        for( int k = 0; k < 4; ++k )
+        {
+            lo[k] =  std::numeric_limits<float>::max();
+            hi[k] = -std::numeric_limits<float>::max();
+        }
+    }
+
+    void grow( const float* plo, const float* phi )
+    {
+        for( int k = 0; k < 3; ++k )
+        {
+            lo[k] = std::min( lo[k], plo[k] );
+            hi[k] = std::max( hi[k], phi[k] );
+        }
+    }
+
+    void grow( const Bounds& other ) { grow( other.lo, other.hi ); }
+
+    void store( float* plo, float* phi ) const
+    {
+        std::copy( lo, lo + 3, plo );
+        std::copy( hi, hi + 3, phi );
+    }
+#endif
+
+    float halfArea() const
+    {
+        float l[3], h[3];
+        store( l, h );
+        const float dx = h[0] - l[0];
+        const float dy = h[1] - l[1];
+        const float dz = h[2] - l[2];
+        return dx < 0.0f ? 0.0f : dx * dy + dy * dz + dz * dx;
+    }
+};
+
+struct BuildContext
+{
+    PrimRef*                   prims;
+    const MeshBVHBuildOptions* options;
+    int                        parallel_depth;  // Levels that may spawn a thread for the right child
+};
+
+void makeLeaf( MeshBVHNode& node, int32_t begin, int32_t end )
+{
+    node.offset = begin;
+    node.count  = end - begin;
+}
+
+// Finds the cheapest binned SAH split of [begin, end). Returns false if
+// keeping the leaf is cheaper, or the centroids can't be told apart
+bool findSplit( const BuildContext& ctx, int32_t begin, int32_t end, const Bounds& bounds, const Bounds& centroids,
+                int& split_axis, float& split_position )
+{
+    const MeshBVHBuildOptions& options = *ctx.options;
+    const int bins = options.bins;
+
+    float clo[3], chi[3];
+    centroids.store( clo, chi );
+
+    int32_t counts[3][MAX_BINS];
+    Bounds  bin_bounds[3][MAX_BINS];
+    float   scale[3];
+    for( int k = 0; k < 3; ++k )
+    {
+        const float extent = chi[k] - clo[k];
+        scale[k] = extent > 0.0f ? bins * ( 1.0f - 1e-6f ) / extent : 0.0f;
+        for( int b = 0; b < bins; ++b )
+        {
+            counts[k][b] = 0;
+            bin_bounds[k][b].reset();
+        }
+    }
+
+    // Centroids are kept doubled (lo + hi), as are their bounds
+    for( int32_t i = begin; i < end; ++i )
+    {
+        const PrimRef& prim = ctx.prims[i];
+        for( int k = 0; k < 3; ++k )
+        {
+            const int b = static_cast<int>( ( prim.lo[k] + prim.hi[k] - clo[k] ) * scale[k] );
+            counts[k][b]++;
+            bin_bounds[k][b].grow( prim.lo, prim.hi );
+        }
+    }
+
+    const int32_t count = end - begin;
+    const float   leaf_cost = count * options.intersection_cost;
+    float best_cost = std::numeric_limits<float>::max();
+    split_axis = -1;
+
+    for( int k = 0; k < 3; ++k )
+    {
+        if( scale[k] == 0.0f )
+            continue;
+
+        // Area times count of everything right of each plane, swept from the right
+        float   right_cost[MAX_BINS];
+        Bounds  accumulated;
+        int32_t accumulated_count = 0;
+        accumulated.reset();
+        for( int b = bins - 1; b > 0; --b )
+        {
+            accumulated.grow( bin_bounds[k][b] );
+            accumulated_count += counts[k][b];
+            right_cost[b] = accumulated.halfArea() * accumulated_count;
+        }
+
+        accumulated.reset();
+        accumulated_count = 0;
+        for( int b = 1; b < bins; ++b )
+        {
+            accumulated.grow( bin_bounds[k][b - 1] );
+            accumulated_count += counts[k][b - 1];
+            const float cost = accumulated.halfArea() * accumulated_count + right_cost[b];
+            if( cost < best_cost && accumulated_count > 0 && accumulated_count < count )
+            {
+                best_cost      = cost;
+                split_axis     = k;
+                split_position = clo[k] + b / scale[k];
+            }
+        }
+    }
+
+    if( split_axis < 0 )
+        return false;
+
+    best_cost = options.traversal_cost + options.intersection_cost * best_cost / bounds.halfArea();
+    return count > options.max_leaf_size || best_cost < leaf_cost;
+}
+
+// Appends the subtree for [begin, end) to nodes in depth first order. Child
+// offsets are relative to the start of nodes, so subtrees built on other
+// threads can be spliced in by shifting them
+void buildNode( const BuildContext& ctx, int32_t begin, int32_t end, int depth, std::vector<MeshBVHNode>& nodes )
+{
+    Bounds bounds, centroids;
+    bounds.reset();
+    centroids.reset();
+    for( int32_t i = begin; i < end; ++i )
+    {
+        const PrimRef& prim = ctx.prims[i];
+        bounds.grow( prim.lo, prim.hi );
+        const float c[4] = { prim.lo[0] + prim.hi[0], prim.lo[1] + prim.hi[1], prim.lo[2] + prim.hi[2], 0.0f };
+        centroids.grow( c, c );
+    }
+
+    const size_t index = nodes.size();
+    nodes.push_back( MeshBVHNode() );
+    bounds.store( nodes[index].bbox_min, nodes[index].bbox_max );
+
+    const bool can_split = depth < MAX_DEPTH - 1;
+    int32_t mid = begin;
+    int     axis;
+    float   position;
+    if( can_split && findSplit( ctx, begin, end, bounds, centroids, axis, position ) )
+    {
+        mid = static_cast<int32_t>( std::partition( ctx.prims + begin, ctx.prims + end,
+            [axis, position]( const PrimRef& prim ) { return prim.lo[axis] + prim.hi[axis] < position; } ) - ctx.prims );
+    }
+    else if( can_split && end - begin > ctx.options->max_leaf_size )
+    {
+        // Every centroid in the same spot, any split is as good as another
+        mid = begin + ( end - begin ) / 2;
+    }
+
+    if( mid == begin || mid == end )
+    {
+        makeLeaf( nodes[index], begin, end );
+        return;
+    }
+
+    nodes[index].count = 0;
+    if( depth < ctx.parallel_depth && end - begin >= PARALLEL_MIN_TRIANGLES )
+    {
+        std::vector<MeshBVHNode> right_nodes;
+        right_nodes.reserve( 2 * ( end - mid ) / ctx.options->max_leaf_size );
+        std::thread right( buildNode, std::cref( ctx ), mid, end, depth + 1, std::ref( right_nodes ) );
+        buildNode( ctx, begin, mid, depth + 1, nodes );
+        right.join();
+
+        const int32_t shift = static_cast<int32_t>( nodes.size() );
+        nodes[index].offset = shift;
+        for( size_t i = 0; i < right_nodes.size(); ++i )
+        {
+            if( !right_nodes[i].isLeaf() )
+                right_nodes[i].offset += shift;
+        }
+        nodes.insert( nodes.end(), right_nodes.begin(), right_nodes.end() );
+    }
+    else
+    {
+        buildNode( ctx, begin, mid, depth + 1, nodes );
+        nodes[index].offset = static_cast<int32_t>( nodes.size() );
+        buildNode( ctx, mid, end, depth + 1, nodes );
+    }
+}
+
+// Triangle bounds for [begin, end)
+void makePrimRefs( const Mesh& mesh, int32_t begin, int32_t end, PrimRef* prims )
+{
+    for( int32_t i = begin; i < end; ++i )
+    {
+        PrimRef& prim = prims[i];
+        prim.triangle = i;
+        prim.pad      = 0;
+        for( int k = 0; k < 3; ++k )
+        {
+            const float a = mesh.positions[ mesh.tri_indices[i * 3 + 0] * 3 + k ];
+            const float b = mesh.positions[ mesh.tri_indices[i * 3 + 1] * 3 + k ];
+            const float c = mesh.positions[ mesh.tri_indices[i * 3 + 2] * 3 + k ];
+            prim.lo[k] = std::min( a, std::min( b, c ) );
+            prim.hi[k] = std::max( a, std::max( b, c ) );
+        }
+    }
+}
+
+// Entry and exit distance of the ray through the box, false if it misses
+bool intersectBox( const MeshBVHNode& node, const float* origin, const float* inv_direction, float tmin, float tmax, float& tenter )
+{
+    for( int k = 0; k < 3; ++k )
+    {
+        float t0 = ( node.bbox_min[k] - origin[k] ) * inv_direction[k];
+        float t1 = ( node.bbox_max[k] - origin[k] ) * inv_direction[k];
+        if( t0 > t1 )
+            std::swap( t0, t1 );
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+    }
+    tenter = tmin;
+    return tmin <= tmax;
+}
+
+bool intersectTriangle( const Mesh& mesh, int32_t triangle, const float* origin, const float* direction,
+                        float tmin, float tmax, MeshBVHHit& hit )
+{
+    const float* p0 = mesh.positions + mesh.tri_indices[triangle * 3 + 0] * 3;
+    const float* p1 = mesh.positions + mesh.tri_indices[triangle * 3 + 1] * 3;
+    const float* p2 = mesh.positions + mesh.tri_indices[triangle * 3 + 2] * 3;
+
+    const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    const float pv[3] = { direction[1] * e2[2] - direction[2] * e2[1],
+                          direction[2] * e2[0] - direction[0] * e2[2],
+                          direction[0] * e2[1] - direction[1] * e2[0] };
+    const float det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+    if( det == 0.0f )
+        return false;
+
+    const float inv_det = 1.0f / det;
+    const float tv[3] = { origin[0] - p0[0], origin[1] - p0[1], origin[2] - p0[2] };
+    const float u = ( tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2] ) * inv_det;
+    if( u < 0.0f || u > 1.0f )
+        return false;
+
+    const float qv[3] = { tv[1] * e1[2] - tv[2] * e1[1],
+                          tv[2] * e1[0] - tv[0] * e1[2],
+                          tv[0] * e1[1] - tv[1] * e1[0] };
+    const float v = ( direction[0] * qv[0] + direction[1] * qv[1] + direction[2] * qv[2] ) * inv_det;
+    if( v < 0.0f || u + v > 1.0f )
+        return false;
+
+    const float t = ( e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2] ) * inv_det;
+    if( t <= tmin || t >= tmax )
+        return false;
+
+    hit.t        = t;
+    hit.u        = u;
+    hit.v        = v;
+    hit.triangle = triangle;
+    return true;
+}
+
+float nodeHalfArea( const MeshBVHNode& node )
+{
+    const float dx = node.bbox_max[0] - node.bbox_min[0];
+    const float dy = node.bbox_max[1] - node.bbox_min[1];
+    const float dz = node.bbox_max[2] - node.bbox_min[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+} // namespace
+
+
+MeshBVH::MeshBVH()
+{
+    memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+
+void MeshBVH::build( const Mesh& mesh, const MeshBVHBuildOptions& options )
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    m_nodes.clear();
+    m_triangles.clear();
+
+    const int32_t count = mesh.num_triangles;
+    if( count > 0 )
+    {
+        unsigned threads = options.threads;
+        if( threads == 0 )
+            threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+        std::vector<PrimRef> prims( count );
+        {
+            const unsigned slices = std::min<unsigned>( threads, count / PARALLEL_MIN_TRIANGLES + 1 );
+            std::vector<std::thread> workers;
+            for( unsigned t = 1; t < slices; ++t )
+                workers.push_back( std::thread( makePrimRefs, std::cref( mesh ),
+                    static_cast<int32_t>( int64_t( count ) * t / slices ),
+                    static_cast<int32_t>( int64_t( count ) * ( t + 1 ) / slices ), prims.data() ) );
+            makePrimRefs( mesh, 0, static_cast<int32_t>( count / slices ), prims.data() );
+            for( size_t t = 0; t < workers.size(); ++t )
+                workers[t].join();
+        }
+
+        // Each spawning level doubles the builders, one extra level evens out uneven splits
+        int parallel_depth = 0;
+        while( threads > 1 && ( 1u << parallel_depth ) < threads )
+            ++parallel_depth;
+        if( parallel_depth > 0 )
+            ++parallel_depth;
+
+        MeshBVHBuildOptions clamped = options;
+        clamped.bins          = std::max( 2, std::min( options.bins, MAX_BINS ) );
+        clamped.max_leaf_size = std::max( 1, options.max_leaf_size );
+
+        BuildContext ctx;
+        ctx.prims          = prims.data();
+        ctx.options        = &clamped;
+        ctx.parallel_depth = parallel_depth;
+
+        m_nodes.reserve( 2 * count / clamped.max_leaf_size + 1 );
+        buildNode( ctx, 0, count, 0, m_nodes );
+
+        m_triangles.resize( count );
+        for( int32_t i = 0; i < count; ++i )
+            m_triangles[i] = prims[i].triangle;
+    }
+
+    updateStats( options );
+    m_stats.build_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+
+bool MeshBVH::buildCached( const std::string& source_filename, const Mesh& mesh, const MeshBVHBuildOptions& options )
+{
+    if( !MeshCacheFile::enabled() )
+    {
+        build( mesh, options );
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t mesh_key = key( mesh, options );
+    const std::string path = entryPath( source_filename );
+    if( load( path, mesh_key ) )
+    {
+        updateStats( options );
+        m_stats.build_ms   = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+        m_stats.from_cache = true;
+        return true;
+    }
+
+    build( mesh, options );
+    makeDirectory( path.substr( 0, path.find_last_of( '/' ) ) );
+    save( path, mesh_key );
+    return false;
+}
+
+
+bool MeshBVH::intersect( const Mesh& mesh, const float origin[3], const float direction[3],
+                         float tmin, float tmax, MeshBVHHit& hit ) const
+{
+    if( m_nodes.empty() )
+        return false;
+
+    const float inv_direction[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+
+    int32_t stack[MAX_DEPTH];
+    int     stack_size = 0;
+    int32_t index      = 0;
+    bool    found      = false;
+    float   tenter;
+
+    if( !intersectBox( m_nodes[0], origin, inv_direction, tmin, tmax, tenter ) )
+        return false;
+
+    for( ;; )
+    {
+        const MeshBVHNode& node = m_nodes[index];
+        if( node.isLeaf() )
+        {
+            for( int32_t i = node.offset; i < node.offset + node.count; ++i )
+            {
+                if( intersectTriangle( mesh, m_triangles[i], origin, direction, tmin, tmax, hit ) )
+                {
+                    tmax  = hit.t;
+                    found = true;
+                }
+            }
+        }
+        else
+        {
+            // Visit the nearer child first, the other one goes on the stack
+            float tleft, tright;
+            const bool left  = intersectBox( m_nodes[index + 1],     origin, inv_direction, tmin, tmax, tleft );
+            const bool right = intersectBox( m_nodes[node.offset],   origin, inv_direction, tmin, tmax, tright );
+            if( left && right )
+            {
+                const bool left_first = tleft <= tright;
+                stack[stack_size++] = left_first ? node.offset : index + 1;
+                index = left_first ? index + 1 : node.offset;
+                continue;
+            }
+            if( left || right )
+            {
+                index = left ? index + 1 : node.offset;
+                continue;
+            }
+        }
+
+        // Pop, skipping nodes that are now behind the closest hit
+        bool next = false;
+        while( stack_size > 0 && !next )
+        {
+            index = stack[--stack_size];
+            next = intersectBox( m_nodes[index], origin, inv_direction, tmin, tmax, tenter );
+        }
+        if( !next )
+            break;
+    }
+    return found;
+}
+
+
+bool MeshBVH::save( const std::string& path, uint64_t key ) const
+{
+    MeshBVHHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, BVH_MAGIC, sizeof( BVH_MAGIC ) );
+    header.version       = BVH_VERSION;
+    header.key           = key;
+    header.num_nodes     = static_cast<int32_t>( m_nodes.size() );
+    header.num_triangles = static_cast<int32_t>( m_triangles.size() );
+
+    const void* buffers[3] = { &header, m_nodes.data(), m_triangles.data() };
+    const size_t sizes[3]  = { sizeof( header ),
+                               m_nodes.size() * sizeof( MeshBVHNode ),
+                               m_triangles.size() * sizeof( int32_t ) };
+    return writeFileAtomic( path, buffers, sizes, 3 );
+}
+
+
+bool MeshBVH::load( const std::string& path, uint64_t key )
+{
+    MappedFile file( path );
+    if( file.size() < sizeof( MeshBVHHeader ) )
+        return false;
+
+    MeshBVHHeader header;
+    memcpy( &header, file.data(), sizeof( header ) );
+    if( memcmp( header.magic, BVH_MAGIC, sizeof( BVH_MAGIC ) ) != 0 ||
+        header.version != BVH_VERSION ||
+        header.key != key ||
+        header.num_nodes < 0 || header.num_triangles < 0 )
+        return false;
+
+    const size_t node_bytes     = static_cast<size_t>( header.num_nodes ) * sizeof( MeshBVHNode );
+    const size_t triangle_bytes = static_cast<size_t>( header.num_triangles ) * sizeof( int32_t );
+    if( file.size() != sizeof( header ) + node_bytes + triangle_bytes )
+        return false;
+
+    const char* data = file.data() + sizeof( header );
+    m_nodes.resize( header.num_nodes );
+    m_triangles.resize( header.num_triangles );
+    memcpy( m_nodes.data(), data, node_bytes );
+    memcpy( m_triangles.data(), data + node_bytes, triangle_bytes );
+    return true;
+}
+
+
+uint64_t MeshBVH::key( const Mesh& mesh, const MeshBVHBuildOptions& options )
+{
+    // Thread count doesn't change the tree
+    const float   costs[2]  = { options.traversal_cost, options.intersection_cost };
+    const int32_t values[4] = { mesh.num_vertices, mesh.num_triangles, options.bins, options.max_leaf_size };
+
+    uint64_t hash = hashBytes( &BVH_VERSION, sizeof( BVH_VERSION ) );
+    hash = hashBytes( values, sizeof( values ), hash );
+    hash = hashBytes( costs, sizeof( costs ), hash );
+    hash = hashBytes( mesh.positions, static_cast<size_t>( mesh.num_vertices ) * 3 * sizeof( float ), hash );
+    hash = hashBytes( mesh.tri_indices, static_cast<size_t>( mesh.num_triangles ) * 3 * sizeof( int32_t ), hash );
+    return hash;
+}
+
+
+std::string MeshBVH::entryPath( const std::string& source_filename )
+{
+    std::string path = MeshCacheFile::entryPath( source_filename );
+    return path.substr( 0, path.find_last_of( '.' ) ) + ".bvh";
+}
+
+
+void MeshBVH::updateStats( const MeshBVHBuildOptions& options )
+{
+    memset( &m_stats, 0, sizeof( m_stats ) );
+    m_stats.num_nodes = static_cast<int32_t>( m_nodes.size() );
+    if( m_nodes.empty() )
+        return;
+
+    const float root_area = std::max( nodeHalfArea( m_nodes[0] ), std::numeric_limits<float>::min() );
+
+    std::vector<std::pair<int32_t, int32_t> > stack( 1, std::make_pair( 0, 1 ) );
+    while( !stack.empty() )
+    {
+        const int32_t index = stack.back().first;
+        const int32_t depth = stack.back().second;
+        stack.pop_back();
+
+        const MeshBVHNode& node = m_nodes[index];
+        const float area = nodeHalfArea( node ) / root_area;
+        m_stats.max_depth = std::max( m_stats.max_depth, depth );
+        if( node.isLeaf() )
+        {
+            m_stats.num_leaves++;
+            m_stats.sah_cost += area * node.count * options.intersection_cost;
+        }
+        else
+        {
+            m_stats.sah_cost += area * options.traversal_cost;
+            stack.push_back( std::make_pair( index + 1, depth + 1 ) );
+            stack.push_back( std::make_pair( node.offset, depth + 1 ) );
+        }
+    }
+}
+
+
+void printMeshBVHStats( const MeshBVHStats& stats, std::ostream& out )
+{
+    out << "MeshBVH: " << stats.num_nodes << " nodes, " << stats.num_leaves << " leaves, depth "
+        << stats.max_depth << ", SAH cost " << stats.sah_cost << ", "
+        << ( stats.from_cache ? "loaded in " : "built in " ) << stats.build_ms << " ms" << std::endl;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <sutilapi.h>
+#include <Mesh.h>
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Host BVH over the triangles of a Mesh
+//
+// Built with binned SAH straight from mesh.positions and mesh.tri_indices.
+// Subtrees above a size threshold are built on their own threads and spliced
+// into one depth first node array: an interior node's left child is the next
+// node, so traversal walks memory forward and only jumps for right children.
+//
+// Trees can be saved next to the mesh cache (see MeshCache.h). Entries are
+// keyed on the vertex and index data and the build options, so a different
+// load transform or an optimizeMesh pass builds a new tree.
+//
+//-----------------------------------------------------------------------------
+
+struct MeshBVHNode
+{
+    float   bbox_min[3];
+    int32_t offset;         // Interior: index of the right child. Leaf: first entry in triangles()
+    float   bbox_max[3];
+    int32_t count;          // Triangles in the leaf, 0 for interior nodes
+
+    bool isLeaf() const { return count > 0; }
+};
+
+struct MeshBVHBuildOptions
+{
+    MeshBVHBuildOptions()
+        : bins( 16 )
+        , max_leaf_size( 4 )
+        , traversal_cost( 1.0f )
+        , intersection_cost( 1.0f )
+        , threads( 0 )
+    {}
+
+    int      bins;              // Per axis, at most 64
+    int      max_leaf_size;     // Larger nodes are always split
+    float    traversal_cost;    // SAH cost of visiting a node, relative to...
+    float    intersection_cost; // ...testing one triangle
+    unsigned threads;           // 0 uses every hardware thread
+};
+
+struct MeshBVHHit
+{
+    float   t;
+    float   u;                  // Barycentrics of vertices 1 and 2
+    float   v;
+    int32_t triangle;           // Index into mesh.tri_indices / 3
+};
+
+struct MeshBVHStats
+{
+    int32_t num_nodes;
+    int32_t num_leaves;
+    int32_t max_depth;
+    float   sah_cost;           // Expected cost of a random ray, see MeshBVHBuildOptions
+    double  build_ms;
+    bool    from_cache;
+};
+
+class SUTILCLASSAPI MeshBVH
+{
+public:
+    SUTILAPI MeshBVH();
+
+    SUTILAPI void build( const Mesh& mesh, const MeshBVHBuildOptions& options = MeshBVHBuildOptions() );
+
+    // Loads the cache entry for source_filename if it was built from the same
+    // vertices, indices and options, otherwise builds and writes it.
+    // Returns true on a cache hit
+    SUTILAPI bool buildCached( const std::string& source_filename, const Mesh& mesh,
+                               const MeshBVHBuildOptions& options = MeshBVHBuildOptions() );
+
+    // Closest hit in (tmin, tmax). mesh must be the one the tree was built from
+    SUTILAPI bool intersect( const Mesh& mesh, const float origin[3], const float direction[3],
+                             float tmin, float tmax, MeshBVHHit& hit ) const;
+
+    SUTILAPI bool save( const std::string& path, uint64_t key ) const;
+    SUTILAPI bool load( const std::string& path, uint64_t key );
+
+    // Identifies the mesh data and build options a tree was made from
+    SUTILAPI static uint64_t key( const Mesh& mesh, const MeshBVHBuildOptions& options );
+    SUTILAPI static std::string entryPath( const std::string& source_filename );
+
+    const std::vector<MeshBVHNode>& nodes() const { return m_nodes; }
+    const std::vector<int32_t>& triangles() const { return m_triangles; }
+    const MeshBVHStats& stats() const { return m_stats; }
+
+private:
+    void updateStats( const MeshBVHBuildOptions& options );
+
+    std::vector<MeshBVHNode> m_nodes;
+    std::vector<int32_t>     m_triangles;   // Triangle indices in leaf order
+    MeshBVHStats             m_stats;
+};
+
+SUTILAPI void printMeshBVHStats( const MeshBVHStats& stats, std::ostream& out = std::cout );
@@ -0,0 +1,304 @@
+#include <sutil/MeshCache.h>
+#include <sutil/MappedFile.h>
+#include <sutil/sutil.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+const char     MESH_MAGIC[8]   = { 'O', 'P', 'T', 'X', 'M', 'E', 'S', 'H' };
+const uint32_t MESH_VERSION    = 2;   // 2: OBJ vertices numbered per group like tinyobj
+const uint64_t SECTION_ALIGN   = 64;
+
+enum Section
+{
+    SECTION_POSITIONS = 0,
+    SECTION_NORMALS,
+    SECTION_TEXCOORDS,
+    SECTION_TRI_INDICES,
+    SECTION_MAT_INDICES,
+    SECTION_MATERIALS,
+    SECTION_COUNT
+};
+
+// Bits of MeshCacheHeader::flags
+const uint32_t FLAG_NORMALS   = 1u << 0;
+const uint32_t FLAG_TEXCOORDS = 1u << 1;
+
+struct MeshCacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t source_size;
+    int64_t  source_mtime;
+    int32_t  num_vertices;
+    int32_t  num_triangles;
+    int32_t  num_materials;
+    int32_t  reserved;
+    float    bbox_min[3];
+    float    bbox_max[3];
+    uint64_t offsets[SECTION_COUNT];
+    uint64_t sizes[SECTION_COUNT];
+};
+
+uint64_t alignUp( uint64_t offset )
+{
+    return ( offset + SECTION_ALIGN - 1 ) & ~( SECTION_ALIGN - 1 );
+}
+
+void appendString( std::vector<char>& out, const std::string& str )
+{
+    const uint32_t size = static_cast<uint32_t>( str.size() );
+    out.insert( out.end(), reinterpret_cast<const char*>( &size ), reinterpret_cast<const char*>( &size ) + sizeof( size ) );
+    out.insert( out.end(), str.begin(), str.end() );
+}
+
+void appendFloats( std::vector<char>& out, const float* values, size_t count )
+{
+    out.insert( out.end(), reinterpret_cast<const char*>( values ), reinterpret_cast<const char*>( values + count ) );
+}
+
+// Reads from a bounded range, failing instead of running past the end
+struct SectionReader
+{
+    const char* cur;
+    const char* end;
+
+    bool read( void* dst, size_t size )
+    {
+        if( static_cast<size_t>( end - cur ) < size )
+            return false;
+        memcpy( dst, cur, size );
+        cur += size;
+        return true;
+    }
+
+    bool readString( std::string& str )
+    {
+        uint32_t size;
+        if( !read( &size, sizeof( size ) ) || static_cast<size_t>( end - cur ) < size )
+            return false;
+        str.assign( cur, size );
+        cur += size;
+        return true;
+    }
+};
+
+std::vector<char> serializeMaterials( const Mesh& mesh )
+{
+    std::vector<char> out;
+    for( int32_t i = 0; i < mesh.num_materials; ++i )
+    {
+        const MaterialParams& mat = mesh.mat_params[i];
+        appendString( out, mat.name );
+        appendString( out, mat.Kd_map );
+        appendFloats( out, mat.Kd, 3 );
+        appendFloats( out, mat.Ks, 3 );
+        appendFloats( out, mat.Kr, 3 );
+        appendFloats( out, mat.Ka, 3 );
+        appendFloats( out, &mat.exp, 1 );
+    }
+    return out;
+}
+
+} // namespace
+
+
+MeshCacheFile::MeshCacheFile( const std::string& source_filename )
+    : m_valid( false )
+{
+    FileStamp stamp;
+    if( !enabled() || !getFileStamp( source_filename, stamp ) )
+        return;
+
+    m_file.reset( new MappedFile( entryPath( source_filename ) ) );
+    if( m_file->size() < sizeof( MeshCacheHeader ) )
+        return;
+
+    MeshCacheHeader header;
+    memcpy( &header, m_file->data(), sizeof( header ) );
+    if( memcmp( header.magic, MESH_MAGIC, sizeof( MESH_MAGIC ) ) != 0 ||
+        header.version != MESH_VERSION ||
+        header.source_size != stamp.size ||
+        header.source_mtime != stamp.mtime )
+        return;
+
+    for( int i = 0; i < SECTION_COUNT; ++i )
+    {
+        if( header.offsets[i] % SECTION_ALIGN != 0 ||
+            header.offsets[i] > m_file->size() ||
+            header.sizes[i] > m_file->size() - header.offsets[i] )
+            return;
+    }
+
+    const uint64_t nv = static_cast<uint64_t>( header.num_vertices );
+    const uint64_t nt = static_cast<uint64_t>( header.num_triangles );
+    if( header.sizes[SECTION_POSITIONS]   != nv*3*sizeof( float ) ||
+        header.sizes[SECTION_NORMALS]     != ( header.flags & FLAG_NORMALS   ? nv*3*sizeof( float ) : 0 ) ||
+        header.sizes[SECTION_TEXCOORDS]   != ( header.flags & FLAG_TEXCOORDS ? nv*2*sizeof( float ) : 0 ) ||
+        header.sizes[SECTION_TRI_INDICES] != nt*3*sizeof( int32_t ) ||
+        header.sizes[SECTION_MAT_INDICES] != nt*sizeof( int32_t ) )
+        return;
+
+    SectionReader reader = { section( SECTION_MATERIALS ), section( SECTION_MATERIALS ) + header.sizes[SECTION_MATERIALS] };
+    m_materials.resize( header.num_materials );
+    for( int32_t i = 0; i < header.num_materials; ++i )
+    {
+        MaterialParams& mat = m_materials[i];
+        if( !reader.readString( mat.name ) ||
+            !reader.readString( mat.Kd_map ) ||
+            !reader.read( mat.Kd, sizeof( mat.Kd ) ) ||
+            !reader.read( mat.Ks, sizeof( mat.Ks ) ) ||
+            !reader.read( mat.Kr, sizeof( mat.Kr ) ) ||
+            !reader.read( mat.Ka, sizeof( mat.Ka ) ) ||
+            !reader.read( &mat.exp, sizeof( mat.exp ) ) )
+            return;
+    }
+
+    m_valid = true;
+}
+
+MeshCacheFile::~MeshCacheFile()
+{
+}
+
+const char* MeshCacheFile::section( int index ) const
+{
+    MeshCacheHeader header;
+    memcpy( &header, m_file->data(), sizeof( header ) );
+    return m_file->data() + header.offsets[index];
+}
+
+void MeshCacheFile::scan( Mesh& mesh ) const
+{
+    MeshCacheHeader header;
+    memcpy( &header, m_file->data(), sizeof( header ) );
+
+    mesh.num_vertices  = header.num_vertices;
+    mesh.num_triangles = header.num_triangles;
+    mesh.num_materials = header.num_materials;
+    mesh.has_normals   = ( header.flags & FLAG_NORMALS ) != 0;
+    mesh.has_texcoords = ( header.flags & FLAG_TEXCOORDS ) != 0;
+    std::copy( header.bbox_min, header.bbox_min + 3, mesh.bbox_min );
+    std::copy( header.bbox_max, header.bbox_max + 3, mesh.bbox_max );
+}
+
+void MeshCacheFile::copyTo( Mesh& mesh ) const
+{
+    MeshCacheHeader header;
+    memcpy( &header, m_file->data(), sizeof( header ) );
+
+    std::copy( header.bbox_min, header.bbox_min + 3, mesh.bbox_min );
+    std::copy( header.bbox_max, header.bbox_max + 3, mesh.bbox_max );
+
+    memcpy( mesh.positions, section( SECTION_POSITIONS ), header.sizes[SECTION_POSITIONS] );
+    if( mesh.has_normals )
+        memcpy( mesh.normals, section( SECTION_NORMALS ), header.sizes[SECTION_NORMALS] );
+    if( mesh.has_texcoords )
+        memcpy( mesh.texcoords, section( SECTION_TEXCOORDS ), header.sizes[SECTION_TEXCOORDS] );
+    memcpy( mesh.tri_indices, section( SECTION_TRI_INDICES ), header.sizes[SECTION_TRI_INDICES] );
+    memcpy( mesh.mat_indices, section( SECTION_MAT_INDICES ), header.sizes[SECTION_MAT_INDICES] );
+
+    std::copy( m_materials.begin(), m_materials.end(), mesh.mat_params );
+}
+
+void MeshCacheFile::map( Mesh& mesh )
+{
+    scan( mesh );
+
+    // The mapping is read only, the arrays are only non-const to fit the Mesh struct
+    mesh.positions   = reinterpret_cast<float*>  ( const_cast<char*>( section( SECTION_POSITIONS ) ) );
+    mesh.normals     = mesh.has_normals   ? reinterpret_cast<float*>( const_cast<char*>( section( SECTION_NORMALS ) ) )   : 0;
+    mesh.texcoords   = mesh.has_texcoords ? reinterpret_cast<float*>( const_cast<char*>( section( SECTION_TEXCOORDS ) ) ) : 0;
+    mesh.tri_indices = reinterpret_cast<int32_t*>( const_cast<char*>( section( SECTION_TRI_INDICES ) ) );
+    mesh.mat_indices = reinterpret_cast<int32_t*>( const_cast<char*>( section( SECTION_MAT_INDICES ) ) );
+    mesh.mat_params  = m_materials.empty() ? 0 : &m_materials[0];
+}
+
+bool MeshCacheFile::write( const std::string& source_filename, const Mesh& mesh )
+{
+    FileStamp stamp;
+    if( !enabled() || !getFileStamp( source_filename, stamp ) )
+        return false;
+
+    const std::string path = entryPath( source_filename );
+    makeDirectory( path.substr( 0, path.find_last_of( '/' ) ) );
+
+    MeshCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, MESH_MAGIC, sizeof( MESH_MAGIC ) );
+    header.version       = MESH_VERSION;
+    header.flags         = ( mesh.has_normals ? FLAG_NORMALS : 0u ) | ( mesh.has_texcoords ? FLAG_TEXCOORDS : 0u );
+    header.source_size   = stamp.size;
+    header.source_mtime  = stamp.mtime;
+    header.num_vertices  = mesh.num_vertices;
+    header.num_triangles = mesh.num_triangles;
+    header.num_materials = mesh.num_materials;
+    std::copy( mesh.bbox_min, mesh.bbox_min + 3, header.bbox_min );
+    std::copy( mesh.bbox_max, mesh.bbox_max + 3, header.bbox_max );
+
+    const std::vector<char> materials = serializeMaterials( mesh );
+    const uint64_t nv = static_cast<uint64_t>( mesh.num_vertices );
+    const uint64_t nt = static_cast<uint64_t>( mesh.num_triangles );
+
+    const void* data[SECTION_COUNT] =
+    {
+        mesh.positions,
+        mesh.normals,
+        mesh.texcoords,
+        mesh.tri_indices,
+        mesh.mat_indices,
+        materials.empty() ? 0 : &materials[0]
+    };
+    header.sizes[SECTION_POSITIONS]   = nv*3*sizeof( float );
+    header.sizes[SECTION_NORMALS]     = mesh.has_normals   ? nv*3*sizeof( float ) : 0;
+    header.sizes[SECTION_TEXCOORDS]   = mesh.has_texcoords ? nv*2*sizeof( float ) : 0;
+    header.sizes[SECTION_TRI_INDICES] = nt*3*sizeof( int32_t );
+    header.sizes[SECTION_MAT_INDICES] = nt*sizeof( int32_t );
+    header.sizes[SECTION_MATERIALS]   = materials.size();
+
+    // Header, then each section padded out to the alignment
+    static const char padding[SECTION_ALIGN] = { 0 };
+    const void* buffers[1 + 2*SECTION_COUNT];
+    size_t      sizes[1 + 2*SECTION_COUNT];
+    size_t      count = 0;
+
+    uint64_t offset = sizeof( header );
+    buffers[count] = &header;
+    sizes[count++] = sizeof( header );
+    for( int i = 0; i < SECTION_COUNT; ++i )
+    {
+        const uint64_t aligned = alignUp( offset );
+        buffers[count] = padding;
+        sizes[count++] = static_cast<size_t>( aligned - offset );
+        header.offsets[i] = aligned;
+
+        buffers[count] = data[i] ? data[i] : padding;
+        sizes[count++] = static_cast<size_t>( header.sizes[i] );
+        offset = aligned + header.sizes[i];
+    }
+
+    return writeFileAtomic( path, buffers, sizes, count );
+}
+
+bool MeshCacheFile::enabled()
+{
+    const char* dir = getenv( "OPTIX_MESH_CACHE_DIR" );
+    return !dir || dir[0] != '\0';
+}
+
+std::string MeshCacheFile::entryPath( const std::string& source_filename )
+{
+    const char* dir = getenv( "OPTIX_MESH_CACHE_DIR" );
+    const std::string directory = dir ? std::string( dir ) : std::string( sutil::samplesPTXDir() ) + "/mesh_cache";
+
+    char name[32];
+    snprintf( name, sizeof( name ), "%016llx.mesh",
+              static_cast<unsigned long long>( hashBytes( source_filename.data(), source_filename.size() ) ) );
+    return directory + "/" + name;
+}
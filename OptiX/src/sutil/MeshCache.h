@@ -0,0 +1,60 @@
+#pragma once
+
+#include <sutilapi.h>
+#include <Mesh.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+//-----------------------------------------------------------------------------
+//
+// MeshCacheFile
+//
+// Versioned binary copy of a parsed OBJ/PLY mesh, written the first time the
+// source is loaded and memory mapped afterwards. Positions, normals, texcoords,
+// triangle indices and material indices are stored as raw arrays, each
+// section 64 byte aligned, so they can be used in place. The entry is only
+// used while the source file's size and modification time still match.
+//
+// Cache files live in $OPTIX_MESH_CACHE_DIR, or a mesh_cache folder under
+// samplesPTXDir(). Setting the variable to an empty string turns caching off.
+//
+//-----------------------------------------------------------------------------
+
+class SUTILCLASSAPI MeshCacheFile
+{
+public:
+    // Maps the cache entry for the source mesh file if it is present and up to date
+    SUTILAPI explicit MeshCacheFile( const std::string& source_filename );
+    SUTILAPI ~MeshCacheFile();
+
+    bool valid() const { return m_valid; }
+
+    // Fills in the counts and flags, like MeshLoader::scanMesh
+    SUTILAPI void scan( Mesh& mesh ) const;
+
+    // Copies the arrays into buffers the caller allocated from scan()
+    SUTILAPI void copyTo( Mesh& mesh ) const;
+
+    // Points mesh at the mapped arrays. Valid while this object lives, don't freeMesh it
+    SUTILAPI void map( Mesh& mesh );
+
+    // Writes the cache entry for a fully loaded mesh (before any load transform)
+    SUTILAPI static bool write( const std::string& source_filename, const Mesh& mesh );
+
+    SUTILAPI static bool enabled();
+    SUTILAPI static std::string entryPath( const std::string& source_filename );
+
+private:
+    MeshCacheFile( const MeshCacheFile& );
+    MeshCacheFile& operator=( const MeshCacheFile& );
+
+    const char* section( int index ) const;
+
+    std::unique_ptr<MappedFile>  m_file;
+    std::vector<MaterialParams>  m_materials;
+    bool                         m_valid;
+};
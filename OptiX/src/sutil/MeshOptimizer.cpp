@@ -0,0 +1,233 @@
+#include <sutil/MeshOptimizer.h>
+#include <sutil/MappedFile.h>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+uint64_t meshBytes( const Mesh& mesh )
+{
+    const uint64_t vertex_floats = 3 + ( mesh.has_normals ? 3 : 0 ) + ( mesh.has_texcoords ? 2 : 0 );
+    return mesh.num_vertices * vertex_floats * sizeof( float ) +
+           mesh.num_triangles * 4 * sizeof( int32_t );
+}
+
+// Position, normal and texcoord of one vertex, with -0 folded into 0 so
+// bitwise equality matches float equality
+struct VertexKey
+{
+    float attributes[8];
+
+    bool operator==( const VertexKey& other ) const
+    {
+        return memcmp( attributes, other.attributes, sizeof( attributes ) ) == 0;
+    }
+};
+
+struct VertexKeyHash
+{
+    size_t operator()( const VertexKey& key ) const
+    {
+        return static_cast<size_t>( hashBytes( key.attributes, sizeof( key.attributes ) ) );
+    }
+};
+
+VertexKey vertexKey( const Mesh& mesh, int32_t i )
+{
+    VertexKey key;
+    memset( &key, 0, sizeof( key ) );
+    std::copy( mesh.positions + i * 3, mesh.positions + i * 3 + 3, key.attributes );
+    if( mesh.has_normals )
+        std::copy( mesh.normals + i * 3, mesh.normals + i * 3 + 3, key.attributes + 3 );
+    if( mesh.has_texcoords )
+        std::copy( mesh.texcoords + i * 2, mesh.texcoords + i * 2 + 2, key.attributes + 6 );
+
+    for( int k = 0; k < 8; ++k )
+        key.attributes[k] += 0.0f;
+    return key;
+}
+
+// Moves vertex i to remap[i], entries of -1 are dropped. Heap meshes get
+// arrays of the new size, arena meshes are compacted in place until
+// shrinkArena
+void remapVertices( Mesh& mesh, const std::vector<int32_t>& remap, int32_t new_count )
+{
+    std::vector<float> positions( 3 * new_count );
+    std::vector<float> normals(   mesh.has_normals   ? 3 * new_count : 0 );
+    std::vector<float> texcoords( mesh.has_texcoords ? 2 * new_count : 0 );
+
+    for( int32_t i = 0; i < mesh.num_vertices; ++i )
+    {
+        const int32_t j = remap[i];
+        if( j < 0 )
+            continue;
+
+        std::copy( mesh.positions + i * 3, mesh.positions + i * 3 + 3, &positions[j * 3] );
+        if( mesh.has_normals )
+            std::copy( mesh.normals + i * 3, mesh.normals + i * 3 + 3, &normals[j * 3] );
+        if( mesh.has_texcoords )
+            std::copy( mesh.texcoords + i * 2, mesh.texcoords + i * 2 + 2, &texcoords[j * 2] );
+    }
+
+    for( int32_t i = 0; i < mesh.num_triangles * 3; ++i )
+        mesh.tri_indices[i] = remap[ mesh.tri_indices[i] ];
+
+    if( !mesh.arena )
+    {
+        delete [] mesh.positions;
+        delete [] mesh.normals;
+        delete [] mesh.texcoords;
+        mesh.positions = new float[ 3 * new_count ];
+        mesh.normals   = mesh.has_normals   ? new float[ 3 * new_count ] : 0;
+        mesh.texcoords = mesh.has_texcoords ? new float[ 2 * new_count ] : 0;
+    }
+
+    std::copy( positions.begin(), positions.end(), mesh.positions );
+    std::copy( normals.begin(),   normals.end(),   mesh.normals );
+    std::copy( texcoords.begin(), texcoords.end(), mesh.texcoords );
+    mesh.num_vertices = new_count;
+}
+
+void weldVertices( Mesh& mesh )
+{
+    std::unordered_map<VertexKey, int32_t, VertexKeyHash> unique;
+    unique.reserve( mesh.num_vertices );
+
+    std::vector<int32_t> remap( mesh.num_vertices );
+    for( int32_t i = 0; i < mesh.num_vertices; ++i )
+        remap[i] = unique.insert( std::make_pair( vertexKey( mesh, i ), static_cast<int32_t>( unique.size() ) ) ).first->second;
+
+    if( static_cast<int32_t>( unique.size() ) != mesh.num_vertices )
+        remapVertices( mesh, remap, static_cast<int32_t>( unique.size() ) );
+}
+
+// Spreads the low 10 bits of v out to every third bit
+uint32_t expandBits( uint32_t v )
+{
+    v = ( v * 0x00010001u ) & 0xFF0000FFu;
+    v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+    v = ( v * 0x00000011u ) & 0xC30C30C3u;
+    v = ( v * 0x00000005u ) & 0x49249249u;
+    return v;
+}
+
+uint32_t mortonCode( const float* p, const float* bbox_min, const float* extent )
+{
+    uint32_t code = 0;
+    for( int k = 0; k < 3; ++k )
+    {
+        const float t = extent[k] > 0.0f ? ( p[k] - bbox_min[k] ) / extent[k] : 0.0f;
+        const uint32_t cell = static_cast<uint32_t>( std::min( std::max( t * 1024.0f, 0.0f ), 1023.0f ) );
+        code |= expandBits( cell ) << ( 2 - k );
+    }
+    return code;
+}
+
+void reorderTriangles( Mesh& mesh )
+{
+    // Bounds of the centroids rather than mesh.bbox, which may be stale
+    float bbox_min[3] = {  1e16f,  1e16f,  1e16f };
+    float bbox_max[3] = { -1e16f, -1e16f, -1e16f };
+    std::vector<float> centroids( mesh.num_triangles * 3 );
+    for( int32_t i = 0; i < mesh.num_triangles; ++i )
+    {
+        for( int k = 0; k < 3; ++k )
+        {
+            float c = 0.0f;
+            for( int j = 0; j < 3; ++j )
+                c += mesh.positions[ mesh.tri_indices[i * 3 + j] * 3 + k ];
+            c /= 3.0f;
+
+            centroids[i * 3 + k] = c;
+            bbox_min[k] = std::min( bbox_min[k], c );
+            bbox_max[k] = std::max( bbox_max[k], c );
+        }
+    }
+
+    const float extent[3] = { bbox_max[0] - bbox_min[0], bbox_max[1] - bbox_min[1], bbox_max[2] - bbox_min[2] };
+    std::vector<std::pair<uint32_t, int32_t> > order( mesh.num_triangles );
+    for( int32_t i = 0; i < mesh.num_triangles; ++i )
+        order[i] = std::make_pair( mortonCode( &centroids[i * 3], bbox_min, extent ), i );
+    std::sort( order.begin(), order.end() );
+
+    std::vector<int32_t> tri_indices( mesh.tri_indices, mesh.tri_indices + mesh.num_triangles * 3 );
+    std::vector<int32_t> mat_indices( mesh.mat_indices, mesh.mat_indices + mesh.num_triangles );
+    for( int32_t i = 0; i < mesh.num_triangles; ++i )
+    {
+        const int32_t from = order[i].second;
+        std::copy( &tri_indices[from * 3], &tri_indices[from * 3] + 3, mesh.tri_indices + i * 3 );
+        mesh.mat_indices[i] = mat_indices[from];
+    }
+
+    // Number vertices in the order the sorted triangles first use them,
+    // unreferenced vertices are dropped
+    std::vector<int32_t> remap( mesh.num_vertices, -1 );
+    int32_t next = 0;
+    for( int32_t i = 0; i < mesh.num_triangles * 3; ++i )
+    {
+        int32_t& index = remap[ mesh.tri_indices[i] ];
+        if( index < 0 )
+            index = next++;
+    }
+    remapVertices( mesh, remap, next );
+}
+
+// Moves an arena mesh whose vertex arrays were compacted in place into a
+// block of its new size from the same allocator, so the space is given back
+void shrinkArena( Mesh& mesh )
+{
+    Mesh shrunk = mesh;
+    allocMeshArena( shrunk, *mesh.arena_allocator );
+
+    std::copy( mesh.positions, mesh.positions + 3 * mesh.num_vertices, shrunk.positions );
+    if( mesh.has_normals )
+        std::copy( mesh.normals, mesh.normals + 3 * mesh.num_vertices, shrunk.normals );
+    if( mesh.has_texcoords )
+        std::copy( mesh.texcoords, mesh.texcoords + 2 * mesh.num_vertices, shrunk.texcoords );
+    std::copy( mesh.tri_indices, mesh.tri_indices + 3 * mesh.num_triangles, shrunk.tri_indices );
+    std::copy( mesh.mat_indices, mesh.mat_indices + mesh.num_triangles, shrunk.mat_indices );
+    std::copy( mesh.mat_params, mesh.mat_params + mesh.num_materials, shrunk.mat_params );
+
+    freeMesh( mesh );
+    mesh = shrunk;
+}
+
+} // namespace
+
+
+MeshOptimizeStats optimizeMesh( Mesh& mesh, bool weld, bool reorder )
+{
+    MeshOptimizeStats stats;
+    stats.vertices_before = mesh.num_vertices;
+    stats.num_triangles   = mesh.num_triangles;
+    stats.bytes_before    = meshBytes( mesh );
+
+    if( mesh.num_vertices > 0 && mesh.num_triangles > 0 )
+    {
+        if( weld )
+            weldVertices( mesh );
+        if( reorder )
+            reorderTriangles( mesh );
+
+        if( mesh.arena && mesh.num_vertices < stats.vertices_before )
+            shrinkArena( mesh );
+    }
+
+    stats.vertices_after = mesh.num_vertices;
+    stats.bytes_after    = meshBytes( mesh );
+    return stats;
+}
+
+
+void printMeshOptimizeStats( const MeshOptimizeStats& stats, std::ostream& out )
+{
+    out << "MeshOptimizer: " << stats.num_triangles << " triangles, vertices "
+        << stats.vertices_before << " -> " << stats.vertices_after << ", "
+        << stats.bytes_before / 1024 << " KB -> " << stats.bytes_after / 1024 << " KB ("
+        << ( stats.bytes_before - stats.bytes_after ) / 1024 << " KB saved)" << std::endl;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <sutilapi.h>
+#include <Mesh.h>
+
+#include <iostream>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+//
+// Optional post-load pass for host meshes
+//
+// Welding merges vertices whose position, normal and texcoord are identical,
+// which OBJ files produce wherever faces of different groups or with
+// different vt/vn indices meet. Reordering sorts the triangles by the Morton
+// code of their centroid and renumbers the vertices in first use order, so
+// triangles and vertices that are close in space are close in memory for the
+// BVH build and traversal.
+//
+//-----------------------------------------------------------------------------
+
+struct MeshOptimizeStats
+{
+    int32_t  vertices_before;
+    int32_t  vertices_after;
+    int32_t  num_triangles;
+    uint64_t bytes_before;      // Vertex, index and material index arrays
+    uint64_t bytes_after;
+};
+
+// mesh must own its arrays (allocMesh, allocMeshArena or loadMesh). When
+// vertices are dropped, heap vertex arrays are reallocated at their new size
+// and an arena is replaced by a smaller one from the same allocator
+SUTILAPI MeshOptimizeStats optimizeMesh( Mesh& mesh, bool weld = true, bool reorder = true );
+
+SUTILAPI void printMeshOptimizeStats( const MeshOptimizeStats& stats, std::ostream& out = std::cout );
@@ -0,0 +1,561 @@
+#include <sutil/ObjChunkParser.h>
+#include <sutil/MappedFile.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+
+// Smaller files aren't worth another thread
+const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+inline bool isBlank( char c )
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit( char c )
+{
+    return c >= '0' && c <= '9';
+}
+
+inline void skipBlanks( const char*& p, const char* end )
+{
+    while( p < end && isBlank( *p ) )
+        ++p;
+}
+
+// Decimal and exponent forms only, anything else (inf, nan, hex) fails and the
+// file goes to tinyobj
+bool parseFloat( const char*& p, const char* end, float& value )
+{
+    static const double POW10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    skipBlanks( p, end );
+
+    bool negative = false;
+    if( p < end && ( *p == '-' || *p == '+' ) )
+        negative = *p++ == '-';
+
+    // 18 digits fit in the mantissa, later ones only scale it
+    uint64_t mantissa = 0;
+    int      exponent = 0;
+    int      digits   = 0;
+    for( ; p < end && isDigit( *p ); ++p, ++digits )
+    {
+        if( mantissa < 100000000000000000ULL )
+            mantissa = mantissa * 10 + ( *p - '0' );
+        else
+            ++exponent;
+    }
+
+    if( p < end && *p == '.' )
+    {
+        for( ++p; p < end && isDigit( *p ); ++p, ++digits )
+        {
+            if( mantissa < 100000000000000000ULL )
+            {
+                mantissa = mantissa * 10 + ( *p - '0' );
+                --exponent;
+            }
+        }
+    }
+
+    if( digits == 0 )
+        return false;
+
+    if( p < end && ( *p == 'e' || *p == 'E' ) )
+    {
+        ++p;
+        bool negative_exponent = false;
+        if( p < end && ( *p == '-' || *p == '+' ) )
+            negative_exponent = *p++ == '-';
+
+        if( p == end || !isDigit( *p ) )
+            return false;
+
+        int e = 0;
+        for( ; p < end && isDigit( *p ); ++p )
+            e = std::min( e * 10 + ( *p - '0' ), 10000 );
+        exponent += negative_exponent ? -e : e;
+    }
+
+    if( p < end && !isBlank( *p ) && *p != '\n' )
+        return false;
+
+    double result = static_cast<double>( mantissa );
+    if( exponent < 0 )
+        result = -exponent <= 22 ? result / POW10[-exponent] : result * std::pow( 10.0, exponent );
+    else if( exponent > 0 )
+        result = exponent <= 22 ? result * POW10[exponent] : result * std::pow( 10.0, exponent );
+
+    value = static_cast<float>( negative ? -result : result );
+    return true;
+}
+
+// Positive 1 based index, stored 0 based
+bool parseIndex( const char*& p, const char* end, int32_t& index )
+{
+    if( p == end || !isDigit( *p ) )
+        return false;
+
+    int64_t value = 0;
+    for( ; p < end && isDigit( *p ); ++p )
+    {
+        value = value * 10 + ( *p - '0' );
+        if( value > INT32_MAX )
+            return false;
+    }
+
+    if( value == 0 )
+        return false;
+
+    index = static_cast<int32_t>( value - 1 );
+    return true;
+}
+
+// v, v/vt, v//vn or v/vt/vn
+bool parseCorner( const char*& p, const char* end, int32_t corner[3] )
+{
+    corner[0] = corner[1] = corner[2] = -1;
+    if( !parseIndex( p, end, corner[0] ) )
+        return false;
+
+    if( p < end && *p == '/' )
+    {
+        ++p;
+        if( p < end && *p != '/' && !parseIndex( p, end, corner[1] ) )
+            return false;
+
+        if( p < end && *p == '/' )
+        {
+            ++p;
+            if( !parseIndex( p, end, corner[2] ) )
+                return false;
+        }
+    }
+
+    return p == end || isBlank( *p ) || *p == '\n';
+}
+
+bool parseFloats( const char*& p, const char* end, int count, std::vector<float>& out )
+{
+    for( int i = 0; i < count; ++i )
+    {
+        float value;
+        if( !parseFloat( p, end, value ) )
+            return false;
+        out.push_back( value );
+    }
+    return true;
+}
+
+bool parseFace( const char*& p, const char* end, std::vector<int32_t>& polygon, ObjChunkParser::Chunk& chunk )
+{
+    polygon.clear();
+    for( ;; )
+    {
+        skipBlanks( p, end );
+        if( p == end || *p == '\n' )
+            break;
+
+        int32_t corner[3];
+        if( !parseCorner( p, end, corner ) )
+            return false;
+        polygon.insert( polygon.end(), corner, corner + 3 );
+    }
+
+    const size_t count = polygon.size() / 3;
+    if( count < 3 )
+        return false;
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        const int32_t* corner = &polygon[i * 3];
+        chunk.max_position = std::max( chunk.max_position, corner[0] );
+        chunk.max_texcoord = std::max( chunk.max_texcoord, corner[1] );
+        chunk.max_normal   = std::max( chunk.max_normal,   corner[2] );
+        chunk.direct       = chunk.direct &&
+                             ( corner[1] < 0 || corner[1] == corner[0] ) &&
+                             ( corner[2] < 0 || corner[2] == corner[0] );
+    }
+
+    // Fan triangulation, the same as tinyobj
+    for( size_t i = 1; i + 1 < count; ++i )
+    {
+        const size_t fan[3] = { 0, i, i + 1 };
+        for( int j = 0; j < 3; ++j )
+        {
+            const int32_t* corner = &polygon[fan[j] * 3];
+            chunk.corners.insert( chunk.corners.end(), corner, corner + 3 );
+            chunk.corners_with_texcoords += corner[1] >= 0;
+            chunk.corners_with_normals   += corner[2] >= 0;
+        }
+    }
+    return true;
+}
+
+bool startsWith( const char* p, const char* end, const char* keyword )
+{
+    const size_t length = strlen( keyword );
+    return static_cast<size_t>( end - p ) > length &&
+           memcmp( p, keyword, length ) == 0 &&
+           isBlank( p[length] );
+}
+
+void parseChunk( const char* begin, const char* end, ObjChunkParser::Chunk& chunk )
+{
+    chunk.supported              = true;
+    chunk.direct                 = true;
+    chunk.corners_with_normals   = 0;
+    chunk.corners_with_texcoords = 0;
+    chunk.max_position           = -1;
+    chunk.max_normal             = -1;
+    chunk.max_texcoord           = -1;
+
+    std::vector<int32_t> polygon;
+    const char* p = begin;
+    while( p < end && chunk.supported )
+    {
+        const char* line_end = static_cast<const char*>( memchr( p, '\n', end - p ) );
+        if( !line_end )
+            line_end = end;
+
+        skipBlanks( p, line_end );
+
+        if( p == line_end || *p == '#' )
+        {
+        }
+        else if( startsWith( p, line_end, "v" ) )
+        {
+            p += 2;
+            chunk.supported = parseFloats( p, line_end, 3, chunk.positions );
+        }
+        else if( startsWith( p, line_end, "vn" ) )
+        {
+            p += 3;
+            chunk.supported = parseFloats( p, line_end, 3, chunk.normals );
+        }
+        else if( startsWith( p, line_end, "vt" ) )
+        {
+            p += 3;
+            chunk.supported = parseFloats( p, line_end, 2, chunk.texcoords );
+        }
+        else if( startsWith( p, line_end, "f" ) )
+        {
+            p += 2;
+            chunk.supported = parseFace( p, line_end, polygon, chunk );
+        }
+        else if( startsWith( p, line_end, "g" ) || startsWith( p, line_end, "o" ) || startsWith( p, line_end, "s" ) )
+        {
+            // tinyobj starts a new shape here, numbering its vertices afresh
+            if( !startsWith( p, line_end, "s" ) )
+                chunk.shape_starts.push_back( static_cast<int32_t>( chunk.corners.size() / 9 ) );
+        }
+        else
+        {
+            // mtllib, usemtl, l, p, curves...
+            chunk.supported = false;
+        }
+
+        p = line_end + 1;
+    }
+}
+
+struct VertexKey
+{
+    int32_t v, vt, vn;
+
+    bool operator==( const VertexKey& other ) const
+    {
+        return v == other.v && vt == other.vt && vn == other.vn;
+    }
+};
+
+struct VertexKeyHash
+{
+    size_t operator()( const VertexKey& key ) const
+    {
+        return static_cast<size_t>( hashBytes( &key, sizeof( key ) ) );
+    }
+};
+
+template <typename T>
+void appendTo( std::vector<T>& dst, std::vector<T>& src )
+{
+    dst.insert( dst.end(), src.begin(), src.end() );
+    std::vector<T>().swap( src );
+}
+
+} // namespace
+
+
+bool ObjChunkParser::parse( const std::string& filename, unsigned int threads )
+{
+    m_chunks.clear();
+    m_vertices.clear();
+    m_tri_indices.clear();
+
+    MappedFile file( filename );
+    if( !file.data() )
+        return false;
+
+    if( threads == 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    const size_t chunk_count = std::min<size_t>( threads, file.size() / MIN_CHUNK_BYTES + 1 );
+
+    //
+    // Split at line starts so no line straddles two chunks
+    //
+    std::vector<const char*> bounds( 1, file.data() );
+    const char* file_end = file.data() + file.size();
+    for( size_t i = 1; i < chunk_count; ++i )
+    {
+        const char* split = std::max( bounds.back(), file.data() + file.size() * i / chunk_count );
+        const char* newline = static_cast<const char*>( memchr( split, '\n', file_end - split ) );
+        bounds.push_back( newline ? newline + 1 : file_end );
+    }
+    bounds.push_back( file_end );
+
+    m_chunks.resize( chunk_count );
+    std::vector<std::thread> workers;
+    for( size_t i = 1; i < chunk_count; ++i )
+        workers.push_back( std::thread( parseChunk, bounds[i], bounds[i + 1], std::ref( m_chunks[i] ) ) );
+    parseChunk( bounds[0], bounds[1], m_chunks[0] );
+    for( size_t i = 0; i < workers.size(); ++i )
+        workers[i].join();
+
+    //
+    // Merge the counts and check the indices now that the totals are known
+    //
+    int64_t num_positions          = 0;
+    int64_t num_normals            = 0;
+    int64_t num_texcoords          = 0;
+    int64_t num_corners            = 0;
+    int64_t corners_with_normals   = 0;
+    int64_t corners_with_texcoords = 0;
+    int32_t max_position           = -1;
+    int32_t max_normal             = -1;
+    int32_t max_texcoord           = -1;
+    bool    direct                 = true;
+    for( size_t i = 0; i < m_chunks.size(); ++i )
+    {
+        Chunk& chunk = m_chunks[i];
+        if( !chunk.supported )
+            return false;
+
+        chunk.position_offset = static_cast<int32_t>( num_positions );
+        chunk.normal_offset   = static_cast<int32_t>( num_normals );
+        chunk.texcoord_offset = static_cast<int32_t>( num_texcoords );
+        chunk.triangle_offset = static_cast<int32_t>( num_corners / 3 );
+
+        num_positions          += chunk.positions.size() / 3;
+        num_normals            += chunk.normals.size() / 3;
+        num_texcoords          += chunk.texcoords.size() / 2;
+        num_corners            += chunk.corners.size() / 3;
+        corners_with_normals   += chunk.corners_with_normals;
+        corners_with_texcoords += chunk.corners_with_texcoords;
+        max_position            = std::max( max_position, chunk.max_position );
+        max_normal              = std::max( max_normal,   chunk.max_normal );
+        max_texcoord            = std::max( max_texcoord, chunk.max_texcoord );
+        direct                  = direct && chunk.direct;
+    }
+
+    if( num_corners == 0 || num_corners / 3 > INT32_MAX )
+        return false;
+
+    if( max_position >= num_positions || max_normal >= num_normals || max_texcoord >= num_texcoords )
+        return false;
+
+    // tinyobj drops attributes some faces lack, leave that case to it
+    if( ( corners_with_normals   != 0 && corners_with_normals   != num_corners ) ||
+        ( corners_with_texcoords != 0 && corners_with_texcoords != num_corners ) )
+        return false;
+
+    m_num_positions = static_cast<int32_t>( num_positions );
+    m_num_normals   = static_cast<int32_t>( num_normals );
+    m_num_texcoords = static_cast<int32_t>( num_texcoords );
+    m_num_triangles = static_cast<int32_t>( num_corners / 3 );
+    m_has_normals   = corners_with_normals != 0;
+    m_has_texcoords = corners_with_texcoords != 0;
+
+    //
+    // tinyobj numbers each shape's vertices in order of first use and drops
+    // positions no face references. The positions are its vertices as they
+    // stand only if there is one shape and faces first use all of them in file order
+    //
+    if( direct &&
+        ( !m_has_normals   || m_num_normals   == m_num_positions ) &&
+        ( !m_has_texcoords || m_num_texcoords == m_num_positions ) )
+    {
+        bool    in_order = true;
+        int32_t next     = 0;
+        for( size_t i = 0; i < m_chunks.size() && in_order; ++i )
+        {
+            const Chunk& chunk = m_chunks[i];
+            for( size_t j = 0; j < chunk.shape_starts.size(); ++j )
+                in_order = in_order && chunk.triangle_offset + chunk.shape_starts[j] == 0;
+
+            for( size_t j = 0; j < chunk.corners.size() && in_order; j += 3 )
+            {
+                if( chunk.corners[j] == next )
+                    ++next;
+                else
+                    in_order = chunk.corners[j] < next;
+            }
+        }
+
+        if( in_order && next == m_num_positions )
+            return true;
+    }
+
+    //
+    // Otherwise build one vertex per unique (v, vt, vn) within each shape like
+    // tinyobj, and merge the attribute streams so they can be indexed directly
+    //
+    Chunk& merged = m_chunks[0];
+    for( size_t i = 1; i < m_chunks.size(); ++i )
+    {
+        appendTo( merged.positions, m_chunks[i].positions );
+        appendTo( merged.normals,   m_chunks[i].normals );
+        appendTo( merged.texcoords, m_chunks[i].texcoords );
+    }
+
+    std::unordered_map<VertexKey, int32_t, VertexKeyHash> unique;
+    unique.reserve( static_cast<size_t>( num_positions ) );
+    m_tri_indices.reserve( static_cast<size_t>( num_corners ) );
+    for( size_t i = 0; i < m_chunks.size(); ++i )
+    {
+        const std::vector<int32_t>& corners      = m_chunks[i].corners;
+        const std::vector<int32_t>& shape_starts = m_chunks[i].shape_starts;
+        size_t                      shape        = 0;
+        for( size_t j = 0; j < corners.size(); j += 3 )
+        {
+            for( ; shape < shape_starts.size() && static_cast<size_t>( shape_starts[shape] ) * 9 <= j; ++shape )
+                unique.clear();
+
+            const VertexKey key = { corners[j], corners[j + 1], corners[j + 2] };
+            const std::pair<std::unordered_map<VertexKey, int32_t, VertexKeyHash>::iterator, bool> inserted =
+                unique.insert( std::make_pair( key, static_cast<int32_t>( m_vertices.size() / 3 ) ) );
+            if( inserted.second )
+                m_vertices.insert( m_vertices.end(), &corners[j], &corners[j] + 3 );
+            m_tri_indices.push_back( inserted.first->second );
+        }
+    }
+
+    m_chunks.resize( 1 );
+    std::vector<int32_t>().swap( merged.corners );
+    std::vector<int32_t>().swap( merged.shape_starts );
+    return true;
+}
+
+
+void ObjChunkParser::scan( Mesh& mesh ) const
+{
+    mesh.num_vertices  = m_vertices.empty() ? m_num_positions : static_cast<int32_t>( m_vertices.size() / 3 );
+    mesh.num_triangles = m_num_triangles;
+    mesh.has_normals   = m_has_normals;
+    mesh.has_texcoords = m_has_texcoords;
+    mesh.num_materials = 1; // default material
+}
+
+
+namespace
+{
+
+void growBBox( float* bbox_min, float* bbox_max, const float* p )
+{
+    for( int k = 0; k < 3; ++k )
+    {
+        bbox_min[k] = std::min<float>( bbox_min[k], p[k] );
+        bbox_max[k] = std::max<float>( bbox_max[k], p[k] );
+    }
+}
+
+} // namespace
+
+
+void ObjChunkParser::load( Mesh& mesh ) const
+{
+    if( m_vertices.empty() )
+    {
+        // Each chunk writes its own slice of the Mesh arrays
+        // Per chunk min and max, merged after the join
+        std::vector<float> bounds( m_chunks.size() * 6 );
+        const auto copyChunk = [this, &mesh, &bounds]( size_t index )
+        {
+            const Chunk& chunk = m_chunks[index];
+            float* bbox_min = &bounds[index * 6];
+            float* bbox_max = bbox_min + 3;
+            std::copy( mesh.bbox_min, mesh.bbox_min + 3, bbox_min );
+            std::copy( mesh.bbox_max, mesh.bbox_max + 3, bbox_max );
+
+            if( !chunk.positions.empty() )
+                memcpy( mesh.positions + chunk.position_offset * 3, &chunk.positions[0], chunk.positions.size() * sizeof( float ) );
+            if( mesh.has_normals && !chunk.normals.empty() )
+                memcpy( mesh.normals + chunk.normal_offset * 3, &chunk.normals[0], chunk.normals.size() * sizeof( float ) );
+            if( mesh.has_texcoords && !chunk.texcoords.empty() )
+                memcpy( mesh.texcoords + chunk.texcoord_offset * 2, &chunk.texcoords[0], chunk.texcoords.size() * sizeof( float ) );
+
+            // Every position is referenced on this path, so the bounds match tinyobj's
+            for( size_t i = 0; i < chunk.positions.size(); i += 3 )
+                growBBox( bbox_min, bbox_max, &chunk.positions[i] );
+
+            int32_t* tri_indices = mesh.tri_indices + chunk.triangle_offset * 3;
+            for( size_t i = 0; i < chunk.corners.size() / 3; ++i )
+                tri_indices[i] = chunk.corners[i * 3];
+
+            std::fill( mesh.mat_indices + chunk.triangle_offset,
+                       mesh.mat_indices + chunk.triangle_offset + chunk.corners.size() / 9, 0 );
+        };
+
+        std::vector<std::thread> workers;
+        for( size_t i = 1; i < m_chunks.size(); ++i )
+            workers.push_back( std::thread( copyChunk, i ) );
+        copyChunk( 0 );
+        for( size_t i = 0; i < workers.size(); ++i )
+            workers[i].join();
+
+        for( size_t i = 0; i < m_chunks.size(); ++i )
+        {
+            if( m_chunks[i].positions.empty() )
+                continue;
+            growBBox( mesh.bbox_min, mesh.bbox_max, &bounds[i * 6] );
+            growBBox( mesh.bbox_min, mesh.bbox_max, &bounds[i * 6 + 3] );
+        }
+    }
+    else
+    {
+        const Chunk& merged = m_chunks[0];
+        for( size_t i = 0; i < m_vertices.size() / 3; ++i )
+        {
+            const int32_t* vertex = &m_vertices[i * 3];
+            const float* position = &merged.positions[vertex[0] * 3];
+            std::copy( position, position + 3, mesh.positions + i * 3 );
+            growBBox( mesh.bbox_min, mesh.bbox_max, position );
+
+            if( mesh.has_normals )
+                std::copy( &merged.normals[vertex[2] * 3], &merged.normals[vertex[2] * 3] + 3, mesh.normals + i * 3 );
+            if( mesh.has_texcoords )
+                std::copy( &merged.texcoords[vertex[1] * 2], &merged.texcoords[vertex[1] * 2] + 2, mesh.texcoords + i * 2 );
+        }
+
+        std::copy( m_tri_indices.begin(), m_tri_indices.end(), mesh.tri_indices );
+        std::fill( mesh.mat_indices, mesh.mat_indices + m_num_triangles, 0 );
+    }
+
+    // tinyobj's default material, which it adds when the file names none
+    MaterialParams mat;
+    mat.Kd[0] = mat.Kd[1] = mat.Kd[2] = 0.7f;
+    mat.Ks[0] = mat.Ks[1] = mat.Ks[2] = 0.0f;
+    mat.Kr[0] = mat.Kr[1] = mat.Kr[2] = 0.0f;
+    mat.Ka[0] = mat.Ka[1] = mat.Ka[2] = 0.0f;
+    mat.exp   = 1.0f;
+    mesh.mat_params[0] = mat;
+}
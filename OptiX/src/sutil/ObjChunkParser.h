@@ -0,0 +1,73 @@
+#pragma once
+
+#include <sutilapi.h>
+#include <Mesh.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// ObjChunkParser
+//
+// Multithreaded parser for the geometry subset of OBJ used by scanned and
+// exported meshes: v, vn, vt and f lines with positive indices. The file is
+// memory mapped, split into line aligned chunks and each chunk is parsed on
+// its own thread. load() then writes straight into the Mesh arrays, with the
+// same vertices, order and bounds tinyobj would give.
+//
+// parse() returns false for anything it doesn't handle (materials, negative
+// indices, mixed per-face attributes, other statements) so MeshLoader can
+// fall back to tinyobj.
+//
+//-----------------------------------------------------------------------------
+
+class SUTILCLASSAPI ObjChunkParser
+{
+public:
+    // threads == 0 picks one per hardware thread
+    SUTILAPI bool parse( const std::string& filename, unsigned int threads = 0 );
+
+    // Same contract as MeshLoader::scanMesh / loadMesh for the parsed file
+    SUTILAPI void scan( Mesh& mesh ) const;
+    SUTILAPI void load( Mesh& mesh ) const;
+
+    struct Chunk
+    {
+        std::vector<float>   positions;
+        std::vector<float>   normals;
+        std::vector<float>   texcoords;
+        std::vector<int32_t> corners;       // v, vt, vn per triangle corner, 0 based, -1 if absent
+        std::vector<int32_t> shape_starts;  // Triangles before each g or o line
+
+        bool                 supported;
+        bool                 direct;        // Every corner's vt and vn match v or are absent
+        int64_t              corners_with_normals;
+        int64_t              corners_with_texcoords;
+        int32_t              max_position;  // Largest index referenced, -1 if none
+        int32_t              max_normal;
+        int32_t              max_texcoord;
+
+        // Where this chunk's data starts in the merged arrays
+        int32_t              position_offset;
+        int32_t              normal_offset;
+        int32_t              texcoord_offset;
+        int32_t              triangle_offset;
+    };
+
+private:
+    std::vector<Chunk>   m_chunks;
+    int32_t              m_num_positions;
+    int32_t              m_num_normals;
+    int32_t              m_num_texcoords;
+    int32_t              m_num_triangles;
+    bool                 m_has_normals;
+    bool                 m_has_texcoords;
+
+    // Empty when the positions are tinyobj's vertices as they stand: one shape,
+    // every corner using the same index for v, vt and vn, and every position first
+    // used in file order. Otherwise the unique (v, vt, vn) triples of each shape
+    std::vector<int32_t> m_vertices;
+    std::vector<int32_t> m_tri_indices;     // Only used along with m_vertices
+};
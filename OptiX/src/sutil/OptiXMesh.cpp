@@ -247,3 +247,35 @@ void loadMesh(
 
   unmap( buffers, mesh );
 }
+
+
+void loadMesh(
+    const Mesh&                 host_mesh,
+    OptiXMesh&                  optix_mesh
+    )
+{
+  if( !optix_mesh.context )
+  {
+    throw std::runtime_error( "OptiXMesh: loadMesh() requires valid OptiX context" );
+  }
+
+  optix::Context context = optix_mesh.context;
+
+  Mesh mesh = host_mesh;
+
+  MeshBuffers buffers;
+  setupMeshLoaderInputs( context, buffers, mesh );
+
+  memcpy( mesh.tri_indices, host_mesh.tri_indices, mesh.num_triangles*3*sizeof(int32_t) );
+  memcpy( mesh.mat_indices, host_mesh.mat_indices, mesh.num_triangles*sizeof(int32_t) );
+  memcpy( mesh.positions,   host_mesh.positions,   mesh.num_vertices*3*sizeof(float) );
+  if( mesh.has_normals )
+    memcpy( mesh.normals,   host_mesh.normals,     mesh.num_vertices*3*sizeof(float) );
+  if( mesh.has_texcoords )
+    memcpy( mesh.texcoords, host_mesh.texcoords,   mesh.num_vertices*2*sizeof(float) );
+  std::copy( host_mesh.mat_params, host_mesh.mat_params + mesh.num_materials, mesh.mat_params );
+
+  translateMeshToOptiX( mesh, buffers, optix_mesh );
+
+  unmap( buffers, mesh );
+}
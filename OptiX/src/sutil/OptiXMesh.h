@@ -74,3 +74,10 @@ SUTILAPI void loadMesh(
     OptiXMesh&                mesh, 
     const optix::Matrix4x4&   load_xform = optix::Matrix4x4::identity()
     );
+
+// Uploads a mesh that was already loaded on the host, e.g. by a HostMesh on a
+// worker thread. The transform is expected to be applied already.
+SUTILAPI void loadMesh(
+    const Mesh&               host_mesh,
+    OptiXMesh&                mesh
+    );
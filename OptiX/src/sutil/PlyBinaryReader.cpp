@@ -0,0 +1,375 @@
+#include <sutil/PlyBinaryReader.h>
+#include <sutil/MappedFile.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#    include <emmintrin.h>
+#    define PLY_SSE2 1
+#endif
+
+namespace
+{
+
+struct PlyProperty
+{
+    std::string name;
+    std::string type;           // Item type for lists
+    size_t      size;           // Bytes, item size for lists
+    bool        is_list;
+    size_t      count_size;
+};
+
+struct PlyElement
+{
+    std::string              name;
+    int64_t                  count;
+    std::vector<PlyProperty> properties;
+};
+
+// Size in bytes of a PLY scalar type, 0 if unknown
+size_t typeSize( const std::string& type )
+{
+    if( type == "char"  || type == "int8"   || type == "uchar"  || type == "uint8" )
+        return 1;
+    if( type == "short" || type == "int16"  || type == "ushort" || type == "uint16" )
+        return 2;
+    if( type == "int"   || type == "int32"  || type == "uint"   || type == "uint32" ||
+        type == "float" || type == "float32" )
+        return 4;
+    if( type == "double" || type == "float64" )
+        return 8;
+    return 0;
+}
+
+bool isFloat( const std::string& type )
+{
+    return type == "float" || type == "float32";
+}
+
+bool isInteger( const std::string& type )
+{
+    return typeSize( type ) != 0 && !isFloat( type ) && type != "double" && type != "float64";
+}
+
+bool hostIsLittleEndian()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const unsigned char*>( &one ) == 1;
+}
+
+// Reverses the bytes of each 32 bit word in place
+void byteSwap32( void* data, size_t count )
+{
+    uint32_t* words = static_cast<uint32_t*>( data );
+    size_t i = 0;
+
+#if defined(PLY_SSE2)
+    for( ; i + 4 <= count; i += 4 )
+    {
+        __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( words + i ) );
+        // Swap the 16 bit halves of each word, then the bytes of each half
+        v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, 0xB1 ), 0xB1 );
+        v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( words + i ), v );
+    }
+#endif
+
+    for( ; i < count; ++i )
+    {
+        const uint32_t w = words[i];
+        words[i] = ( w >> 24 ) | ( ( w >> 8 ) & 0xFF00u ) | ( ( w << 8 ) & 0xFF0000u ) | ( w << 24 );
+    }
+}
+
+uint32_t readCount( const char* p, size_t size, bool swap )
+{
+    unsigned char bytes[4] = { 0, 0, 0, 0 };
+    memcpy( bytes, p, size );
+    if( swap )
+        std::reverse( bytes, bytes + size );
+
+    // Host order from here, only small values matter
+    uint32_t value = 0;
+    for( size_t i = size; i > 0; --i )
+        value = ( value << 8 ) | bytes[hostIsLittleEndian() ? i - 1 : size - i];
+    return value;
+}
+
+// Copies three consecutive or scattered 4 byte fields of each record
+void gather3( const char* records, size_t stride, const size_t offset[3], int32_t count, void* dst )
+{
+    char* out = static_cast<char*>( dst );
+    const bool packed = offset[1] == offset[0] + 4 && offset[2] == offset[0] + 8;
+    if( packed && stride == 12 )
+    {
+        memcpy( out, records + offset[0], static_cast<size_t>( count ) * 12 );
+        return;
+    }
+
+    for( int32_t i = 0; i < count; ++i )
+    {
+        const char* record = records + i * stride;
+        if( packed )
+        {
+            memcpy( out + i * 12, record + offset[0], 12 );
+        }
+        else
+        {
+            memcpy( out + i * 12 + 0, record + offset[0], 4 );
+            memcpy( out + i * 12 + 4, record + offset[1], 4 );
+            memcpy( out + i * 12 + 8, record + offset[2], 4 );
+        }
+    }
+}
+
+bool readHeader( const char* data, size_t size, bool& little_endian, std::vector<PlyElement>& elements, size_t& header_size )
+{
+    const char* end_marker = "end_header";
+    const char* p = data;
+    const char* end = data + size;
+
+    bool have_format = false;
+    for( int line_number = 0; p < end; ++line_number )
+    {
+        const char* line_end = static_cast<const char*>( memchr( p, '\n', end - p ) );
+        if( !line_end )
+            return false;
+
+        std::string line( p, line_end );
+        if( !line.empty() && line[line.size() - 1] == '\r' )
+            line.erase( line.size() - 1 );
+        p = line_end + 1;
+
+        std::istringstream words( line );
+        std::string keyword;
+        words >> keyword;
+
+        if( line_number == 0 )
+        {
+            if( keyword != "ply" )
+                return false;
+        }
+        else if( keyword == "format" )
+        {
+            std::string format, version;
+            words >> format >> version;
+            if( format == "binary_little_endian" )
+                little_endian = true;
+            else if( format == "binary_big_endian" )
+                little_endian = false;
+            else
+                return false;
+            have_format = true;
+        }
+        else if( keyword == "element" )
+        {
+            PlyElement element;
+            words >> element.name >> element.count;
+            if( words.fail() || element.count < 0 )
+                return false;
+            elements.push_back( element );
+        }
+        else if( keyword == "property" )
+        {
+            if( elements.empty() )
+                return false;
+
+            PlyProperty property;
+            std::string type;
+            words >> type;
+            property.is_list = type == "list";
+            if( property.is_list )
+            {
+                std::string count_type;
+                words >> count_type >> property.type;
+                if( !isInteger( count_type ) )
+                    return false;
+                property.count_size = typeSize( count_type );
+            }
+            else
+            {
+                property.type = type;
+                property.count_size = 0;
+            }
+            words >> property.name;
+
+            property.size = typeSize( property.type );
+            if( words.fail() || property.size == 0 )
+                return false;
+            elements.back().properties.push_back( property );
+        }
+        else if( keyword == end_marker )
+        {
+            header_size = p - data;
+            return have_format;
+        }
+        else if( keyword != "comment" && keyword != "obj_info" )
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+
+PlyBinaryReader::PlyBinaryReader()
+    : m_swap( false )
+    , m_num_vertices( 0 )
+    , m_vertices( NULL )
+    , m_vertex_stride( 0 )
+    , m_has_normals( false )
+    , m_num_faces( 0 )
+    , m_faces( NULL )
+    , m_face_stride( 0 )
+    , m_count_size( 0 )
+{
+}
+
+
+PlyBinaryReader::~PlyBinaryReader()
+{
+}
+
+
+bool PlyBinaryReader::parse( const std::string& filename )
+{
+    m_file.reset( new MappedFile( filename ) );
+    if( !m_file->data() )
+        return false;
+
+    bool little_endian = true;
+    size_t header_size = 0;
+    std::vector<PlyElement> elements;
+    if( !readHeader( m_file->data(), m_file->size(), little_endian, elements, header_size ) )
+        return false;
+    m_swap = little_endian != hostIsLittleEndian();
+
+    //
+    // Walk the element blocks, only vertex and face are read but any other
+    // fixed size element can be stepped over
+    //
+    bool have_vertices = false;
+    bool have_faces    = false;
+    uint64_t offset = header_size;
+    for( size_t i = 0; i < elements.size(); ++i )
+    {
+        const PlyElement& element = elements[i];
+        const char* block = m_file->data() + offset;
+
+        if( element.name == "face" )
+        {
+            const PlyProperty& list = element.properties.empty() ? PlyProperty() : element.properties[0];
+            if( have_faces || element.properties.size() != 1 || !list.is_list ||
+                list.name != "vertex_indices" || list.size != 4 || !isInteger( list.type ) ||
+                element.count > INT32_MAX )
+                return false;
+
+            m_num_faces   = static_cast<int32_t>( element.count );
+            m_faces       = block;
+            m_count_size  = list.count_size;
+            m_face_stride = m_count_size + 12;
+            offset       += element.count * m_face_stride;
+            if( offset > m_file->size() )
+                return false;
+
+            // rply would keep only the first triangle of a polygon, leave those to it
+            for( int32_t f = 0; f < m_num_faces; ++f )
+            {
+                if( readCount( m_faces + f * m_face_stride, m_count_size, m_swap ) != 3 )
+                    return false;
+            }
+            have_faces = true;
+            continue;
+        }
+
+        size_t stride = 0;
+        int    found  = 0;
+        for( size_t j = 0; j < element.properties.size(); ++j )
+        {
+            const PlyProperty& property = element.properties[j];
+            if( property.is_list )
+                return false;
+
+            if( element.name == "vertex" )
+            {
+                static const char* const NAMES[6] = { "x", "y", "z", "nx", "ny", "nz" };
+                for( int k = 0; k < 6; ++k )
+                {
+                    if( property.name != NAMES[k] )
+                        continue;
+                    if( !isFloat( property.type ) )
+                        return false;
+                    ( k < 3 ? m_position_offset[k] : m_normal_offset[k - 3] ) = stride;
+                    found |= 1 << k;
+                }
+            }
+            stride += property.size;
+        }
+
+        if( element.name == "vertex" )
+        {
+            // Positions are required, normals are all or nothing
+            if( have_vertices || ( found & 7 ) != 7 || ( found >> 3 != 0 && found >> 3 != 7 ) ||
+                element.count > INT32_MAX )
+                return false;
+
+            m_num_vertices  = static_cast<int32_t>( element.count );
+            m_vertices      = block;
+            m_vertex_stride = stride;
+            m_has_normals   = found >> 3 == 7;
+            have_vertices   = true;
+        }
+
+        offset += element.count * stride;
+        if( offset > m_file->size() )
+            return false;
+    }
+
+    return have_vertices && have_faces;
+}
+
+
+void PlyBinaryReader::scan( Mesh& mesh ) const
+{
+    mesh.num_vertices  = m_num_vertices;
+    mesh.num_triangles = m_num_faces;
+    mesh.has_normals   = m_has_normals;
+    mesh.has_texcoords = false;
+    mesh.num_materials = 1; // default material
+}
+
+
+void PlyBinaryReader::load( Mesh& mesh ) const
+{
+    gather3( m_vertices, m_vertex_stride, m_position_offset, m_num_vertices, mesh.positions );
+    if( m_swap )
+        byteSwap32( mesh.positions, static_cast<size_t>( m_num_vertices ) * 3 );
+
+    if( m_has_normals )
+    {
+        gather3( m_vertices, m_vertex_stride, m_normal_offset, m_num_vertices, mesh.normals );
+        if( m_swap )
+            byteSwap32( mesh.normals, static_cast<size_t>( m_num_vertices ) * 3 );
+    }
+
+    const size_t index_offset[3] = { m_count_size, m_count_size + 4, m_count_size + 8 };
+    gather3( m_faces, m_face_stride, index_offset, m_num_faces, mesh.tri_indices );
+    if( m_swap )
+        byteSwap32( mesh.tri_indices, static_cast<size_t>( m_num_faces ) * 3 );
+
+    for( int32_t i = 0; i < m_num_vertices; ++i )
+    {
+        const float* p = mesh.positions + i * 3;
+        for( int k = 0; k < 3; ++k )
+        {
+            mesh.bbox_min[k] = std::min( mesh.bbox_min[k], p[k] );
+            mesh.bbox_max[k] = std::max( mesh.bbox_max[k], p[k] );
+        }
+    }
+}
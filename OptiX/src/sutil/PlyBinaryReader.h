@@ -0,0 +1,61 @@
+#pragma once
+
+#include <sutilapi.h>
+#include <Mesh.h>
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class MappedFile;
+
+//-----------------------------------------------------------------------------
+//
+// PlyBinaryReader
+//
+// Bulk reader for the binary PLY layout scanners and exporters write: a
+// vertex element with float x, y, z and optionally nx, ny, nz (other fixed
+// size properties are skipped), and a face element holding only a triangle
+// list with an 8/16/32 bit count and 32 bit indices. The file is memory
+// mapped and whole element blocks are copied and byte swapped in one pass
+// instead of going through rply's per-value callbacks.
+//
+// parse() returns false for anything else (ASCII files, double positions,
+// polygons, extra face properties, list properties on other elements) so
+// MeshLoader can fall back to rply.
+//
+//-----------------------------------------------------------------------------
+
+class SUTILCLASSAPI PlyBinaryReader
+{
+public:
+    SUTILAPI PlyBinaryReader();
+    SUTILAPI ~PlyBinaryReader();
+
+    SUTILAPI bool parse( const std::string& filename );
+
+    // Same contract as MeshLoader::scanMesh / loadMesh for the parsed file,
+    // load() leaves the materials to the caller
+    SUTILAPI void scan( Mesh& mesh ) const;
+    SUTILAPI void load( Mesh& mesh ) const;
+
+private:
+    PlyBinaryReader( const PlyBinaryReader& );
+    PlyBinaryReader& operator=( const PlyBinaryReader& );
+
+    std::unique_ptr<MappedFile> m_file;
+    bool                        m_swap;             // File endianness differs from the host
+
+    int32_t                     m_num_vertices;
+    const char*                 m_vertices;         // First vertex record
+    size_t                      m_vertex_stride;
+    size_t                      m_position_offset[3];
+    bool                        m_has_normals;
+    size_t                      m_normal_offset[3];
+
+    int32_t                     m_num_faces;
+    const char*                 m_faces;            // First face record
+    size_t                      m_face_stride;      // Count plus three indices
+    size_t                      m_count_size;
+};
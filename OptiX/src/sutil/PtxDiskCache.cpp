@@ -0,0 +1,226 @@
+#include <sutil/PtxDiskCache.h>
+#include <sutil/MappedFile.h>
+#include <sutil/sutil.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace
+{
+
+const char     CACHE_MAGIC[4] = { 'P', 'T', 'X', 'C' };
+const uint32_t CACHE_VERSION  = 1;
+
+struct CacheHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t size;
+};
+
+// Hashes the length first so ("ab","c") and ("a","bc") differ
+uint64_t hashString( uint64_t hash, const std::string& str )
+{
+    const uint64_t size = str.size();
+    hash = hashBytes( &size, sizeof( size ), hash );
+    return hashBytes( str.data(), str.size(), hash );
+}
+
+bool readFile( const std::string& filename, std::string& contents )
+{
+    std::ifstream file( filename.c_str(), std::ios::binary );
+    if( !file.good() )
+        return false;
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+std::string directoryOf( const std::string& path )
+{
+    const size_t slash = path.find_last_of( "/\\" );
+    return slash == std::string::npos ? std::string( "." ) : path.substr( 0, slash );
+}
+
+// Name inside an #include "..." or #include <...> line, empty for any other line
+std::string includeName( const std::string& line )
+{
+    size_t i = line.find_first_not_of( " \t" );
+    if( i == std::string::npos || line[i] != '#' )
+        return std::string();
+
+    i = line.find_first_not_of( " \t", i + 1 );
+    if( i == std::string::npos || line.compare( i, 7, "include" ) != 0 )
+        return std::string();
+
+    i = line.find_first_not_of( " \t", i + 7 );
+    if( i == std::string::npos || ( line[i] != '"' && line[i] != '<' ) )
+        return std::string();
+
+    const char close = line[i] == '"' ? '"' : '>';
+    const size_t end = line.find( close, i + 1 );
+    if( end == std::string::npos )
+        return std::string();
+
+    return line.substr( i + 1, end - i - 1 );
+}
+
+void collectIncludesRecursive(
+        const std::string& source,
+        const std::vector<std::string>& search_dirs,
+        std::set<std::string>& visited,
+        std::vector<std::string>& contents )
+{
+    std::istringstream lines( source );
+    std::string line;
+    while( std::getline( lines, line ) )
+    {
+        const std::string name = includeName( line );
+        if( name.empty() )
+            continue;
+
+        for( size_t i = 0; i < search_dirs.size(); ++i )
+        {
+            const std::string path = search_dirs[i] + "/" + name;
+            std::string header;
+            if( !readFile( path, header ) )
+                continue;
+
+            if( visited.insert( path ).second )
+            {
+                contents.push_back( header );
+
+                // Quoted includes inside the header are relative to it
+                std::vector<std::string> nested_dirs( 1, directoryOf( path ) );
+                nested_dirs.insert( nested_dirs.end(), search_dirs.begin(), search_dirs.end() );
+                collectIncludesRecursive( header, nested_dirs, visited, contents );
+            }
+            break;
+        }
+    }
+}
+
+} // namespace
+
+
+PtxDiskCache::PtxDiskCache( const std::string& directory, const std::string& compiler )
+    : m_directory( directory ),
+      m_compiler( compiler )
+{
+    if( !m_directory.empty() )
+        makeDirectory( m_directory );
+}
+
+std::string PtxDiskCache::defaultDirectory()
+{
+    const char* dir = getenv( "OPTIX_PTX_CACHE_DIR" );
+    if( dir )
+        return std::string( dir );
+
+    return std::string( sutil::samplesPTXDir() ) + "/ptx_cache";
+}
+
+uint64_t PtxDiskCache::hashKey(
+        const std::string& compiler,
+        const std::string& source,
+        const std::vector<std::string>& include_contents,
+        const std::vector<std::string>& options )
+{
+    uint64_t hash = hashBytes( &CACHE_VERSION, sizeof( CACHE_VERSION ) );
+    hash = hashString( hash, compiler );
+    hash = hashString( hash, source );
+    for( size_t i = 0; i < include_contents.size(); ++i )
+        hash = hashString( hash, include_contents[i] );
+    for( size_t i = 0; i < options.size(); ++i )
+        hash = hashString( hash, options[i] );
+    return hash;
+}
+
+std::vector<std::string> PtxDiskCache::collectIncludes(
+        const std::string& source,
+        const std::vector<std::string>& search_dirs )
+{
+    std::set<std::string> visited;
+    std::vector<std::string> contents;
+    collectIncludesRecursive( source, search_dirs, visited, contents );
+    return contents;
+}
+
+std::string PtxDiskCache::entryPath( uint64_t key ) const
+{
+    char name[32];
+    snprintf( name, sizeof( name ), "%016llx.ptx", static_cast<unsigned long long>( key ) );
+    return m_directory + "/" + name;
+}
+
+bool PtxDiskCache::load( uint64_t key, std::string& ptx ) const
+{
+    if( m_directory.empty() )
+        return false;
+
+    MappedFile file( entryPath( key ) );
+    if( file.size() < sizeof( CacheHeader ) )
+        return false;
+
+    CacheHeader header;
+    memcpy( &header, file.data(), sizeof( header ) );
+    if( memcmp( header.magic, CACHE_MAGIC, sizeof( CACHE_MAGIC ) ) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.key != key ||
+        header.size != file.size() - sizeof( CacheHeader ) )
+        return false;
+
+    ptx.assign( file.data() + sizeof( CacheHeader ), static_cast<size_t>( header.size ) );
+    return true;
+}
+
+bool PtxDiskCache::store( uint64_t key, const std::string& ptx ) const
+{
+    if( m_directory.empty() )
+        return false;
+
+    CacheHeader header;
+    memcpy( header.magic, CACHE_MAGIC, sizeof( CACHE_MAGIC ) );
+    header.version = CACHE_VERSION;
+    header.key = key;
+    header.size = ptx.size();
+
+    const void* buffers[] = { &header, ptx.data() };
+    const size_t sizes[]  = { sizeof( header ), ptx.size() };
+    return writeFileAtomic( entryPath( key ), buffers, sizes, 2 );
+}
+
+bool PtxDiskCache::getOrCompile(
+        const std::string& source,
+        const std::vector<std::string>& include_contents,
+        const std::vector<std::string>& options,
+        const CompileFunction& compile,
+        std::string& ptx,
+        std::string& log,
+        bool* from_cache ) const
+{
+    const uint64_t key = hashKey( m_compiler, source, include_contents, options );
+    if( from_cache )
+        *from_cache = false;
+
+    if( load( key, ptx ) )
+    {
+        if( from_cache )
+            *from_cache = true;
+        return true;
+    }
+
+    if( !compile( source, ptx, log ) )
+        return false;
+
+    // A failed write only costs a recompile next time
+    store( key, ptx );
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <sutilapi.h>
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// PtxDiskCache
+//
+// Keeps compiled PTX on disk between runs so a warm start skips NVRTC.
+// Entries are keyed by a hash of the compiler version, the CUDA source, the
+// contents of every header it includes and the compiler options, so upgrading
+// the compiler or editing any of them recompiles.
+// Files are written to a temporary name and renamed into place, and read back
+// through a memory mapping.
+//
+//-----------------------------------------------------------------------------
+
+class SUTILCLASSAPI PtxDiskCache
+{
+public:
+    // Compiles source to ptx, returning false and filling log on failure
+    typedef std::function<bool( const std::string& source, std::string& ptx, std::string& log )> CompileFunction;
+
+    // An empty directory disables the cache, every request compiles. compiler
+    // identifies the compiler and its version, ie "nvrtc 9.1"
+    PtxDiskCache( const std::string& directory, const std::string& compiler );
+
+    // $OPTIX_PTX_CACHE_DIR if set, otherwise a ptx_cache folder under samplesPTXDir()
+    static std::string defaultDirectory();
+
+    // 64 bit FNV-1a over the compiler, source, include contents and options
+    static uint64_t hashKey(
+            const std::string& compiler,
+            const std::string& source,
+            const std::vector<std::string>& include_contents,
+            const std::vector<std::string>& options );
+
+    // Follows #include directives through the search directories and returns the contents
+    // of every header found, each once. Headers that can't be found are skipped
+    static std::vector<std::string> collectIncludes(
+            const std::string& source,
+            const std::vector<std::string>& search_dirs );
+
+    // Returns the cached ptx for the key or compiles and stores it.
+    // from_cache is set when compilation was skipped
+    bool getOrCompile(
+            const std::string& source,
+            const std::vector<std::string>& include_contents,
+            const std::vector<std::string>& options,
+            const CompileFunction& compile,
+            std::string& ptx,
+            std::string& log,
+            bool* from_cache = NULL ) const;
+
+    bool load( uint64_t key, std::string& ptx ) const;
+    bool store( uint64_t key, const std::string& ptx ) const;
+
+    std::string entryPath( uint64_t key ) const;
+    const std::string& directory() const { return m_directory; }
+    const std::string& compiler() const { return m_compiler; }
+
+private:
+    std::string m_directory;
+    std::string m_compiler;
+};
@@ -27,20 +27,12 @@
  */
 
 
-// Note: wglew.h has to be included before sutil.h on Windows
-#if defined(__APPLE__)
-#  include <GLUT/glut.h>
-#else
-#  include <GL/glew.h>
-#  if defined(_WIN32)
-#    include <GL/wglew.h>
-#  endif
-#  include <GL/glut.h>
-#endif
-
 #include <sutil/sutil.h>
+#include <sutil/FrameMemory.h>
 #include <sutil/HDRLoader.h>
+#include <sutil/ImageWriter.h>
 #include <sutil/PPMLoader.h>
+#include <sutil/PtxDiskCache.h>
 #include <sampleConfig.h>
 
 #include <optixu/optixu_math_namespace.h>
@@ -55,6 +47,7 @@
 #include <sstream>
 #include <map>
 #include <memory>
+#include <mutex>
 
 #if defined(_WIN32)
 #    ifndef WIN32_LEAN_AND_MEAN
@@ -75,198 +68,6 @@ using namespace optix;
 namespace
 {
 
-// Global variables for GLUT display functions
-RTcontext g_context                  = 0;
-RTbuffer  g_image_buffer             = 0;
-bufferPixelFormat g_image_buffer_format = BUFFER_PIXEL_FORMAT_DEFAULT;
-bool      g_glut_initialized         = false;
-bool      g_disable_srgb_conversion  = false;
-
-
-// Converts the buffer format to gl format
-GLenum glFormatFromBufferFormat(bufferPixelFormat pixel_format, RTformat buffer_format)
-{
-    if (buffer_format == RT_FORMAT_UNSIGNED_BYTE4)
-    {
-        switch (pixel_format)
-        {
-        case BUFFER_PIXEL_FORMAT_DEFAULT:
-            return GL_BGRA;
-        case BUFFER_PIXEL_FORMAT_RGB:
-            return GL_RGBA;
-        case BUFFER_PIXEL_FORMAT_BGR:
-            return GL_BGRA;
-        default:
-            throw Exception("Unknown buffer pixel format");
-        }
-    }
-    else if (buffer_format == RT_FORMAT_FLOAT4)
-    {
-        switch (pixel_format)
-        {
-        case BUFFER_PIXEL_FORMAT_DEFAULT:
-            return GL_RGBA;
-        case BUFFER_PIXEL_FORMAT_RGB:
-            return GL_RGBA;
-        case BUFFER_PIXEL_FORMAT_BGR:
-            return GL_BGRA;
-        default:
-            throw Exception("Unknown buffer pixel format");
-        }
-    }
-    else if (buffer_format == RT_FORMAT_FLOAT3)
-        switch (pixel_format)
-        {
-        case BUFFER_PIXEL_FORMAT_DEFAULT:
-            return GL_RGB;
-        case BUFFER_PIXEL_FORMAT_RGB:
-            return GL_RGB;
-        case BUFFER_PIXEL_FORMAT_BGR:
-            return GL_BGR;
-        default:
-            throw Exception("Unknown buffer pixel format");
-        }
-    else if (buffer_format == RT_FORMAT_FLOAT)
-        return GL_LUMINANCE;
-    else
-        throw Exception("Unknown buffer format");
-}
-
-
-void keyPressed(unsigned char key, int x, int y)
-{
-    switch (key)
-    {
-        case 27: // esc
-        case 'q':
-            rtContextDestroy( g_context );
-            exit(EXIT_SUCCESS);
-    }
-}
-
-
-void checkBuffer( RTbuffer buffer )
-{
-    // Check to see if the buffer is two dimensional
-    unsigned int dimensionality;
-    RT_CHECK_ERROR( rtBufferGetDimensionality(buffer, &dimensionality) );
-    if (2 != dimensionality)
-        throw Exception( "Attempting to display non-2D buffer" );
-
-    // Check to see if the buffer is of type float{1,3,4} or uchar4
-    RTformat format;
-    RT_CHECK_ERROR( rtBufferGetFormat(buffer, &format) );
-    if( RT_FORMAT_FLOAT  != format &&
-            RT_FORMAT_FLOAT4 != format &&
-            RT_FORMAT_FLOAT3 != format &&
-            RT_FORMAT_UNSIGNED_BYTE4 != format )
-        throw Exception( "Attempting to display buffer with format not float, float3, float4, or uchar4");
-}
-
-
-void displayBuffer()
-{
-    optix::Buffer buffer = Buffer::take( g_image_buffer );
-
-    // Query buffer information
-    RTsize buffer_width_rts, buffer_height_rts;
-    buffer->getSize( buffer_width_rts, buffer_height_rts );
-    uint32_t width  = static_cast<int>(buffer_width_rts);
-    uint32_t height = static_cast<int>(buffer_height_rts);
-    RTformat buffer_format = buffer->getFormat();
-
-    GLboolean use_SRGB = GL_FALSE;
-    if( !g_disable_srgb_conversion && (buffer_format == RT_FORMAT_FLOAT4 || buffer_format == RT_FORMAT_FLOAT3) )
-    {
-        glGetBooleanv( GL_FRAMEBUFFER_SRGB_CAPABLE_EXT, &use_SRGB );
-        if( use_SRGB )
-            glEnable(GL_FRAMEBUFFER_SRGB_EXT);
-    }
-
-    static unsigned int gl_tex_id = 0;
-    if( !gl_tex_id )
-    {
-        glGenTextures( 1, &gl_tex_id );
-        glBindTexture( GL_TEXTURE_2D, gl_tex_id );
-
-        // Change these to GL_LINEAR for super- or sub-sampling
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-        // GL_CLAMP_TO_EDGE for linear filtering, not relevant for nearest.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    }
-
-    glBindTexture( GL_TEXTURE_2D, gl_tex_id );
-
-    // send PBO or host-mapped image data to texture
-    const unsigned pboId = buffer->getGLBOId();
-    GLvoid* imageData = 0;
-    if( pboId )
-        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pboId );
-    else
-        imageData = buffer->map( 0, RT_BUFFER_MAP_READ );
-
-    RTsize elmt_size = buffer->getElementSize();
-    if      ( elmt_size % 8 == 0) glPixelStorei(GL_UNPACK_ALIGNMENT, 8);
-    else if ( elmt_size % 4 == 0) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    else if ( elmt_size % 2 == 0) glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
-    else                          glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    GLenum pixel_format = glFormatFromBufferFormat(g_image_buffer_format, buffer_format);
-
-    if( buffer_format == RT_FORMAT_UNSIGNED_BYTE4)
-        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, pixel_format, GL_UNSIGNED_BYTE, imageData);
-    else if(buffer_format == RT_FORMAT_FLOAT4)
-        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, width, height, 0, pixel_format, GL_FLOAT, imageData );
-    else if(buffer_format == RT_FORMAT_FLOAT3)
-        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB32F_ARB, width, height, 0, pixel_format, GL_FLOAT, imageData );
-    else if(buffer_format == RT_FORMAT_FLOAT)
-        glTexImage2D( GL_TEXTURE_2D, 0, GL_LUMINANCE32F_ARB, width, height, 0, pixel_format, GL_FLOAT, imageData );
-    else
-        throw Exception( "Unknown buffer format" );
-
-    if( pboId )
-        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
-    else
-        buffer->unmap();
-
-    // 1:1 texel to pixel mapping with glOrtho(0, 1, 0, 1, -1, 1) setup:
-    // The quad coordinates go from lower left corner of the lower left pixel
-    // to the upper right corner of the upper right pixel.
-    // Same for the texel coordinates.
-
-    glEnable(GL_TEXTURE_2D);
-
-    glBegin(GL_QUADS);
-    glTexCoord2f( 0.0f, 0.0f );
-    glVertex2f( 0.0f, 0.0f );
-
-    glTexCoord2f( 1.0f, 0.0f );
-    glVertex2f( 1.0f, 0.0f);
-
-    glTexCoord2f( 1.0f, 1.0f );
-    glVertex2f( 1.0f, 1.0f );
-
-    glTexCoord2f(0.0f, 1.0f );
-    glVertex2f( 0.0f, 1.0f );
-    glEnd();
-
-    glDisable(GL_TEXTURE_2D);
-
-    if ( use_SRGB )
-        glDisable(GL_FRAMEBUFFER_SRGB_EXT);
-}
-
-
-void displayBufferSwap()
-{
-    displayBuffer();
-    glutSwapBuffers();
-}
-
-
 void SavePPM(const unsigned char *Pix, const char *fname, int wid, int hgt, int chan)
 {
     if( Pix==NULL || wid < 1 || hgt < 1 )
@@ -371,128 +172,6 @@ const char* sutil::samplesPTXDir()
     return ".";
 }
 
-optix::Buffer createBufferImpl(
-        optix::Context context,
-        RTformat format,
-        unsigned width,
-        unsigned height,
-        bool use_pbo,
-        RTbuffertype buffer_type)
-{
-    optix::Buffer buffer;
-    if( use_pbo )
-    {
-        // First allocate the memory for the GL buffer, then attach it to OptiX.
-
-        // Assume ubyte4 or float4 for now
-        unsigned int elmt_size = format == RT_FORMAT_UNSIGNED_BYTE4 ?  4 : 16;
-
-        GLuint vbo = 0;
-        glGenBuffers( 1, &vbo );
-        glBindBuffer( GL_ARRAY_BUFFER, vbo );
-        glBufferData( GL_ARRAY_BUFFER, elmt_size * width * height, 0, GL_STREAM_DRAW);
-        glBindBuffer( GL_ARRAY_BUFFER, 0 );
-
-        buffer = context->createBufferFromGLBO(buffer_type, vbo);
-        buffer->setFormat( format );
-        buffer->setSize( width, height );
-    }
-    else
-    {
-        buffer = context->createBuffer( buffer_type, format, width, height );
-    }
-
-    return buffer;
-}
-
-optix::Buffer sutil::createOutputBuffer(
-    optix::Context context,
-    RTformat format,
-    unsigned width,
-    unsigned height,
-    bool use_pbo)
-{
-    return createBufferImpl(context, format, width, height, use_pbo, RT_BUFFER_OUTPUT);
-}
-
-
-optix::Buffer SUTILAPI sutil::createInputOutputBuffer(optix::Context context, 
-    RTformat format, 
-    unsigned width, 
-    unsigned height, 
-    bool use_pbo)
-{
-    return createBufferImpl(context, format, width, height, use_pbo, RT_BUFFER_INPUT_OUTPUT);
-}
-
-void sutil::resizeBuffer( optix::Buffer buffer, unsigned width, unsigned height )
-{
-    buffer->setSize( width, height );
-
-    // Check if we have a GL interop display buffer
-    const unsigned pboId = buffer->getGLBOId();
-    if( pboId )
-    {
-        buffer->unregisterGLBuffer();
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboId );
-        glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer->getElementSize() * width * height, 0, GL_STREAM_DRAW);
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-        buffer->registerGLBuffer();
-    }
-}
-
-
-void sutil::initGlut( int* argc, char** argv)
-{
-    // Initialize GLUT
-    glutInit( argc, argv );
-    glutInitDisplayMode( GLUT_RGB | GLUT_ALPHA | GLUT_DOUBLE );
-    glutInitWindowSize( 100, 100 );
-    glutInitWindowPosition( 100, 100 );
-    glutCreateWindow( argv[0] );
-    g_glut_initialized = true;
-}
-
-
-void sutil::displayBufferGlut( const char* window_title, Buffer buffer )
-{
-    displayBufferGlut(window_title, buffer->get() );
-}
-
-
-void sutil::displayBufferGlut( const char* window_title, RTbuffer buffer )
-{
-    if( !g_glut_initialized )
-        throw Exception( "displayGlutWindow called before initGlut.");
-
-    checkBuffer(buffer);
-    g_image_buffer = buffer;
-
-    RTsize buffer_width, buffer_height;
-    RT_CHECK_ERROR( rtBufferGetSize2D(buffer, &buffer_width, &buffer_height ) );
-
-    GLsizei width  = static_cast<int>( buffer_width );
-    GLsizei height = static_cast<int>( buffer_height );
-    glutSetWindowTitle(window_title);
-    glutReshapeWindow( width, height );
-
-    // Init state
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, 1, 0, 1, -1, 1 );
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glViewport(0, 0, width, height);
-
-    glutKeyboardFunc(keyPressed);
-    glutDisplayFunc(displayBufferSwap);
-    glutSwapBuffers();
-
-    glutMainLoop();
-}
-
 
 void sutil::displayBufferPPM( const char* filename, Buffer buffer, bool disable_srgb_conversion)
 {
@@ -502,182 +181,35 @@ void sutil::displayBufferPPM( const char* filename, Buffer buffer, bool disable_
 
 void sutil::displayBufferPPM( const char* filename, RTbuffer buffer, bool disable_srgb_conversion)
 {
-    GLsizei width, height;
+    int width, height;
     RTsize buffer_width, buffer_height;
 
-    GLvoid* imageData;
+    void* imageData;
     RT_CHECK_ERROR( rtBufferMap( buffer, &imageData) );
 
     RT_CHECK_ERROR( rtBufferGetSize2D(buffer, &buffer_width, &buffer_height) );
-    width  = static_cast<GLsizei>(buffer_width);
-    height = static_cast<GLsizei>(buffer_height);
+    width  = static_cast<int>(buffer_width);
+    height = static_cast<int>(buffer_height);
 
-    std::vector<unsigned char> pix(width * height * 3);
+    // Pooled, saving every frame of a capture shouldn't allocate per frame
+    PooledArray<unsigned char> pix(width * height * 3);
 
     RTformat buffer_format;
     RT_CHECK_ERROR( rtBufferGetFormat(buffer, &buffer_format) );
 
-    const float gamma_inv = 1.0f / 2.2f;
-
-    switch(buffer_format) {
-        case RT_FORMAT_UNSIGNED_BYTE4:
-            // Data is BGRA and upside down, so we need to swizzle to RGB
-            for(int j = height-1; j >= 0; --j) {
-                unsigned char *dst = &pix[0] + (3*width*(height-1-j));
-                unsigned char *src = ((unsigned char*)imageData) + (4*width*j);
-                for(int i = 0; i < width; i++) {
-                    *dst++ = *(src + 2);
-                    *dst++ = *(src + 1);
-                    *dst++ = *(src + 0);
-                    src += 4;
-                }
-            }
-            break;
-
-        case RT_FORMAT_FLOAT:
-            // This buffer is upside down
-            for(int j = height-1; j >= 0; --j) {
-                unsigned char *dst = &pix[0] + width*(height-1-j);
-                float* src = ((float*)imageData) + (3*width*j);
-                for(int i = 0; i < width; i++) {
-                    int P;
-                    if (disable_srgb_conversion)
-                        P = static_cast<int>((*src++) * 255.0f);
-                    else
-                        P = static_cast<int>(std::pow(*src++, gamma_inv) * 255.0f);
-                    unsigned int Clamped = P < 0 ? 0 : P > 0xff ? 0xff : P;
-
-                    // write the pixel to all 3 channels
-                    *dst++ = static_cast<unsigned char>(Clamped);
-                    *dst++ = static_cast<unsigned char>(Clamped);
-                    *dst++ = static_cast<unsigned char>(Clamped);
-                }
-            }
-            break;
-
-        case RT_FORMAT_FLOAT3:
-            // This buffer is upside down
-            for(int j = height-1; j >= 0; --j) {
-                unsigned char *dst = &pix[0] + (3*width*(height-1-j));
-                float* src = ((float*)imageData) + (3*width*j);
-                for(int i = 0; i < width; i++) {
-                    for(int elem = 0; elem < 3; ++elem) {
-                        int P;
-                        if (disable_srgb_conversion)
-                            P = static_cast<int>((*src++) * 255.0f);
-                        else
-                            P = static_cast<int>(std::pow(*src++, gamma_inv) * 255.0f);
-                        unsigned int Clamped = P < 0 ? 0 : P > 0xff ? 0xff : P;
-                        *dst++ = static_cast<unsigned char>(Clamped);
-                    }
-                }
-            }
-            break;
-
-        case RT_FORMAT_FLOAT4:
-            // This buffer is upside down
-            for(int j = height-1; j >= 0; --j) {
-                unsigned char *dst = &pix[0] + (3*width*(height-1-j));
-                float* src = ((float*)imageData) + (4*width*j);
-                for(int i = 0; i < width; i++) {
-                    for(int elem = 0; elem < 3; ++elem) {
-                        int P;
-                        if(disable_srgb_conversion)
-                            P = static_cast<int>((*src++) * 255.0f);
-                        else
-                            P = static_cast<int>(std::pow(*src++, gamma_inv) * 255.0f);
-                        unsigned int Clamped = P < 0 ? 0 : P > 0xff ? 0xff : P;
-                        *dst++ = static_cast<unsigned char>(Clamped);
-                    }
-
-                    // skip alpha
-                    src++;
-                }
-            }
-            break;
-
-        default:
-            fprintf(stderr, "Unrecognized buffer data type or format.\n");
-            exit(2);
-            break;
+    // Flipped, swizzled and gamma corrected by ImageWriter's vector and lookup table paths
+    if( !convertToRGB8( imageData, buffer_format, width, height, !disable_srgb_conversion, pix.data() ) ) {
+        fprintf(stderr, "Unrecognized buffer data type or format.\n");
+        exit(2);
     }
 
-    SavePPM(&pix[0], filename, width, height, 3);
+    SavePPM(pix.data(), filename, width, height, 3);
 
     // Now unmap the buffer
     RT_CHECK_ERROR( rtBufferUnmap(buffer) );
 }
 
 
-void sutil::displayBufferGL( optix::Buffer buffer, bufferPixelFormat format, bool disable_srgb_conversion )
-{
-    g_image_buffer = buffer->get();
-    g_image_buffer_format = format;
-    g_disable_srgb_conversion = disable_srgb_conversion;
-    displayBuffer();
-}
-
-
-namespace
-{
-
-void drawText( const std::string& text, float x, float y, void* font )
-{
-    // Save state
-    glPushAttrib( GL_CURRENT_BIT | GL_ENABLE_BIT );
-
-    glDisable( GL_TEXTURE_2D );
-    glDisable( GL_LIGHTING );
-    glDisable( GL_DEPTH_TEST);
-
-    static const float3 shadow_color = make_float3( 0.10f );
-    glColor3fv( &( shadow_color.x) ); // drop shadow
-    // Shift shadow one pixel to the lower right.
-    glWindowPos2f(x + 1.0f, y - 1.0f);
-    for( std::string::const_iterator it = text.begin(); it != text.end(); ++it )
-        glutBitmapCharacter( font, *it );
-
-    static const float3 text_color = make_float3( 0.95f );
-    glColor3fv( &( text_color.x) );        // main text
-    glWindowPos2f(x, y);
-    for( std::string::const_iterator it = text.begin(); it != text.end(); ++it )
-        glutBitmapCharacter( font, *it );
-
-    // Restore state
-    glPopAttrib();
-}
-
-static const float FPS_UPDATE_INTERVAL = 0.5;  //seconds
-
-} // namespace
-
-
-void sutil::displayFps( unsigned int frame_count )
-{
-    static double fps = -1.0;
-    static unsigned last_frame_count = 0;
-    static double last_update_time = sutil::currentTime();
-    static double current_time = 0.0;
-    current_time = sutil::currentTime();
-    if ( current_time - last_update_time > FPS_UPDATE_INTERVAL ) {
-        fps = ( frame_count - last_frame_count ) / ( current_time - last_update_time );
-        last_frame_count = frame_count;
-        last_update_time = current_time;
-    }
-    if ( frame_count > 0 && fps >= 0.0 ) {
-        static char fps_text[32];
-        sprintf( fps_text, "fps: %7.2f", fps );
-        drawText( fps_text, 10.0f, 10.0f, GLUT_BITMAP_8_BY_13 );
-    }
-}
-
-
-void sutil::displayText(const char* text, float x, float y)
-{
-  drawText(text, x, y, GLUT_BITMAP_8_BY_13);
-}
-
-
 optix::TextureSampler sutil::loadTexture( optix::Context context,
         const std::string& filename, optix::float3 default_color )
 {
@@ -866,46 +398,47 @@ static void getCuStringFromFile( std::string &cu, std::string& location, const c
     throw Exception( "Couldn't open source file " + std::string( filename ) );
 }
 
-static std::string g_nvrtcLog;
+static thread_local std::string g_nvrtcLog;
 
-static void getPtxFromCuString( std::string &ptx, const char* sample_name, const char* cu_source, const char* name, const char** log_string )
+// Include directories and compiler options, in the order NVRTC receives them
+static void getNvrtcOptions( std::vector<std::string> &options, std::vector<std::string> &include_dirs, const char* sample_name )
 {
-    // Create program
-    nvrtcProgram prog = 0;
-    NVRTC_CHECK_ERROR( nvrtcCreateProgram( &prog, cu_source, name, 0, NULL, NULL ) );
-
-    // Gather NVRTC options
-    std::vector<const char *> options;
-
     std::string base_dir = std::string( sutil::samplesDir() );
 
     // Set sample dir as the primary include path
-    std::string sample_dir;
     if( sample_name )
-    {
-        sample_dir = std::string( "-I" ) + base_dir + "/" + sample_name;
-        options.push_back( sample_dir.c_str() );
-    }
+        include_dirs.push_back( base_dir + "/" + sample_name );
 
     // Collect include dirs
-    std::vector<std::string> include_dirs;
     const char *abs_dirs[] = { SAMPLES_ABSOLUTE_INCLUDE_DIRS };
     const char *rel_dirs[] = { SAMPLES_RELATIVE_INCLUDE_DIRS };
 
     const size_t n_abs_dirs = sizeof( abs_dirs ) / sizeof( abs_dirs[0] );
     for( size_t i = 0; i < n_abs_dirs; i++ )
-        include_dirs.push_back(std::string( "-I" ) + abs_dirs[i]);
+        include_dirs.push_back( abs_dirs[i] );
     const size_t n_rel_dirs = sizeof( rel_dirs ) / sizeof( rel_dirs[0] );
     for( size_t i = 0; i < n_rel_dirs; i++ )
-        include_dirs.push_back(std::string( "-I" ) + base_dir + rel_dirs[i]);
+        include_dirs.push_back( base_dir + rel_dirs[i] );
+
     for( std::vector<std::string>::const_iterator it = include_dirs.begin(); it != include_dirs.end(); ++it )
-        options.push_back( it->c_str() );
+        options.push_back( std::string( "-I" ) + *it );
 
     // Collect NVRTC options
     const char *compiler_options[] = { CUDA_NVRTC_OPTIONS };
     const size_t n_compiler_options = sizeof( compiler_options ) / sizeof( compiler_options[0] );
     for( size_t i = 0; i < n_compiler_options - 1; i++ )
         options.push_back( compiler_options[i] );
+}
+
+static bool compileCuString( const std::string &cu_source, const char* name, const std::vector<std::string> &option_strings, std::string &ptx, std::string &log )
+{
+    // Create program
+    nvrtcProgram prog = 0;
+    NVRTC_CHECK_ERROR( nvrtcCreateProgram( &prog, cu_source.c_str(), name, 0, NULL, NULL ) );
+
+    std::vector<const char *> options;
+    for( std::vector<std::string>::const_iterator it = option_strings.begin(); it != option_strings.end(); ++it )
+        options.push_back( it->c_str() );
 
     // JIT compile CU to PTX
     const nvrtcResult compileRes = nvrtcCompileProgram( prog, (int) options.size(), options.data() );
@@ -913,15 +446,15 @@ static void getPtxFromCuString( std::string &ptx, const char* sample_name, const
     // Retrieve log output
     size_t log_size = 0;
     NVRTC_CHECK_ERROR( nvrtcGetProgramLogSize( prog, &log_size ) );
-    g_nvrtcLog.resize( log_size );
+    log.resize( log_size );
     if( log_size > 1 )
+        NVRTC_CHECK_ERROR( nvrtcGetProgramLog( prog, &log[0] ) );
+
+    if( compileRes != NVRTC_SUCCESS )
     {
-        NVRTC_CHECK_ERROR( nvrtcGetProgramLog( prog, &g_nvrtcLog[0] ) );
-        if( log_string )
-            *log_string = g_nvrtcLog.c_str();
+        nvrtcDestroyProgram( &prog );
+        return false;
     }
-    if( compileRes != NVRTC_SUCCESS )
-        throw Exception( "NVRTC Compilation failed.\n" + g_nvrtcLog );
 
     // Retrieve PTX code
     size_t ptx_size = 0;
@@ -931,6 +464,44 @@ static void getPtxFromCuString( std::string &ptx, const char* sample_name, const
 
     // Cleanup
     NVRTC_CHECK_ERROR( nvrtcDestroyProgram( &prog ) );
+    return true;
+}
+
+// The PTX NVRTC writes changes between releases, so cache entries are keyed by it
+static std::string nvrtcVersionString()
+{
+    int major = 0;
+    int minor = 0;
+    NVRTC_CHECK_ERROR( nvrtcVersion( &major, &minor ) );
+
+    std::ostringstream version;
+    version << "nvrtc " << major << "." << minor;
+    return version.str();
+}
+
+static void getPtxFromCuString( std::string &ptx, const char* sample_name, const char* cu_source, const char* name, const char** log_string )
+{
+    std::vector<std::string> options;
+    std::vector<std::string> include_dirs;
+    getNvrtcOptions( options, include_dirs, sample_name );
+
+    // Compiled PTX is kept on disk, keyed by the compiler, the source, its headers and the options
+    static const PtxDiskCache disk_cache( PtxDiskCache::defaultDirectory(), nvrtcVersionString() );
+
+    const std::string source( cu_source );
+    const std::vector<std::string> include_contents = PtxDiskCache::collectIncludes( source, include_dirs );
+
+    PtxDiskCache::CompileFunction compile = [name, &options]( const std::string& cu, std::string& out, std::string& log )
+    {
+        return compileCuString( cu, name, options, out, log );
+    };
+
+    g_nvrtcLog.clear();
+    if( !disk_cache.getOrCompile( source, include_contents, options, compile, ptx, g_nvrtcLog ) )
+        throw Exception( "NVRTC Compilation failed.\n" + g_nvrtcLog );
+
+    if( log_string && g_nvrtcLog.size() > 1 )
+        *log_string = g_nvrtcLog.c_str();
 }
 
 #else // CUDA_NVRTC_ENABLED
@@ -950,14 +521,18 @@ static void getPtxStringFromFile( std::string &ptx, const char* sample_name, con
 
 #endif // CUDA_NVRTC_ENABLED
 
+// Entries are compiled once, outside the map lock, so different files can compile concurrently
+struct PtxSourceEntry
+{
+    std::once_flag compiled;
+    std::string    ptx;
+    std::string    log;
+};
+
 struct PtxSourceCache
 {
-    std::map<std::string, std::string *> map;
-    ~PtxSourceCache()
-    {
-        for( std::map<std::string, std::string *>::const_iterator it = map.begin(); it != map.end(); ++it )
-            delete it->second;
-    }
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<PtxSourceEntry> > map;
 };
 static PtxSourceCache g_ptxSourceCache;
 
@@ -969,28 +544,35 @@ const char* sutil::getPtxString(
     if (log)
         *log = NULL;
 
-    std::string *ptx, cu;
     std::string key = std::string( filename ) + ";" + ( sample ? sample : "" );
-    std::map<std::string, std::string *>::iterator elem = g_ptxSourceCache.map.find( key );
+    std::shared_ptr<PtxSourceEntry> entry;
+    {
+        std::lock_guard<std::mutex> lock( g_ptxSourceCache.mutex );
+        std::shared_ptr<PtxSourceEntry>& slot = g_ptxSourceCache.map[key];
+        if( !slot )
+            slot = std::make_shared<PtxSourceEntry>();
+        entry = slot;
+    }
 
-    if( elem == g_ptxSourceCache.map.end() )
+    // Threads asking for the same file wait here for the first one to finish
+    std::call_once( entry->compiled, [&]()
     {
-        ptx = new std::string();
 #if CUDA_NVRTC_ENABLED
-        std::string location;
+        std::string cu, location;
+        const char* compile_log = NULL;
         getCuStringFromFile( cu, location, sample, filename );
-        getPtxFromCuString( *ptx, sample, cu.c_str(), location.c_str(), log );
+        getPtxFromCuString( entry->ptx, sample, cu.c_str(), location.c_str(), &compile_log );
+        if( compile_log )
+            entry->log = compile_log;
 #else
-        getPtxStringFromFile( *ptx, sample, filename );
+        getPtxStringFromFile( entry->ptx, sample, filename );
 #endif
-        g_ptxSourceCache.map[key] = ptx;
-    }
-    else
-    {
-        ptx = elem->second;
-    }
+    } );
+
+    if( log && !entry->log.empty() )
+        *log = entry->log.c_str();
 
-    return ptx->c_str();
+    return entry->ptx.c_str();
 }
 
 void sutil::ensureMinimumSize(int& w, int& h)
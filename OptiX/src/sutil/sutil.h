@@ -91,6 +91,9 @@ SUTILAPI const char* samplesDir();
 // The pointer returned may point to a static array.
 SUTILAPI const char* samplesPTXDir();
 
+// From here to displayText, except displayBufferPPM, the functions use GL and are only in
+// sutil_sdk. Everything else is also in sutil_core, which builds without GL.
+
 // Create an output buffer with given specifications
 optix::Buffer SUTILAPI createOutputBuffer(
         optix::Context context,             // optix context
@@ -107,7 +110,7 @@ optix::Buffer SUTILAPI createInputOutputBuffer(
     unsigned height,                    // Buffer height
     bool use_pbo);                      // Buffer type                    
 
-// Resize a Buffer and its underlying GLBO if necessary
+// Resize a Buffer and its underlying GLBO if necessary. The GLBO only grows
 void SUTILAPI resizeBuffer(
         optix::Buffer buffer,               // Buffer to be modified
         unsigned width,                     // New buffer width
@@ -193,10 +196,11 @@ void SUTILAPI parseDimensions(
 double SUTILAPI currentTime();
 
 // Get PTX, either pre-compiled with NVCC or JIT compiled by NVRTC.
+// Safe to call from several threads, each file is compiled once and the strings stay valid until exit.
 SUTILAPI const char* getPtxString(
         const char* sample,                 // Name of the sample, used to locate the input file. NULL = only search the common /cuda dir
         const char* filename,               // Cuda C input file name
-        const char** log = NULL );          // (Optional) pointer to compiler log string. If *log == NULL there is no output. Only valid until the next getPtxString call
+        const char** log = NULL );          // (Optional) pointer to compiler log string. If *log == NULL there is no output.
 
 // Ensures that width and height have the minimum size to prevent launch errors.
 void SUTILAPI ensureMinimumSize(
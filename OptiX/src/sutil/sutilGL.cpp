@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2018 NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// The OpenGL and GLUT display half of sutil, built into sutil_sdk. Everything else is in
+// sutil.cpp and builds without GL into sutil_core.
+
+// Note: wglew.h has to be included before sutil.h on Windows
+#if defined(__APPLE__)
+#  include <GLUT/glut.h>
+#else
+#  include <GL/glew.h>
+#  if defined(_WIN32)
+#    include <GL/wglew.h>
+#  endif
+#  include <GL/glut.h>
+#endif
+
+#include <sutil/sutil.h>
+
+#include <optixu/optixu_math_namespace.h>
+
+#include <cstdlib>
+#include <stdint.h>
+
+
+using namespace optix;
+
+
+namespace
+{
+
+// Global variables for GLUT display functions
+RTcontext g_context                  = 0;
+RTbuffer  g_image_buffer             = 0;
+bufferPixelFormat g_image_buffer_format = BUFFER_PIXEL_FORMAT_DEFAULT;
+bool      g_glut_initialized         = false;
+bool      g_disable_srgb_conversion  = false;
+
+
+// Converts the buffer format to gl format
+GLenum glFormatFromBufferFormat(bufferPixelFormat pixel_format, RTformat buffer_format)
+{
+    if (buffer_format == RT_FORMAT_UNSIGNED_BYTE4)
+    {
+        switch (pixel_format)
+        {
+        case BUFFER_PIXEL_FORMAT_DEFAULT:
+            return GL_BGRA;
+        case BUFFER_PIXEL_FORMAT_RGB:
+            return GL_RGBA;
+        case BUFFER_PIXEL_FORMAT_BGR:
+            return GL_BGRA;
+        default:
+            throw Exception("Unknown buffer pixel format");
+        }
+    }
+    else if (buffer_format == RT_FORMAT_FLOAT4)
+    {
+        switch (pixel_format)
+        {
+        case BUFFER_PIXEL_FORMAT_DEFAULT:
+            return GL_RGBA;
+        case BUFFER_PIXEL_FORMAT_RGB:
+            return GL_RGBA;
+        case BUFFER_PIXEL_FORMAT_BGR:
+            return GL_BGRA;
+        default:
+            throw Exception("Unknown buffer pixel format");
+        }
+    }
+    else if (buffer_format == RT_FORMAT_FLOAT3)
+        switch (pixel_format)
+        {
+        case BUFFER_PIXEL_FORMAT_DEFAULT:
+            return GL_RGB;
+        case BUFFER_PIXEL_FORMAT_RGB:
+            return GL_RGB;
+        case BUFFER_PIXEL_FORMAT_BGR:
+            return GL_BGR;
+        default:
+            throw Exception("Unknown buffer pixel format");
+        }
+    else if (buffer_format == RT_FORMAT_FLOAT)
+        return GL_LUMINANCE;
+    else
+        throw Exception("Unknown buffer format");
+}
+
+
+void keyPressed(unsigned char key, int x, int y)
+{
+    switch (key)
+    {
+        case 27: // esc
+        case 'q':
+            rtContextDestroy( g_context );
+            exit(EXIT_SUCCESS);
+    }
+}
+
+
+void checkBuffer( RTbuffer buffer )
+{
+    // Check to see if the buffer is two dimensional
+    unsigned int dimensionality;
+    RT_CHECK_ERROR( rtBufferGetDimensionality(buffer, &dimensionality) );
+    if (2 != dimensionality)
+        throw Exception( "Attempting to display non-2D buffer" );
+
+    // Check to see if the buffer is of type float{1,3,4} or uchar4
+    RTformat format;
+    RT_CHECK_ERROR( rtBufferGetFormat(buffer, &format) );
+    if( RT_FORMAT_FLOAT  != format &&
+            RT_FORMAT_FLOAT4 != format &&
+            RT_FORMAT_FLOAT3 != format &&
+            RT_FORMAT_UNSIGNED_BYTE4 != format )
+        throw Exception( "Attempting to display buffer with format not float, float3, float4, or uchar4");
+}
+
+
+void displayBuffer()
+{
+    optix::Buffer buffer = Buffer::take( g_image_buffer );
+
+    // Query buffer information
+    RTsize buffer_width_rts, buffer_height_rts;
+    buffer->getSize( buffer_width_rts, buffer_height_rts );
+    uint32_t width  = static_cast<int>(buffer_width_rts);
+    uint32_t height = static_cast<int>(buffer_height_rts);
+    RTformat buffer_format = buffer->getFormat();
+
+    GLboolean use_SRGB = GL_FALSE;
+    if( !g_disable_srgb_conversion && (buffer_format == RT_FORMAT_FLOAT4 || buffer_format == RT_FORMAT_FLOAT3) )
+    {
+        glGetBooleanv( GL_FRAMEBUFFER_SRGB_CAPABLE_EXT, &use_SRGB );
+        if( use_SRGB )
+            glEnable(GL_FRAMEBUFFER_SRGB_EXT);
+    }
+
+    static unsigned int gl_tex_id = 0;
+    if( !gl_tex_id )
+    {
+        glGenTextures( 1, &gl_tex_id );
+        glBindTexture( GL_TEXTURE_2D, gl_tex_id );
+
+        // Change these to GL_LINEAR for super- or sub-sampling
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        // GL_CLAMP_TO_EDGE for linear filtering, not relevant for nearest.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    glBindTexture( GL_TEXTURE_2D, gl_tex_id );
+
+    // send PBO or host-mapped image data to texture
+    const unsigned pboId = buffer->getGLBOId();
+    GLvoid* imageData = 0;
+    if( pboId )
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pboId );
+    else
+        imageData = buffer->map( 0, RT_BUFFER_MAP_READ );
+
+    RTsize elmt_size = buffer->getElementSize();
+    if      ( elmt_size % 8 == 0) glPixelStorei(GL_UNPACK_ALIGNMENT, 8);
+    else if ( elmt_size % 4 == 0) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    else if ( elmt_size % 2 == 0) glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    else                          glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    GLenum pixel_format = glFormatFromBufferFormat(g_image_buffer_format, buffer_format);
+
+    if( buffer_format == RT_FORMAT_UNSIGNED_BYTE4)
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, pixel_format, GL_UNSIGNED_BYTE, imageData);
+    else if(buffer_format == RT_FORMAT_FLOAT4)
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, width, height, 0, pixel_format, GL_FLOAT, imageData );
+    else if(buffer_format == RT_FORMAT_FLOAT3)
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB32F_ARB, width, height, 0, pixel_format, GL_FLOAT, imageData );
+    else if(buffer_format == RT_FORMAT_FLOAT)
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_LUMINANCE32F_ARB, width, height, 0, pixel_format, GL_FLOAT, imageData );
+    else
+        throw Exception( "Unknown buffer format" );
+
+    if( pboId )
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    else
+        buffer->unmap();
+
+    // 1:1 texel to pixel mapping with glOrtho(0, 1, 0, 1, -1, 1) setup:
+    // The quad coordinates go from lower left corner of the lower left pixel
+    // to the upper right corner of the upper right pixel.
+    // Same for the texel coordinates.
+
+    glEnable(GL_TEXTURE_2D);
+
+    glBegin(GL_QUADS);
+    glTexCoord2f( 0.0f, 0.0f );
+    glVertex2f( 0.0f, 0.0f );
+
+    glTexCoord2f( 1.0f, 0.0f );
+    glVertex2f( 1.0f, 0.0f);
+
+    glTexCoord2f( 1.0f, 1.0f );
+    glVertex2f( 1.0f, 1.0f );
+
+    glTexCoord2f(0.0f, 1.0f );
+    glVertex2f( 0.0f, 1.0f );
+    glEnd();
+
+    glDisable(GL_TEXTURE_2D);
+
+    if ( use_SRGB )
+        glDisable(GL_FRAMEBUFFER_SRGB_EXT);
+}
+
+
+void displayBufferSwap()
+{
+    displayBuffer();
+    glutSwapBuffers();
+}
+
+} // end anonymous namespace
+
+
+optix::Buffer createBufferImpl(
+        optix::Context context,
+        RTformat format,
+        unsigned width,
+        unsigned height,
+        bool use_pbo,
+        RTbuffertype buffer_type)
+{
+    optix::Buffer buffer;
+    if( use_pbo )
+    {
+        // First allocate the memory for the GL buffer, then attach it to OptiX.
+
+        // Assume ubyte4 or float4 for now
+        unsigned int elmt_size = format == RT_FORMAT_UNSIGNED_BYTE4 ?  4 : 16;
+
+        GLuint vbo = 0;
+        glGenBuffers( 1, &vbo );
+        glBindBuffer( GL_ARRAY_BUFFER, vbo );
+        glBufferData( GL_ARRAY_BUFFER, elmt_size * width * height, 0, GL_STREAM_DRAW);
+        glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+        buffer = context->createBufferFromGLBO(buffer_type, vbo);
+        buffer->setFormat( format );
+        buffer->setSize( width, height );
+    }
+    else
+    {
+        buffer = context->createBuffer( buffer_type, format, width, height );
+    }
+
+    return buffer;
+}
+
+optix::Buffer sutil::createOutputBuffer(
+    optix::Context context,
+    RTformat format,
+    unsigned width,
+    unsigned height,
+    bool use_pbo)
+{
+    return createBufferImpl(context, format, width, height, use_pbo, RT_BUFFER_OUTPUT);
+}
+
+
+optix::Buffer SUTILAPI sutil::createInputOutputBuffer(optix::Context context, 
+    RTformat format, 
+    unsigned width, 
+    unsigned height, 
+    bool use_pbo)
+{
+    return createBufferImpl(context, format, width, height, use_pbo, RT_BUFFER_INPUT_OUTPUT);
+}
+
+void sutil::resizeBuffer( optix::Buffer buffer, unsigned width, unsigned height )
+{
+    buffer->setSize( width, height );
+
+    // Check if we have a GL interop display buffer
+    const unsigned pboId = buffer->getGLBOId();
+    if( pboId )
+    {
+        buffer->unregisterGLBuffer();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboId );
+
+        // Only reallocate to grow, a smaller size keeps using the existing storage
+        GLint capacity = 0;
+        glGetBufferParameteriv(GL_PIXEL_UNPACK_BUFFER, GL_BUFFER_SIZE, &capacity);
+        const RTsize bytes = buffer->getElementSize() * width * height;
+        if( static_cast<RTsize>(capacity) < bytes )
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, 0, GL_STREAM_DRAW);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        buffer->registerGLBuffer();
+    }
+}
+
+
+void sutil::initGlut( int* argc, char** argv)
+{
+    // Initialize GLUT
+    glutInit( argc, argv );
+    glutInitDisplayMode( GLUT_RGB | GLUT_ALPHA | GLUT_DOUBLE );
+    glutInitWindowSize( 100, 100 );
+    glutInitWindowPosition( 100, 100 );
+    glutCreateWindow( argv[0] );
+    g_glut_initialized = true;
+}
+
+
+void sutil::displayBufferGlut( const char* window_title, Buffer buffer )
+{
+    displayBufferGlut(window_title, buffer->get() );
+}
+
+
+void sutil::displayBufferGlut( const char* window_title, RTbuffer buffer )
+{
+    if( !g_glut_initialized )
+        throw Exception( "displayGlutWindow called before initGlut.");
+
+    checkBuffer(buffer);
+    g_image_buffer = buffer;
+
+    RTsize buffer_width, buffer_height;
+    RT_CHECK_ERROR( rtBufferGetSize2D(buffer, &buffer_width, &buffer_height ) );
+
+    GLsizei width  = static_cast<int>( buffer_width );
+    GLsizei height = static_cast<int>( buffer_height );
+    glutSetWindowTitle(window_title);
+    glutReshapeWindow( width, height );
+
+    // Init state
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, 1, 0, 1, -1, 1 );
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    glViewport(0, 0, width, height);
+
+    glutKeyboardFunc(keyPressed);
+    glutDisplayFunc(displayBufferSwap);
+    glutSwapBuffers();
+
+    glutMainLoop();
+}
+
+
+void sutil::displayBufferGL( optix::Buffer buffer, bufferPixelFormat format, bool disable_srgb_conversion )
+{
+    g_image_buffer = buffer->get();
+    g_image_buffer_format = format;
+    g_disable_srgb_conversion = disable_srgb_conversion;
+    displayBuffer();
+}
+
+
+namespace
+{
+
+// Takes a C string, a std::string built from the per frame GUI text would allocate
+void drawText( const char* text, float x, float y, void* font )
+{
+    // Save state
+    glPushAttrib( GL_CURRENT_BIT | GL_ENABLE_BIT );
+
+    glDisable( GL_TEXTURE_2D );
+    glDisable( GL_LIGHTING );
+    glDisable( GL_DEPTH_TEST);
+
+    static const float3 shadow_color = make_float3( 0.10f );
+    glColor3fv( &( shadow_color.x) ); // drop shadow
+    // Shift shadow one pixel to the lower right.
+    glWindowPos2f(x + 1.0f, y - 1.0f);
+    for( const char* it = text; *it; ++it )
+        glutBitmapCharacter( font, *it );
+
+    static const float3 text_color = make_float3( 0.95f );
+    glColor3fv( &( text_color.x) );        // main text
+    glWindowPos2f(x, y);
+    for( const char* it = text; *it; ++it )
+        glutBitmapCharacter( font, *it );
+
+    // Restore state
+    glPopAttrib();
+}
+
+static const float FPS_UPDATE_INTERVAL = 0.5;  //seconds
+
+} // namespace
+
+
+void sutil::displayFps( unsigned int frame_count )
+{
+    static double fps = -1.0;
+    static unsigned last_frame_count = 0;
+    static double last_update_time = sutil::currentTime();
+    static double current_time = 0.0;
+    current_time = sutil::currentTime();
+    if ( current_time - last_update_time > FPS_UPDATE_INTERVAL ) {
+        fps = ( frame_count - last_frame_count ) / ( current_time - last_update_time );
+        last_frame_count = frame_count;
+        last_update_time = current_time;
+    }
+    if ( frame_count > 0 && fps >= 0.0 ) {
+        static char fps_text[32];
+        sprintf( fps_text, "fps: %7.2f", fps );
+        drawText( fps_text, 10.0f, 10.0f, GLUT_BITMAP_8_BY_13 );
+    }
+}
+
+
+void sutil::displayText(const char* text, float x, float y)
+{
+  drawText(text, x, y, GLUT_BITMAP_8_BY_13);
+}
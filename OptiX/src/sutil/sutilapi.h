@@ -37,7 +37,7 @@
 #define __samples_util_sutilapi_h__
 
 #ifndef SUTILAPI
-#  if sutil_sdk_EXPORTS /* Set by CMAKE */
+#  if sutil_sdk_EXPORTS || sutil_core_EXPORTS /* Set by CMAKE */
 #    if defined( _WIN32 ) || defined( _WIN64 )
 #      define SUTILAPI __declspec(dllexport) 
 #      define SUTILCLASSAPI